@@ -2,22 +2,7 @@
 #include <QDateTime>
 #include <QDebug>
 #include <QtEndian>
-
-struct WavHeader {
-  char riff[4] = {'R', 'I', 'F', 'F'};
-  uint32_t overallSize; // File size - 8
-  char wave[4] = {'W', 'A', 'V', 'E'};
-  char fmt[4] = {'f', 'm', 't', ' '};
-  uint32_t fmtLength = 16;
-  uint16_t audioFormat = 1; // PCM
-  uint16_t numChannels;
-  uint32_t sampleRate;
-  uint32_t byteRate;
-  uint16_t blockAlign;
-  uint16_t bitsPerSample;
-  char data[4] = {'d', 'a', 't', 'a'};
-  uint32_t dataSize;
-};
+#include <algorithm>
 
 AudioManager::AudioManager(QObject *parent) : QObject(parent) { setupFormat(); }
 
@@ -91,7 +76,8 @@ bool AudioManager::startRecording() {
   return true;
 }
 
-std::vector<uint8_t> AudioManager::stopRecording(uint16_t &duration) {
+std::vector<uint8_t> AudioManager::stopRecording(uint16_t &duration,
+                                                 wizz::VoiceCodec &codec) {
   if (!m_isRecording || !m_audioSource) {
     return {};
   }
@@ -105,47 +91,48 @@ std::vector<uint8_t> AudioManager::stopRecording(uint16_t &duration) {
   if (duration == 0)
     duration = 1; // Minimum 1 sec
 
-  QByteArray rawPcm = m_inputBuffer.buffer();
+  const QByteArray &rawPcm = m_inputBuffer.buffer();
+  int channels = std::max(1, m_format.channelCount());
+  size_t frames = static_cast<size_t>(rawPcm.size()) / (2 * channels);
 
-  QByteArray wavData = addWavHeader(rawPcm);
+  // Speech doesn't need the device's 48 kHz stereo: mono 16 kHz, 4 bits
+  std::vector<int16_t> mono = wizz::downmixToMono(
+      reinterpret_cast<const int16_t *>(rawPcm.constData()), frames, channels);
+  mono = wizz::resample(mono, static_cast<uint32_t>(m_format.sampleRate()),
+                        wizz::VOICE_SAMPLE_RATE);
+  std::vector<uint8_t> encoded =
+      wizz::encodeImaAdpcm(mono, wizz::VOICE_SAMPLE_RATE);
+  codec = wizz::VoiceCodec::ImaAdpcm;
 
   qDebug() << "Stopped recording. Duration:" << duration
-           << "s. Size:" << wavData.size();
-
-  // Convert to std::vector
-  return std::vector<uint8_t>(wavData.begin(), wavData.end());
-}
-
-QByteArray AudioManager::addWavHeader(const QByteArray &rawPcmData) {
-  WavHeader header;
-  header.numChannels = static_cast<uint16_t>(m_format.channelCount());
-  header.sampleRate = static_cast<uint32_t>(m_format.sampleRate());
-  header.bitsPerSample = 16; // We forced Int16 or compatible
-
-  // Derived fields
-  header.byteRate =
-      header.sampleRate * header.numChannels * (header.bitsPerSample / 8);
-  header.blockAlign = header.numChannels * (header.bitsPerSample / 8);
-  header.dataSize = static_cast<uint32_t>(rawPcmData.size());
-  header.overallSize = header.dataSize + 36;
-
-  QByteArray wavFile;
-  wavFile.resize(sizeof(WavHeader) + rawPcmData.size());
+           << "s. PCM:" << rawPcm.size() << "bytes, encoded:" << encoded.size();
 
-  // Copy Header safely
-  std::memcpy(wavFile.data(), &header, sizeof(WavHeader));
-
-  // Copy Data
-  std::memcpy(wavFile.data() + sizeof(WavHeader), rawPcmData.data(),
-              rawPcmData.size());
-
-  return wavFile;
+  return encoded;
 }
 
-void AudioManager::playAudio(const std::vector<uint8_t> &wavData) {
-  if (wavData.size() < sizeof(WavHeader)) {
-    qWarning() << "Invalid WAV data size";
-    return;
+void AudioManager::playAudio(const std::vector<uint8_t> &data,
+                             wizz::VoiceCodec codec) {
+  // Decode to interleaved 16-bit PCM
+  std::vector<int16_t> pcm;
+  int channels = 1;
+  uint32_t sampleRate = 0;
+
+  if (codec == wizz::VoiceCodec::ImaAdpcm) {
+    if (!wizz::decodeImaAdpcm(data.data(), data.size(), pcm, sampleRate)) {
+      qWarning() << "Invalid ADPCM voice data";
+      return;
+    }
+  } else {
+    const uint8_t *samples = nullptr;
+    size_t bytes = 0;
+    if (!wizz::parseWav(data.data(), data.size(), samples, bytes, channels,
+                        sampleRate)) {
+      qWarning() << "Invalid WAV data";
+      return;
+    }
+    pcm.resize(bytes / 2);
+    for (size_t i = 0; i < pcm.size(); ++i)
+      pcm[i] = qFromLittleEndian<qint16>(samples + 2 * i);
   }
 
   // 1. Setup Sink on Default Output
@@ -160,22 +147,25 @@ void AudioManager::playAudio(const std::vector<uint8_t> &wavData) {
     m_audioSink.reset();
   }
 
-  // Header Parsing to determine format
-  const WavHeader *header = reinterpret_cast<const WavHeader *>(wavData.data());
-
   QAudioFormat playFormat;
-  playFormat.setSampleRate(header->sampleRate);
-  playFormat.setChannelCount(header->numChannels);
-  playFormat.setSampleFormat(
-      QAudioFormat::Int16); // Assuming Int16 based on our writer
+  playFormat.setSampleRate(static_cast<int>(sampleRate));
+  playFormat.setChannelCount(channels);
+  playFormat.setSampleFormat(QAudioFormat::Int16);
+
+  if (!device.isFormatSupported(playFormat) && channels == 1) {
+    // Typically 16 kHz on an output that only does 44.1/48 kHz
+    uint32_t deviceRate =
+        static_cast<uint32_t>(device.preferredFormat().sampleRate());
+    pcm = wizz::resample(pcm, sampleRate, deviceRate);
+    playFormat.setSampleRate(static_cast<int>(deviceRate));
+  }
 
-  qDebug() << "Playing WAV: " << header->sampleRate << "Hz, "
-           << header->numChannels << " channels, " << header->bitsPerSample
-           << " bits";
+  qDebug() << "Playing voice: " << playFormat.sampleRate() << "Hz, "
+           << channels << " channels";
 
   if (!device.isFormatSupported(playFormat)) {
-    qWarning()
-        << "Format from WAV not supported by output device. Playback may fail.";
+    qWarning() << "Voice format not supported by output device. Playback may "
+                  "fail.";
   }
 
   m_audioSink = std::make_unique<QAudioSink>(device, playFormat);
@@ -193,16 +183,10 @@ void AudioManager::playAudio(const std::vector<uint8_t> &wavData) {
             }
           });
 
-  // 2. Prepare Buffer (Skip Header)
-  // We modify m_outputBuffer. Since QBuffer references a QByteArray, we need to
-  // hold that data. We'll just copy the payload.
-
-  // Extract PCM
-  size_t headerSize = sizeof(WavHeader);
-  if (wavData.size() > headerSize) {
-    QByteArray pcmData(
-        reinterpret_cast<const char *>(wavData.data() + headerSize),
-        wavData.size() - headerSize);
+  // 2. The sink reads from m_outputBuffer, which owns its copy of the PCM
+  if (!pcm.empty()) {
+    QByteArray pcmData(reinterpret_cast<const char *>(pcm.data()),
+                       static_cast<qsizetype>(pcm.size() * sizeof(int16_t)));
 
     m_outputBuffer.close();
     m_outputBuffer.setData(pcmData);
@@ -8,6 +8,7 @@
 #include <QMediaDevices>
 #include <QObject>
 #include <memory>
+#include "../common/VoiceCodec.h"
 #include <vector>
 
 class AudioManager : public QObject {
@@ -19,10 +20,12 @@ public:
 
   // Recording
   bool startRecording();
-  std::vector<uint8_t> stopRecording(uint16_t &duration); // Returns WAV data
+  // Returns the encoded note (mono, VOICE_SAMPLE_RATE, IMA-ADPCM)
+  std::vector<uint8_t> stopRecording(uint16_t &duration,
+                                     wizz::VoiceCodec &codec);
 
   // Playback
-  void playAudio(const std::vector<uint8_t> &wavData);
+  void playAudio(const std::vector<uint8_t> &data, wizz::VoiceCodec codec);
 
   bool isRecording() const { return m_isRecording; }
 
@@ -32,7 +35,6 @@ signals:
 
 private:
   void setupFormat();
-  QByteArray addWavHeader(const QByteArray &rawPcmData);
 
   QAudioFormat m_format;
   std::unique_ptr<QAudioSource> m_audioSource;
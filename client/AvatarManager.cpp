@@ -1,8 +1,11 @@
 #include "AvatarManager.h"
 #include "NetworkManager.h"
+#include <QDir>
+#include <QFile>
 #include <QFont>
 #include <QPainter>
 #include <QPainterPath>
+#include <QStandardPaths>
 
 AvatarManager &AvatarManager::instance() {
   static AvatarManager _instance;
@@ -10,9 +13,19 @@ AvatarManager &AvatarManager::instance() {
 }
 
 AvatarManager::AvatarManager(QObject *parent) : QObject(parent) {
+  m_cacheDir =
+      QStandardPaths::writableLocation(QStandardPaths::CacheLocation) +
+      "/avatars";
+  QDir().mkpath(m_cacheDir);
+
   // Listen to Network Manager for incoming avatars
   connect(&NetworkManager::instance(), &NetworkManager::avatarReceived, this,
           &AvatarManager::onNetworkAvatarReceived);
+  connect(&NetworkManager::instance(), &NetworkManager::avatarNotModified,
+          this, &AvatarManager::onAvatarNotModified);
+  connect(&NetworkManager::instance(),
+          &NetworkManager::avatarVersionsReceived, this,
+          &AvatarManager::onAvatarVersionsReceived);
 }
 
 AvatarManager::~AvatarManager() {}
@@ -22,14 +35,72 @@ QPixmap AvatarManager::getAvatar(const QString &username, int size) {
     return m_avatarCache[username];
   }
 
+  if (loadFromDisk(username)) {
+    // Revalidate unless the ContactList already told us it is current
+    if (m_serverVersions.value(username) != m_avatarHashes.value(username)) {
+      requestFromServer(username);
+    }
+    return m_avatarCache[username];
+  }
+
   // If not in cache, request it from the server.
   // Assuming NetworkManager sends the packet asynchronously.
-  NetworkManager::instance().requestAvatar(username);
+  requestFromServer(username);
 
   // Return a generated placeholder immediately
   return createAvatarWithInitials(username, size);
 }
 
+void AvatarManager::requestFromServer(const QString &username) {
+  if (m_pendingRequests.contains(username))
+    return;
+  m_pendingRequests.insert(username);
+
+  QString heldHash = m_avatarHashes.value(username);
+  if (heldHash.isEmpty()) {
+    NetworkManager::instance().requestAvatar(username);
+  } else {
+    NetworkManager::instance().requestAvatarIfChanged(username, heldHash);
+  }
+}
+
+QString AvatarManager::cacheFilePath(const QString &username,
+                                     const QString &suffix) const {
+  // Hex-encode so any username is a safe file name
+  return m_cacheDir + "/" + QString::fromLatin1(username.toUtf8().toHex()) +
+         suffix;
+}
+
+bool AvatarManager::loadFromDisk(const QString &username) {
+  QFile imgFile(cacheFilePath(username, ".img"));
+  if (!imgFile.open(QIODevice::ReadOnly))
+    return false;
+
+  QPixmap avatar;
+  if (!avatar.loadFromData(imgFile.readAll()))
+    return false;
+
+  QString hash;
+  QFile hashFile(cacheFilePath(username, ".hash"));
+  if (hashFile.open(QIODevice::ReadOnly))
+    hash = QString::fromUtf8(hashFile.readAll()).trimmed();
+
+  m_avatarCache[username] = avatar;
+  m_avatarHashes[username] = hash;
+  return true;
+}
+
+void AvatarManager::saveToDisk(const QString &username, const QByteArray &data,
+                               const QString &hash) {
+  QFile imgFile(cacheFilePath(username, ".img"));
+  if (imgFile.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    imgFile.write(data);
+
+  QFile hashFile(cacheFilePath(username, ".hash"));
+  if (hashFile.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    hashFile.write(hash.toUtf8());
+}
+
 QPixmap AvatarManager::createAvatarWithInitials(const QString &name, int size) {
   QPixmap avatar(size, size);
   avatar.fill(Qt::transparent);
@@ -70,10 +141,33 @@ QPixmap AvatarManager::createAvatarWithInitials(const QString &name, int size) {
 }
 
 void AvatarManager::onNetworkAvatarReceived(const QString &username,
-                                            const QByteArray &data) {
+                                            const QByteArray &data,
+                                            const QString &hash) {
+  m_pendingRequests.remove(username);
+
   QPixmap avatar;
   if (avatar.loadFromData(data)) {
     m_avatarCache[username] = avatar;
+    m_avatarHashes[username] = hash;
+    saveToDisk(username, data, hash);
     emit avatarUpdated(username, avatar);
   }
 }
+
+void AvatarManager::onAvatarNotModified(const QString &username) {
+  m_pendingRequests.remove(username);
+}
+
+void AvatarManager::onAvatarVersionsReceived(
+    const QHash<QString, QString> &versions) {
+  for (auto it = versions.constBegin(); it != versions.constEnd(); ++it) {
+    m_serverVersions[it.key()] = it.value();
+
+    // A contact changed their avatar while we held an older one in memory
+    if (!it.value().isEmpty() && m_avatarCache.contains(it.key()) &&
+        m_avatarHashes.value(it.key()) != it.value()) {
+      m_pendingRequests.remove(it.key());
+      requestFromServer(it.key());
+    }
+  }
+}
@@ -3,6 +3,7 @@
 #include <QHash>
 #include <QObject>
 #include <QPixmap>
+#include <QSet>
 #include <QString>
 
 class AvatarManager : public QObject {
@@ -10,8 +11,9 @@ class AvatarManager : public QObject {
 public:
   static AvatarManager &instance();
 
-  // Retrieves from cache, or returns generated initials avatar.
-  // Also requests from server if not cached yet.
+  // Retrieves from memory or the on-disk cache, or returns a generated
+  // initials avatar. Only asks the server when the copy we hold doesn't match
+  // the version advertised in the ContactList.
   QPixmap getAvatar(const QString &username, int size = 50);
 
   // Explicitly generate the default initials avatar
@@ -21,7 +23,10 @@ signals:
   void avatarUpdated(const QString &username, const QPixmap &avatar);
 
 private slots:
-  void onNetworkAvatarReceived(const QString &username, const QByteArray &data);
+  void onNetworkAvatarReceived(const QString &username, const QByteArray &data,
+                               const QString &hash);
+  void onAvatarNotModified(const QString &username);
+  void onAvatarVersionsReceived(const QHash<QString, QString> &versions);
 
 private:
   explicit AvatarManager(QObject *parent = nullptr);
@@ -31,5 +36,16 @@ private:
   AvatarManager(const AvatarManager &) = delete;
   AvatarManager &operator=(const AvatarManager &) = delete;
 
+  // Disk cache survives restarts, so logins don't re-download avatars
+  QString cacheFilePath(const QString &username, const QString &suffix) const;
+  bool loadFromDisk(const QString &username);
+  void saveToDisk(const QString &username, const QByteArray &data,
+                  const QString &hash);
+  void requestFromServer(const QString &username);
+
   QHash<QString, QPixmap> m_avatarCache;
+  QHash<QString, QString> m_avatarHashes;   // Hash of the copy we hold
+  QHash<QString, QString> m_serverVersions; // Hash the server advertised
+  QSet<QString> m_pendingRequests;
+  QString m_cacheDir;
 };
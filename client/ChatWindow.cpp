@@ -164,11 +164,12 @@ void ChatWindow::mouseMoveEvent(QMouseEvent *event) {
 }
 
 void ChatWindow::addVoiceMessage(const QString &sender, uint16_t duration,
+                                 wizz::VoiceCodec codec,
                                  const std::vector<uint8_t> &data,
                                  bool isSelf) {
   Q_UNUSED(sender);
   QString time = QDateTime::currentDateTime().toString("HH:mm");
-  QWidget *bubble = createVoiceBubble(duration, data, time, isSelf);
+  QWidget *bubble = createVoiceBubble(duration, codec, data, time, isSelf);
   m_chatLayout->addWidget(bubble);
 
   QTimer::singleShot(10, [this]() {
@@ -303,7 +304,8 @@ void ChatWindow::onMicClicked() {
     }
   } else {
     uint16_t duration = 0;
-    auto data = m_audioManager->stopRecording(duration);
+    wizz::VoiceCodec codec = wizz::VoiceCodec::Wav;
+    auto data = m_audioManager->stopRecording(duration, codec);
     m_micBtn->setText("🎤");
     // Reset Style
     m_micBtn->setStyleSheet(R"(
@@ -319,8 +321,8 @@ void ChatWindow::onMicClicked() {
         )");
 
     if (!data.empty()) {
-      emit sendVoiceMessage(duration, data);
-      addVoiceMessage("Me", duration, data, true);
+      emit sendVoiceMessage(duration, codec, data);
+      addVoiceMessage("Me", duration, codec, data, true);
     }
   }
 }
@@ -386,6 +388,7 @@ QWidget *ChatWindow::createMessageBubble(const QString &text,
 }
 
 QWidget *ChatWindow::createVoiceBubble(uint16_t duration,
+                                       wizz::VoiceCodec codec,
                                        const std::vector<uint8_t> &data,
                                        const QString &time, bool isSelf) {
   QWidget *container = new QWidget();
@@ -407,7 +410,7 @@ QWidget *ChatWindow::createVoiceBubble(uint16_t duration,
 
   // Connection for click
   connect(playBtn, &QPushButton::clicked, this,
-          [this, audioData, playBtn, duration]() {
+          [this, audioData, codec, playBtn, duration]() {
             // Disconnect previous connections if any (simple approach: rely on
             // AudioManager single instance behavior) Ideally we track the
             // currently playing button, but for now:
@@ -438,7 +441,7 @@ QWidget *ChatWindow::createVoiceBubble(uint16_t duration,
                                    disconnect(*connStart);
                                  });
 
-            m_audioManager->playAudio(audioData);
+            m_audioManager->playAudio(audioData, codec);
           });
 
   QLabel *timeLabel = new QLabel(time);
@@ -26,6 +26,7 @@ public:
 
   void addMessage(const QString &sender, const QString &text, bool isSelf);
   void addVoiceMessage(const QString &sender, uint16_t duration,
+                       wizz::VoiceCodec codec,
                        const std::vector<uint8_t> &data, bool isSelf);
   void addGameInvite(const QString &sender, const QString &gameName);
   void flash(const QColor &color);
@@ -34,7 +35,8 @@ public:
 
 signals:
   void sendMessage(const QString &text);
-  void sendVoiceMessage(uint16_t duration, const std::vector<uint8_t> &data);
+  void sendVoiceMessage(uint16_t duration, wizz::VoiceCodec codec,
+                        const std::vector<uint8_t> &data);
   void sendNudge();
   void windowClosed(const QString &partnerName);
 
@@ -54,7 +56,7 @@ private:
   void setupUI();
   QWidget *createMessageBubble(const QString &text, const QString &time,
                                bool isSelf);
-  QWidget *createVoiceBubble(uint16_t duration,
+  QWidget *createVoiceBubble(uint16_t duration, wizz::VoiceCodec codec,
                              const std::vector<uint8_t> &data,
                              const QString &time, bool isSelf);
   QWidget *createInviteBubble(const QString &sender, const QString &gameName);
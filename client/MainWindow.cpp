@@ -78,6 +78,8 @@ MainWindow::MainWindow(const QString &username, const QPoint &initialPos,
           this, [this](const QString &username, int status, const QString &statusMsg) {
             updateContactStatus(username, static_cast<UserStatus>(status), statusMsg);
           });
+  connect(&NetworkManager::instance(), &NetworkManager::presenceReceived, this,
+          &MainWindow::applyPresence);
 
   // Connect Error
   connect(&NetworkManager::instance(), &NetworkManager::errorOccurred, this,
@@ -120,13 +122,14 @@ MainWindow::MainWindow(const QString &username, const QPoint &initialPos,
   // Connect Voice Message Received
   connect(
       &NetworkManager::instance(), &NetworkManager::voiceMessageReceived, this,
-      [this](const QString &sender, uint16_t duration,
+      [this](const QString &sender, uint16_t duration, wizz::VoiceCodec codec,
              const std::vector<uint8_t> &data) {
         if (!m_openChats.contains(sender)) {
           onContactDoubleClicked(sender); // Open window
         }
         if (m_openChats.contains(sender)) {
-          m_openChats[sender]->addVoiceMessage(sender, duration, data, false);
+          m_openChats[sender]->addVoiceMessage(sender, duration, codec, data,
+                                              false);
           m_openChats[sender]->show();
           m_openChats[sender]->activateWindow();
         }
@@ -674,16 +677,34 @@ void MainWindow::populateContactList() {
   }
 }
 
+static void applyStatus(ContactInfo &contact, UserStatus status,
+                        const QString &statusMessage) {
+  contact.status = status;
+  if (status == UserStatus::Offline) {
+    contact.statusMessage = "";
+  } else if (!statusMessage.isEmpty()) {
+    contact.statusMessage = statusMessage;
+  }
+}
+
+static void applyGameStatus(ContactInfo &contact, const QString &gameName,
+                            uint32_t score) {
+  if (gameName.isEmpty()) {
+    contact.isPlayingGame = false;
+    contact.currentGameName = "";
+    contact.currentGameScore = 0;
+  } else {
+    contact.isPlayingGame = true;
+    contact.currentGameName = gameName;
+    contact.currentGameScore = score;
+  }
+}
+
 void MainWindow::updateContactStatus(const QString &username, UserStatus status,
                                      const QString &statusMessage) {
   for (ContactInfo &contact : m_contacts) {
     if (contact.username == username) {
-      contact.status = status;
-      if (status == UserStatus::Offline) {
-        contact.statusMessage = "";
-      } else if (!statusMessage.isEmpty()) {
-        contact.statusMessage = statusMessage;
-      }
+      applyStatus(contact, status, statusMessage);
       break;
     }
   }
@@ -695,21 +716,31 @@ void MainWindow::updateContactGameStatus(const QString &username,
                                          uint32_t score) {
   for (ContactInfo &contact : m_contacts) {
     if (contact.username == username) {
-      if (gameName.isEmpty()) {
-        contact.isPlayingGame = false;
-        contact.currentGameName = "";
-        contact.currentGameScore = 0;
-      } else {
-        contact.isPlayingGame = true;
-        contact.currentGameName = gameName;
-        contact.currentGameScore = score;
-      }
+      applyGameStatus(contact, gameName, score);
       break;
     }
   }
   populateContactList();
 }
 
+void MainWindow::applyPresence(const QList<ContactPresence> &updates) {
+  QHash<QString, ContactInfo *> byName;
+  byName.reserve(m_contacts.size());
+  for (ContactInfo &contact : m_contacts)
+    byName.insert(contact.username, &contact);
+
+  for (const ContactPresence &update : updates) {
+    ContactInfo *contact = byName.value(update.username, nullptr);
+    if (!contact)
+      continue;
+    applyStatus(*contact, static_cast<UserStatus>(update.status),
+                update.statusMessage);
+    if (update.hasGameStatus)
+      applyGameStatus(*contact, update.gameName, update.gameScore);
+  }
+  populateContactList();
+}
+
 void MainWindow::updateContactAvatar(const QString &username,
                                      const QPixmap &avatar) {
   if (username == m_username) {
@@ -813,10 +844,7 @@ void MainWindow::onContactDoubleClicked(const QString &username) {
   ChatWindow *w = new ChatWindow(username, startPos);
   connect(w, &ChatWindow::windowClosed, this, &MainWindow::onChatWindowClosed);
   connect(w, &ChatWindow::sendMessage, this, [username](const QString &text) {
-    wizz::Packet pkt(wizz::PacketType::DirectMessage);
-    pkt.writeString(username.toStdString()); // Target
-    pkt.writeString(text.toStdString());     // Message
-    NetworkManager::instance().sendPacket(pkt);
+    NetworkManager::instance().sendDirectMessage(username, text);
   });
   connect(w, &ChatWindow::sendNudge, this, [username]() {
     wizz::Packet pkt(wizz::PacketType::Nudge);
@@ -825,9 +853,10 @@ void MainWindow::onContactDoubleClicked(const QString &username) {
   });
 
   connect(w, &ChatWindow::sendVoiceMessage, this,
-          [username](uint16_t duration, const std::vector<uint8_t> &data) {
+          [username](uint16_t duration, wizz::VoiceCodec codec,
+                     const std::vector<uint8_t> &data) {
             NetworkManager::instance().sendVoiceMessage(username, duration,
-                                                        data);
+                                                        codec, data);
           });
 
   w->show();
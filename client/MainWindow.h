@@ -3,6 +3,7 @@
 #include "../common/NativeSharedMemory.h"
 #include "../common/Packet.h"
 #include "../common/TicTacToeIPC.h"
+#include "NetworkManager.h"
 #include <QComboBox>
 #include <QFrame>
 #include <QLabel>
@@ -55,6 +56,8 @@ public:
   void updateContactAvatar(const QString &username, const QPixmap &avatar);
   void updateContactGameStatus(const QString &username, const QString &gameName,
                                uint32_t score);
+  // Applies many updates, then redraws the list once
+  void applyPresence(const QList<ContactPresence> &updates);
 
 signals:
   void contactDoubleClicked(const QString &username);
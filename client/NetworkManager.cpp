@@ -1,8 +1,10 @@
 #include "NetworkManager.h"
 #include <QDataStream>
 #include <QDebug>
-
+#include <QSignalBlocker>
 #include <QThread>
+#include <algorithm>
+#include <stdexcept>
 
 #ifdef _WIN32
 #include <winsock2.h>
@@ -10,6 +12,13 @@
 #include <arpa/inet.h>
 #endif
 
+// Features this client build understands (see wizz::Capability)
+static const uint32_t CLIENT_CAPABILITIES =
+    wizz::CapFraming | wizz::CapVoiceAdpcm | wizz::CapPresenceBatch |
+    wizz::CapCompact | wizz::CapDeflate | wizz::CapContactDeltas;
+// Servers that predate Hello never answer; fall back to plain packets
+static const int HELLO_TIMEOUT_MS = 2000;
+
 NetworkManager &NetworkManager::instance() {
   static NetworkManager *_instance = nullptr;
   if (!_instance) {
@@ -61,8 +70,11 @@ NetworkManager::NetworkManager(QObject *parent) : QObject(parent) {
   qRegisterMetaType<wizz::Packet>("wizz::Packet");
   qRegisterMetaType<std::vector<uint8_t>>("std::vector<uint8_t>");
   qRegisterMetaType<uint16_t>("uint16_t");
+  qRegisterMetaType<wizz::VoiceCodec>("wizz::VoiceCodec");
   qRegisterMetaType<QList<std::tuple<QString, int, QString>>>(
       "QList<std::tuple<QString, int, QString>>");
+  qRegisterMetaType<QHash<QString, QString>>("QHash<QString, QString>");
+  qRegisterMetaType<QList<ContactPresence>>("QList<ContactPresence>");
 }
 
 void NetworkManager::initSocket() {
@@ -75,6 +87,21 @@ void NetworkManager::initSocket() {
   connect(m_socket, &QSslSocket::errorOccurred, this,
           &NetworkManager::onSocketError);
   connect(m_socket, &QSslSocket::readyRead, this, &NetworkManager::onReadyRead);
+  connect(m_socket, &QSslSocket::bytesWritten, this,
+          &NetworkManager::pumpFrames);
+
+  m_helloTimer = new QTimer(this);
+  m_helloTimer->setSingleShot(true);
+  connect(m_helloTimer, &QTimer::timeout, this, [this]() {
+    if (m_helloPending) {
+      qDebug() << "[Network] No HelloAck, using unframed protocol";
+      finishNegotiation(0, 0);
+    }
+  });
+
+  m_reconnectTimer = new QTimer(this);
+  m_reconnectTimer->setSingleShot(true);
+  connect(m_reconnectTimer, &QTimer::timeout, this, &NetworkManager::reconnect);
 
   // Ignore SSL errors since we use self-signed certificates for local
   // development
@@ -103,6 +130,8 @@ void NetworkManager::connectToHost(const QString &host, quint16 port) {
   if (m_socket->state() != QAbstractSocket::UnconnectedState) {
     m_socket->disconnectFromHost();
   }
+  m_host = host;
+  m_port = port;
   m_socket->connectToHostEncrypted(host, port);
 }
 
@@ -111,6 +140,14 @@ void NetworkManager::disconnectFromHost() {
     QMetaObject::invokeMethod(this, "disconnectFromHost", Qt::QueuedConnection);
     return;
   }
+  m_unacked.clear(); // Logging out: a new login may be someone else
+  m_serverAcks = false;
+  m_pendingLogin.clear();
+  m_loginPacket.clear();
+  m_resumeToken.clear();
+  m_reconnectTimer->stop();
+  m_reconnecting = false;
+  m_reconnectAttempts = 0;
   if (m_socket)
     m_socket->disconnectFromHost();
 }
@@ -126,24 +163,161 @@ void NetworkManager::sendPacket(const wizz::Packet &packet) {
   if (!isConnected())
     return;
 
-  std::vector<uint8_t> data = packet.serialize();
+  if (packet.type() == wizz::PacketType::Login) {
+    // Tell the server which contact list we hold, if it is this user's
+    wizz::Packet in = packet;
+    std::string username = in.readString();
+    std::string password = in.readString();
+    if (username != m_contactsUser) {
+      m_cachedContacts.clear();
+      m_contactsVersion = 0;
+      m_contactsUser = username;
+    }
+    wizz::Packet login(wizz::PacketType::Login);
+    login.writeString(username);
+    login.writeString(password);
+    login.writeInt(m_contactsVersion);
+    m_pendingLogin = login.serialize();
+    writeSerialized(m_pendingLogin);
+    return;
+  }
+  writeSerialized(packet.serialize());
+}
+
+void NetworkManager::sendDirectMessage(const QString &target,
+                                       const QString &text) {
+  if (QThread::currentThread() != this->thread()) {
+    QMetaObject::invokeMethod(this, "sendDirectMessage", Qt::QueuedConnection,
+                              Q_ARG(QString, target), Q_ARG(QString, text));
+    return;
+  }
+  OutgoingMessage msg{++m_lastSeq, target, text};
+  if (isConnected())
+    writeDirectMessage(msg);
+  if (m_serverAcks)
+    m_unacked.push_back(std::move(msg));
+}
+
+void NetworkManager::writeDirectMessage(const OutgoingMessage &msg) {
+  wizz::Packet pkt(wizz::PacketType::DirectMessage);
+  pkt.writeString(msg.target.toStdString());
+  pkt.writeString(msg.text.toStdString());
+  pkt.writeInt(msg.seq);
+  writeSerialized(pkt.serialize());
+}
+
+void NetworkManager::writeSerialized(std::vector<uint8_t> data) {
+  if (m_helloPending) {
+    m_heldPackets.push_back(std::move(data));
+    return;
+  }
+  wizz::PacketType type = wizz::Packet::peekType(data);
+  if (m_codec) {
+    data = m_codec->encode(wizz::Packet(data));
+  }
+  if (m_framing) {
+    m_frameScheduler.enqueue(std::move(data), wizz::priorityFor(type));
+    pumpFrames();
+    return;
+  }
+  m_socket->write(reinterpret_cast<const char *>(data.data()), data.size());
+  m_socket->flush();
+}
+
+void NetworkManager::pumpFrames() {
+  if (!m_socket || !m_framing)
+    return;
+  // Keep the socket's write buffer shallow so a chat packet queued behind a
+  // voice upload only waits for a couple of frames
+  const qint64 highWater = 2 * m_frameScheduler.maxFrameSize();
+  while (!m_frameScheduler.empty() && m_socket->bytesToWrite() < highWater) {
+    std::vector<uint8_t> frame = m_frameScheduler.nextFrame();
+    m_socket->write(reinterpret_cast<const char *>(frame.data()),
+                    frame.size());
+  }
+  m_socket->flush();
+}
+
+void NetworkManager::sendHello() {
+  wizz::Packet hello(wizz::PacketType::Hello);
+  hello.writeInt(CLIENT_CAPABILITIES);
+  hello.writeInt(wizz::DEFAULT_MAX_FRAME_SIZE);
+  std::vector<uint8_t> data = hello.serialize();
   m_socket->write(reinterpret_cast<const char *>(data.data()), data.size());
   m_socket->flush();
+
+  m_helloPending = true;
+  m_helloTimer->start(HELLO_TIMEOUT_MS);
+}
+
+void NetworkManager::finishNegotiation(uint32_t capabilities,
+                                       uint32_t maxFrameSize) {
+  m_helloTimer->stop();
+  m_helloPending = false;
+  m_capabilities = capabilities & CLIENT_CAPABILITIES;
+
+  if (m_capabilities & wizz::CapFraming) {
+    uint32_t frameSize = wizz::clampFrameSize(maxFrameSize);
+    m_frameScheduler.setMaxFrameSize(frameSize);
+    m_frameAssembler.setMaxFrameSize(frameSize);
+    m_framing = true;
+  }
+  if (m_capabilities & wizz::CapCompact) {
+    m_codec = std::make_unique<wizz::CompactCodec>(wizz::Direction::ToServer);
+    if (m_capabilities & wizz::CapDeflate)
+      m_codec->enableCompression();
+  }
+
+  auto held = std::move(m_heldPackets);
+  m_heldPackets.clear();
+  for (auto &data : held) {
+    writeSerialized(std::move(data));
+  }
+}
+
+void NetworkManager::resetTransport() {
+  m_helloTimer->stop();
+  m_helloPending = false;
+  m_framing = false;
+  m_codec.reset();
+  m_capabilities = 0;
+  m_heldPackets.clear();
+  m_buffer.clear();
+  m_frameScheduler = wizz::FrameScheduler();
+  m_frameAssembler = wizz::FrameAssembler();
 }
 
 void NetworkManager::sendVoiceMessage(const QString &target, uint16_t duration,
+                                      wizz::VoiceCodec codec,
                                       const std::vector<uint8_t> &data) {
   if (QThread::currentThread() != this->thread()) {
     QMetaObject::invokeMethod(this, "sendVoiceMessage", Qt::QueuedConnection,
                               Q_ARG(QString, target), Q_ARG(uint16_t, duration),
+                              Q_ARG(wizz::VoiceCodec, codec),
                               Q_ARG(std::vector<uint8_t>, data));
     return;
   }
+  // Without CapVoiceAdpcm the server only relays WAV (also while the Hello
+  // is outstanding: we don't know yet)
+  const std::vector<uint8_t> *blob = &data;
+  std::vector<uint8_t> wav;
+  if (codec == wizz::VoiceCodec::ImaAdpcm &&
+      !(m_capabilities & wizz::CapVoiceAdpcm)) {
+    std::vector<int16_t> mono;
+    uint32_t sampleRate = 0;
+    if (!wizz::decodeImaAdpcm(data.data(), data.size(), mono, sampleRate))
+      return;
+    wav = wizz::encodeWav(mono.data(), mono.size(), 1, sampleRate);
+    blob = &wav;
+    codec = wizz::VoiceCodec::Wav;
+  }
+
   wizz::Packet p(wizz::PacketType::VoiceMessage);
   p.writeString(target.toStdString());
   p.writeInt(static_cast<uint32_t>(duration));
-  p.writeInt(static_cast<uint32_t>(data.size()));
-  p.writeData(data.data(), data.size());
+  p.writeInt(static_cast<uint32_t>(blob->size()));
+  p.writeData(blob->data(), blob->size());
+  p.writeInt(static_cast<uint32_t>(codec));
 
   sendPacket(p);
 }
@@ -205,6 +379,22 @@ void NetworkManager::requestAvatar(const QString &username) {
   sendPacket(p);
 }
 
+void NetworkManager::requestAvatarIfChanged(const QString &username,
+                                            const QString &hash) {
+  if (QThread::currentThread() != this->thread()) {
+    QMetaObject::invokeMethod(this, "requestAvatarIfChanged",
+                              Qt::QueuedConnection, Q_ARG(QString, username),
+                              Q_ARG(QString, hash));
+    return;
+  }
+  if (!isConnected())
+    return;
+  wizz::Packet p(wizz::PacketType::GetAvatarIfChanged);
+  p.writeString(username.toStdString());
+  p.writeString(hash.toStdString());
+  sendPacket(p);
+}
+
 void NetworkManager::sendStatusChange(int status,
                                       const QString &statusMessage) {
   if (QThread::currentThread() != this->thread()) {
@@ -277,74 +467,260 @@ void NetworkManager::sendGameInviteResponse(const QString &originalSender,
 // --- Slots ---
 
 void NetworkManager::onSocketConnected() {
+  resetTransport();
   m_isConnected.store(true);
+  sendHello();
+  if (m_reconnecting) {
+    // Held until the HelloAck
+    if (m_resumeToken.empty()) {
+      writeSerialized(m_loginPacket);
+    } else {
+      wizz::Packet resume(wizz::PacketType::Resume);
+      resume.writeString(m_resumeToken);
+      writeSerialized(resume.serialize());
+    }
+    return;
+  }
+  if (m_redirecting) {
+    // The UI is still waiting on its login
+    m_redirecting = false;
+    writeSerialized(m_pendingLogin);
+    return;
+  }
   emit connected();
 }
 
 void NetworkManager::onSocketDisconnected() {
   m_isConnected.store(false);
+  m_redirecting = false;
+  resetTransport();
+  if (recovering())
+    return;
   emit disconnected();
 }
 
 void NetworkManager::onSocketError(QAbstractSocket::SocketError socketError) {
   Q_UNUSED(socketError);
+  m_redirecting = false;
+  bool wasReconnecting = m_reconnecting;
+  if (recovering())
+    return;
   emit errorOccurred(m_socket->errorString());
+  // A failed connect never emits disconnected; the UI still thinks we are on
+  if (wasReconnecting &&
+      m_socket->state() == QAbstractSocket::UnconnectedState)
+    emit disconnected();
+}
+
+// Whether a reconnect is (now) scheduled for the session we lost: the
+// restarting server may close before its advised delay is up, and other
+// drops retry after 0.5, 1, 2, 4 and 8 s, well inside the server's resume
+// window
+bool NetworkManager::recovering() {
+  if (m_reconnectTimer->isActive())
+    return true;
+  if (m_loginPacket.empty())
+    return false; // Logged out, or never logged in
+  if (m_reconnectAttempts < 5) {
+    m_reconnectTimer->start(500 << m_reconnectAttempts++);
+    return true;
+  }
+  // Could not get back in: up to the UI now
+  m_loginPacket.clear();
+  m_resumeToken.clear();
+  m_reconnecting = false;
+  m_reconnectAttempts = 0;
+  return false;
+}
+
+void NetworkManager::reconnect() {
+  qDebug() << "[Network] Reconnecting, attempt" << m_reconnectAttempts;
+  m_reconnecting = true;
+  m_isConnected.store(false);
+  resetTransport();
+  {
+    QSignalBlocker quiet(m_socket); // Not a drop the UI needs to hear about
+    m_socket->abort();
+  }
+  m_socket->connectToHostEncrypted(m_host, m_port);
 }
 
 void NetworkManager::onReadyRead() {
   QByteArray newData = m_socket->readAll();
+  if (m_framing) {
+    processFramed(reinterpret_cast<const uint8_t *>(newData.constData()),
+                  newData.size());
+    return;
+  }
   m_buffer.insert(m_buffer.end(), newData.begin(), newData.end());
 
   // Process Buffer (Loop for multiple packets)
+  size_t offset = 0;
   while (true) {
     // 1. Check Header
-    if (m_buffer.size() < 12)
-      break; // Not enough for header
+    size_t headerSize = 12;
+    uint32_t bodyLen = 0;
+    if (m_codec) {
+      wizz::CompactHeader header;
+      try {
+        if (!wizz::parseCompactHeader(m_buffer.data() + offset,
+                                      m_buffer.size() - offset, header))
+          break; // Not enough for header
+      } catch (const std::exception &e) {
+        emit errorOccurred(QString("Protocol error: ") + e.what());
+        m_buffer.clear();
+        m_socket->abort();
+        return;
+      }
+      headerSize = header.size;
+      bodyLen = header.length;
+    } else {
+      if (m_buffer.size() - offset < 12)
+        break; // Not enough for header
 
-    // Read Body Length (Offset 8)
-    uint32_t netLen;
-    std::memcpy(&netLen, m_buffer.data() + 8, 4);
-    uint32_t bodyLen =
-        ntohl(netLen); // Helper needed? ntohl is cross-platform usually
+      // Read Body Length (Offset 8)
+      uint32_t netLen;
+      std::memcpy(&netLen, m_buffer.data() + offset + 8, 4);
+      bodyLen = ntohl(netLen); // Helper needed? ntohl is cross-platform usually
+    }
 
     // 2. Check Full Packet
-    size_t totalSize = 12 + bodyLen;
-    if (m_buffer.size() < totalSize)
+    size_t totalSize = headerSize + bodyLen;
+    if (m_buffer.size() - offset < totalSize)
       break; // Wait for more data
 
     // 3. Extract
-    std::vector<uint8_t> packetData(m_buffer.begin(),
-                                    m_buffer.begin() + totalSize);
+    std::vector<uint8_t> packetData(m_buffer.begin() + offset,
+                                    m_buffer.begin() + offset + totalSize);
+    offset += totalSize;
 
-    try {
-      wizz::Packet pkt(packetData);
-      emit packetReceived(pkt);
+    if (m_helloPending && !m_codec &&
+        wizz::Packet::peekType(packetData) == wizz::PacketType::HelloAck) {
+      try {
+        wizz::Packet ack(packetData);
+        uint32_t capabilities = ack.readInt();
+        uint32_t maxFrameSize = ack.readInt();
+        finishNegotiation(capabilities, maxFrameSize);
+      } catch (...) {
+        finishNegotiation(0, 0);
+      }
 
-      // Dispatch packet through registered handlers
-      if (m_packetHandlers.contains(pkt.type())) {
-        m_packetHandlers[pkt.type()](pkt);
-      } else {
-        // Unhandled packet logic can go here (or be ignored)
+      if (m_framing) {
+        // Everything after the ack is frames
+        std::vector<uint8_t> rest(m_buffer.begin() + offset, m_buffer.end());
+        m_buffer.clear();
+        if (!rest.empty())
+          processFramed(rest.data(), rest.size());
+        return;
       }
+      continue;
+    }
+
+    dispatchPacket(packetData);
+  }
 
-    } catch (...) {
-      // Log error?
-      emit errorOccurred("Packet parsing error");
+  // 4. Remove from buffer
+  m_buffer.erase(m_buffer.begin(), m_buffer.begin() + offset);
+}
+
+void NetworkManager::processFramed(const uint8_t *data, size_t length) {
+  std::vector<std::vector<uint8_t>> packets;
+  try {
+    m_frameAssembler.feed(data, length, packets);
+  } catch (const std::exception &e) {
+    emit errorOccurred(QString("Framing error: ") + e.what());
+    m_socket->abort();
+    return;
+  }
+  for (const auto &packetData : packets) {
+    dispatchPacket(packetData);
+  }
+}
+
+// Rehydrates a received packet; v2 bytes are transcoded to a v1 Packet
+static wizz::Packet readPacket(wizz::CompactCodec *codec,
+                               const std::vector<uint8_t> &packetData) {
+  if (!codec)
+    return wizz::Packet(packetData);
+  wizz::CompactHeader header;
+  if (!wizz::parseCompactHeader(packetData.data(), packetData.size(), header) ||
+      header.size + header.length != packetData.size()) {
+    throw std::runtime_error("Truncated packet");
+  }
+  return codec->decode(header.type, packetData.data() + header.size,
+                       header.length, header.flags);
+}
+
+void NetworkManager::dispatchPacket(const std::vector<uint8_t> &packetData) {
+  try {
+    wizz::Packet pkt = readPacket(m_codec.get(), packetData);
+    wizz::PacketType type = pkt.type();
+    if (m_reconnecting && (type == wizz::PacketType::LoginSuccess ||
+                           type == wizz::PacketType::LoginFailed ||
+                           type == wizz::PacketType::ResumeSuccess ||
+                           type == wizz::PacketType::ResumeFailed)) {
+      // Our own login again: the UI already went through this one
+      if (type == wizz::PacketType::LoginFailed) {
+        m_reconnecting = false;
+        m_loginPacket.clear();
+        m_socket->disconnectFromHost();
+        return;
+      }
+      if (type != wizz::PacketType::ResumeFailed) {
+        m_reconnecting = false;
+        m_reconnectAttempts = 0;
+      }
+    } else {
+      if (type == wizz::PacketType::LoginSuccess) {
+        m_loginPacket = std::move(m_pendingLogin);
+        // Kept contacts are offline until the presence snapshot says otherwise
+        for (auto &contact : m_cachedContacts) {
+          std::get<1>(contact) = 3;
+          std::get<2>(contact).clear();
+        }
+      }
+      emit packetReceived(pkt);
+    }
+
+    // Dispatch packet through registered handlers
+    if (m_packetHandlers.contains(pkt.type())) {
+      m_packetHandlers[pkt.type()](pkt);
+    } else {
+      // Unhandled packet logic can go here (or be ignored)
     }
 
-    // 4. Remove from buffer
-    m_buffer.erase(m_buffer.begin(), m_buffer.begin() + totalSize);
+  } catch (...) {
+    // Log error?
+    emit errorOccurred("Packet parsing error");
   }
 }
 
 // --- Packet Handlers ---
 
 void NetworkManager::registerHandlers() {
+  m_packetHandlers[wizz::PacketType::LoginSuccess] =
+      [this](wizz::Packet &pkt) { handleLoginSuccessPacket(pkt); };
+  m_packetHandlers[wizz::PacketType::ResumeSuccess] =
+      [this](wizz::Packet &pkt) { handleLoginSuccessPacket(pkt); };
+  m_packetHandlers[wizz::PacketType::ResumeFailed] =
+      [this](wizz::Packet &pkt) { handleResumeFailedPacket(pkt); };
+  m_packetHandlers[wizz::PacketType::Reconnect] =
+      [this](wizz::Packet &pkt) { handleReconnectPacket(pkt); };
+  m_packetHandlers[wizz::PacketType::Redirect] =
+      [this](wizz::Packet &pkt) { handleRedirectPacket(pkt); };
+  m_packetHandlers[wizz::PacketType::MessageSent] =
+      [this](wizz::Packet &pkt) { handleMessageSentPacket(pkt); };
   m_packetHandlers[wizz::PacketType::ContactList] = [this](wizz::Packet &pkt) {
     handleContactListPacket(pkt);
   };
+  m_packetHandlers[wizz::PacketType::ContactListDelta] =
+      [this](wizz::Packet &pkt) { handleContactListDeltaPacket(pkt); };
   m_packetHandlers[wizz::PacketType::ContactStatusChange] =
       [this](wizz::Packet &pkt) { handleContactStatusChangePacket(pkt); };
+  m_packetHandlers[wizz::PacketType::PresenceBatch] =
+      [this](wizz::Packet &pkt) { handlePresenceBatchPacket(pkt); };
+  m_packetHandlers[wizz::PacketType::PresenceSnapshot] =
+      [this](wizz::Packet &pkt) { handlePresenceSnapshotPacket(pkt); };
   m_packetHandlers[wizz::PacketType::Error] = [this](wizz::Packet &pkt) {
     handleErrorPacket(pkt);
   };
@@ -361,6 +737,8 @@ void NetworkManager::registerHandlers() {
   m_packetHandlers[wizz::PacketType::AvatarData] = [this](wizz::Packet &pkt) {
     handleAvatarDataPacket(pkt);
   };
+  m_packetHandlers[wizz::PacketType::AvatarNotModified] =
+      [this](wizz::Packet &pkt) { handleAvatarNotModifiedPacket(pkt); };
   m_packetHandlers[wizz::PacketType::GameStatus] = [this](wizz::Packet &pkt) {
     handleGameStatusPacket(pkt);
   };
@@ -377,19 +755,114 @@ void NetworkManager::registerHandlers() {
   };
 }
 
+void NetworkManager::handleLoginSuccessPacket(wizz::Packet &pkt) {
+  // Older servers send no sequence number and never acknowledge
+  m_serverAcks = pkt.remaining() >= 4;
+  uint32_t stored = m_serverAcks ? pkt.readInt() : 0;
+
+  while (!m_unacked.empty() && m_unacked.front().seq <= stored)
+    m_unacked.pop_front();
+  m_lastSeq = m_unacked.empty() ? stored
+                                : std::max(stored, m_unacked.back().seq);
+  // Whatever the server did not store before we lost it, in order
+  for (const auto &msg : m_unacked)
+    writeDirectMessage(msg);
+  if (!m_serverAcks)
+    m_unacked.clear();
+  // Older servers issue no resume token
+  m_resumeToken = pkt.remaining() >= 4 ? pkt.readString() : std::string();
+}
+
+void NetworkManager::handleResumeFailedPacket(wizz::Packet &pkt) {
+  Q_UNUSED(pkt);
+  // Too late (or a different server): log in the long way
+  m_resumeToken.clear();
+  if (!m_loginPacket.empty())
+    writeSerialized(m_loginPacket);
+}
+
+void NetworkManager::handleReconnectPacket(wizz::Packet &pkt) {
+  uint32_t delay = pkt.readInt();
+  if (m_loginPacket.empty())
+    return; // Not logged in: nothing to resume, the server just closes
+  qDebug() << "[Network] Server restarting, reconnecting in" << delay << "ms";
+  m_reconnectTimer->start(static_cast<int>(delay));
+}
+
+// Cluster mode: this user is served by another node. The login (or the
+// reconnect in progress) is retried there, and later reconnects go there too.
+void NetworkManager::handleRedirectPacket(wizz::Packet &pkt) {
+  std::string host = pkt.readString();
+  uint32_t port = pkt.readInt();
+  if (m_pendingLogin.empty() && !m_reconnecting)
+    return;
+  qDebug() << "[Network] Redirected to" << QString::fromStdString(host) << port;
+  m_host = QString::fromStdString(host);
+  m_port = static_cast<quint16>(port);
+  m_redirecting = !m_reconnecting;
+  m_isConnected.store(false);
+  resetTransport();
+  {
+    QSignalBlocker quiet(m_socket); // Not a drop the UI needs to hear about
+    m_socket->abort();
+  }
+  m_socket->connectToHostEncrypted(m_host, m_port);
+}
+
+void NetworkManager::handleMessageSentPacket(wizz::Packet &pkt) {
+  uint32_t seq = pkt.readInt();
+  while (!m_unacked.empty() && m_unacked.front().seq <= seq)
+    m_unacked.pop_front();
+  emit messagesStored(seq);
+}
+
 void NetworkManager::handleContactListPacket(wizz::Packet &pkt) {
   uint32_t count = pkt.readInt();
   QList<std::tuple<QString, int, QString>> contacts;
+  QHash<QString, QString> avatarVersions;
   for (uint32_t i = 0; i < count; ++i) {
     QString name = QString::fromStdString(pkt.readString());
     int status = static_cast<int>(pkt.readInt());
     QString statusMsg = QString::fromStdString(pkt.readString());
+    avatarVersions.insert(name, QString::fromStdString(pkt.readString()));
     contacts.append(std::make_tuple(name, status, statusMsg));
   }
+  // Older servers do not version the list
+  m_contactsVersion = pkt.remaining() >= 4 ? pkt.readInt() : 0;
   m_cachedContacts = contacts;
+  // Versions first, so AvatarManager can skip fetches for unchanged avatars
+  emit avatarVersionsReceived(avatarVersions);
   emit contactListReceived(contacts);
 }
 
+void NetworkManager::handleContactListDeltaPacket(wizz::Packet &pkt) {
+  uint32_t version = pkt.readInt();
+  uint32_t count = pkt.readInt();
+  QHash<QString, QString> avatarVersions;
+  for (uint32_t i = 0; i < count; ++i) {
+    QString name = QString::fromStdString(pkt.readString());
+    bool added = pkt.readInt() != 0;
+    int status = static_cast<int>(pkt.readInt());
+    QString statusMsg = QString::fromStdString(pkt.readString());
+    QString avatarHash = QString::fromStdString(pkt.readString());
+    // Applying a change twice is harmless: a replayed login may resend it
+    for (int j = 0; j < m_cachedContacts.size(); ++j) {
+      if (std::get<0>(m_cachedContacts[j]) == name) {
+        m_cachedContacts.removeAt(j);
+        break;
+      }
+    }
+    if (added) {
+      m_cachedContacts.append(std::make_tuple(name, status, statusMsg));
+      avatarVersions.insert(name, avatarHash);
+    }
+  }
+  m_contactsVersion = version;
+  if (!avatarVersions.isEmpty())
+    emit avatarVersionsReceived(avatarVersions);
+  emit contactListReceived(m_cachedContacts);
+}
+
 void NetworkManager::handleContactStatusChangePacket(wizz::Packet &pkt) {
   int status = static_cast<int>(pkt.readInt());
   QString username = QString::fromStdString(pkt.readString());
@@ -397,6 +870,56 @@ void NetworkManager::handleContactStatusChangePacket(wizz::Packet &pkt) {
   emit contactStatusChanged(username, status, statusMsg);
 }
 
+void NetworkManager::handlePresenceBatchPacket(wizz::Packet &pkt) {
+  // Latest status per contact, then latest typing state per contact
+  uint32_t statusCount = pkt.readInt();
+  QList<ContactPresence> updates;
+  updates.reserve(statusCount);
+  for (uint32_t i = 0; i < statusCount; ++i) {
+    ContactPresence presence;
+    presence.username = QString::fromStdString(pkt.readString());
+    presence.status = static_cast<int>(pkt.readInt());
+    presence.statusMessage = QString::fromStdString(pkt.readString());
+    updates.append(presence);
+  }
+  if (!updates.isEmpty())
+    emit presenceReceived(updates);
+
+  uint32_t typingCount = pkt.readInt();
+  for (uint32_t i = 0; i < typingCount; ++i) {
+    QString sender = QString::fromStdString(pkt.readString());
+    bool isTyping = (pkt.readInt() != 0);
+    emit userTyping(sender, isTyping);
+  }
+}
+
+void NetworkManager::handlePresenceSnapshotPacket(wizz::Packet &pkt) {
+  uint32_t count = pkt.readInt();
+  QList<ContactPresence> updates;
+  updates.reserve(count);
+  for (uint32_t i = 0; i < count; ++i) {
+    ContactPresence presence;
+    presence.username = QString::fromStdString(pkt.readString());
+    presence.status = static_cast<int>(pkt.readInt());
+    presence.statusMessage = QString::fromStdString(pkt.readString());
+    presence.hasGameStatus = true;
+    presence.gameName = QString::fromStdString(pkt.readString());
+    presence.gameScore = pkt.readInt();
+    updates.append(presence);
+  }
+  // A login that kept its contact list gets no statuses in a ContactList
+  for (auto &contact : m_cachedContacts) {
+    for (const ContactPresence &presence : updates) {
+      if (presence.username == std::get<0>(contact)) {
+        std::get<1>(contact) = presence.status;
+        std::get<2>(contact) = presence.statusMessage;
+        break;
+      }
+    }
+  }
+  emit presenceReceived(updates);
+}
+
 void NetworkManager::handleErrorPacket(wizz::Packet &pkt) {
   QString msg = QString::fromStdString(pkt.readString());
   emit errorOccurred(msg);
@@ -420,7 +943,11 @@ void NetworkManager::handleVoiceMessagePacket(wizz::Packet &pkt) {
   // Safety / Sanity check
   if (len < 50 * 1024 * 1024) { // Limit to 50MB (arbitrary large for MVP)
     std::vector<uint8_t> audioData = pkt.readBytes(len);
-    emit voiceMessageReceived(sender, duration, audioData);
+    // Older servers don't send the codec: it's WAV then
+    wizz::VoiceCodec codec = wizz::VoiceCodec::Wav;
+    if (pkt.remaining() >= sizeof(uint32_t))
+      codec = static_cast<wizz::VoiceCodec>(pkt.readInt());
+    emit voiceMessageReceived(sender, duration, codec, audioData);
   }
 }
 
@@ -437,10 +964,19 @@ void NetworkManager::handleAvatarDataPacket(wizz::Packet &pkt) {
     std::vector<uint8_t> imgData = pkt.readBytes(len);
     QByteArray qData(reinterpret_cast<const char *>(imgData.data()),
                      imgData.size());
-    emit avatarReceived(username, qData);
+    // Hash trails the image; older servers don't send it
+    QString hash;
+    if (pkt.remaining() > 0)
+      hash = QString::fromStdString(pkt.readString());
+    emit avatarReceived(username, qData, hash);
   }
 }
 
+void NetworkManager::handleAvatarNotModifiedPacket(wizz::Packet &pkt) {
+  QString username = QString::fromStdString(pkt.readString());
+  emit avatarNotModified(username);
+}
+
 void NetworkManager::handleGameStatusPacket(wizz::Packet &pkt) {
   // Server will relay: username(string) -> gameName(string) -> score(uint32_t)
   QString username = QString::fromStdString(pkt.readString());
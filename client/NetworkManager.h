@@ -1,16 +1,31 @@
 #pragma once
 
+#include "../common/CompactCodec.h"
+#include "../common/Frame.h"
 #include "../common/Packet.h"
+#include "../common/VoiceCodec.h"
 #include <QHash>
 #include <QMetaType>
 #include <QObject>
 #include <QSslError>
 #include <QSslSocket>
+#include <QTimer>
 #include <atomic>
+#include <deque>
 #include <functional>
 #include <memory>
 #include <tuple>
 
+// One contact's presence, as carried by PresenceBatch and PresenceSnapshot
+struct ContactPresence {
+  QString username;
+  int status = 3;
+  QString statusMessage;
+  bool hasGameStatus = false; // Snapshot only; empty gameName = not playing
+  QString gameName;
+  uint32_t gameScore = 0;
+};
+
 class NetworkManager : public QObject {
   Q_OBJECT
 
@@ -32,12 +47,17 @@ public slots:
 
   // Sending Data
   void sendPacket(const wizz::Packet &packet);
+  // Numbered and kept until the server has stored it (MessageSent), so
+  // messages can be pipelined and are resent after a reconnect
+  void sendDirectMessage(const QString &target, const QString &text);
   void sendVoiceMessage(const QString &target, uint16_t duration,
+                        wizz::VoiceCodec codec,
                         const std::vector<uint8_t> &data);
   void sendTypingPacket(const QString &target, bool isTyping);
   void sendUpdateAvatar(const QByteArray &data);
   void sendUpdateStatus(const QString &status);
   void requestAvatar(const QString &username);
+  void requestAvatarIfChanged(const QString &username, const QString &hash);
   void sendStatusChange(int status, const QString &statusMessage = "");
   void sendGameStatus(const QString &gameName, uint32_t score);
 
@@ -60,12 +80,21 @@ signals:
       const QList<std::tuple<QString, int, QString>> &contacts);
   void contactStatusChanged(const QString &username, int status,
                             const QString &statusMessage);
+  // Many contacts at once (batched updates, login snapshot): apply together
+  void presenceReceived(const QList<ContactPresence> &updates);
   void messageReceived(const QString &sender, const QString &text);
+  // Every message numbered up to `seq` is stored on the server
+  void messagesStored(uint32_t seq);
   void nudgeReceived(const QString &sender);
   void voiceMessageReceived(const QString &sender, uint16_t duration,
+                            wizz::VoiceCodec codec,
                             const std::vector<uint8_t> &data);
   void userTyping(const QString &sender, bool isTyping);
-  void avatarReceived(const QString &username, const QByteArray &data);
+  void avatarReceived(const QString &username, const QByteArray &data,
+                      const QString &hash);
+  void avatarNotModified(const QString &username);
+  // Avatar hash per contact, as advertised in the ContactList
+  void avatarVersionsReceived(const QHash<QString, QString> &versions);
   void gameStatusChanged(const QString &username, const QString &gameName,
                          uint32_t score);
   void gameInviteReceived(const QString &sender, const QString &gameName);
@@ -80,6 +109,7 @@ private slots:
   void onSocketDisconnected();
   void onSocketError(QAbstractSocket::SocketError socketError);
   void onReadyRead();
+  void pumpFrames();
 
 private:
   explicit NetworkManager(QObject *parent = nullptr);
@@ -93,18 +123,76 @@ private:
   std::vector<uint8_t> m_buffer; // Receive buffer
   std::atomic<bool> m_isConnected{false};
   QList<std::tuple<QString, int, QString>> m_cachedContacts;
+  // Version of m_cachedContacts and whose list it is. Sent with the next
+  // Login by that user, so the server only sends what changed since.
+  uint32_t m_contactsVersion = 0;
+  std::string m_contactsUser;
   QThread *m_thread = nullptr;
 
+  // Protocol negotiation (Hello/HelloAck). Packets sent while the Hello is
+  // outstanding are held, then flushed in whichever format was agreed.
+  bool m_helloPending = false;
+  bool m_framing = false;
+  uint32_t m_capabilities = 0;
+  std::vector<std::vector<uint8_t>> m_heldPackets;
+  wizz::FrameScheduler m_frameScheduler;
+  wizz::FrameAssembler m_frameAssembler;
+  std::unique_ptr<wizz::CompactCodec> m_codec; // Protocol v2, once agreed
+  QTimer *m_helloTimer = nullptr;
+
+  // Direct messages not acknowledged yet, oldest first
+  struct OutgoingMessage {
+    uint32_t seq;
+    QString target;
+    QString text;
+  };
+  std::deque<OutgoingMessage> m_unacked;
+  uint32_t m_lastSeq = 0;     // Last sequence number handed out
+  bool m_serverAcks = false;  // Server reported its stored seq at login
+
+  // Server restarts (Reconnect) and dropped connections: we reconnect,
+  // after the advised delay or with backoff, and resume the session with
+  // its token, or log in again with the last Login sent. The UI only hears
+  // about it if that fails.
+  QString m_host;
+  quint16 m_port = 0;
+  std::vector<uint8_t> m_pendingLogin; // Sent, not answered yet
+  std::vector<uint8_t> m_loginPacket;  // Serialized; empty = not logged in
+  std::string m_resumeToken;          // From LoginSuccess/ResumeSuccess
+  QTimer *m_reconnectTimer = nullptr;
+  bool m_reconnecting = false;
+  bool m_redirecting = false; // Cluster: taking the login to another node
+  int m_reconnectAttempts = 0;
+  void reconnect();
+  bool recovering();
+
+  void sendHello();
+  void finishNegotiation(uint32_t capabilities, uint32_t maxFrameSize);
+  void resetTransport();
+  void writeSerialized(std::vector<uint8_t> data);
+  void processFramed(const uint8_t *data, size_t length);
+  void dispatchPacket(const std::vector<uint8_t> &packetData);
+  void writeDirectMessage(const OutgoingMessage &msg);
+
   // Packet Handlers
   void registerHandlers();
+  void handleLoginSuccessPacket(wizz::Packet &pkt);
+  void handleReconnectPacket(wizz::Packet &pkt);
+  void handleRedirectPacket(wizz::Packet &pkt);
+  void handleResumeFailedPacket(wizz::Packet &pkt);
+  void handleMessageSentPacket(wizz::Packet &pkt);
   void handleContactListPacket(wizz::Packet &pkt);
+  void handleContactListDeltaPacket(wizz::Packet &pkt);
   void handleContactStatusChangePacket(wizz::Packet &pkt);
+  void handlePresenceBatchPacket(wizz::Packet &pkt);
+  void handlePresenceSnapshotPacket(wizz::Packet &pkt);
   void handleErrorPacket(wizz::Packet &pkt);
   void handleDirectMessagePacket(wizz::Packet &pkt);
   void handleNudgePacket(wizz::Packet &pkt);
   void handleVoiceMessagePacket(wizz::Packet &pkt);
   void handleTypingIndicatorPacket(wizz::Packet &pkt);
   void handleAvatarDataPacket(wizz::Packet &pkt);
+  void handleAvatarNotModifiedPacket(wizz::Packet &pkt);
   void handleGameStatusPacket(wizz::Packet &pkt);
   void handleGameInvitePacket(wizz::Packet &pkt);
   void handleGameInviteResponsePacket(wizz::Packet &pkt);
@@ -0,0 +1,442 @@
+#include "CompactCodec.h"
+
+#include <stdexcept>
+
+namespace wizz {
+
+namespace {
+
+// Field kinds of a packet body, as written by the v1 Packet API
+enum Op : uint8_t {
+  Int,    // writeInt
+  Str,    // writeString
+  Name,   // writeString of a user (or game/room) name: aliased
+  Blob,   // writeInt(size) + writeData
+  Repeat  // writeInt(count), then the next N ops `count` times
+};
+
+using Layout = std::vector<uint8_t>;
+
+// nullptr = no layout, the v1 body travels as is. Fields may be left off
+// the end (older senders); anything past the layout is copied verbatim.
+const Layout *layoutFor(PacketType type, Direction direction) {
+  static const Layout name = {Name};
+  static const Layout str = {Str};
+  static const Layout strStr = {Str, Str};
+  static const Layout strStrInt = {Str, Str, Int};
+  static const Layout nameStr = {Name, Str};
+  static const Layout nameInt = {Name, Int};
+  static const Layout integer = {Int};
+  static const Layout intStr = {Int, Str};
+  static const Layout strInt = {Str, Int};
+  static const Layout directMessage = {Name, Str, Int}; // Int: client seq
+  static const Layout contactList = {Repeat, 4, Name, Int, Str, Str, Int};
+  static const Layout contactListDelta = {Int, Repeat, 5, Name, Int, Int, Str, Str};
+  static const Layout statusChange = {Int, Name, Str};
+  static const Layout presenceBatch = {Repeat, 3, Name, Int, Str,
+                                       Repeat, 2, Name, Int};
+  static const Layout presenceSnapshot = {Repeat, 5, Name, Int, Str, Str, Int};
+  static const Layout voice = {Name, Int, Blob, Int};
+  static const Layout blob = {Blob};
+  static const Layout avatarData = {Name, Blob, Str};
+  static const Layout gameStatusUp = {Name, Int};
+  static const Layout gameStatusDown = {Name, Name, Int};
+  static const Layout gameInviteResponse = {Name, Name, Int};
+  static const Layout gameStart = {Name, Name, Int, Name};
+  static const Layout gameMove = {Name, Int};
+  static const Layout groupCreate = {Str, Repeat, 1, Name};
+  static const Layout groupInfo = {Int, Str, Repeat, 1, Name};
+  static const Layout groupMessageUp = {Int, Str};
+  static const Layout groupMessageDown = {Int, Name, Str};
+  static const Layout groupMember = {Int, Name};
+
+  switch (type) {
+  case PacketType::Login: // + contacts version (CapContactDeltas)
+    return &strStrInt;
+  case PacketType::Register:
+    return &strStr;
+  case PacketType::LoginFailed:
+  case PacketType::Resume:
+  case PacketType::ResumeFailed:
+  case PacketType::RegisterSuccess:
+  case PacketType::RegisterFailed:
+  case PacketType::UpdateStatus:
+  case PacketType::Error:
+    return &str;
+  case PacketType::AddContact:
+  case PacketType::RemoveContact:
+  case PacketType::Nudge:
+  case PacketType::GetAvatar:
+  case PacketType::AvatarNotModified:
+    return &name;
+  case PacketType::ContactList:
+    return &contactList;
+  case PacketType::ContactListDelta:
+    return &contactListDelta;
+  case PacketType::ContactStatusChange:
+    return &statusChange;
+  case PacketType::PresenceBatch:
+    return &presenceBatch;
+  case PacketType::PresenceSnapshot:
+    return &presenceSnapshot;
+  case PacketType::LoginSuccess:
+  case PacketType::ResumeSuccess:
+    return &intStr;
+  case PacketType::Redirect:
+    return &strInt;
+  case PacketType::Reconnect:
+  case PacketType::MessageSent:
+  case PacketType::GroupLeave:
+    return &integer;
+  case PacketType::DirectMessage:
+    return &directMessage;
+  case PacketType::GetAvatarIfChanged:
+    return &nameStr;
+  case PacketType::TypingIndicator:
+    return &nameInt;
+  case PacketType::VoiceMessage:
+    return &voice;
+  case PacketType::UpdateAvatar:
+    return &blob;
+  case PacketType::AvatarData:
+    return &avatarData;
+  case PacketType::GameStatus: // The server adds who is playing
+    return direction == Direction::ToServer ? &gameStatusUp : &gameStatusDown;
+  case PacketType::GameInvite:
+    return &nameStr;
+  case PacketType::GameInviteResponse:
+    return &gameInviteResponse;
+  case PacketType::GameStart:
+    return &gameStart;
+  case PacketType::GameMove:
+    return &gameMove;
+  case PacketType::GroupCreate:
+    return &groupCreate;
+  case PacketType::GroupInfo:
+    return &groupInfo;
+  case PacketType::GroupMessage: // The server adds the sender
+    return direction == Direction::ToServer ? &groupMessageUp
+                                            : &groupMessageDown;
+  case PacketType::GroupAddMember:
+    return &groupMember;
+  default:
+    return nullptr;
+  }
+}
+
+struct Cursor {
+  const uint8_t *data;
+  size_t length;
+  size_t offset = 0;
+
+  size_t remaining() const { return length - offset; }
+  void need(size_t n) const {
+    if (n > remaining())
+      throw std::out_of_range("Not enough data in packet body");
+  }
+};
+
+uint32_t readBigEndian(Cursor &in) {
+  in.need(4);
+  const uint8_t *p = in.data + in.offset;
+  in.offset += 4;
+  return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) |
+         (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+void encodeOps(const uint8_t *ops, size_t count, Cursor &in,
+               std::vector<uint8_t> &out, UserAlias &aliases, bool topLevel) {
+  for (size_t i = 0; i < count; ++i) {
+    if (topLevel && in.remaining() == 0)
+      return;
+    switch (ops[i]) {
+    case Int:
+      writeVarint(out, readBigEndian(in));
+      break;
+    case Str:
+    case Blob: {
+      uint32_t size = readBigEndian(in);
+      in.need(size);
+      writeVarint(out, size);
+      out.insert(out.end(), in.data + in.offset, in.data + in.offset + size);
+      in.offset += size;
+      break;
+    }
+    case Name: {
+      uint32_t size = readBigEndian(in);
+      in.need(size);
+      aliases.writeUser(
+          out, std::string(reinterpret_cast<const char *>(in.data + in.offset),
+                           size));
+      in.offset += size;
+      break;
+    }
+    case Repeat: {
+      size_t group = ops[++i];
+      uint32_t n = readBigEndian(in);
+      writeVarint(out, n);
+      for (uint32_t k = 0; k < n; ++k)
+        encodeOps(ops + i + 1, group, in, out, aliases, false);
+      i += group;
+      break;
+    }
+    }
+  }
+}
+
+void decodeOps(const uint8_t *ops, size_t count, Cursor &in, Packet &out,
+               UserAlias &aliases, bool topLevel) {
+  for (size_t i = 0; i < count; ++i) {
+    if (topLevel && in.remaining() == 0)
+      return;
+    switch (ops[i]) {
+    case Int:
+      out.writeInt(readVarint(in.data, in.length, in.offset));
+      break;
+    case Str:
+    case Blob: {
+      uint32_t size = readVarint(in.data, in.length, in.offset);
+      in.need(size);
+      out.writeInt(size);
+      out.writeData(in.data + in.offset, size);
+      in.offset += size;
+      break;
+    }
+    case Name:
+      out.writeString(aliases.readUser(in.data, in.length, in.offset));
+      break;
+    case Repeat: {
+      size_t group = ops[++i];
+      uint32_t n = readVarint(in.data, in.length, in.offset);
+      in.need(n); // Every entry takes at least a byte
+      out.writeInt(n);
+      for (uint32_t k = 0; k < n; ++k)
+        decodeOps(ops + i + 1, group, in, out, aliases, false);
+      i += group;
+      break;
+    }
+    }
+  }
+}
+
+size_t blobIndex(const Layout &layout) {
+  for (size_t i = 0; i < layout.size(); ++i) {
+    if (layout[i] == Blob)
+      return i;
+    if (layout[i] == Repeat)
+      ++i;
+  }
+  throw std::logic_error("Packet type has no blob field");
+}
+
+} // namespace
+
+// --- Header and varints ---
+
+void writeCompactHeader(std::vector<uint8_t> &out, PacketType type,
+                        uint32_t length, uint8_t flags) {
+  uint32_t typeValue = static_cast<uint32_t>(type);
+  if (typeValue > COMPACT_MAX_TYPE) {
+    throw std::logic_error("Packet type does not fit the compact header");
+  }
+  bool escaped = length >= COMPACT_LENGTH_ESCAPE;
+  uint32_t word = (uint32_t(flags & 0x3) << 30) | (typeValue << 20) |
+                  (escaped ? COMPACT_LENGTH_ESCAPE : length);
+  for (int shift = 24; shift >= 0; shift -= 8)
+    out.push_back(static_cast<uint8_t>(word >> shift));
+  if (escaped) {
+    for (int shift = 24; shift >= 0; shift -= 8)
+      out.push_back(static_cast<uint8_t>(length >> shift));
+  }
+}
+
+size_t compactHeaderSize(const uint8_t *data) {
+  bool escaped = (data[1] & 0x0F) == 0x0F && data[2] == 0xFF && data[3] == 0xFF;
+  return escaped ? COMPACT_HEADER_SIZE + 4 : COMPACT_HEADER_SIZE;
+}
+
+bool parseCompactHeader(const uint8_t *data, size_t length,
+                        CompactHeader &out) {
+  if (length < COMPACT_HEADER_SIZE)
+    return false;
+  Cursor in{data, length};
+  uint32_t word = readBigEndian(in);
+
+  out.flags = static_cast<uint8_t>(word >> 30);
+  if (out.flags == (CompactFlagDeflate | CompactFlagStream)) {
+    throw std::runtime_error("Unsupported compact header flags");
+  }
+  out.type = static_cast<PacketType>((word >> 20) & COMPACT_MAX_TYPE);
+  out.length = word & COMPACT_LENGTH_ESCAPE;
+  out.size = COMPACT_HEADER_SIZE;
+  if (out.length == COMPACT_LENGTH_ESCAPE) {
+    if (in.remaining() < 4)
+      return false;
+    out.length = readBigEndian(in);
+    out.size += 4;
+  }
+  return true;
+}
+
+void writeVarint(std::vector<uint8_t> &out, uint32_t value) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<uint8_t>(value));
+}
+
+uint32_t readVarint(const uint8_t *data, size_t length, size_t &offset) {
+  uint32_t value = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    if (offset >= length)
+      throw std::out_of_range("Not enough data to read varint");
+    uint8_t byte = data[offset++];
+    if (shift == 28 && (byte & 0xF0))
+      throw std::runtime_error("Varint overflows uint32");
+    value |= uint32_t(byte & 0x7F) << shift;
+    if (!(byte & 0x80))
+      return value;
+  }
+  throw std::runtime_error("Varint overflows uint32"); // Not reached
+}
+
+// --- UserAlias ---
+
+void UserAlias::writeUser(std::vector<uint8_t> &out, const std::string &name) {
+  auto it = m_ids.find(name);
+  if (it != m_ids.end()) {
+    writeVarint(out, (it->second << 1) | 1);
+    return;
+  }
+  writeVarint(out, static_cast<uint32_t>(name.size()) << 1);
+  out.insert(out.end(), name.begin(), name.end());
+  if (name.size() <= MAX_ALIAS_LENGTH && m_ids.size() < MAX_ALIASES)
+    m_ids.emplace(name, static_cast<uint32_t>(m_ids.size()));
+}
+
+std::string UserAlias::readUser(const uint8_t *data, size_t length,
+                                size_t &offset) {
+  uint32_t tag = readVarint(data, length, offset);
+  if (tag & 1) {
+    uint32_t id = tag >> 1;
+    if (id >= m_names.size()) {
+      throw std::runtime_error("Unknown user alias");
+    }
+    return m_names[id];
+  }
+
+  uint32_t size = tag >> 1;
+  if (size > length - offset)
+    throw std::out_of_range("Not enough data to read user name");
+  std::string name(reinterpret_cast<const char *>(data + offset), size);
+  offset += size;
+  if (size <= MAX_ALIAS_LENGTH && m_names.size() < MAX_ALIASES)
+    m_names.push_back(name);
+  return name;
+}
+
+void UserAlias::truncate(size_t size) {
+  if (size < m_names.size())
+    m_names.resize(size);
+}
+
+// --- CompactCodec ---
+
+CompactCodec::CompactCodec(Direction outbound) : m_outbound(outbound) {}
+
+void CompactCodec::enableCompression(int level) {
+  m_deflater = std::make_unique<Deflater>(level);
+  m_inflater = std::make_unique<Inflater>();
+}
+
+UserAlias &CompactCodec::aliases(UserAlias *tables, PacketType type) {
+  return tables[static_cast<size_t>(priorityFor(type))];
+}
+
+std::vector<uint8_t> CompactCodec::encode(const Packet &packet) {
+  const std::vector<uint8_t> &v1 = packet.body();
+  std::vector<uint8_t> body;
+  body.reserve(v1.size());
+
+  Cursor in{v1.data(), v1.size()};
+  if (const Layout *layout = layoutFor(packet.type(), m_outbound)) {
+    encodeOps(layout->data(), layout->size(), in, body,
+              aliases(m_sent, packet.type()), true);
+  }
+  body.insert(body.end(), v1.begin() + in.offset, v1.end());
+
+  uint8_t flags = 0;
+  if (m_deflater &&
+      (m_outbound == Direction::ToClient || body.size() < COMPRESS_MAX_UPLOAD)) {
+    flags = m_deflater->compress(
+        body, priorityFor(packet.type()) == FramePriority::Chat);
+  }
+
+  std::vector<uint8_t> out;
+  out.reserve(COMPACT_HEADER_SIZE + 4 + body.size());
+  writeCompactHeader(out, packet.type(), static_cast<uint32_t>(body.size()),
+                     flags);
+  out.insert(out.end(), body.begin(), body.end());
+  return out;
+}
+
+Packet CompactCodec::decode(PacketType type, const uint8_t *body,
+                            size_t length, uint8_t flags) {
+  std::vector<uint8_t> inflated;
+  if (flags) {
+    if (!m_inflater)
+      throw std::runtime_error("Compressed packet without CapDeflate");
+    inflated = m_inflater->decompress(flags, body, length, MAX_PACKET_SIZE);
+    body = inflated.data();
+    length = inflated.size();
+  }
+
+  Packet packet(type);
+  Cursor in{body, length};
+  if (const Layout *layout = layoutFor(type, inbound())) {
+    decodeOps(layout->data(), layout->size(), in, packet,
+              aliases(m_received, type), true);
+  }
+  packet.writeData(body + in.offset, in.remaining());
+  return packet;
+}
+
+size_t CompactCodec::decodePrefix(PacketType type, const uint8_t *body,
+                                  size_t length, Packet &out,
+                                  uint32_t &blobLength) {
+  const Layout *layout = layoutFor(type, inbound());
+  if (!layout)
+    throw std::logic_error("Packet type has no blob field");
+  size_t blob = blobIndex(*layout);
+
+  UserAlias &table = aliases(m_received, type);
+  size_t bound = table.size();
+  Cursor in{body, length};
+  try {
+    Packet prefix(type);
+    decodeOps(layout->data(), blob, in, prefix, table, false);
+    blobLength = readVarint(in.data, in.length, in.offset);
+    prefix.writeInt(blobLength);
+    out = std::move(prefix);
+  } catch (const std::out_of_range &) {
+    table.truncate(bound); // Parsed again once more bytes arrive
+    throw;
+  }
+  return in.offset;
+}
+
+void CompactCodec::decodeSuffix(PacketType type, const uint8_t *body,
+                                size_t length, Packet &out) {
+  const Layout *layout = layoutFor(type, inbound());
+  if (!layout)
+    throw std::logic_error("Packet type has no blob field");
+  size_t blob = blobIndex(*layout);
+
+  Cursor in{body, length};
+  decodeOps(layout->data() + blob + 1, layout->size() - blob - 1, in, out,
+            aliases(m_received, type), true);
+  out.writeData(body + in.offset, in.remaining());
+}
+
+} // namespace wizz
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "Compression.h"
+#include "Frame.h"
+#include "Packet.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace wizz {
+
+/**
+ * @brief Protocol v2 wire format (negotiated via CapCompact).
+ * Same packets, smaller encoding:
+ *  - 4-byte header: 2 flag bits, 10-bit type, 20-bit body length
+ *    (COMPACT_LENGTH_ESCAPE: the real length follows as a 32-bit word)
+ *  - integers and string lengths as unsigned LEB128 varints
+ *  - user names (and other repeated names: games, rooms) as session-local
+ *    aliases, see UserAlias
+ *  - optionally deflated bodies (CapDeflate), see Compression.h
+ * Handlers keep reading and writing v1 Packets; CompactCodec transcodes at
+ * the connection edge using a per-type field layout. Types without a
+ * layout carry their v1 body unchanged, so both formats stay in sync.
+ */
+static const size_t COMPACT_HEADER_SIZE = 4;
+static const uint32_t COMPACT_MAX_TYPE = 0x3FF;
+static const uint32_t COMPACT_LENGTH_ESCAPE = 0xFFFFF;
+
+// Header flag bits (top two bits of the header word). At most one is set.
+enum CompactFlags : uint8_t {
+  CompactFlagDeflate = 0x1, // Body deflated on its own
+  CompactFlagStream = 0x2   // Body continues the chat deflate stream
+};
+// Uploads the server streams to disk are not compressed on the way up
+static const uint32_t COMPRESS_MAX_UPLOAD = 64 * 1024;
+
+struct CompactHeader {
+  uint8_t flags = 0;
+  PacketType type = PacketType::Error;
+  uint32_t length = 0; // Body length
+  size_t size = 0;     // Header bytes (4, or 8 with the escape)
+};
+
+void writeCompactHeader(std::vector<uint8_t> &out, PacketType type,
+                        uint32_t length, uint8_t flags = 0);
+// Full header size (4, or 8 with the escape) from its first four bytes
+size_t compactHeaderSize(const uint8_t *data);
+// False if `length` bytes do not hold the whole header yet
+bool parseCompactHeader(const uint8_t *data, size_t length,
+                        CompactHeader &out);
+
+// Unsigned LEB128. Reads throw std::out_of_range when the data runs out.
+void writeVarint(std::vector<uint8_t> &out, uint32_t value);
+uint32_t readVarint(const uint8_t *data, size_t length, size_t &offset);
+
+/**
+ * @brief One direction's table of session-local name aliases.
+ * The first time a name is written it goes out as a literal and both
+ * sides append it to their table; after that it is sent as its index.
+ * Writer and reader must see the same packets in the same order, which
+ * holds per frame priority class, so a codec keeps one table per class.
+ */
+class UserAlias {
+public:
+  static const size_t MAX_ALIASES = 4096;
+  static const size_t MAX_ALIAS_LENGTH = 64; // Longer names stay literal
+
+  void writeUser(std::vector<uint8_t> &out, const std::string &name);
+  std::string readUser(const uint8_t *data, size_t length, size_t &offset);
+
+  // Reader side: undo bindings of a partially parsed packet
+  size_t size() const { return m_names.size(); }
+  void truncate(size_t size);
+
+private:
+  std::vector<std::string> m_names;
+  std::unordered_map<std::string, uint32_t> m_ids; // Writer side
+};
+
+// Which way a packet travels; a few types are laid out differently
+enum class Direction : uint8_t { ToServer, ToClient };
+
+class CompactCodec {
+public:
+  // `outbound`: direction of the packets this side encodes
+  explicit CompactCodec(Direction outbound);
+
+  // Both ways, once both peers agreed on CapDeflate
+  void enableCompression(int level = COMPRESS_DEFAULT_LEVEL);
+  bool compressing() const { return m_deflater != nullptr; }
+
+  // v1 Packet -> v2 header + body
+  std::vector<uint8_t> encode(const Packet &packet);
+  // v2 body -> v1 Packet, `flags` from its header. Throws
+  // std::out_of_range on truncated input, std::runtime_error on bad input.
+  Packet decode(PacketType type, const uint8_t *body, size_t length,
+                uint8_t flags = 0);
+
+  // Streamed uploads (blob types only): the fields in front of the blob,
+  // up to and including its length. Returns the bytes used; throws
+  // std::out_of_range (and binds nothing) if they are not all there yet.
+  size_t decodePrefix(PacketType type, const uint8_t *body, size_t length,
+                      Packet &out, uint32_t &blobLength);
+  // The fields behind the blob, appended to the prefix packet
+  void decodeSuffix(PacketType type, const uint8_t *body, size_t length,
+                    Packet &out);
+
+private:
+  UserAlias &aliases(UserAlias *tables, PacketType type);
+  Direction inbound() const {
+    return m_outbound == Direction::ToServer ? Direction::ToClient
+                                             : Direction::ToServer;
+  }
+
+  Direction m_outbound;
+  UserAlias m_sent[FRAME_PRIORITY_COUNT];
+  UserAlias m_received[FRAME_PRIORITY_COUNT];
+  std::unique_ptr<Deflater> m_deflater;
+  std::unique_ptr<Inflater> m_inflater;
+};
+
+} // namespace wizz
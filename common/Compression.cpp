@@ -0,0 +1,223 @@
+#include "Compression.h"
+#include "CompactCodec.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <zlib.h>
+
+namespace wizz {
+
+namespace {
+
+// Raw deflate (no zlib header or checksum: TLS already covers integrity)
+const int BULK_WINDOW_BITS = 15;
+const int BULK_MEM_LEVEL = 8;
+// The chat stream lives as long as the connection, so keep it small:
+// a 4 KB window is ~24 KB of deflate state and ~12 KB of inflate state
+const int CHAT_WINDOW_BITS = 12;
+const int CHAT_MEM_LEVEL = 4;
+// What Z_SYNC_FLUSH ends every chat message with; not sent
+const uint8_t SYNC_TAIL[] = {0x00, 0x00, 0xFF, 0xFF};
+
+// One-shot streams are reset per packet, so one per thread serves every
+// connection (instead of ~300 KB of zlib state per session)
+struct OneShotStreams {
+  z_stream deflater{};
+  z_stream inflater{};
+  int level = 0;
+  bool deflaterReady = false;
+  bool inflaterReady = false;
+
+  ~OneShotStreams() {
+    if (deflaterReady)
+      deflateEnd(&deflater);
+    if (inflaterReady)
+      inflateEnd(&inflater);
+  }
+
+  z_stream &deflaterFor(int wanted) {
+    if (!deflaterReady) {
+      if (deflateInit2(&deflater, wanted, Z_DEFLATED, -BULK_WINDOW_BITS,
+                       BULK_MEM_LEVEL, Z_DEFAULT_STRATEGY) != Z_OK) {
+        throw std::runtime_error("deflateInit failed");
+      }
+      deflaterReady = true;
+      level = wanted;
+    } else {
+      deflateReset(&deflater);
+      if (level != wanted) {
+        deflateParams(&deflater, wanted, Z_DEFAULT_STRATEGY);
+        level = wanted;
+      }
+    }
+    return deflater;
+  }
+
+  z_stream &resetInflater() {
+    if (!inflaterReady) {
+      if (inflateInit2(&inflater, -BULK_WINDOW_BITS) != Z_OK) {
+        throw std::runtime_error("inflateInit failed");
+      }
+      inflaterReady = true;
+    } else {
+      inflateReset(&inflater);
+    }
+    return inflater;
+  }
+};
+
+OneShotStreams &oneShot() {
+  thread_local OneShotStreams streams;
+  return streams;
+}
+
+// True if deflating saved at least an eighth of the input
+bool deflateOnce(int level, const uint8_t *data, size_t length,
+                 std::vector<uint8_t> &out) {
+  z_stream &z = oneShot().deflaterFor(level);
+  out.resize(deflateBound(&z, static_cast<uLong>(length)));
+  z.next_in = const_cast<Bytef *>(data);
+  z.avail_in = static_cast<uInt>(length);
+  z.next_out = out.data();
+  z.avail_out = static_cast<uInt>(out.size());
+  if (deflate(&z, Z_FINISH) != Z_STREAM_END) {
+    throw std::runtime_error("deflate failed");
+  }
+  out.resize(out.size() - z.avail_out);
+  return out.size() + length / 8 <= length;
+}
+
+// Appends everything `z` produces from the input to `out`. A one-shot
+// body must end its deflate stream; a chat message must not.
+void inflateInto(z_stream &z, const uint8_t *data, size_t length,
+                 size_t maxSize, std::vector<uint8_t> &out, bool oneShotBody) {
+  z.next_in = const_cast<Bytef *>(data);
+  z.avail_in = static_cast<uInt>(length);
+  while (true) {
+    size_t used = out.size();
+    size_t grown = std::max<size_t>(used * 2, used + 4 * length + 256);
+    out.resize(std::min(grown, maxSize));
+    z.next_out = out.data() + used;
+    z.avail_out = static_cast<uInt>(out.size() - used);
+
+    int rc = inflate(&z, Z_SYNC_FLUSH);
+    out.resize(out.size() - z.avail_out);
+    if (rc == Z_STREAM_END) {
+      if (!oneShotBody || z.avail_in != 0)
+        throw std::runtime_error("Corrupt compressed body");
+      return;
+    }
+    if (rc != Z_OK && rc != Z_BUF_ERROR) {
+      throw std::runtime_error("Corrupt compressed body");
+    }
+    if (z.avail_out > 0) { // Out of input
+      if (oneShotBody)
+        throw std::runtime_error("Truncated compressed body");
+      return;
+    }
+    if (out.size() >= maxSize) {
+      throw std::runtime_error("Decompressed body too large");
+    }
+  }
+}
+
+} // namespace
+
+// --- Deflater ---
+
+Deflater::Deflater(int level) : m_level(level) {}
+
+Deflater::~Deflater() {
+  if (m_chat)
+    deflateEnd(m_chat.get());
+}
+
+uint8_t Deflater::compress(std::vector<uint8_t> &body, bool chat) {
+  if (chat) {
+    if (body.size() < COMPRESS_STREAM_MIN_SIZE)
+      return 0;
+    compressChat(body);
+    return CompactFlagStream;
+  }
+
+  if (body.size() < COMPRESS_MIN_SIZE)
+    return 0;
+  std::vector<uint8_t> out;
+  if (body.size() > 4 * COMPRESS_PROBE_SIZE &&
+      !deflateOnce(m_level, body.data(), COMPRESS_PROBE_SIZE, out)) {
+    return 0;
+  }
+  if (!deflateOnce(m_level, body.data(), body.size(), out))
+    return 0;
+  body.swap(out);
+  return CompactFlagDeflate;
+}
+
+// Always compressed once past the minimum: the receiver's window has to
+// see every message, so there is no falling back to raw here.
+void Deflater::compressChat(std::vector<uint8_t> &body) {
+  if (!m_chat) {
+    auto stream = std::make_unique<z_stream_s>();
+    if (deflateInit2(stream.get(), m_level, Z_DEFLATED, -CHAT_WINDOW_BITS,
+                     CHAT_MEM_LEVEL, Z_DEFAULT_STRATEGY) != Z_OK) {
+      throw std::runtime_error("deflateInit failed");
+    }
+    m_chat = std::move(stream);
+  }
+
+  z_stream &z = *m_chat;
+  std::vector<uint8_t> out(body.size() + body.size() / 8 + 64);
+  z.next_in = body.data();
+  z.avail_in = static_cast<uInt>(body.size());
+  size_t produced = 0;
+  while (true) {
+    z.next_out = out.data() + produced;
+    z.avail_out = static_cast<uInt>(out.size() - produced);
+    if (deflate(&z, Z_SYNC_FLUSH) != Z_OK) {
+      throw std::runtime_error("deflate failed");
+    }
+    produced = out.size() - z.avail_out;
+    if (z.avail_out > 0)
+      break;
+    out.resize(out.size() * 2);
+  }
+  out.resize(produced - sizeof(SYNC_TAIL));
+  body.swap(out);
+}
+
+// --- Inflater ---
+
+Inflater::Inflater() = default;
+
+Inflater::~Inflater() {
+  if (m_chat)
+    inflateEnd(m_chat.get());
+}
+
+std::vector<uint8_t> Inflater::decompress(uint8_t flags, const uint8_t *data,
+                                          size_t length, size_t maxSize) {
+  std::vector<uint8_t> out;
+  if (flags == CompactFlagDeflate) {
+    inflateInto(oneShot().resetInflater(), data, length, maxSize, out, true);
+  } else if (flags == CompactFlagStream) {
+    decompressChat(data, length, maxSize, out);
+  } else {
+    throw std::runtime_error("Unsupported compression flags");
+  }
+  return out;
+}
+
+void Inflater::decompressChat(const uint8_t *data, size_t length,
+                              size_t maxSize, std::vector<uint8_t> &out) {
+  if (!m_chat) {
+    auto stream = std::make_unique<z_stream_s>();
+    if (inflateInit2(stream.get(), -CHAT_WINDOW_BITS) != Z_OK) {
+      throw std::runtime_error("inflateInit failed");
+    }
+    m_chat = std::move(stream);
+  }
+  inflateInto(*m_chat, data, length, maxSize, out, false);
+  inflateInto(*m_chat, SYNC_TAIL, sizeof(SYNC_TAIL), maxSize, out, false);
+}
+
+} // namespace wizz
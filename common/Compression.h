@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct z_stream_s; // zlib
+
+namespace wizz {
+
+/**
+ * @brief Payload compression for protocol v2 bodies (negotiated via
+ * CapDeflate, signalled by the compact header flags).
+ * Bodies of at least COMPRESS_MIN_SIZE are deflated on their own
+ * (CompactFlagDeflate) and sent raw if that does not pay off.
+ * Chat bodies are short, so they share one deflate stream per direction
+ * instead (CompactFlagStream): every message is flushed to a byte boundary
+ * and may refer back to the previous few KB of conversation. Like the
+ * alias tables this needs the receiver to see chat packets in encode
+ * order, which the frame layer guarantees within a priority class.
+ */
+static const size_t COMPRESS_MIN_SIZE = 256;
+static const size_t COMPRESS_STREAM_MIN_SIZE = 32;
+// Large bodies are first probed on a sample this big, so already
+// compressed media (avatars, ADPCM voice) costs little CPU
+static const size_t COMPRESS_PROBE_SIZE = 4 * 1024;
+static const int COMPRESS_DEFAULT_LEVEL = 3;
+
+class Deflater {
+public:
+  explicit Deflater(int level = COMPRESS_DEFAULT_LEVEL);
+  ~Deflater();
+
+  Deflater(const Deflater &) = delete;
+  Deflater &operator=(const Deflater &) = delete;
+
+  // Compresses `body` in place if worthwhile. `chat` selects the shared
+  // stream. Returns the header flags to send (0 = body left as is).
+  uint8_t compress(std::vector<uint8_t> &body, bool chat);
+
+private:
+  void compressChat(std::vector<uint8_t> &body);
+
+  int m_level;
+  // One-shot bodies use a stream per thread; only chat keeps state here
+  std::unique_ptr<z_stream_s> m_chat; // Created on first use
+};
+
+class Inflater {
+public:
+  Inflater();
+  ~Inflater();
+
+  Inflater(const Inflater &) = delete;
+  Inflater &operator=(const Inflater &) = delete;
+
+  // Undoes Deflater::compress for the given header flags. Throws
+  // std::runtime_error on corrupt input or output above `maxSize`.
+  std::vector<uint8_t> decompress(uint8_t flags, const uint8_t *data,
+                                  size_t length, size_t maxSize);
+
+private:
+  void decompressChat(const uint8_t *data, size_t length, size_t maxSize,
+                      std::vector<uint8_t> &out);
+
+  std::unique_ptr<z_stream_s> m_chat;
+};
+
+} // namespace wizz
@@ -0,0 +1,163 @@
+#include "Frame.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+// Platform-specific includes for ntohl/htonl
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <arpa/inet.h>
+#endif
+
+namespace wizz {
+
+FramePriority priorityFor(PacketType type) {
+  switch (type) {
+  case PacketType::DirectMessage:
+  case PacketType::MessageSent:
+  case PacketType::TypingIndicator:
+  case PacketType::GroupMessage:
+    return FramePriority::Chat;
+
+  case PacketType::AddContact:
+  case PacketType::RemoveContact:
+  case PacketType::ContactList:
+  case PacketType::ContactStatusChange:
+  case PacketType::PresenceBatch:
+  case PacketType::PresenceSnapshot:
+  case PacketType::UpdateStatus:
+  case PacketType::GetAvatar:
+  case PacketType::GetAvatarIfChanged:
+  case PacketType::AvatarNotModified:
+  case PacketType::GameStatus:
+    return FramePriority::Presence;
+
+  case PacketType::VoiceMessage:
+  case PacketType::UpdateAvatar:
+  case PacketType::AvatarData:
+    return FramePriority::Bulk;
+
+  default:
+    return FramePriority::Control;
+  }
+}
+
+uint32_t clampFrameSize(uint32_t requested) {
+  return std::min(std::max(requested, MIN_MAX_FRAME_SIZE), MAX_MAX_FRAME_SIZE);
+}
+
+// --- FrameScheduler ---
+
+FrameScheduler::FrameScheduler(uint32_t maxFrameSize)
+    : m_maxFrameSize(maxFrameSize) {}
+
+void FrameScheduler::enqueue(std::vector<uint8_t> packetBytes,
+                             FramePriority priority) {
+  if (packetBytes.empty())
+    return;
+
+  m_pendingBytes += packetBytes.size();
+  m_queues[static_cast<size_t>(priority)].push_back(
+      Stream{m_nextStreamId++, std::move(packetBytes), 0});
+}
+
+std::vector<uint8_t> FrameScheduler::nextFrame() {
+  for (size_t p = 0; p < FRAME_PRIORITY_COUNT; ++p) {
+    auto &queue = m_queues[p];
+    if (queue.empty())
+      continue;
+
+    Stream &stream = queue.front();
+    size_t chunk =
+        std::min<size_t>(m_maxFrameSize, stream.payload.size() - stream.offset);
+    bool fin = (stream.offset + chunk == stream.payload.size());
+
+    FrameHeader header;
+    header.streamId = htonl(stream.id);
+    header.priority = static_cast<uint8_t>(p);
+    header.flags = fin ? FrameFin : 0;
+    header.reserved = 0;
+    header.length = htonl(static_cast<uint32_t>(chunk));
+
+    std::vector<uint8_t> frame;
+    frame.reserve(sizeof(FrameHeader) + chunk);
+    const uint8_t *headerPtr = reinterpret_cast<const uint8_t *>(&header);
+    frame.insert(frame.end(), headerPtr, headerPtr + sizeof(FrameHeader));
+    frame.insert(frame.end(), stream.payload.begin() + stream.offset,
+                 stream.payload.begin() + stream.offset + chunk);
+
+    stream.offset += chunk;
+    m_pendingBytes -= chunk;
+    if (fin) {
+      queue.pop_front();
+    }
+    return frame;
+  }
+  return {};
+}
+
+// --- FrameAssembler ---
+
+FrameAssembler::FrameAssembler(uint32_t maxFrameSize)
+    : m_maxFrameSize(maxFrameSize) {}
+
+void FrameAssembler::feed(const uint8_t *data, size_t length,
+                          std::vector<std::vector<uint8_t>> &outPackets) {
+  feed(data, length,
+       [this, &outPackets](uint32_t streamId, const uint8_t *chunk,
+                           size_t chunkLength, bool fin) {
+         std::vector<uint8_t> &payload = m_streams[streamId];
+         payload.insert(payload.end(), chunk, chunk + chunkLength);
+         if (fin) {
+           outPackets.push_back(std::move(payload));
+           m_streams.erase(streamId);
+         }
+       });
+}
+
+void FrameAssembler::feed(const uint8_t *data, size_t length,
+                          const ChunkHandler &onChunk) {
+  m_buffer.insert(m_buffer.end(), data, data + length);
+
+  size_t offset = 0;
+  while (m_buffer.size() - offset >= sizeof(FrameHeader)) {
+    FrameHeader header;
+    std::memcpy(&header, m_buffer.data() + offset, sizeof(FrameHeader));
+    uint32_t streamId = ntohl(header.streamId);
+    uint32_t chunk = ntohl(header.length);
+
+    if (chunk > m_maxFrameSize) {
+      throw std::runtime_error("Frame exceeds negotiated max frame size");
+    }
+    if (m_buffer.size() - offset < sizeof(FrameHeader) + chunk)
+      break; // Wait for the rest of the frame
+
+    auto it = m_openStreams.find(streamId);
+    if (it == m_openStreams.end()) {
+      if (m_openStreams.size() >= MAX_OPEN_STREAMS) {
+        throw std::runtime_error("Too many concurrent frame streams");
+      }
+      it = m_openStreams.emplace(streamId, 0).first;
+    }
+    it->second += chunk;
+    if (it->second > MAX_PACKET_SIZE) {
+      throw std::runtime_error("Framed packet exceeds max packet size");
+    }
+
+    bool fin = (header.flags & FrameFin) != 0;
+    if (fin) {
+      m_openStreams.erase(it);
+    }
+
+    const uint8_t *chunkStart = m_buffer.data() + offset + sizeof(FrameHeader);
+    offset += sizeof(FrameHeader) + chunk;
+    onChunk(streamId, chunkStart, chunk, fin);
+  }
+
+  // Compact once per feed rather than once per frame
+  m_buffer.erase(m_buffer.begin(), m_buffer.begin() + offset);
+}
+
+} // namespace wizz
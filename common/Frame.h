@@ -0,0 +1,119 @@
+#pragma once
+
+#include "Packet.h"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+namespace wizz {
+
+/**
+ * @brief Frame layer (negotiated via CapFraming).
+ * Each serialized Packet travels on its own logical stream, split into
+ * frames of at most the agreed max frame size. Frames from higher-priority
+ * streams are sent first, so chat never waits behind a voice blob for more
+ * than one frame.
+ */
+enum class FramePriority : uint8_t {
+  Control = 0,  // Session, auth, errors, game signalling
+  Chat = 1,     // Messages, typing
+  Presence = 2, // Contact lists, status, avatar requests
+  Bulk = 3      // Voice and avatar payloads
+};
+
+static const size_t FRAME_PRIORITY_COUNT = 4;
+
+FramePriority priorityFor(PacketType type);
+
+/**
+ * @brief Fixed-size frame header.
+ * Size: 12 Bytes (4 stream + 1 priority + 1 flags + 2 reserved + 4 length)
+ */
+struct FrameHeader {
+  uint32_t streamId;
+  uint8_t priority;
+  uint8_t flags;
+  uint16_t reserved;
+  uint32_t length; // Length of this frame's chunk (excluding this header)
+};
+
+enum FrameFlags : uint8_t {
+  FrameFin = 0x01 // Last frame of the stream (packet complete)
+};
+
+static const uint32_t DEFAULT_MAX_FRAME_SIZE = 16 * 1024;
+static const uint32_t MIN_MAX_FRAME_SIZE = 1024;
+static const uint32_t MAX_MAX_FRAME_SIZE = 1024 * 1024;
+
+// Largest packet either side will reassemble (framed or not)
+static const size_t MAX_PACKET_SIZE = 64 * 1024 * 1024;
+
+// Clamp a peer-proposed max frame size to sane bounds
+uint32_t clampFrameSize(uint32_t requested);
+
+// Sender side: splits queued packets into prioritized frames
+class FrameScheduler {
+public:
+  explicit FrameScheduler(uint32_t maxFrameSize = DEFAULT_MAX_FRAME_SIZE);
+
+  void setMaxFrameSize(uint32_t maxFrameSize) { m_maxFrameSize = maxFrameSize; }
+  uint32_t maxFrameSize() const { return m_maxFrameSize; }
+
+  // Queue a serialized packet on a new stream
+  void enqueue(std::vector<uint8_t> packetBytes, FramePriority priority);
+  // Stream id the next enqueue() will use
+  uint32_t nextStreamId() const { return m_nextStreamId; }
+
+  // Header + next chunk from the highest-priority pending stream.
+  // Streams of equal priority are sent in order.
+  std::vector<uint8_t> nextFrame();
+
+  bool empty() const { return m_pendingBytes == 0; }
+  size_t pendingBytes() const { return m_pendingBytes; }
+
+private:
+  struct Stream {
+    uint32_t id;
+    std::vector<uint8_t> payload;
+    size_t offset;
+  };
+
+  uint32_t m_maxFrameSize;
+  uint32_t m_nextStreamId = 1;
+  size_t m_pendingBytes = 0;
+  std::deque<Stream> m_queues[FRAME_PRIORITY_COUNT];
+};
+
+// Receiver side: turns a byte stream of frames back into packets.
+// Throws std::runtime_error if the peer violates the negotiated limits.
+class FrameAssembler {
+public:
+  explicit FrameAssembler(uint32_t maxFrameSize = DEFAULT_MAX_FRAME_SIZE);
+
+  void setMaxFrameSize(uint32_t maxFrameSize) { m_maxFrameSize = maxFrameSize; }
+
+  // Appends every packet completed by these bytes to `outPackets`
+  void feed(const uint8_t *data, size_t length,
+            std::vector<std::vector<uint8_t>> &outPackets);
+
+  // Lower-level variant: hands over each frame's chunk as soon as it is
+  // complete, without reassembling, so callers can stream large packets.
+  using ChunkHandler = std::function<void(uint32_t streamId, const uint8_t *data,
+                                          size_t length, bool fin)>;
+  void feed(const uint8_t *data, size_t length, const ChunkHandler &onChunk);
+
+private:
+  static const size_t MAX_OPEN_STREAMS = 64;
+
+  uint32_t m_maxFrameSize;
+  std::vector<uint8_t> m_buffer; // Partial frame
+  // Bytes received so far on each open stream
+  std::unordered_map<uint32_t, size_t> m_openStreams;
+  // Reassembly buffers (packet-level feed only)
+  std::unordered_map<uint32_t, std::vector<uint8_t>> m_streams;
+};
+
+} // namespace wizz
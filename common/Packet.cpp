@@ -1,5 +1,6 @@
 #include "Packet.h"
 
+#include <cstddef>
 #include <stdexcept>
 
 // Platform-specific includes for ntohl/htonl
@@ -53,6 +54,16 @@ Packet::Packet(const std::vector<uint8_t> &rawData) {
   m_readOffset = 0;
 }
 
+PacketType Packet::peekType(const std::vector<uint8_t> &rawData) {
+  if (rawData.size() < sizeof(PacketHeader)) {
+    throw std::runtime_error("Packet too small to contain header");
+  }
+  uint32_t networkType;
+  std::memcpy(&networkType, rawData.data() + offsetof(PacketHeader, type),
+              sizeof(uint32_t));
+  return static_cast<PacketType>(ntohl(networkType));
+}
+
 void Packet::writeString(const std::string &str) {
   // 1. Write the length of the string first (so we know how much to read later)
   uint32_t len = static_cast<uint32_t>(str.size());
@@ -12,32 +12,57 @@ namespace wizz {
  * Used in the Packet Header to dispatch logic.
  */
 enum class PacketType : uint32_t {
+  // Session (always sent unframed, before anything else)
+  Hello = 10,    // Client -> Server (Capabilities + max frame size)
+  HelloAck = 11, // Server -> Client (Accepted capabilities + max frame size)
+  Reconnect = 12, // Server -> Client (Server is restarting: reconnect after
+                  // this many milliseconds)
+  Redirect = 13,  // Server -> Client (Host + port of the cluster node that
+                  // serves this user: log in there instead)
+
   // Auth
   Login = 100,
   Register = 101,
-  LoginSuccess = 102,
+  LoginSuccess = 102, // Stored message seq + resume token
   LoginFailed = 103,
   RegisterSuccess = 104,
   RegisterFailed = 105,
+  Resume = 106,        // Client -> Server (Resume token, after a dropped
+                       // connection)
+  ResumeSuccess = 107, // Server -> Client (Stored message seq + new token)
+  ResumeFailed = 108,  // Server -> Client (Token expired: log in again)
 
   // Contacts
   AddContact = 200,
   RemoveContact = 201,
-  ContactList = 202,
+  ContactList = 202, // Server -> Client (Every friend, then the list version)
   ContactStatusChange = 203,
   UpdateStatus = 204,
+  PresenceBatch = 205, // Server -> Client (Coalesced status + typing updates)
+  PresenceSnapshot = 206, // Server -> Client (All online contacts, at login)
+  ContactListDelta = 207, // Server -> Client (New version + friends added
+                          // or removed since the client's version)
 
   // Messaging
   DirectMessage = 300,
   MessageSent = 301,     // Acknowledge
   Nudge = 302,           // Wizz/Nudge
-  VoiceMessage = 303,    // Voice Message (Binary Blob)
+  VoiceMessage = 303,    // Voice Message (Binary Blob + VoiceCodec)
   TypingIndicator = 304, // Typing Status (Sender -> Server -> Target)
 
+  // Group Chats
+  GroupCreate = 310,    // Client -> Server (Name + members)
+  GroupInfo = 311,      // Server -> Members (Id, name, members)
+  GroupMessage = 312,   // Sender -> Server -> Members (Id [+ sender], text)
+  GroupLeave = 313,     // Client -> Server (Id), echoed back once done
+  GroupAddMember = 314, // Client -> Server (Id + username)
+
   // Avatars
   UpdateAvatar = 400, // Client -> Server (Upload)
   GetAvatar = 401,    // Client -> Server (Request)
   AvatarData = 402,   // Server -> Client (Download)
+  GetAvatarIfChanged = 403, // Client -> Server (Request + hash it holds)
+  AvatarNotModified = 404,  // Server -> Client (Cached copy is current)
 
   // Games
   GameStatus = 500,
@@ -46,10 +71,41 @@ enum class PacketType : uint32_t {
   GameStart = 503,          // Server -> Client A & Client B
   GameMove = 504,           // Client -> Server -> Client
 
+  // Cluster link (node <-> broker only, never to or from clients). Bodies
+  // start with a node id: the destination when a node sends (0 = every
+  // other node), the source when it receives.
+  ClusterHello = 900,    // Node -> Broker (Its own id)
+  ClusterJoined = 901,   // Broker -> Nodes (That node is up: tell it your
+                         // users)
+  ClusterLeft = 902,     // Broker -> Nodes (That node is gone, and its users)
+  ClusterPresence = 903, // Users online on the sender (status 3 = gone)
+  ClusterDeliver = 904,  // A packet for a user connected to the receiver
+  ClusterFanout = 905,   // A packet for the receiver's subscribers of a user
+  ClusterGroup = 906,    // A group's name and members (none = dropped)
+  ClusterAvatar = 907,   // A user's avatar changed: drop cached copies
+  ClusterMail = 908,     // Direct messages for a user connected to the
+                         // receiver are in the offline log: send them
+
   // Errors
   Error = 999
 };
 
+/**
+ * @brief Optional protocol features, negotiated with Hello/HelloAck.
+ * A peer that never sends Hello gets the plain Packet stream.
+ */
+enum Capability : uint32_t {
+  CapFraming = 1u << 0,    // Prioritized, multiplexed frame layer (Frame.h)
+  CapVoiceAdpcm = 1u << 1, // Understands VoiceCodec::ImaAdpcm voice notes
+  CapPresenceBatch = 1u << 2, // Takes PresenceBatch/PresenceSnapshot instead
+                              // of per-contact status packets
+  CapCompact = 1u << 3, // Protocol v2 encoding after HelloAck (CompactCodec.h)
+  CapDeflate = 1u << 4, // Compressed v2 bodies (Compression.h); needs
+                         // CapCompact
+  CapContactDeltas = 1u << 5 // Sends its contact list version at login and
+                             // takes ContactListDelta instead of ContactList
+};
+
 /**
  * @brief The Fixed-Size Header prefixed to all transmissions.
  * Size: 12 Bytes (4 magic + 4 type + 4 length)
@@ -81,8 +137,13 @@ public:
   std::string readString();
   std::vector<uint8_t> readBytes(uint32_t len);
 
+  // Reads the type out of serialized bytes without parsing the body
+  static PacketType peekType(const std::vector<uint8_t> &rawData);
+
   // Accessors
   uint32_t bodySize() const { return static_cast<uint32_t>(m_body.size()); }
+  const std::vector<uint8_t> &body() const { return m_body; }
+  size_t remaining() const { return m_body.size() - m_readOffset; }
   PacketType type() const { return static_cast<PacketType>(m_header.type); }
 
 private:
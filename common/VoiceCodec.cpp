@@ -0,0 +1,299 @@
+#include "VoiceCodec.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace wizz {
+
+namespace {
+
+const int IMA_INDEX_TABLE[16] = {-1, -1, -1, -1, 2, 4, 6, 8,
+                                 -1, -1, -1, -1, 2, 4, 6, 8};
+
+const int IMA_STEP_TABLE[89] = {
+    7,     8,     9,     10,    11,    12,    13,    14,    16,    17,
+    19,    21,    23,    25,    28,    31,    34,    37,    41,    45,
+    50,    55,    60,    66,    73,    80,    88,    97,    107,   118,
+    130,   143,   157,   173,   190,   209,   230,   253,   279,   307,
+    337,   371,   408,   449,   494,   544,   598,   658,   724,   796,
+    876,   963,   1060,  1166,  1282,  1411,  1552,  1707,  1878,  2066,
+    2272,  2499,  2749,  3024,  3327,  3660,  4026,  4428,  4871,  5358,
+    5894,  6484,  7132,  7845,  8630,  9493,  10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767};
+
+const uint8_t IMA_MAGIC[4] = {'I', 'M', 'A', '1'};
+const size_t IMA_HEADER_SIZE = 12;
+const size_t IMA_BLOCK_HEADER_SIZE = 4;
+
+int16_t clampSample(float v) {
+  return static_cast<int16_t>(std::min(32767.0f, std::max(-32768.0f, v)));
+}
+
+// Decoder step; the encoder runs the same update so both stay in lockstep
+void applyNibble(uint8_t nibble, int &predictor, int &index) {
+  int step = IMA_STEP_TABLE[index];
+  int diff = step >> 3;
+  if (nibble & 4)
+    diff += step;
+  if (nibble & 2)
+    diff += step >> 1;
+  if (nibble & 1)
+    diff += step >> 2;
+  predictor += (nibble & 8) ? -diff : diff;
+  predictor = std::min(32767, std::max(-32768, predictor));
+  index = std::min(88, std::max(0, index + IMA_INDEX_TABLE[nibble]));
+}
+
+uint8_t encodeSample(int sample, int &predictor, int &index) {
+  int step = IMA_STEP_TABLE[index];
+  int diff = sample - predictor;
+  uint8_t nibble = 0;
+  if (diff < 0) {
+    nibble = 8;
+    diff = -diff;
+  }
+  if (diff >= step) {
+    nibble |= 4;
+    diff -= step;
+  }
+  if (diff >= (step >> 1)) {
+    nibble |= 2;
+    diff -= step >> 1;
+  }
+  if (diff >= (step >> 2)) {
+    nibble |= 1;
+  }
+  applyNibble(nibble, predictor, index);
+  return nibble;
+}
+
+size_t blockBytes(size_t samples) {
+  return IMA_BLOCK_HEADER_SIZE + samples / 2; // First sample is in the header
+}
+
+void putBE32(std::vector<uint8_t> &out, uint32_t v) {
+  out.push_back(static_cast<uint8_t>(v >> 24));
+  out.push_back(static_cast<uint8_t>(v >> 16));
+  out.push_back(static_cast<uint8_t>(v >> 8));
+  out.push_back(static_cast<uint8_t>(v));
+}
+
+uint32_t getBE32(const uint8_t *p) {
+  return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) |
+         (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+void putLE16(uint8_t *p, uint16_t v) {
+  p[0] = static_cast<uint8_t>(v);
+  p[1] = static_cast<uint8_t>(v >> 8);
+}
+
+void putLE32(uint8_t *p, uint32_t v) {
+  putLE16(p, static_cast<uint16_t>(v));
+  putLE16(p + 2, static_cast<uint16_t>(v >> 16));
+}
+
+uint16_t getLE16(const uint8_t *p) { return uint16_t(p[0] | (p[1] << 8)); }
+
+uint32_t getLE32(const uint8_t *p) {
+  return uint32_t(getLE16(p)) | (uint32_t(getLE16(p + 2)) << 16);
+}
+
+} // namespace
+
+std::vector<int16_t> downmixToMono(const int16_t *interleaved, size_t frames,
+                                   int channels) {
+  std::vector<int16_t> mono(frames);
+  if (channels <= 1) {
+    std::copy(interleaved, interleaved + frames, mono.begin());
+  } else if (channels == 2) {
+    // Common case kept branch-free so it vectorizes
+    for (size_t f = 0; f < frames; ++f) {
+      mono[f] = static_cast<int16_t>(
+          (int32_t(interleaved[2 * f]) + int32_t(interleaved[2 * f + 1])) >> 1);
+    }
+  } else {
+    for (size_t f = 0; f < frames; ++f) {
+      int32_t sum = 0;
+      for (int c = 0; c < channels; ++c)
+        sum += interleaved[f * channels + c];
+      mono[f] = static_cast<int16_t>(sum / channels);
+    }
+  }
+  return mono;
+}
+
+std::vector<int16_t> resample(const std::vector<int16_t> &samples,
+                              uint32_t fromRate, uint32_t toRate) {
+  if (fromRate == toRate || fromRate == 0 || toRate == 0 || samples.empty())
+    return samples;
+
+  const size_t n = samples.size();
+  std::vector<float> in(n);
+  for (size_t i = 0; i < n; ++i)
+    in[i] = samples[i];
+
+  if (fromRate > toRate) {
+    size_t taps = (fromRate + toRate - 1) / toRate;
+    if (taps > 1) {
+      // Tap-major order so the inner loop is a plain vector add
+      std::vector<float> acc(in);
+      for (size_t t = 1; t < taps; ++t) {
+        for (size_t i = t; i < n; ++i)
+          acc[i] += in[i - t];
+      }
+      const float scale = 1.0f / static_cast<float>(taps);
+      for (size_t i = 0; i < n; ++i)
+        in[i] = acc[i] * scale;
+    }
+  }
+
+  size_t outCount = static_cast<size_t>(uint64_t(n) * toRate / fromRate);
+  std::vector<int16_t> out(outCount);
+  const double step = static_cast<double>(fromRate) / toRate;
+  for (size_t j = 0; j < outCount; ++j) {
+    double pos = j * step;
+    size_t i = static_cast<size_t>(pos);
+    float frac = static_cast<float>(pos - i);
+    float a = in[i];
+    float b = in[std::min(i + 1, n - 1)];
+    out[j] = clampSample(a + (b - a) * frac);
+  }
+  return out;
+}
+
+std::vector<uint8_t> encodeImaAdpcm(const std::vector<int16_t> &mono,
+                                    uint32_t sampleRate) {
+  const size_t count = mono.size();
+  const size_t blocks = (count + IMA_BLOCK_SAMPLES - 1) / IMA_BLOCK_SAMPLES;
+
+  std::vector<uint8_t> out;
+  out.reserve(IMA_HEADER_SIZE + blocks * blockBytes(IMA_BLOCK_SAMPLES));
+  out.insert(out.end(), IMA_MAGIC, IMA_MAGIC + 4);
+  putBE32(out, sampleRate);
+  putBE32(out, static_cast<uint32_t>(count));
+
+  int index = 0; // Carried across blocks so adaptation isn't restarted
+  for (size_t start = 0; start < count; start += IMA_BLOCK_SAMPLES) {
+    size_t n = std::min(IMA_BLOCK_SAMPLES, count - start);
+    int predictor = mono[start];
+
+    out.push_back(static_cast<uint8_t>(uint16_t(predictor) >> 8));
+    out.push_back(static_cast<uint8_t>(predictor));
+    out.push_back(static_cast<uint8_t>(index));
+    out.push_back(0);
+
+    uint8_t packed = 0;
+    for (size_t k = 1; k < n; ++k) {
+      uint8_t nibble = encodeSample(mono[start + k], predictor, index);
+      if ((k & 1) == 1) {
+        packed = nibble;
+      } else {
+        out.push_back(static_cast<uint8_t>(packed | (nibble << 4)));
+      }
+    }
+    if ((n & 1) == 0)
+      out.push_back(packed); // Odd number of nibbles: pad the high half
+  }
+  return out;
+}
+
+bool decodeImaAdpcm(const uint8_t *data, size_t size,
+                    std::vector<int16_t> &outMono, uint32_t &outSampleRate) {
+  if (size < IMA_HEADER_SIZE || std::memcmp(data, IMA_MAGIC, 4) != 0)
+    return false;
+
+  outSampleRate = getBE32(data + 4);
+  size_t count = getBE32(data + 8);
+  // Cheap sanity check before allocating: every sample needs half a byte
+  if (outSampleRate == 0 || count / 2 > size)
+    return false;
+
+  outMono.assign(count, 0);
+  size_t offset = IMA_HEADER_SIZE;
+  for (size_t start = 0; start < count; start += IMA_BLOCK_SAMPLES) {
+    size_t n = std::min(IMA_BLOCK_SAMPLES, count - start);
+    if (size - offset < blockBytes(n))
+      return false;
+
+    const uint8_t *block = data + offset;
+    int predictor = static_cast<int16_t>((block[0] << 8) | block[1]);
+    int index = block[2];
+    if (index > 88)
+      return false;
+
+    outMono[start] = static_cast<int16_t>(predictor);
+    const uint8_t *nibbles = block + IMA_BLOCK_HEADER_SIZE;
+    for (size_t k = 1; k < n; ++k) {
+      uint8_t byte = nibbles[(k - 1) >> 1];
+      uint8_t nibble = (k & 1) ? (byte & 0x0F) : (byte >> 4);
+      applyNibble(nibble, predictor, index);
+      outMono[start + k] = static_cast<int16_t>(predictor);
+    }
+    offset += blockBytes(n);
+  }
+  return true;
+}
+
+std::vector<uint8_t> encodeWav(const int16_t *interleaved, size_t frames,
+                               int channels, uint32_t sampleRate) {
+  const uint32_t dataSize = static_cast<uint32_t>(frames * channels * 2);
+  std::vector<uint8_t> out(44 + dataSize);
+  uint8_t *h = out.data();
+
+  std::memcpy(h, "RIFF", 4);
+  putLE32(h + 4, dataSize + 36);
+  std::memcpy(h + 8, "WAVEfmt ", 8);
+  putLE32(h + 16, 16);
+  putLE16(h + 20, 1); // PCM
+  putLE16(h + 22, static_cast<uint16_t>(channels));
+  putLE32(h + 24, sampleRate);
+  putLE32(h + 28, sampleRate * channels * 2);
+  putLE16(h + 32, static_cast<uint16_t>(channels * 2));
+  putLE16(h + 34, 16);
+  std::memcpy(h + 36, "data", 4);
+  putLE32(h + 40, dataSize);
+
+  uint8_t *pcm = h + 44;
+  for (size_t i = 0; i < frames * channels; ++i)
+    putLE16(pcm + 2 * i, static_cast<uint16_t>(interleaved[i]));
+  return out;
+}
+
+bool parseWav(const uint8_t *data, size_t size, const uint8_t *&outPcm,
+              size_t &outPcmBytes, int &outChannels, uint32_t &outSampleRate) {
+  if (size < 12 || std::memcmp(data, "RIFF", 4) != 0 ||
+      std::memcmp(data + 8, "WAVE", 4) != 0)
+    return false;
+
+  bool haveFormat = false;
+  size_t offset = 12;
+  while (size - offset >= 8) {
+    const uint8_t *chunk = data + offset;
+    size_t chunkSize = getLE32(chunk + 4);
+    size_t available = size - offset - 8;
+
+    if (std::memcmp(chunk, "fmt ", 4) == 0) {
+      if (chunkSize < 16 || available < 16)
+        return false;
+      if (getLE16(chunk + 8) != 1 || getLE16(chunk + 22) != 16)
+        return false; // Only 16-bit PCM
+      outChannels = getLE16(chunk + 10);
+      outSampleRate = getLE32(chunk + 12);
+      haveFormat = outChannels > 0;
+    } else if (std::memcmp(chunk, "data", 4) == 0) {
+      if (!haveFormat)
+        return false;
+      outPcm = chunk + 8;
+      outPcmBytes = std::min(chunkSize, available) & ~size_t(1);
+      return true;
+    }
+
+    if (chunkSize > available)
+      return false;
+    offset += 8 + chunkSize + (chunkSize & 1); // Chunks are word aligned
+  }
+  return false;
+}
+
+} // namespace wizz
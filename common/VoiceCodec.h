@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace wizz {
+
+/**
+ * @brief Encoding of a VoiceMessage blob (trailing field of the packet).
+ * Absent = Wav, which is what clients without CapVoiceAdpcm send and expect.
+ */
+enum class VoiceCodec : uint32_t {
+  Wav = 0,     // RIFF/WAV, 16-bit PCM
+  ImaAdpcm = 1 // 4-bit IMA-ADPCM, mono (see encodeImaAdpcm)
+};
+
+// Voice notes are stored and sent at this rate; plenty for speech
+static const uint32_t VOICE_SAMPLE_RATE = 16000;
+
+// Interleaved 16-bit frames -> mono (average of all channels)
+std::vector<int16_t> downmixToMono(const int16_t *interleaved, size_t frames,
+                                   int channels);
+
+// Linear-interpolation resampler. When downsampling, a box filter over one
+// source period runs first to keep aliasing out of the speech band.
+std::vector<int16_t> resample(const std::vector<int16_t> &samples,
+                              uint32_t fromRate, uint32_t toRate);
+
+/**
+ * @brief IMA-ADPCM container.
+ * Header: "IMA1", sample rate and sample count (big-endian, 12 bytes).
+ * Then independent blocks of IMA_BLOCK_SAMPLES samples: first sample as a
+ * big-endian int16, step index, one pad byte, then two samples per byte
+ * (low nibble first). Each block resets the predictor, so a corrupt byte
+ * only damages ~30 ms of audio.
+ */
+static const size_t IMA_BLOCK_SAMPLES = 505; // 256-byte blocks
+
+std::vector<uint8_t> encodeImaAdpcm(const std::vector<int16_t> &mono,
+                                    uint32_t sampleRate);
+// Returns false on a malformed container
+bool decodeImaAdpcm(const uint8_t *data, size_t size,
+                    std::vector<int16_t> &outMono, uint32_t &outSampleRate);
+
+// Canonical 44-byte WAV header + little-endian PCM
+std::vector<uint8_t> encodeWav(const int16_t *interleaved, size_t frames,
+                               int channels, uint32_t sampleRate);
+// Accepts 16-bit PCM WAV only. `outPcm` points into `data`.
+bool parseWav(const uint8_t *data, size_t size, const uint8_t *&outPcm,
+              size_t &outPcmBytes, int &outChannels, uint32_t &outSampleRate);
+
+} // namespace wizz
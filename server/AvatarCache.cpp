@@ -0,0 +1,74 @@
+#include "AvatarCache.h"
+
+namespace wizz {
+
+AvatarCache::AvatarCache(size_t maxBytes) : m_maxBytes(maxBytes) {}
+
+const AvatarCache::Avatar *AvatarCache::get(const std::string &username) {
+  auto it = m_entries.find(username);
+  if (it == m_entries.end()) {
+    return nullptr;
+  }
+  // Move to front (most recently used)
+  m_lru.splice(m_lru.begin(), m_lru, it->second);
+  return &it->second->avatar;
+}
+
+void AvatarCache::put(const std::string &username, Bytes packet,
+                      const std::string &hash, uint64_t generation) {
+  if (!packet || generation != this->generation(username)) {
+    return;
+  }
+
+  Avatar avatar{std::move(packet), hash};
+  size_t cost = costOf(username, avatar);
+  if (cost > m_maxBytes) {
+    return; // Would evict everything else, not worth it
+  }
+
+  auto it = m_entries.find(username);
+  if (it != m_entries.end()) {
+    m_currentBytes -= it->second->cost;
+    m_lru.erase(it->second);
+    m_entries.erase(it);
+  }
+
+  evictUntilFits(cost);
+
+  m_lru.push_front(Entry{username, std::move(avatar), cost});
+  m_entries[username] = m_lru.begin();
+  m_currentBytes += cost;
+}
+
+uint64_t AvatarCache::generation(const std::string &username) const {
+  auto it = m_generations.find(username);
+  return it == m_generations.end() ? 0 : it->second;
+}
+
+void AvatarCache::invalidate(const std::string &username) {
+  ++m_generations[username];
+  auto it = m_entries.find(username);
+  if (it != m_entries.end()) {
+    m_currentBytes -= it->second->cost;
+    m_lru.erase(it->second);
+    m_entries.erase(it);
+  }
+}
+
+void AvatarCache::evictUntilFits(size_t incoming) {
+  while (!m_lru.empty() && m_currentBytes + incoming > m_maxBytes) {
+    Entry &victim = m_lru.back();
+    m_currentBytes -= victim.cost;
+    m_entries.erase(victim.username);
+    m_lru.pop_back();
+  }
+}
+
+size_t AvatarCache::costOf(const std::string &username, const Avatar &avatar) {
+  // Account for the key and bookkeeping too, so "no avatar" entries
+  // (empty packets) still count against the budget.
+  return avatar.packet->size() + avatar.hash.size() + username.size() +
+         sizeof(Entry) + 64;
+}
+
+} // namespace wizz
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace wizz {
+
+// In-memory LRU of fully serialized AvatarData packets, keyed by username.
+// Bounded by the total number of cached bytes, not by entry count.
+// Only touched from the io thread (handlers and postResponse callbacks).
+class AvatarCache {
+public:
+  using Bytes = std::shared_ptr<const std::vector<uint8_t>>;
+
+  struct Avatar {
+    Bytes packet;     // Empty buffer = "user has no avatar"
+    std::string hash; // Content fingerprint, for conditional fetches
+  };
+
+  explicit AvatarCache(size_t maxBytes = 32 * 1024 * 1024);
+
+  // Returns the cached avatar, or nullptr on a miss. A hit refreshes the
+  // entry's recency. The pointer is only valid until the next put().
+  const Avatar *get(const std::string &username);
+
+  // Inserts only if `username` was not invalidated since `generation` was
+  // read, so a slow disk read can't resurrect an avatar replaced meanwhile.
+  // Other users' changes do not count.
+  void put(const std::string &username, Bytes packet, const std::string &hash,
+           uint64_t generation);
+
+  void invalidate(const std::string &username);
+
+  uint64_t generation(const std::string &username) const;
+  size_t sizeBytes() const { return m_currentBytes; }
+  size_t entryCount() const { return m_entries.size(); }
+
+private:
+  struct Entry {
+    std::string username;
+    Avatar avatar;
+    size_t cost;
+  };
+
+  void evictUntilFits(size_t incoming);
+  static size_t costOf(const std::string &username, const Avatar &avatar);
+
+  size_t m_maxBytes;
+  size_t m_currentBytes = 0;
+  // Invalidations per user (only users who were ever invalidated)
+  std::unordered_map<std::string, uint64_t> m_generations;
+
+  // Front = most recently used
+  std::list<Entry> m_lru;
+  std::unordered_map<std::string, std::list<Entry>::iterator> m_entries;
+};
+
+} // namespace wizz
@@ -1,6 +1,6 @@
 #include "ClientSession.h"
+#include <algorithm>
 #include <cstring> // for memcpy
-#include <iostream>
 #include <utility> // for std::move
 
 // Needed for ntohl
@@ -11,18 +11,38 @@
 #endif
 
 // Include full definition for implementation
+#include "Logger.h"
 #include "TcpServer.h"
 #include "handlers/PacketRouter.h"
 
 namespace wizz {
 
+// Features this server build understands
+static const uint32_t SERVER_CAPABILITIES =
+    CapFraming | CapVoiceAdpcm | CapPresenceBatch | CapCompact | CapDeflate |
+    CapContactDeltas;
+
+// Temporary home of streamed uploads until a handler claims them
+static const char *UPLOAD_DIRECTORY = "server/storage/uploads";
+// Upload writes (up to UploadSink::FLUSH_SIZE each) a session may have
+// queued on the DB thread, across all its uploads, before it stops reading
+static const uint32_t MAX_UPLOAD_WRITES = 4;
+
 ClientSession::ClientSession(
     int sessionId, asio::ip::tcp::socket socket, asio::ssl::context &sslContext,
     TcpServer *server)
     : m_sessionId(sessionId), m_socket(std::move(socket), sslContext),
-      m_isLoggedIn(false), m_server(server) {}
+      m_isLoggedIn(false), m_server(server),
+      m_readTimer(m_socket.get_executor()),
+      m_deferredTimer(m_socket.get_executor()),
+      m_presenceTimer(m_socket.get_executor()) {
+  if (m_server)
+    m_server->getMetrics().activeSessions.add(1);
+}
 
 ClientSession::~ClientSession() {
+  if (m_server)
+    m_server->getMetrics().activeSessions.add(-1);
   if (m_socket.lowest_layer().is_open()) {
     asio::error_code ec;
     m_socket.lowest_layer().close(ec);
@@ -31,30 +51,189 @@ ClientSession::~ClientSession() {
 
 void ClientSession::sendPacket(const Packet &packet) {
   // Serialize Packet
-  std::vector<uint8_t> data = packet.serialize();
+  if (m_codec) {
+    queueBytes(m_codec->encode(packet), packet.type());
+  } else {
+    queueBytes(packet.serialize(), packet.type());
+  }
+}
+
+void ClientSession::sendSerialized(const std::vector<uint8_t> &data) {
+  if (m_codec) {
+    sendPacket(Packet(data)); // Cached v1 bytes: re-encode for this peer
+  } else {
+    queueBytes(data, Packet::peekType(data));
+  }
+}
+
+void ClientSession::sendPacket(const Packet &packet,
+                               const std::vector<uint8_t> &serialized) {
+  if (m_codec) {
+    sendPacket(packet);
+  } else {
+    queueBytes(serialized, packet.type());
+  }
+}
 
+void ClientSession::queueBytes(std::vector<uint8_t> data, PacketType type) {
   // Must run on the io_context thread!
-  bool writeInProgress = !m_outbox.empty();
-  m_outbox.push_back(std::move(data));
-  if (!writeInProgress) {
-    doWrite();
+  if (m_server)
+    m_server->getMetrics().outboxBytes.record(
+        m_framing ? m_frameScheduler.pendingBytes() : m_outboxBytes);
+  if (uint64_t trace = Tracer::current()) {
+    uint32_t key = m_framing ? m_frameScheduler.nextStreamId() : m_outboxPushed;
+    m_tracedWrites.push_back({trace, Tracer::Clock::now(), key, m_framing});
+  }
+  if (m_framing) {
+    m_frameScheduler.enqueue(std::move(data), priorityFor(type));
+  } else {
+    m_outboxBytes += data.size();
+    m_outbox.push_back(std::move(data));
+    ++m_outboxPushed;
   }
+  doWrite();
 }
 
-void ClientSession::doWrite() {
+void ClientSession::queueStatus(const std::string &username, uint32_t status,
+                                const std::string &customStatus) {
+  if (m_presence.addStatus(username, status, customStatus))
+    schedulePresenceFlush();
+}
+
+void ClientSession::queueTyping(const std::string &username, bool isTyping) {
+  if (m_presence.addTyping(username, isTyping))
+    schedulePresenceFlush();
+}
+
+bool ClientSession::acceptMessageSeq(uint32_t seq) {
+  if (seq > m_acceptedSeq) {
+    m_acceptedSeq = seq;
+    return true;
+  }
+  if (seq <= m_storedSeq) {
+    // The ack was lost with the old connection; pending ones come later
+    Packet ack(PacketType::MessageSent);
+    ack.writeInt(m_storedSeq);
+    sendPacket(ack);
+  }
+  return false;
+}
+
+void ClientSession::acknowledgeMessages(uint32_t seq) {
+  if (seq <= m_storedSeq)
+    return;
+  m_storedSeq = seq;
+  Packet ack(PacketType::MessageSent);
+  ack.writeInt(seq);
+  sendPacket(ack);
+}
+
+bool ClientSession::takePendingMessage(uint64_t id) {
+  if (id <= m_pendingSentId)
+    return false;
+  m_pendingSentId = id;
+  return true;
+}
+
+void ClientSession::schedulePresenceFlush() {
+  auto self(shared_from_this());
+  m_presenceTimer.expires_after(PresenceCoalescer::WINDOW);
+  m_presenceTimer.async_wait([this, self](const asio::error_code &ec) {
+    if (!ec)
+      flushPresence();
+  });
+}
+
+void ClientSession::scheduleDeferred() {
+  if (m_deferredScheduled)
+    return;
+  m_deferredScheduled = true;
   auto self(shared_from_this());
+  // A token at the tightest state limit (10/s)
+  m_deferredTimer.expires_after(RateLimiter::READ_PAUSE);
+  m_deferredTimer.async_wait([this, self](const asio::error_code &ec) {
+    m_deferredScheduled = false;
+    if (ec || m_draining || !m_server || !m_socket.lowest_layer().is_open())
+      return;
+    m_server->getPacketRouter().replayDeferred(this);
+    if (m_rateLimiter.hasDeferred())
+      scheduleDeferred();
+  });
+}
+
+void ClientSession::flushPresence() {
+  for (const Packet &packet : m_presence.flush(hasCapability(CapPresenceBatch)))
+    sendPacket(packet);
+}
+
+void ClientSession::flushTyping(const std::string &username) {
+  for (const Packet &packet :
+       m_presence.flushTyping(username, hasCapability(CapPresenceBatch)))
+    sendPacket(packet);
+}
+
+void ClientSession::negotiate(uint32_t clientCapabilities,
+                              uint32_t clientMaxFrameSize) {
+  if (m_negotiated)
+    return; // Hello is only valid once
+  m_negotiated = true;
 
-  asio::async_write(m_socket, asio::buffer(m_outbox.front()),
-                    [this, self](asio::error_code ec, std::size_t /*length*/) {
+  m_capabilities = clientCapabilities & SERVER_CAPABILITIES;
+  if (!hasCapability(CapCompact))
+    m_capabilities &= ~CapDeflate; // Signalled in the v2 header
+  uint32_t frameSize = clampFrameSize(
+      std::min(clientMaxFrameSize, m_server ? m_server->getMaxFrameSize()
+                                            : DEFAULT_MAX_FRAME_SIZE));
+
+  Packet ack(PacketType::HelloAck);
+  ack.writeInt(m_capabilities);
+  ack.writeInt(frameSize);
+  sendPacket(ack); // Still unframed v1: the client switches after reading it
+
+  if (hasCapability(CapCompact)) {
+    m_codec = std::make_unique<CompactCodec>(Direction::ToClient);
+    if (hasCapability(CapDeflate))
+      m_codec->enableCompression();
+  }
+  if (hasCapability(CapFraming)) {
+    m_frameScheduler.setMaxFrameSize(frameSize);
+    m_frameAssembler.setMaxFrameSize(frameSize);
+    m_framing = true;
+  }
+}
+
+void ClientSession::doWrite() {
+  if (m_writeInProgress)
+    return;
+
+  if (!m_outbox.empty()) {
+    m_writeBuffer = std::move(m_outbox.front());
+    m_outbox.pop_front();
+    m_outboxBytes -= m_writeBuffer.size();
+    ++m_outboxPopped;
+    m_writingFrame = false;
+  } else if (!m_frameScheduler.empty()) {
+    // One frame per write, so newly queued high-priority packets get the
+    // next slot even while a large transfer is in progress
+    m_writeBuffer = m_frameScheduler.nextFrame();
+    m_writingFrame = true;
+  } else {
+    return;
+  }
+
+  m_writeInProgress = true;
+  auto self(shared_from_this());
+  asio::async_write(m_socket, asio::buffer(m_writeBuffer),
+                    [this, self](asio::error_code ec, std::size_t length) {
+                      m_writeInProgress = false;
+                      if (m_server)
+                        m_server->getMetrics().bytesOut.add(length);
                       if (!ec) {
-                        m_outbox.pop_front();
-                        if (!m_outbox.empty()) {
-                          doWrite();
-                        }
+                        if (!m_tracedWrites.empty())
+                          finishTracedWrite();
+                        doWrite();
                       } else {
-                        std::cerr << "[Session " << m_sessionId
-                                  << "] TLS Write Error: " << ec.message()
-                                  << std::endl;
+                        LOG_WARN("[Session {}] TLS Write Error: {}", m_sessionId, ec.message());
                         if (m_socket.lowest_layer().is_open()) {
                           asio::error_code closeEc;
                           m_socket.lowest_layer().close(closeEc);
@@ -63,16 +242,62 @@ void ClientSession::doWrite() {
                     });
 }
 
+void ClientSession::finishTracedWrite() {
+  // The buffer just written was an outbox packet, or one frame of a stream
+  bool framed = m_writingFrame;
+  uint32_t key = m_outboxPopped - 1;
+  if (framed) {
+    FrameHeader header;
+    std::memcpy(&header, m_writeBuffer.data(), sizeof(header));
+    if (!(header.flags & FrameFin))
+      return;
+    key = ntohl(header.streamId);
+  }
+  for (auto it = m_tracedWrites.begin(); it != m_tracedWrites.end(); ++it) {
+    if (it->framed == framed && it->key == key) {
+      Tracer::instance().record("outbox", it->trace, it->queued, Tracer::Clock::now(),
+                                static_cast<uint32_t>(m_writeBuffer.size()));
+      m_tracedWrites.erase(it);
+      return;
+    }
+  }
+}
+
+void ClientSession::drain(uint32_t reconnectDelayMs) {
+  m_draining = true;
+  m_reconnectDelay = reconnectDelayMs;
+  m_inbound.clear(); // Drops partial uploads
+  if (m_handshakeDone)
+    sendReconnect();
+}
+
+void ClientSession::close() {
+  asio::error_code ec;
+  m_socket.lowest_layer().close(ec);
+}
+
+void ClientSession::sendReconnect() {
+  Packet reconnect(PacketType::Reconnect);
+  reconnect.writeInt(m_reconnectDelay);
+  sendPacket(reconnect);
+}
+
 void ClientSession::start() {
   auto self(shared_from_this());
   m_socket.async_handshake(asio::ssl::stream_base::server,
                            [this, self](const asio::error_code &error) {
+                             if (m_server) {
+                               (error ? m_server->getMetrics().tlsHandshakeFailures
+                                      : m_server->getMetrics().tlsHandshakes)
+                                   .add();
+                             }
                              if (!error) {
+                               m_handshakeDone = true;
+                               if (m_draining)
+                                 sendReconnect();
                                doRead();
                              } else {
-                               std::cerr << "[Session " << m_sessionId
-                                         << "] TLS Handshake Failed: "
-                                         << error.message() << std::endl;
+                               LOG_WARN("[Session {}] TLS Handshake Failed: {}", m_sessionId, error.message());
                              }
                            });
 }
@@ -83,10 +308,10 @@ void ClientSession::doRead() {
   // We read enough for the packet header first.
   // Instead of a loop, we rely on callbacks holding a shared_ptr to keep the
   // Session alive.
-  m_buffer.resize(1024); // Generic read buffer
+  m_buffer.resize(16 * 1024); // One full TLS record
 
   m_socket.async_read_some(
-      asio::buffer(m_buffer.data(), m_buffer.capacity()),
+      asio::buffer(m_buffer.data(), m_buffer.size()),
       [this, self](asio::error_code ec, std::size_t length) {
         if (!ec) {
           // Re-use legacy logic temporarily by feeding the bytes to a stream
@@ -96,10 +321,10 @@ void ClientSession::doRead() {
           this->onDataReceived(reinterpret_cast<const char *>(m_buffer.data()),
                                length);
         } else if (ec != asio::error::operation_aborted) {
-          std::cout << "[Session " << m_sessionId
-                    << "] Disconnected: " << ec.message() << std::endl;
+          LOG_INFO("[Session {}] Disconnected: {}", m_sessionId, ec.message());
           if (m_server) {
-            m_server->handleDisconnect(m_sessionId);
+            // eof: TLS close_notify, the client logged out
+            m_server->handleDisconnect(m_sessionId, ec == asio::error::eof);
           }
           // The connection is dropped. `self` drops out of scope, destroying
           // the session.
@@ -108,49 +333,143 @@ void ClientSession::doRead() {
 }
 
 void ClientSession::onDataReceived(const char *data, size_t length) {
-  // Rather than keeping `m_buffer` as the main read destination, we use it as
-  // the accumulator
-  // 1. Append new incoming bytes to our persistent accumulating buffer (renamed
-  // later if needed, using `m_buffer` right now causes a conflict if we async
-  // read into it directly) Let's create an `m_receiveBuffer` in the class
-  // later, for now we will cheat by statically analyzing it
-  static std::vector<uint8_t> accumulator;
-  accumulator.insert(accumulator.end(), data, data + length);
-
-  while (true) {
-    if (accumulator.size() < sizeof(PacketHeader))
-      break;
-
-    uint32_t networkLength;
-    std::memcpy(&networkLength, accumulator.data() + 8, sizeof(uint32_t));
-    uint32_t bodyLength = ntohl(networkLength);
-
-    size_t totalSize = sizeof(PacketHeader) + bodyLength;
-    if (accumulator.size() < totalSize)
-      break;
-
-    try {
-      std::vector<uint8_t> packetData(accumulator.begin(),
-                                      accumulator.begin() + totalSize);
-      Packet pkt(packetData);
-      processPacket(pkt);
-      accumulator.erase(accumulator.begin(), accumulator.begin() + totalSize);
-    } catch (const std::exception &e) {
-      std::cerr << "[Session " << m_sessionId << "] Data Error: " << e.what()
-                << std::endl;
-      // Close socket explicitly on error
-      asio::error_code closeEc;
-      m_socket.lowest_layer().close(closeEc);
-      return;
+  m_readStart = Tracer::Clock::now();
+  if (m_server)
+    m_server->getMetrics().bytesIn.add(length);
+  if (m_draining) {
+    doRead(); // Only to notice when the client leaves
+    return;
+  }
+  uint64_t throttled = m_rateLimiter.throttled();
+  try {
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data);
+    if (m_framing) {
+      processFramed(bytes, length);
+    } else {
+      processUnframed(bytes, length);
     }
+  } catch (const std::exception &e) {
+    LOG_WARN("[Session {}] Data Error: {}", m_sessionId, e.what());
+    m_inbound.clear(); // Drops partial uploads
+    // Close socket explicitly on error
+    asio::error_code closeEc;
+    m_socket.lowest_layer().close(closeEc);
+    return;
+  }
+
+  // The disk is behind: read on once it catches up (uploadWriteDone)
+  if (m_uploadWrites > MAX_UPLOAD_WRITES) {
+    m_uploadPaused = true;
+    return;
+  }
+
+  if (m_rateLimiter.throttled() != throttled) {
+    auto self(shared_from_this());
+    m_readTimer.expires_after(RateLimiter::READ_PAUSE);
+    m_readTimer.async_wait([this, self](const asio::error_code &ec) {
+      if (!ec)
+        doRead();
+    });
+    return;
   }
 
   // Chain the next read asynchronously
   doRead();
 }
 
-// Legacy signature preserved, now rewritten using the `static accumulator`
-// logic in the chunk above
+void ClientSession::processUnframed(const uint8_t *data, size_t length) {
+  while (length > 0) {
+    std::unique_ptr<InboundPacket> &inbound = m_inbound[0];
+    if (!inbound)
+      inbound = newInboundPacket();
+
+    size_t used = inbound->feed(data, length);
+    data += used;
+    length -= used;
+    if (!inbound->complete())
+      return;
+
+    std::unique_ptr<InboundPacket> done = std::move(inbound);
+    m_inbound.erase(0);
+    deliver(*done);
+
+    if (m_framing) {
+      // Hello switched the transport: whatever follows is frames
+      if (length > 0)
+        processFramed(data, length);
+      return;
+    }
+  }
+}
+
+void ClientSession::processFramed(const uint8_t *data, size_t length) {
+  m_frameAssembler.feed(
+      data, length,
+      [this](uint32_t streamId, const uint8_t *chunk, size_t chunkLength,
+             bool fin) {
+        std::unique_ptr<InboundPacket> &inbound = m_inbound[streamId];
+        if (!inbound)
+          inbound = newInboundPacket();
+
+        size_t used = inbound->feed(chunk, chunkLength);
+        if (used != chunkLength || fin != inbound->complete()) {
+          throw std::runtime_error("Frame stream does not match packet length");
+        }
+        if (fin) {
+          std::unique_ptr<InboundPacket> done = std::move(inbound);
+          m_inbound.erase(streamId);
+          deliver(*done);
+        }
+      });
+}
+
+// Uploads are written on the DB thread, and only accepted once logged in.
+// Each write is counted until done, so a slow disk pauses reading instead
+// of letting chunks pile up in the DB queue.
+std::unique_ptr<InboundPacket> ClientSession::newInboundPacket() {
+  FileExecutor executor;
+  if (m_server) {
+    TcpServer *server = m_server;
+    std::weak_ptr<ClientSession> weak = weak_from_this();
+    executor = [server, weak](std::function<void()> task) {
+      if (auto self = weak.lock())
+        ++self->m_uploadWrites;
+      server->getDb().postTask([server, weak, task = std::move(task)]() {
+        task();
+        server->postResponse([weak]() {
+          if (auto self = weak.lock())
+            self->uploadWriteDone();
+        });
+      });
+    };
+  }
+  return std::make_unique<InboundPacket>(m_isLoggedIn ? UPLOAD_DIRECTORY : "",
+                                         m_codec.get(), std::move(executor));
+}
+
+void ClientSession::uploadWriteDone() {
+  if (m_uploadWrites > 0)
+    --m_uploadWrites;
+  if (m_uploadPaused && m_uploadWrites <= MAX_UPLOAD_WRITES) {
+    m_uploadPaused = false;
+    if (m_socket.lowest_layer().is_open())
+      doRead();
+  }
+}
+
+void ClientSession::deliver(InboundPacket &inbound) {
+  Packet pkt = inbound.takePacket();
+  uint64_t trace = Tracer::instance().sample();
+  TraceScope scope(trace);
+  if (trace) // Parsing since the read that completed the packet
+    Tracer::instance().record("decode", trace, m_readStart, Tracer::Clock::now());
+  TraceSpan span("packet", static_cast<uint32_t>(pkt.type()));
+  if (!inbound.streamed()) {
+    processPacket(pkt);
+  } else if (m_server) {
+    m_server->getPacketRouter().handleUpload(this, pkt, inbound.upload());
+  }
+}
 
 void ClientSession::processPacket(Packet &packet) {
   if (m_server) {
@@ -1,6 +1,14 @@
 #pragma once
 
+#include "../common/CompactCodec.h"
+#include "../common/Frame.h"
 #include "../common/Packet.h"
+#include "Peer.h"
+#include "PresenceCoalescer.h"
+#include "RateLimiter.h"
+#include "Tracer.h"
+#include "UploadStream.h"
+#include "UserDirectory.h"
 #include <asio.hpp>
 #include <asio/ssl.hpp>
 #include <cstdint>
@@ -9,6 +17,7 @@
 #include <memory>
 #include <set>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 // Forward Declaration
@@ -18,7 +27,7 @@ class TcpServer;
 
 namespace wizz {
 
-class ClientSession : public std::enable_shared_from_this<ClientSession> {
+class ClientSession : public Peer, public std::enable_shared_from_this<ClientSession> {
 public:
   // Pass Server pointer for Async Task dispatch, and Callbacks
   explicit ClientSession(
@@ -40,16 +49,60 @@ public:
   }
   std::string getUsername() const { return m_username; }
   void setUsername(const std::string& name) { m_username = name; }
+  UserId getUserId() const { return m_userId; }
+  void setUserId(UserId id) { m_userId = id; }
   bool isLoggedIn() const { return m_isLoggedIn; }
   void setLoggedIn(bool b) { m_isLoggedIn = b; }
   TcpServer* getServer() const { return m_server; }
+  RateLimiter& getRateLimiter() { return m_rateLimiter; }
+  // Replays the rate limiter's deferred state updates as tokens free up
+  void scheduleDeferred();
 
-  // Contact list cache – populated at login, used for fast broadcasts
-  void setContacts(std::set<std::string> contacts) { m_contacts = std::move(contacts); }
-  const std::set<std::string>& getContacts() const { return m_contacts; }
+  // Protocol negotiation (Hello). Replies with HelloAck and switches the
+  // connection to the framed transport if both sides support it.
+  void negotiate(uint32_t clientCapabilities, uint32_t clientMaxFrameSize);
+  bool hasCapability(Capability cap) const override { return (m_capabilities & cap) != 0; }
+  uint32_t capabilities() const { return m_capabilities; }
+  ClientSession *local() override { return this; }
 
   // High-level Send Helper (must become async)
-  void sendPacket(const Packet &packet);
+  void sendPacket(const Packet &packet) override;
+  // Queue bytes that were already serialized (e.g. from the avatar cache)
+  void sendSerialized(const std::vector<uint8_t> &data) override;
+  // Fan-out: `serialized` is packet.serialize(), shared by every v1 peer;
+  // v2 peers still encode for their own alias tables
+  void sendPacket(const Packet &packet, const std::vector<uint8_t> &serialized) override;
+
+  // Presence and typing updates about contacts. Coalesced for
+  // PresenceCoalescer::WINDOW, so rapid changes cost one packet.
+  void queueStatus(const std::string &username, uint32_t status,
+                   const std::string &customStatus) override;
+  void queueTyping(const std::string &username, bool isTyping) override;
+  // A status update about `username` is still waiting for the flush
+  bool hasPendingStatus(const std::string &username) const {
+    return m_presence.hasStatus(username);
+  }
+  // Sends a pending typing update about `username` now, before a direct
+  // message from them
+  void flushTyping(const std::string &username);
+
+  // Client-numbered DirectMessages. Sequence numbers only grow; anything
+  // at or below the last accepted one is a retry and is dropped (after
+  // re-acknowledging it if it is already stored).
+  void setLastMessageSeq(uint32_t seq) { m_acceptedSeq = m_storedSeq = seq; }
+  bool acceptMessageSeq(uint32_t seq);
+  // Everything up to `seq` is committed: cumulative MessageSent
+  void acknowledgeMessages(uint32_t seq);
+  // Offline log messages go out in id order, and fetches can overlap (a
+  // login and a cluster mail notice): false if `id` was sent already
+  bool takePendingMessage(uint64_t id);
+
+  // Hot restart: tells the client when to reconnect, then ignores whatever
+  // it sends. Replies already under way are still delivered.
+  void drain(uint32_t reconnectDelayMs);
+  // Drops the connection at once. Pending reads and writes are cancelled,
+  // so handleDisconnect is not called: the caller deals with the session.
+  void close();
 
   // Start the asynchronous read loop
   void start();
@@ -61,6 +114,9 @@ private:
   // Helper to dispatch packets
   void onDataReceived(const char *data, size_t length);
   void processPacket(Packet &packet);
+  void deliver(InboundPacket &inbound);
+  std::unique_ptr<InboundPacket> newInboundPacket();
+  void uploadWriteDone();
 
   // Forward packets to router
 
@@ -68,8 +124,8 @@ private:
   int m_sessionId;
   asio::ssl::stream<asio::ip::tcp::socket> m_socket;
   std::string m_username;
+  UserId m_userId = INVALID_USER;
   bool m_isLoggedIn;
-  std::set<std::string> m_contacts; // cached at login
 
   // Pointer to the Server for Async Task Queue access
   TcpServer *m_server;
@@ -78,10 +134,65 @@ private:
 
   // Buffer for incoming partial data
   std::vector<uint8_t> m_buffer;
-
-  // Outbound message queue to prevent overlapping async_writes on TLS stream
+  // Packets being received, by frame stream id (0 = unframed). Large
+  // uploads are streamed to disk instead of accumulating here.
+  std::unordered_map<uint32_t, std::unique_ptr<InboundPacket>> m_inbound;
+  uint32_t m_uploadWrites = 0; // Queued on the DB thread, not yet done
+  bool m_uploadPaused = false; // Reading stopped until they catch up
+
+  // Negotiated features (see Capability)
+  bool m_negotiated = false;
+  uint32_t m_capabilities = 0;
+  bool m_framing = false;
+  std::unique_ptr<CompactCodec> m_codec; // Set once v2 is agreed
+  FrameScheduler m_frameScheduler;
+  FrameAssembler m_frameAssembler;
+
+  // Outbound message queue to prevent overlapping async_writes on TLS stream.
+  // Unframed packets go to m_outbox; once framing is on, everything goes
+  // through m_frameScheduler and is written one frame at a time.
   std::deque<std::vector<uint8_t>> m_outbox;
+  size_t m_outboxBytes = 0;
+  std::vector<uint8_t> m_writeBuffer;
+  bool m_writeInProgress = false;
+  bool m_writingFrame = false; // m_writeBuffer came from m_frameScheduler
+  void queueBytes(std::vector<uint8_t> data, PacketType type);
   void doWrite();
+
+  // Sampled packets waiting in the outbox: keyed by their m_outbox position
+  // or frame stream id, so the write that finishes them closes the span
+  struct TracedWrite {
+    uint64_t trace;
+    Tracer::Clock::time_point queued;
+    uint32_t key;
+    bool framed;
+  };
+  std::vector<TracedWrite> m_tracedWrites;
+  uint32_t m_outboxPushed = 0;
+  uint32_t m_outboxPopped = 0;
+  Tracer::Clock::time_point m_readStart; // When the current read completed
+  void finishTracedWrite();
+
+  uint32_t m_acceptedSeq = 0; // Highest DirectMessage seq handed to the DB
+  uint32_t m_storedSeq = 0;   // Highest one committed (and acknowledged)
+  uint64_t m_pendingSentId = 0;
+
+  RateLimiter m_rateLimiter;
+  bool m_handshakeDone = false;
+  bool m_draining = false;
+  uint32_t m_reconnectDelay = 0; // Sent once the handshake is done
+  void sendReconnect();
+  asio::steady_timer m_readTimer;
+  asio::steady_timer m_deferredTimer;
+  bool m_deferredScheduled = false;
+
+  PresenceCoalescer m_presence;
+  asio::steady_timer m_presenceTimer;
+  void schedulePresenceFlush();
+  void flushPresence();
+
+  void processUnframed(const uint8_t *data, size_t length);
+  void processFramed(const uint8_t *data, size_t length);
 };
 
 } // namespace wizz
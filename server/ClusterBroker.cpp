@@ -0,0 +1,240 @@
+#include "ClusterBroker.h"
+#include "Logger.h"
+#include <cstring>
+#include <fstream>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <arpa/inet.h>
+#endif
+
+namespace wizz {
+
+namespace {
+
+uint32_t readNode(const std::vector<uint8_t> &packet) {
+  uint32_t node;
+  std::memcpy(&node, packet.data() + sizeof(PacketHeader), sizeof(node));
+  return ntohl(node);
+}
+
+void writeNode(std::vector<uint8_t> &packet, uint32_t node) {
+  node = htonl(node);
+  std::memcpy(packet.data() + sizeof(PacketHeader), &node, sizeof(node));
+}
+
+} // namespace
+
+std::vector<uint8_t> clusterNonce() {
+  std::vector<uint8_t> nonce(CLUSTER_NONCE_SIZE);
+  if (RAND_bytes(nonce.data(), static_cast<int>(nonce.size())) != 1) nonce.clear();
+  return nonce;
+}
+
+std::vector<uint8_t> clusterProof(const std::string &secret, const std::string &label,
+                                  const std::vector<uint8_t> &nonce) {
+  std::vector<uint8_t> message(label.begin(), label.end());
+  message.push_back(0);
+  message.insert(message.end(), nonce.begin(), nonce.end());
+  std::vector<uint8_t> proof(EVP_MAX_MD_SIZE);
+  unsigned int length = 0;
+  HMAC(EVP_sha256(), secret.data(), static_cast<int>(secret.size()), message.data(), message.size(),
+       proof.data(), &length);
+  proof.resize(length);
+  return proof;
+}
+
+bool sameProof(const std::vector<uint8_t> &a, const std::vector<uint8_t> &b) {
+  return !a.empty() && a.size() == b.size() && CRYPTO_memcmp(a.data(), b.data(), a.size()) == 0;
+}
+
+std::string readClusterSecret(const std::string &path) {
+  std::ifstream file(path);
+  std::string secret;
+  std::getline(file, secret);
+  while (!secret.empty() && (secret.back() == '\r' || secret.back() == ' '))
+    secret.pop_back();
+  return secret;
+}
+
+ClusterBroker::ClusterBroker(asio::io_context &io, const asio::ip::address &bind, uint16_t port,
+                             std::string secret)
+    : m_acceptor(io), m_secret(std::move(secret)) {
+  asio::ip::tcp::endpoint endpoint(bind, port);
+  m_acceptor.open(endpoint.protocol());
+  m_acceptor.set_option(asio::ip::tcp::acceptor::reuse_address(true));
+  m_acceptor.bind(endpoint);
+  m_acceptor.listen();
+}
+
+void ClusterBroker::start() { doAccept(); }
+
+void ClusterBroker::doAccept() {
+  m_acceptor.async_accept([this](asio::error_code ec, asio::ip::tcp::socket socket) {
+    if (!ec) {
+      asio::error_code optEc;
+      socket.set_option(asio::ip::tcp::no_delay(true), optEc);
+      auto conn = std::make_shared<Connection>(std::move(socket));
+      conn->challenge = clusterNonce();
+      if (conn->challenge.empty()) {
+        LOG_ERROR("[Broker] No randomness for a link challenge");
+      } else {
+        Packet challenge(PacketType::ClusterHello);
+        challenge.writeInt(0);
+        challenge.writeInt(static_cast<uint32_t>(conn->challenge.size()));
+        challenge.writeData(conn->challenge.data(), conn->challenge.size());
+        send(conn, std::make_shared<const std::vector<uint8_t>>(challenge.serialize()));
+        readHeader(conn);
+      }
+    } else {
+      LOG_ERROR("[Broker] Accept Error: {}", ec.message());
+    }
+    doAccept();
+  });
+}
+
+void ClusterBroker::readHeader(const ConnectionPtr &conn) {
+  asio::async_read(conn->socket, asio::buffer(conn->header, sizeof(conn->header)),
+                   [this, conn](const asio::error_code &ec, size_t) {
+                     if (ec) {
+                       drop(conn);
+                       return;
+                     }
+                     PacketHeader header;
+                     std::memcpy(&header, conn->header, sizeof(header));
+                     uint32_t length = ntohl(header.length);
+                     if (ntohl(header.magic) != 0xCAFEBABE || length < sizeof(uint32_t) ||
+                         length > MAX_CLUSTER_PACKET) {
+                       LOG_ERROR("[Broker] Bad packet from node {}", conn->node);
+                       drop(conn);
+                       return;
+                     }
+                     readBody(conn, length);
+                   });
+}
+
+void ClusterBroker::readBody(const ConnectionPtr &conn, uint32_t length) {
+  conn->body.resize(sizeof(conn->header) + length);
+  std::memcpy(conn->body.data(), conn->header, sizeof(conn->header));
+  asio::async_read(conn->socket, asio::buffer(conn->body.data() + sizeof(conn->header), length),
+                   [this, conn](const asio::error_code &ec, size_t) {
+                     if (ec) {
+                       drop(conn);
+                       return;
+                     }
+                     route(conn);
+                     readHeader(conn);
+                   });
+}
+
+void ClusterBroker::route(const ConnectionPtr &conn) {
+  uint32_t type;
+  std::memcpy(&type, conn->body.data() + offsetof(PacketHeader, type), sizeof(type));
+  uint32_t target = readNode(conn->body);
+
+  if (static_cast<PacketType>(ntohl(type)) == PacketType::ClusterHello) {
+    if (target == 0 || conn->node != 0) return;
+    if (!welcome(conn, target)) {
+      LOG_WARN("[Broker] Refused a link as node {}: wrong cluster secret", target);
+      drop(conn);
+      return;
+    }
+    // A node restarted before its old connection was noticed gone
+    auto it = m_nodes.find(target);
+    if (it != m_nodes.end() && it->second != conn) {
+      asio::error_code ec;
+      it->second->socket.close(ec);
+      it->second->node = 0;
+    }
+    conn->node = target;
+    m_nodes[target] = conn;
+    LOG_INFO("[Broker] Node {} joined ({} linked)", target, m_nodes.size());
+    broadcast(PacketType::ClusterJoined, target, target);
+    return;
+  }
+  if (conn->node == 0) return; // Not introduced yet
+
+  writeNode(conn->body, conn->node);
+  auto data = std::make_shared<const std::vector<uint8_t>>(std::move(conn->body));
+  if (target != 0) {
+    auto it = m_nodes.find(target);
+    if (it != m_nodes.end()) send(it->second, data);
+    return;
+  }
+  for (const auto &[node, other] : m_nodes) {
+    if (node != conn->node) send(other, data);
+  }
+}
+
+bool ClusterBroker::welcome(const ConnectionPtr &conn, uint32_t node) {
+  std::vector<uint8_t> challenge = std::move(conn->challenge);
+  conn->challenge.clear();
+  std::vector<uint8_t> nonce, proof;
+  try {
+    Packet hello(conn->body);
+    hello.readInt(); // `node`
+    nonce = hello.readBytes(hello.readInt());
+    proof = hello.readBytes(hello.readInt());
+  } catch (const std::exception &) {
+    return false;
+  }
+  if (challenge.size() != CLUSTER_NONCE_SIZE || nonce.size() != CLUSTER_NONCE_SIZE ||
+      !sameProof(proof, clusterProof(m_secret, "node " + std::to_string(node), challenge)))
+    return false;
+
+  std::vector<uint8_t> answer = clusterProof(m_secret, "broker", nonce);
+  Packet reply(PacketType::ClusterHello);
+  reply.writeInt(0);
+  reply.writeInt(static_cast<uint32_t>(answer.size()));
+  reply.writeData(answer.data(), answer.size());
+  send(conn, std::make_shared<const std::vector<uint8_t>>(reply.serialize()));
+  return true;
+}
+
+void ClusterBroker::drop(const ConnectionPtr &conn) {
+  asio::error_code ec;
+  conn->socket.close(ec);
+  uint32_t node = conn->node;
+  conn->node = 0;
+  auto it = m_nodes.find(node);
+  if (node == 0 || it == m_nodes.end() || it->second != conn) return; // Replaced already
+  m_nodes.erase(it);
+  LOG_INFO("[Broker] Node {} left ({} linked)", node, m_nodes.size());
+  broadcast(PacketType::ClusterLeft, node, node);
+}
+
+void ClusterBroker::broadcast(PacketType type, uint32_t node, uint32_t except) {
+  Packet packet(type);
+  packet.writeInt(node);
+  auto data = std::make_shared<const std::vector<uint8_t>>(packet.serialize());
+  for (const auto &[id, conn] : m_nodes) {
+    if (id != except) send(conn, data);
+  }
+}
+
+void ClusterBroker::send(const ConnectionPtr &conn, std::shared_ptr<const std::vector<uint8_t>> data) {
+  conn->outbox.push_back(std::move(data));
+  doWrite(conn);
+}
+
+void ClusterBroker::doWrite(const ConnectionPtr &conn) {
+  if (conn->writing || conn->outbox.empty()) return;
+  conn->writing = true;
+  asio::async_write(conn->socket, asio::buffer(*conn->outbox.front()),
+                    [this, conn](const asio::error_code &ec, size_t) {
+                      conn->writing = false;
+                      if (ec) {
+                        drop(conn);
+                        return;
+                      }
+                      conn->outbox.pop_front();
+                      doWrite(conn);
+                    });
+}
+
+} // namespace wizz
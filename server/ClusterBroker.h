@@ -0,0 +1,80 @@
+#pragma once
+
+#include "../common/Frame.h"
+#include "../common/Packet.h"
+#include <asio.hpp>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace wizz {
+
+// Largest link packet: a client packet plus the routing around it
+static const size_t MAX_CLUSTER_PACKET = MAX_PACKET_SIZE + 4096;
+
+// The broker and the nodes share a secret, proved both ways over fresh
+// nonces: the broker opens each connection with a ClusterHello holding a
+// random challenge; the node's ClusterHello proves the secret for
+// "node <id>" over that challenge and carries a nonce of its own; the
+// broker answers with a ClusterHello proving it for "broker" over that
+// one. A captured handshake is no use on another connection. The secret
+// never crosses the link, but the link is plain TCP: whoever can tamper
+// with the traffic can still take over a linked connection.
+static const size_t CLUSTER_NONCE_SIZE = 16;
+// CLUSTER_NONCE_SIZE random bytes; empty if there is no randomness
+std::vector<uint8_t> clusterNonce();
+// HMAC-SHA256 of `label` and `nonce`
+std::vector<uint8_t> clusterProof(const std::string &secret, const std::string &label,
+                                  const std::vector<uint8_t> &nonce);
+bool sameProof(const std::vector<uint8_t> &a, const std::vector<uint8_t> &b);
+// The first line of `path`; empty if it cannot be read
+std::string readClusterSecret(const std::string &path);
+
+// Relays cluster link packets (ClusterLink.h) between the nodes. It only
+// reads the node id at the start of each body: packets go to that node, or
+// to every other one for 0, with the id rewritten to the sender's. It
+// announces nodes as they answer its challenge with the right proof and as
+// their connection drops.
+class ClusterBroker {
+public:
+  ClusterBroker(asio::io_context &io, const asio::ip::address &bind, uint16_t port, std::string secret);
+
+  void start();
+  uint16_t port() const { return m_acceptor.local_endpoint().port(); }
+
+private:
+  struct Connection : std::enable_shared_from_this<Connection> {
+    explicit Connection(asio::ip::tcp::socket socket) : socket(std::move(socket)) {}
+
+    asio::ip::tcp::socket socket;
+    uint32_t node = 0; // 0 until its ClusterHello
+    std::vector<uint8_t> challenge; // Sent on accept, good for one ClusterHello
+    uint8_t header[sizeof(PacketHeader)];
+    std::vector<uint8_t> body; // Header included
+    std::deque<std::shared_ptr<const std::vector<uint8_t>>> outbox;
+    bool writing = false;
+  };
+  using ConnectionPtr = std::shared_ptr<Connection>;
+
+  void doAccept();
+  void readHeader(const ConnectionPtr &conn);
+  void readBody(const ConnectionPtr &conn, uint32_t length);
+  void route(const ConnectionPtr &conn);
+  // Checks a ClusterHello's proof against the challenge and answers it
+  bool welcome(const ConnectionPtr &conn, uint32_t node);
+  void drop(const ConnectionPtr &conn);
+
+  // The packet, with `node` as its node id, to every node but `except`
+  void broadcast(PacketType type, uint32_t node, uint32_t except);
+  void send(const ConnectionPtr &conn, std::shared_ptr<const std::vector<uint8_t>> data);
+  void doWrite(const ConnectionPtr &conn);
+
+  asio::ip::tcp::acceptor m_acceptor;
+  std::string m_secret;
+  std::unordered_map<uint32_t, ConnectionPtr> m_nodes;
+};
+
+} // namespace wizz
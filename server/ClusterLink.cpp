@@ -0,0 +1,402 @@
+#include "ClusterLink.h"
+#include "ClusterBroker.h"
+#include "ClientSession.h"
+#include "Logger.h"
+#include "TcpServer.h"
+#include "handlers/AuthHandlers.h"
+#include <cstring>
+#include <memory>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <arpa/inet.h>
+#endif
+
+namespace wizz {
+
+namespace {
+
+void writeBlob(Packet &packet, const std::vector<uint8_t> &data) {
+  packet.writeInt(static_cast<uint32_t>(data.size()));
+  packet.writeData(data.data(), data.size());
+}
+
+std::vector<uint8_t> readBlob(Packet &packet) {
+  uint32_t size = packet.readInt();
+  return packet.readBytes(size);
+}
+
+} // namespace
+
+void RemotePeer::queueStatus(const std::string &username, uint32_t status, const std::string &customStatus) {
+  Packet packet(PacketType::ContactStatusChange);
+  packet.writeInt(status);
+  packet.writeString(username);
+  packet.writeString(customStatus);
+  sendPacket(packet);
+}
+
+void RemotePeer::queueTyping(const std::string &username, bool isTyping) {
+  Packet packet(PacketType::TypingIndicator);
+  packet.writeString(username);
+  packet.writeInt(isTyping ? 1 : 0);
+  sendPacket(packet);
+}
+
+ClusterLink::ClusterLink(TcpServer &server, asio::io_context &io, uint32_t self, std::vector<Node> nodes,
+                         asio::ip::tcp::endpoint broker, std::string secret)
+    : m_server(server), m_io(io), m_self(self), m_nodes(std::move(nodes)), m_broker(broker),
+      m_secret(std::move(secret)), m_socket(io), m_reconnectTimer(io) {
+  for (const Node &node : m_nodes) m_ring.addNode(node.id);
+}
+
+void ClusterLink::start() { connect(); }
+
+void ClusterLink::stop() {
+  m_stopped = true;
+  m_connected = false;
+  m_linked = false;
+  m_reconnectTimer.cancel();
+  asio::error_code ec;
+  m_socket.close(ec);
+  m_outbox.clear();
+}
+
+const ClusterLink::Node *ClusterLink::redirectFor(const std::string &username) const {
+  uint32_t owner = m_ring.nodeFor(username);
+  if (owner == m_self || owner == HashRing::NO_NODE) return nullptr;
+  for (const Node &node : m_nodes) {
+    if (node.id == owner) return &node;
+  }
+  return nullptr;
+}
+
+void ClusterLink::connect() {
+  m_socket = asio::ip::tcp::socket(m_io);
+  m_socket.async_connect(m_broker, [this](const asio::error_code &ec) {
+    if (m_stopped) return;
+    if (ec) {
+      scheduleReconnect();
+      return;
+    }
+    asio::error_code optEc;
+    m_socket.set_option(asio::ip::tcp::no_delay(true), optEc);
+    m_connected = true;
+    m_nonce.clear(); // The broker speaks first
+    readHeader();
+  });
+}
+
+void ClusterLink::scheduleReconnect() {
+  m_reconnectTimer.expires_after(std::chrono::seconds(1));
+  m_reconnectTimer.async_wait([this](const asio::error_code &ec) {
+    if (!ec && !m_stopped) connect();
+  });
+}
+
+// Nothing heard from the other nodes can be trusted any more
+void ClusterLink::onDisconnected() {
+  if (!m_connected) return;
+  m_connected = false;
+  m_linked = false;
+  LOG_WARN("[Cluster] Lost the broker; other nodes' users are offline until it is back");
+  asio::error_code ec;
+  m_socket.close(ec);
+  m_outbox.clear();
+  m_writeInProgress = false;
+  dropNode(0);
+  scheduleReconnect();
+}
+
+void ClusterLink::readHeader() {
+  asio::async_read(m_socket, asio::buffer(m_header, sizeof(m_header)),
+                   [this](const asio::error_code &ec, size_t) {
+                     if (ec) {
+                       onDisconnected();
+                       return;
+                     }
+                     uint32_t length;
+                     std::memcpy(&length, m_header + offsetof(PacketHeader, length), sizeof(length));
+                     length = ntohl(length);
+                     if (length > MAX_CLUSTER_PACKET) {
+                       LOG_ERROR("[Cluster] Oversized link packet ({} bytes)", length);
+                       onDisconnected();
+                       return;
+                     }
+                     readBody(length);
+                   });
+}
+
+void ClusterLink::readBody(uint32_t length) {
+  m_body.resize(sizeof(m_header) + length);
+  std::memcpy(m_body.data(), m_header, sizeof(m_header));
+  asio::async_read(m_socket, asio::buffer(m_body.data() + sizeof(m_header), length),
+                   [this](const asio::error_code &ec, size_t) {
+                     if (ec) {
+                       onDisconnected();
+                       return;
+                     }
+                     try {
+                       Packet packet(m_body);
+                       handle(packet);
+                     } catch (const std::exception &e) {
+                       LOG_ERROR("[Cluster] Bad link packet: {}", e.what());
+                     }
+                     if (m_connected) readHeader();
+                   });
+}
+
+bool ClusterLink::handshake(Packet &packet) {
+  if (packet.type() != PacketType::ClusterHello) return false;
+  std::vector<uint8_t> blob;
+  try {
+    packet.readInt(); // 0: the broker
+    blob = packet.readBytes(packet.readInt());
+  } catch (const std::exception &) {
+    return false;
+  }
+  if (!m_nonce.empty()) {
+    m_linked = sameProof(blob, clusterProof(m_secret, "broker", m_nonce));
+    return m_linked;
+  }
+
+  // The challenge. Nothing else is sent until the broker answers.
+  m_nonce = clusterNonce();
+  if (blob.size() != CLUSTER_NONCE_SIZE || m_nonce.empty()) return false;
+  std::vector<uint8_t> proof = clusterProof(m_secret, "node " + std::to_string(m_self), blob);
+  Packet hello(PacketType::ClusterHello);
+  hello.writeInt(m_self);
+  hello.writeInt(static_cast<uint32_t>(m_nonce.size()));
+  hello.writeData(m_nonce.data(), m_nonce.size());
+  hello.writeInt(static_cast<uint32_t>(proof.size()));
+  hello.writeData(proof.data(), proof.size());
+  m_outbox.push_back(hello.serialize());
+  doWrite();
+  return true;
+}
+
+void ClusterLink::handle(Packet &packet) {
+  if (!m_linked) {
+    if (!handshake(packet)) {
+      LOG_ERROR("[Cluster] The broker did not prove the cluster secret");
+      onDisconnected();
+      return;
+    }
+    if (!m_linked) return; // Answered the challenge
+
+    LOG_INFO("[Cluster] Node {} linked to the broker", m_self);
+    // The others dropped our users if we were gone
+    announceUsers(0);
+    // and any mail notice sent to us meanwhile
+    for (ClientSession *session : m_server.getSessionManager().getAllOnlineSessions())
+      deliverPendingMessages(&m_server, session->getUsername());
+    return;
+  }
+
+  uint32_t node = packet.readInt(); // The sender (or for the broker's own, the node concerned)
+  SessionManager &sessions = m_server.getSessionManager();
+
+  switch (packet.type()) {
+  case PacketType::ClusterJoined:
+    LOG_INFO("[Cluster] Node {} joined", node);
+    announceUsers(node);
+    break;
+  case PacketType::ClusterLeft:
+    LOG_INFO("[Cluster] Node {} left", node);
+    dropNode(node);
+    break;
+  case PacketType::ClusterPresence: {
+    uint32_t count = packet.readInt();
+    for (uint32_t i = 0; i < count; ++i) {
+      std::string username = packet.readString();
+      uint32_t status = packet.readInt();
+      std::string customStatus = packet.readString();
+      uint32_t capabilities = packet.readInt();
+      applyPresence(node, username, status, customStatus, capabilities);
+    }
+    break;
+  }
+  case PacketType::ClusterDeliver: {
+    std::string username = packet.readString();
+    receiveDelivery(username, readBlob(packet));
+    break;
+  }
+  case PacketType::ClusterFanout: {
+    std::string username = packet.readString();
+    std::vector<uint8_t> serialized = readBlob(packet);
+    for (ClientSession *target : sessions.getSubscribers(username)) target->sendSerialized(serialized);
+    break;
+  }
+  case PacketType::ClusterGroup: {
+    GroupId id = packet.readInt();
+    std::string name = packet.readString();
+    uint32_t count = packet.readInt();
+    std::vector<std::string> members;
+    members.reserve(count);
+    for (uint32_t i = 0; i < count; ++i) members.push_back(packet.readString());
+    m_server.getGroupManager().replaceGroup(id, std::move(name), sessions.internUsers(members));
+    break;
+  }
+  case PacketType::ClusterAvatar:
+    m_server.getAvatarCache().invalidate(packet.readString());
+    break;
+  case PacketType::ClusterMail:
+    deliverPendingMessages(&m_server, packet.readString());
+    break;
+  default:
+    LOG_WARN("[Cluster] Unexpected link packet type {}", packet.type());
+    break;
+  }
+}
+
+void ClusterLink::applyPresence(uint32_t node, const std::string &username, uint32_t status,
+                                const std::string &customStatus, uint32_t capabilities) {
+  SessionManager &sessions = m_server.getSessionManager();
+  UserId id = sessions.getUserId(username);
+  if (id != INVALID_USER && sessions.getSession(id)) return; // Connected here after all
+
+  if (status == 3) {
+    if (id == INVALID_USER || !sessions.isRemote(id)) return;
+    sessions.setRemoteOffline(id);
+    m_remoteNodes.erase(id);
+  } else {
+    sessions.setUserRemote(username, std::make_unique<RemotePeer>(*this, node, username, capabilities),
+                           static_cast<int>(status), customStatus);
+    id = sessions.getUserId(username);
+    m_remoteNodes[id] = node;
+  }
+  for (ClientSession *target : sessions.getSubscribers(id)) target->queueStatus(username, status, customStatus);
+}
+
+// Status and typing updates go through the session's coalescer, like
+// those from users on this node
+void ClusterLink::receiveDelivery(const std::string &username, const std::vector<uint8_t> &serialized) {
+  SessionManager &sessions = m_server.getSessionManager();
+  ClientSession *target = sessions.getSession(sessions.getUserId(username));
+  if (!target) return; // Gone since the sender looked
+  Packet packet(serialized);
+
+  if (packet.type() == PacketType::ContactStatusChange) {
+    uint32_t status = packet.readInt();
+    std::string contact = packet.readString();
+    target->queueStatus(contact, status, packet.readString());
+  } else if (packet.type() == PacketType::TypingIndicator) {
+    std::string contact = packet.readString();
+    target->queueTyping(contact, packet.readInt() != 0);
+  } else {
+    target->sendSerialized(serialized);
+  }
+}
+
+void ClusterLink::dropNode(uint32_t node) {
+  SessionManager &sessions = m_server.getSessionManager();
+  for (auto it = m_remoteNodes.begin(); it != m_remoteNodes.end();) {
+    if (node != 0 && it->second != node) {
+      ++it;
+      continue;
+    }
+    UserId id = it->first;
+    it = m_remoteNodes.erase(it);
+    sessions.setRemoteOffline(id);
+    const std::string &username = sessions.getUsername(id);
+    for (ClientSession *target : sessions.getSubscribers(id)) target->queueStatus(username, 3, ""); // Offline
+  }
+}
+
+// Every user online here, to `node` (0 = all of them)
+void ClusterLink::announceUsers(uint32_t node) {
+  SessionManager &sessions = m_server.getSessionManager();
+  std::vector<ClientSession *> online = sessions.getAllOnlineSessions();
+  Packet packet(PacketType::ClusterPresence);
+  packet.writeInt(node);
+  packet.writeInt(static_cast<uint32_t>(online.size()));
+  for (ClientSession *session : online) {
+    UserId id = session->getUserId();
+    packet.writeString(session->getUsername());
+    packet.writeInt(static_cast<uint32_t>(sessions.getStatus(id)));
+    packet.writeString(sessions.getCustomStatus(id));
+    packet.writeInt(session->capabilities());
+  }
+  send(packet);
+}
+
+void ClusterLink::publishPresence(const std::string &username, uint32_t status, const std::string &customStatus,
+                                  uint32_t capabilities) {
+  Packet packet(PacketType::ClusterPresence);
+  packet.writeInt(0);
+  packet.writeInt(1);
+  packet.writeString(username);
+  packet.writeInt(status);
+  packet.writeString(customStatus);
+  packet.writeInt(capabilities);
+  send(packet);
+}
+
+void ClusterLink::deliver(uint32_t node, const std::string &username, const std::vector<uint8_t> &serialized) {
+  Packet packet(PacketType::ClusterDeliver);
+  packet.writeInt(node);
+  packet.writeString(username);
+  writeBlob(packet, serialized);
+  send(packet);
+}
+
+void ClusterLink::notifyMail(const std::string &username) {
+  auto it = m_remoteNodes.find(m_server.getSessionManager().getUserId(username));
+  if (it == m_remoteNodes.end()) return;
+  Packet packet(PacketType::ClusterMail);
+  packet.writeInt(it->second);
+  packet.writeString(username);
+  send(packet);
+}
+
+void ClusterLink::fanout(const std::string &username, const Packet &packet) {
+  Packet wrapped(PacketType::ClusterFanout);
+  wrapped.writeInt(0);
+  wrapped.writeString(username);
+  writeBlob(wrapped, packet.serialize());
+  send(wrapped);
+}
+
+void ClusterLink::publishGroup(GroupId id, const GroupManager::Group *group) {
+  SessionManager &sessions = m_server.getSessionManager();
+  Packet packet(PacketType::ClusterGroup);
+  packet.writeInt(0);
+  packet.writeInt(id);
+  packet.writeString(group ? group->name : "");
+  packet.writeInt(group ? static_cast<uint32_t>(group->members.size()) : 0);
+  if (group) {
+    for (UserId member : group->members) packet.writeString(sessions.getUsername(member));
+  }
+  send(packet);
+}
+
+void ClusterLink::publishAvatarChange(const std::string &username) {
+  Packet packet(PacketType::ClusterAvatar);
+  packet.writeInt(0);
+  packet.writeString(username);
+  send(packet);
+}
+
+// Dropped while unlinked: presence is announced again on reconnect
+void ClusterLink::send(const Packet &packet) {
+  if (!m_linked) return;
+  m_outbox.push_back(packet.serialize());
+  doWrite();
+}
+
+void ClusterLink::doWrite() {
+  if (m_writeInProgress || m_outbox.empty()) return;
+  m_writeInProgress = true;
+  asio::async_write(m_socket, asio::buffer(m_outbox.front()), [this](const asio::error_code &ec, size_t) {
+    m_writeInProgress = false;
+    if (ec) {
+      onDisconnected();
+      return;
+    }
+    m_outbox.pop_front();
+    doWrite();
+  });
+}
+
+} // namespace wizz
@@ -0,0 +1,141 @@
+#pragma once
+
+#include "../common/Packet.h"
+#include "GroupManager.h"
+#include "HashRing.h"
+#include "Peer.h"
+#include "UserDirectory.h"
+#include <asio.hpp>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace wizz {
+
+class TcpServer;
+
+// Cluster mode. Users are placed on nodes by a HashRing over the configured
+// nodes and log in at theirs; the others answer Redirect. Nodes share the
+// database and talk through a broker (wizz_broker, ClusterBroker.h) over
+// plain TCP, in v1 Packets (PacketType::Cluster*), once each side has
+// proved the cluster secret:
+//  - each node publishes the presence of its users; the others keep them
+//    as remote users in their SessionManager and fan the change out to
+//    their own subscribers;
+//  - packets for a user on another node go through that user's RemotePeer
+//    and are sent on by the node it is connected to;
+//  - direct messages are the exception: they are committed to the shared
+//    offline log first, then the user's node is told (ClusterMail) and sends
+//    them from there. A notice lost with the link only delays them: each
+//    node checks the log for its users when it links again, and at login.
+//
+// Membership is static: the ring is built once from --cluster-nodes and
+// ClusterJoined/ClusterLeft only change who is reachable, never placement.
+// There is no failover. While a node is down its users are still
+// redirected to it and cannot log in anywhere. Changing the node list
+// means restarting every node with the new one; that moves about 1/N of
+// the users per node added or removed, at their next login.
+// Lives on the io thread.
+class ClusterLink {
+public:
+  struct Node {
+    uint32_t id; // Not 0
+    std::string host; // As clients reach it
+    uint16_t port;
+  };
+
+  ClusterLink(TcpServer &server, asio::io_context &io, uint32_t self, std::vector<Node> nodes,
+              asio::ip::tcp::endpoint broker, std::string secret);
+
+  // Connects to the broker, and again whenever the connection drops
+  void start();
+  // For good (hot restart: the successor takes over as this node)
+  void stop();
+
+  uint32_t self() const { return m_self; }
+  // The node `username` belongs on; nullptr if that is this one
+  const Node *redirectFor(const std::string &username) const;
+
+  // A user of this node came online, changed status or left (status 3)
+  void publishPresence(const std::string &username, uint32_t status, const std::string &customStatus,
+                       uint32_t capabilities);
+  // `serialized` (a v1 packet) for `username`, connected to `node`
+  void deliver(uint32_t node, const std::string &username, const std::vector<uint8_t> &serialized);
+  // `packet` for the subscribers of `username` on the other nodes
+  void fanout(const std::string &username, const Packet &packet);
+  // nullptr: the group was dropped
+  void publishGroup(GroupId id, const GroupManager::Group *group);
+  void publishAvatarChange(const std::string &username);
+  // Direct messages for `username`, a user on another node, are in the
+  // offline log
+  void notifyMail(const std::string &username);
+
+private:
+  void connect();
+  void scheduleReconnect();
+  void onDisconnected();
+  void readHeader();
+  void readBody(uint32_t length);
+  void handle(Packet &packet);
+  // The broker's challenge, then its answer to our ClusterHello; false if
+  // either is wrong
+  bool handshake(Packet &packet);
+  void send(const Packet &packet);
+  void doWrite();
+
+  void announceUsers(uint32_t node);
+  void applyPresence(uint32_t node, const std::string &username, uint32_t status,
+                     const std::string &customStatus, uint32_t capabilities);
+  void receiveDelivery(const std::string &username, const std::vector<uint8_t> &serialized);
+  void dropNode(uint32_t node); // 0 = every node
+
+  TcpServer &m_server;
+  asio::io_context &m_io;
+  uint32_t m_self;
+  std::vector<Node> m_nodes;
+  HashRing m_ring;
+  asio::ip::tcp::endpoint m_broker;
+  std::string m_secret;
+  std::vector<uint8_t> m_nonce; // Of our ClusterHello; empty until the challenge
+
+  asio::ip::tcp::socket m_socket;
+  asio::steady_timer m_reconnectTimer;
+  bool m_connected = false;
+  bool m_linked = false; // The broker proved the secret
+  bool m_stopped = false;
+  uint8_t m_header[sizeof(PacketHeader)];
+  std::vector<uint8_t> m_body;
+  std::deque<std::vector<uint8_t>> m_outbox;
+  bool m_writeInProgress = false;
+
+  std::unordered_map<UserId, uint32_t> m_remoteNodes; // Remote user -> its node
+};
+
+// A user connected to another node. Status and typing updates travel as
+// the packets the session there would coalesce.
+class RemotePeer : public Peer {
+public:
+  RemotePeer(ClusterLink &link, uint32_t node, std::string username, uint32_t capabilities)
+      : m_link(link), m_node(node), m_username(std::move(username)), m_capabilities(capabilities) {}
+
+  void sendPacket(const Packet &packet) override { m_link.deliver(m_node, m_username, packet.serialize()); }
+  void sendSerialized(const std::vector<uint8_t> &data) override { m_link.deliver(m_node, m_username, data); }
+  void sendPacket(const Packet &, const std::vector<uint8_t> &serialized) override {
+    m_link.deliver(m_node, m_username, serialized);
+  }
+  void queueStatus(const std::string &username, uint32_t status, const std::string &customStatus) override;
+  void queueTyping(const std::string &username, bool isTyping) override;
+  bool hasCapability(Capability cap) const override { return (m_capabilities & cap) != 0; }
+
+  uint32_t node() const { return m_node; }
+
+private:
+  ClusterLink &m_link;
+  uint32_t m_node;
+  std::string m_username;
+  uint32_t m_capabilities;
+};
+
+} // namespace wizz
@@ -0,0 +1,50 @@
+#include "ContentHash.h"
+#include <iomanip>
+#include <openssl/evp.h>
+#include <sstream>
+
+namespace wizz {
+
+static const size_t FINGERPRINT_BYTES = 8;
+
+ContentHash::ContentHash() : m_ctx(EVP_MD_CTX_new()) {
+  if (m_ctx) {
+    EVP_DigestInit_ex(m_ctx, EVP_sha256(), nullptr);
+  }
+}
+
+ContentHash::~ContentHash() {
+  if (m_ctx) {
+    EVP_MD_CTX_free(m_ctx);
+  }
+}
+
+void ContentHash::update(const void *data, size_t size) {
+  if (m_ctx && size > 0) {
+    EVP_DigestUpdate(m_ctx, data, size);
+  }
+}
+
+std::string ContentHash::finalHex() {
+  if (!m_ctx)
+    return "";
+
+  unsigned char digest[EVP_MAX_MD_SIZE];
+  unsigned int len = 0;
+  EVP_DigestFinal_ex(m_ctx, digest, &len);
+
+  std::stringstream ss;
+  ss << std::hex << std::setfill('0');
+  for (size_t i = 0; i < FINGERPRINT_BYTES && i < len; ++i) {
+    ss << std::setw(2) << static_cast<int>(digest[i]);
+  }
+  return ss.str();
+}
+
+std::string ContentHash::of(const void *data, size_t size) {
+  ContentHash h;
+  h.update(data, size);
+  return h.finalHex();
+}
+
+} // namespace wizz
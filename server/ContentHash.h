@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Forward declaration (OpenSSL)
+typedef struct evp_md_ctx_st EVP_MD_CTX;
+
+namespace wizz {
+
+// Incremental SHA-256 used to fingerprint stored blobs (avatars, uploads).
+class ContentHash {
+public:
+  ContentHash();
+  ~ContentHash();
+
+  ContentHash(const ContentHash &) = delete;
+  ContentHash &operator=(const ContentHash &) = delete;
+
+  void update(const void *data, size_t size);
+
+  // Short hex fingerprint (first 8 bytes of the digest). Plenty to detect
+  // changes while keeping ContactList entries small.
+  std::string finalHex();
+
+  static std::string of(const void *data, size_t size);
+
+private:
+  EVP_MD_CTX *m_ctx;
+};
+
+} // namespace wizz
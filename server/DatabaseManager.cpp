@@ -1,6 +1,9 @@
 #include "DatabaseManager.h"
+#include "Logger.h"
+#include "Tracer.h"
+#include <algorithm>
+#include <ctime>
 #include <iomanip> // Added based on user's snippet
-#include <iostream>
 #include <mutex>          // Added based on user's snippet
 #include <openssl/evp.h>  // Added based on user's instruction
 #include <openssl/rand.h> // Added based on user's instruction
@@ -25,7 +28,7 @@ std::string DatabaseManager::generateSalt() {
   unsigned char salt[SALT_LEN];
   if (RAND_bytes(salt, SALT_LEN) != 1) {
     // Handle error, e.g., log and throw exception or return empty string
-    std::cerr << "[DB] Error generating random salt." << std::endl;
+    LOG_ERROR("[DB] Error generating random salt.");
     return "";
   }
   return bytesToHex(salt, SALT_LEN);
@@ -54,7 +57,8 @@ std::string DatabaseManager::hashPassword(const std::string &password,
 }
 
 DatabaseManager::DatabaseManager(const std::string &dbPath)
-    : m_dbPath(dbPath), m_db(nullptr), m_stopWorker(false) {}
+    : m_dbPath(dbPath), m_db(nullptr), m_offline(dbPath + ".offline"),
+      m_stopWorker(false) {}
 
 DatabaseManager::~DatabaseManager() {
   {
@@ -68,21 +72,198 @@ DatabaseManager::~DatabaseManager() {
 
   if (m_db) {
     sqlite3_close(m_db);
-    std::cout << "[DB] Connection Closed." << std::endl;
+    LOG_INFO("[DB] Connection Closed.");
   }
 }
 
 void DatabaseManager::postTask(std::function<void()> task) {
   {
     std::lock_guard<std::mutex> lock(m_mutex);
-    m_tasks.push(std::move(task));
+    m_tasks.push({std::move(task), std::chrono::steady_clock::now(), Tracer::current()});
+    if (m_metrics)
+      m_metrics->dbQueueDepth.set(static_cast<int64_t>(m_tasks.size()));
   }
   m_cv.notify_one();
 }
 
+uint64_t DatabaseManager::tasksStarted() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_tasksStarted;
+}
+
+size_t DatabaseManager::queuedTasks() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_tasks.size();
+}
+
+void DatabaseManager::setCommitHandler(CommitHandler handler) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_onCommit = std::move(handler);
+}
+
+void DatabaseManager::queueMessage(QueuedMessage message) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_messageBatch.push_back(std::move(message));
+    if (m_commitQueued)
+      return; // Rides along with the commit already in the queue
+    m_commitQueued = true;
+    m_tasks.push({[this] { commitMessages(); }, std::chrono::steady_clock::now(),
+                  Tracer::current()});
+  }
+  m_cv.notify_one();
+}
+
+std::unordered_map<int, uint32_t>
+DatabaseManager::acknowledgments(const std::vector<QueuedMessage> &batch) {
+  std::unordered_map<int, uint32_t> acks;
+  for (const QueuedMessage &msg : batch) {
+    if (msg.seq != 0) {
+      uint32_t &seq = acks[msg.sessionId];
+      seq = std::max(seq, msg.seq);
+    }
+  }
+  return acks;
+}
+
+void DatabaseManager::forgetFailedSessions(const std::vector<int> &sessionIds) {
+  for (int sessionId : sessionIds)
+    m_failedSessions.erase(sessionId);
+}
+
+void DatabaseManager::commitMessages() {
+  std::vector<QueuedMessage> batch;
+  CommitHandler onCommit;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    batch.swap(m_messageBatch);
+    m_commitQueued = false;
+    onCommit = m_onCommit;
+  }
+  if (!m_failedSessions.empty()) {
+    // Their clients resend these once reconnected
+    batch.erase(std::remove_if(batch.begin(), batch.end(),
+                               [this](const QueuedMessage &msg) {
+                                 return msg.seq != 0 &&
+                                        m_failedSessions.count(msg.sessionId);
+                               }),
+                batch.end());
+  }
+  if (batch.empty())
+    return;
+
+  bool committed = writeMessages(batch);
+  if (!committed) {
+    LOG_ERROR("[DB] Dropped a batch of {} messages", batch.size());
+    for (const QueuedMessage &msg : batch) {
+      if (msg.seq != 0)
+        m_failedSessions.insert(msg.sessionId);
+    }
+  }
+  if (onCommit)
+    onCommit(std::move(batch), committed);
+}
+
+bool DatabaseManager::writeMessages(const std::vector<QueuedMessage> &batch) {
+  // Undelivered messages go to the offline log, flushed before the
+  // transaction that records their senders' sequence numbers. Should
+  // anything fail, they are dropped from the log again: the client sees no
+  // ack and resends them. (A crash in between leaves them queued, so those
+  // would arrive twice rather than not at all.)
+  std::unordered_map<std::string, uint32_t> offlineSeqs; // Sender -> highest
+  std::vector<std::pair<std::string, uint64_t>> appended; // Recipient, id
+  auto takeBack = [this, &appended]() {
+    dropOffline(appended);
+    return false;
+  };
+  int64_t now = std::time(nullptr);
+  bool hasDelivered = false;
+  for (const QueuedMessage &msg : batch) {
+    if (msg.isDelivered) {
+      hasDelivered = true;
+      continue;
+    }
+    uint64_t id = m_offline.append(msg.recipient, msg.sender, msg.body, now);
+    if (id == 0)
+      return takeBack();
+    appended.emplace_back(msg.recipient, id);
+    if (msg.seq != 0) {
+      uint32_t &seq = offlineSeqs[msg.sender];
+      seq = std::max(seq, msg.seq);
+    }
+  }
+  if (!m_offline.sync())
+    return takeBack();
+  if (!hasDelivered && offlineSeqs.empty())
+    return true;
+
+  const char *sql = "INSERT INTO messages (sender, recipient, body, "
+                    "is_delivered, client_seq) VALUES (?, ?, ?, 1, ?);";
+  const char *seqSql =
+      "INSERT INTO message_seqs (sender, last_seq) VALUES (?, ?) "
+      "ON CONFLICT(sender) DO UPDATE SET last_seq = MAX(last_seq, excluded.last_seq);";
+  sqlite3_stmt *stmt;
+  sqlite3_stmt *seqStmt;
+  if (sqlite3_prepare_v2(m_db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+    LOG_ERROR("[DB] Prepare failed: {}", sqlite3_errmsg(m_db));
+    return takeBack();
+  }
+  if (sqlite3_prepare_v2(m_db, seqSql, -1, &seqStmt, nullptr) != SQLITE_OK) {
+    LOG_ERROR("[DB] Prepare failed: {}", sqlite3_errmsg(m_db));
+    sqlite3_finalize(stmt);
+    return takeBack();
+  }
+
+  sqlite3_exec(m_db, "BEGIN;", nullptr, nullptr, nullptr);
+  bool ok = true;
+  for (const QueuedMessage &msg : batch) {
+    if (!msg.isDelivered)
+      continue;
+    sqlite3_bind_text(stmt, 1, msg.sender.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, msg.recipient.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 3, msg.body.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 4, msg.seq);
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+      LOG_ERROR("[DB] Msg Insert failed: {}", sqlite3_errmsg(m_db));
+      ok = false;
+      break;
+    }
+    sqlite3_reset(stmt);
+  }
+  for (auto it = offlineSeqs.begin(); ok && it != offlineSeqs.end(); ++it) {
+    sqlite3_bind_text(seqStmt, 1, it->first.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int64(seqStmt, 2, it->second);
+    if (sqlite3_step(seqStmt) != SQLITE_DONE) {
+      LOG_ERROR("[DB] Seq Update failed: {}", sqlite3_errmsg(m_db));
+      ok = false;
+    }
+    sqlite3_reset(seqStmt);
+  }
+  sqlite3_finalize(stmt);
+  sqlite3_finalize(seqStmt);
+
+  if (!ok || sqlite3_exec(m_db, "COMMIT;", nullptr, nullptr, nullptr) !=
+                 SQLITE_OK) {
+    sqlite3_exec(m_db, "ROLLBACK;", nullptr, nullptr, nullptr);
+    return takeBack();
+  }
+  return true;
+}
+
+void DatabaseManager::dropOffline(
+    const std::vector<std::pair<std::string, uint64_t>> &appended) {
+  bool ok = true;
+  for (const auto &[recipient, id] : appended)
+    ok = m_offline.drop(recipient, id) && ok;
+  if (!ok || !m_offline.sync())
+    LOG_ERROR("[DB] Could not drop {} offline messages: they will arrive twice",
+              appended.size());
+}
+
 void DatabaseManager::workerLoop() {
+  Tracer::instance().nameThread("db");
   while (true) {
-    std::function<void()> task;
+    Task task;
     {
       std::unique_lock<std::mutex> lock(m_mutex);
       m_cv.wait(lock, [this] { return m_stopWorker || !m_tasks.empty(); });
@@ -93,9 +274,24 @@ void DatabaseManager::workerLoop() {
 
       task = std::move(m_tasks.front());
       m_tasks.pop();
+      ++m_tasksStarted;
+      if (m_metrics)
+        m_metrics->dbQueueDepth.set(static_cast<int64_t>(m_tasks.size()));
     }
-    if (task) {
-      task();
+    if (task.run) {
+      auto start = std::chrono::steady_clock::now();
+      {
+        TraceScope scope(task.trace);
+        if (task.trace)
+          Tracer::instance().record("db.queue", task.trace, task.queued, start);
+        TraceSpan span("db.run");
+        task.run();
+      }
+      if (m_metrics) {
+        m_metrics->dbWait.record(static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(start - task.queued).count()));
+        m_metrics->dbRun.recordSince(start);
+      }
     }
   }
 }
@@ -104,12 +300,13 @@ bool DatabaseManager::init() {
   // 1. Open Connection
   int rc = sqlite3_open(m_dbPath.c_str(), &m_db);
   if (rc) {
-    std::cerr << "[DB] Can't open database: " << sqlite3_errmsg(m_db)
-              << std::endl;
+    LOG_ERROR("[DB] Can't open database: {}", sqlite3_errmsg(m_db));
     return false;
   }
 
-  std::cout << "[DB] Opened successfully: " << m_dbPath << std::endl;
+  LOG_INFO("[DB] Opened successfully: {}", m_dbPath);
+  // During a hot restart the outgoing server may still be committing
+  sqlite3_busy_timeout(m_db, 5000);
 
   // Start the worker thread
   m_workerThread = std::thread(&DatabaseManager::workerLoop, this);
@@ -121,17 +318,19 @@ bool DatabaseManager::init() {
                          "PASSWORD_HASH TEXT NOT NULL,"
                          "SALT TEXT NOT NULL,"
                          "AVATAR_PATH TEXT,"
-                         "CUSTOM_STATUS TEXT DEFAULT '');";
+                         "CUSTOM_STATUS TEXT DEFAULT '',"
+                         "AVATAR_HASH TEXT DEFAULT '');";
 
   char *errMsg = nullptr;
   if (sqlite3_exec(m_db, sqlUsers, nullptr, 0, &errMsg) != SQLITE_OK) {
-    std::cerr << "[DB] Users Table Error: " << errMsg << std::endl;
+    LOG_ERROR("[DB] Users Table Error: {}", errMsg);
     sqlite3_free(errMsg);
     return false;
   }
 
   // Migration: Add CUSTOM_STATUS if it doesn't exist (in case of table already exists)
   sqlite3_exec(m_db, "ALTER TABLE users ADD COLUMN CUSTOM_STATUS TEXT DEFAULT '';", nullptr, 0, nullptr);
+  sqlite3_exec(m_db, "ALTER TABLE users ADD COLUMN AVATAR_HASH TEXT DEFAULT '';", nullptr, 0, nullptr);
 
   // 3. Create Messages Table
   const char *sqlMsgs = "CREATE TABLE IF NOT EXISTS messages ("
@@ -144,11 +343,23 @@ bool DatabaseManager::init() {
                         ");";
 
   if (sqlite3_exec(m_db, sqlMsgs, nullptr, 0, &errMsg) != SQLITE_OK) {
-    std::cerr << "[DB] Messages Table Error: " << errMsg << std::endl;
+    LOG_ERROR("[DB] Messages Table Error: {}", errMsg);
     sqlite3_free(errMsg);
     return false;
   }
 
+  // Migration: client sequence numbers (0 = not numbered)
+  sqlite3_exec(m_db, "ALTER TABLE messages ADD COLUMN client_seq INTEGER DEFAULT 0;", nullptr, 0, nullptr);
+  sqlite3_exec(m_db, "CREATE INDEX IF NOT EXISTS idx_messages_sender_seq ON messages (sender, client_seq);", nullptr, 0, nullptr);
+
+  // Senders' sequence numbers for messages that went to the offline log
+  // instead, which holds the undelivered ones
+  sqlite3_exec(m_db, "CREATE TABLE IF NOT EXISTS message_seqs (sender TEXT PRIMARY KEY, last_seq INTEGER NOT NULL);", nullptr, 0, nullptr);
+  if (!m_offline.open() || !migrateOfflineMessages()) {
+    LOG_ERROR("[DB] Offline log unavailable");
+    return false;
+  }
+
   // Seed Default User (Dev Mode)
   createUser("Sergey", "Password123!");
 
@@ -162,7 +373,65 @@ bool DatabaseManager::init() {
                            ");";
 
   if (sqlite3_exec(m_db, sqlFriends, nullptr, 0, &errMsg) != SQLITE_OK) {
-    std::cerr << "[DB] Friends Table Error: " << errMsg << std::endl;
+    LOG_ERROR("[DB] Friends Table Error: {}", errMsg);
+    sqlite3_free(errMsg);
+    return false;
+  }
+
+  // 5. Group Chats: groups, members, history and per-member pending rows
+  const char *sqlGroups =
+      "CREATE TABLE IF NOT EXISTS groups ("
+      "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+      "name TEXT NOT NULL);"
+      "CREATE TABLE IF NOT EXISTS group_members ("
+      "group_id INTEGER NOT NULL,"
+      "user_id INTEGER NOT NULL,"
+      "PRIMARY KEY (group_id, user_id),"
+      "FOREIGN KEY(group_id) REFERENCES groups(id),"
+      "FOREIGN KEY(user_id) REFERENCES users(ID));"
+      "CREATE TABLE IF NOT EXISTS group_messages ("
+      "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+      "group_id INTEGER NOT NULL,"
+      "sender TEXT NOT NULL,"
+      "body TEXT NOT NULL,"
+      "timestamp INTEGER DEFAULT (strftime('%s', 'now')));"
+      "CREATE TABLE IF NOT EXISTS group_pending ("
+      "user_id INTEGER NOT NULL,"
+      "message_id INTEGER NOT NULL,"
+      "PRIMARY KEY (user_id, message_id));";
+
+  if (sqlite3_exec(m_db, sqlGroups, nullptr, 0, &errMsg) != SQLITE_OK) {
+    LOG_ERROR("[DB] Group Tables Error: {}", errMsg);
+    sqlite3_free(errMsg);
+    return false;
+  }
+
+  // 6. Contact list versions: triggers log every change to `friends` in the
+  // same statement, keeping the last 256 per user
+  const char *sqlContactLog =
+      "CREATE TABLE IF NOT EXISTS contact_changes ("
+      "user_id INTEGER NOT NULL,"
+      "version INTEGER NOT NULL,"
+      "friend_id INTEGER NOT NULL,"
+      "added INTEGER NOT NULL,"
+      "PRIMARY KEY (user_id, version));"
+      "CREATE TRIGGER IF NOT EXISTS friends_added AFTER INSERT ON friends BEGIN "
+      "INSERT INTO contact_changes (user_id, version, friend_id, added) "
+      "SELECT NEW.user_id, COALESCE(MAX(version), 0) + 1, NEW.friend_id, 1 "
+      "FROM contact_changes WHERE user_id = NEW.user_id;"
+      "DELETE FROM contact_changes WHERE user_id = NEW.user_id AND version <= "
+      "(SELECT MAX(version) FROM contact_changes WHERE user_id = NEW.user_id) - 256;"
+      "END;"
+      "CREATE TRIGGER IF NOT EXISTS friends_removed AFTER DELETE ON friends BEGIN "
+      "INSERT INTO contact_changes (user_id, version, friend_id, added) "
+      "SELECT OLD.user_id, COALESCE(MAX(version), 0) + 1, OLD.friend_id, 0 "
+      "FROM contact_changes WHERE user_id = OLD.user_id;"
+      "DELETE FROM contact_changes WHERE user_id = OLD.user_id AND version <= "
+      "(SELECT MAX(version) FROM contact_changes WHERE user_id = OLD.user_id) - 256;"
+      "END;";
+
+  if (sqlite3_exec(m_db, sqlContactLog, nullptr, 0, &errMsg) != SQLITE_OK) {
+    LOG_ERROR("[DB] Contact Log Error: {}", errMsg);
     sqlite3_free(errMsg);
     return false;
   }
@@ -186,8 +455,7 @@ bool DatabaseManager::addFriend(const std::string &username,
 
   sqlite3_stmt *stmt;
   if (sqlite3_prepare_v2(m_db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-    std::cerr << "[DB] Prepare failed (addFriend): " << sqlite3_errmsg(m_db)
-              << std::endl;
+    LOG_ERROR("[DB] Prepare failed (addFriend): {}", sqlite3_errmsg(m_db));
     return false;
   }
 
@@ -245,6 +513,168 @@ bool DatabaseManager::addFriend(const std::string &username,
   return true;
 }
 
+// --- Group Chats ---
+
+DatabaseManager::StoredGroup
+DatabaseManager::createGroup(const std::string &name,
+                             const std::vector<std::string> &members) {
+  StoredGroup group;
+  sqlite3_stmt *stmt;
+  if (sqlite3_prepare_v2(m_db, "INSERT INTO groups (name) VALUES (?);", -1,
+                         &stmt, nullptr) != SQLITE_OK)
+    return group;
+  sqlite3_bind_text(stmt, 1, name.c_str(), -1, SQLITE_STATIC);
+  bool ok = (sqlite3_step(stmt) == SQLITE_DONE);
+  sqlite3_finalize(stmt);
+  if (!ok)
+    return group;
+
+  group.id = static_cast<uint32_t>(sqlite3_last_insert_rowid(m_db));
+  group.name = name;
+  for (const auto &member : members) {
+    if (addGroupMember(group.id, member))
+      group.members.push_back(member);
+  }
+  return group;
+}
+
+std::vector<DatabaseManager::StoredGroup> DatabaseManager::loadGroups() {
+  std::vector<StoredGroup> groups;
+  const char *sql = "SELECT g.id, g.name, u.USERNAME FROM groups g "
+                    "JOIN group_members m ON m.group_id = g.id "
+                    "JOIN users u ON u.ID = m.user_id ORDER BY g.id;";
+  sqlite3_stmt *stmt;
+  if (sqlite3_prepare_v2(m_db, sql, -1, &stmt, nullptr) != SQLITE_OK)
+    return groups;
+
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    uint32_t id = static_cast<uint32_t>(sqlite3_column_int64(stmt, 0));
+    if (groups.empty() || groups.back().id != id) {
+      StoredGroup group;
+      group.id = id;
+      group.name = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1));
+      groups.push_back(std::move(group));
+    }
+    groups.back().members.emplace_back(
+        reinterpret_cast<const char *>(sqlite3_column_text(stmt, 2)));
+  }
+  sqlite3_finalize(stmt);
+  return groups;
+}
+
+bool DatabaseManager::addGroupMember(uint32_t groupId,
+                                     const std::string &username) {
+  const char *sql = "INSERT OR IGNORE INTO group_members (group_id, user_id) "
+                    "SELECT ?, ID FROM users WHERE USERNAME = ?;";
+  sqlite3_stmt *stmt;
+  if (sqlite3_prepare_v2(m_db, sql, -1, &stmt, nullptr) != SQLITE_OK)
+    return false;
+  sqlite3_bind_int64(stmt, 1, groupId);
+  sqlite3_bind_text(stmt, 2, username.c_str(), -1, SQLITE_STATIC);
+  bool ok = (sqlite3_step(stmt) == SQLITE_DONE && sqlite3_changes(m_db) > 0);
+  sqlite3_finalize(stmt);
+  return ok;
+}
+
+bool DatabaseManager::removeGroupMember(uint32_t groupId,
+                                        const std::string &username) {
+  const char *sql = "DELETE FROM group_members WHERE group_id = ? AND "
+                    "user_id = (SELECT ID FROM users WHERE USERNAME = ?);";
+  sqlite3_stmt *stmt;
+  if (sqlite3_prepare_v2(m_db, sql, -1, &stmt, nullptr) != SQLITE_OK)
+    return false;
+  sqlite3_bind_int64(stmt, 1, groupId);
+  sqlite3_bind_text(stmt, 2, username.c_str(), -1, SQLITE_STATIC);
+  bool ok = (sqlite3_step(stmt) == SQLITE_DONE);
+  sqlite3_finalize(stmt);
+  return ok;
+}
+
+bool DatabaseManager::storeGroupMessage(
+    uint32_t groupId, const std::string &sender, const std::string &body,
+    const std::vector<std::string> &offlineMembers) {
+  sqlite3_exec(m_db, "BEGIN;", nullptr, nullptr, nullptr);
+
+  sqlite3_stmt *stmt;
+  const char *sqlMsg =
+      "INSERT INTO group_messages (group_id, sender, body) VALUES (?, ?, ?);";
+  if (sqlite3_prepare_v2(m_db, sqlMsg, -1, &stmt, nullptr) != SQLITE_OK) {
+    sqlite3_exec(m_db, "ROLLBACK;", nullptr, nullptr, nullptr);
+    return false;
+  }
+  sqlite3_bind_int64(stmt, 1, groupId);
+  sqlite3_bind_text(stmt, 2, sender.c_str(), -1, SQLITE_STATIC);
+  sqlite3_bind_text(stmt, 3, body.c_str(), -1, SQLITE_STATIC);
+  bool ok = (sqlite3_step(stmt) == SQLITE_DONE);
+  sqlite3_finalize(stmt);
+  sqlite3_int64 messageId = sqlite3_last_insert_rowid(m_db);
+
+  // One prepared statement for every offline member
+  const char *sqlPending = "INSERT OR IGNORE INTO group_pending (user_id, "
+                           "message_id) SELECT ID, ? FROM users "
+                           "WHERE USERNAME = ?;";
+  if (ok && !offlineMembers.empty() &&
+      sqlite3_prepare_v2(m_db, sqlPending, -1, &stmt, nullptr) == SQLITE_OK) {
+    sqlite3_bind_int64(stmt, 1, messageId);
+    for (const auto &member : offlineMembers) {
+      sqlite3_bind_text(stmt, 2, member.c_str(), -1, SQLITE_STATIC);
+      if (sqlite3_step(stmt) != SQLITE_DONE) {
+        ok = false;
+        break;
+      }
+      sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+  }
+
+  if (!ok || sqlite3_exec(m_db, "COMMIT;", nullptr, nullptr, nullptr) !=
+                 SQLITE_OK) {
+    LOG_ERROR("[DB] Group message insert failed: {}", sqlite3_errmsg(m_db));
+    sqlite3_exec(m_db, "ROLLBACK;", nullptr, nullptr, nullptr);
+    return false;
+  }
+  return true;
+}
+
+std::vector<DatabaseManager::PendingGroupMessage>
+DatabaseManager::fetchPendingGroupMessages(const std::string &recipient) {
+  std::vector<PendingGroupMessage> messages;
+  const char *sql =
+      "SELECT m.id, m.group_id, m.sender, m.body FROM group_pending p "
+      "JOIN group_messages m ON m.id = p.message_id "
+      "WHERE p.user_id = (SELECT ID FROM users WHERE USERNAME = ?) "
+      "ORDER BY m.id;";
+  sqlite3_stmt *stmt;
+  if (sqlite3_prepare_v2(m_db, sql, -1, &stmt, nullptr) != SQLITE_OK)
+    return messages;
+  sqlite3_bind_text(stmt, 1, recipient.c_str(), -1, SQLITE_STATIC);
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    PendingGroupMessage msg;
+    msg.id = static_cast<uint64_t>(sqlite3_column_int64(stmt, 0));
+    msg.groupId = static_cast<uint32_t>(sqlite3_column_int64(stmt, 1));
+    msg.sender = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 2));
+    msg.body = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 3));
+    messages.push_back(std::move(msg));
+  }
+  sqlite3_finalize(stmt);
+  return messages;
+}
+
+// Only up to what was fetched: later ones were not sent
+void DatabaseManager::markGroupMessagesDelivered(const std::string &recipient,
+                                                 uint64_t lastId) {
+  const char *sql = "DELETE FROM group_pending WHERE user_id = "
+                    "(SELECT ID FROM users WHERE USERNAME = ?) AND message_id <= ?;";
+  sqlite3_stmt *stmt;
+  if (sqlite3_prepare_v2(m_db, sql, -1, &stmt, nullptr) != SQLITE_OK)
+    return;
+  sqlite3_bind_text(stmt, 1, recipient.c_str(), -1, SQLITE_STATIC);
+  sqlite3_bind_int64(stmt, 2, static_cast<sqlite3_int64>(lastId));
+  if (sqlite3_step(stmt) != SQLITE_DONE)
+    LOG_ERROR("[DB] Group pending delete failed: {}", sqlite3_errmsg(m_db));
+  sqlite3_finalize(stmt);
+}
+
 bool DatabaseManager::removeFriend(const std::string &username,
                                    const std::string &friendName) {
   const char *sql = "DELETE FROM friends WHERE "
@@ -314,26 +744,94 @@ DatabaseManager::getFriends(const std::string &username) {
   return friends;
 }
 
+uint32_t DatabaseManager::getContactsVersion(const std::string &username) {
+  const char *sql = "SELECT COALESCE(MAX(version), 0) FROM contact_changes "
+                    "WHERE user_id = (SELECT ID FROM users WHERE USERNAME = ?);";
+  sqlite3_stmt *stmt;
+  if (sqlite3_prepare_v2(m_db, sql, -1, &stmt, nullptr) != SQLITE_OK)
+    return 0;
+  sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_STATIC);
+  uint32_t version = 0;
+  if (sqlite3_step(stmt) == SQLITE_ROW)
+    version = static_cast<uint32_t>(sqlite3_column_int64(stmt, 0));
+  sqlite3_finalize(stmt);
+  return version;
+}
+
+bool DatabaseManager::getContactChanges(const std::string &username,
+                                        uint32_t since,
+                                        std::vector<ContactChange> &changes) {
+  changes.clear();
+  if (since == 0)
+    return false;
+
+  // The oldest change kept must be the one right after `since`
+  const char *rangeSql =
+      "SELECT COALESCE(MIN(version), 0), COALESCE(MAX(version), 0) "
+      "FROM contact_changes "
+      "WHERE user_id = (SELECT ID FROM users WHERE USERNAME = ?);";
+  sqlite3_stmt *stmt;
+  if (sqlite3_prepare_v2(m_db, rangeSql, -1, &stmt, nullptr) != SQLITE_OK)
+    return false;
+  sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_STATIC);
+  bool covered = false;
+  if (sqlite3_step(stmt) == SQLITE_ROW) {
+    uint32_t oldest = static_cast<uint32_t>(sqlite3_column_int64(stmt, 0));
+    uint32_t newest = static_cast<uint32_t>(sqlite3_column_int64(stmt, 1));
+    covered = since <= newest && since + 1 >= oldest;
+  }
+  sqlite3_finalize(stmt);
+  if (!covered)
+    return false;
+
+  const char *sql =
+      "SELECT u.USERNAME, c.added FROM contact_changes c "
+      "JOIN users u ON u.ID = c.friend_id "
+      "WHERE c.user_id = (SELECT ID FROM users WHERE USERNAME = ?) "
+      "AND c.version > ? ORDER BY c.version;";
+  if (sqlite3_prepare_v2(m_db, sql, -1, &stmt, nullptr) != SQLITE_OK)
+    return false;
+  sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_STATIC);
+  sqlite3_bind_int64(stmt, 2, since);
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    const char *name =
+        reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0));
+    if (!name)
+      continue;
+    // Only the last change per contact counts
+    changes.erase(std::remove_if(changes.begin(), changes.end(),
+                                 [&](const ContactChange &change) {
+                                   return change.name == name;
+                                 }),
+                  changes.end());
+    changes.push_back({name, sqlite3_column_int(stmt, 1) != 0});
+  }
+  sqlite3_finalize(stmt);
+  return true;
+}
+
 bool DatabaseManager::storeMessage(const std::string &sender,
                                    const std::string &recipient,
                                    const std::string &body, bool isDelivered) {
+  if (!isDelivered)
+    return m_offline.append(recipient, sender, body, std::time(nullptr)) &&
+           m_offline.sync();
+
   const char *sql = "INSERT INTO messages (sender, recipient, body, "
-                    "is_delivered) VALUES (?, ?, ?, ?);";
+                    "is_delivered) VALUES (?, ?, ?, 1);";
   sqlite3_stmt *stmt;
 
   if (sqlite3_prepare_v2(m_db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-    std::cerr << "[DB] Prepare failed: " << sqlite3_errmsg(m_db) << std::endl;
+    LOG_ERROR("[DB] Prepare failed: {}", sqlite3_errmsg(m_db));
     return false;
   }
 
   sqlite3_bind_text(stmt, 1, sender.c_str(), -1, SQLITE_STATIC);
   sqlite3_bind_text(stmt, 2, recipient.c_str(), -1, SQLITE_STATIC);
   sqlite3_bind_text(stmt, 3, body.c_str(), -1, SQLITE_STATIC);
-  sqlite3_bind_int(stmt, 4, isDelivered ? 1 : 0);
 
   if (sqlite3_step(stmt) != SQLITE_DONE) {
-    std::cerr << "[DB] Msg Insert failed: " << sqlite3_errmsg(m_db)
-              << std::endl;
+    LOG_ERROR("[DB] Msg Insert failed: {}", sqlite3_errmsg(m_db));
     sqlite3_finalize(stmt);
     return false;
   }
@@ -342,41 +840,88 @@ bool DatabaseManager::storeMessage(const std::string &sender,
   return true;
 }
 
-std::vector<DatabaseManager::StoredMessage>
-DatabaseManager::fetchPendingMessages(const std::string &recipient) {
-  std::vector<StoredMessage> messages;
-  // LIMIT 50 to prevent freezing the server loop
-  const char *sql = "SELECT id, sender, body, timestamp FROM messages WHERE "
-                    "recipient = ? AND is_delivered = 0 LIMIT 50;";
+// Databases from before the offline log kept undelivered messages as rows.
+// Runs at every start: an older server draining during a hot restart may
+// still add some. BEGIN IMMEDIATE keeps two servers starting together from
+// both moving them.
+bool DatabaseManager::migrateOfflineMessages() {
+  const char *sql = "SELECT sender, recipient, body, timestamp FROM messages "
+                    "WHERE is_delivered = 0 ORDER BY id;";
+  if (sqlite3_exec(m_db, "BEGIN IMMEDIATE;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+    LOG_ERROR("[DB] Migration failed: {}", sqlite3_errmsg(m_db));
+    return false;
+  }
   sqlite3_stmt *stmt;
-
   if (sqlite3_prepare_v2(m_db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-    return messages;
+    LOG_ERROR("[DB] Prepare failed: {}", sqlite3_errmsg(m_db));
+    sqlite3_exec(m_db, "ROLLBACK;", nullptr, nullptr, nullptr);
+    return false;
   }
-
-  sqlite3_bind_text(stmt, 1, recipient.c_str(), -1, SQLITE_STATIC);
-
-  while (sqlite3_step(stmt) == SQLITE_ROW) {
-    StoredMessage msg;
-    msg.id = sqlite3_column_int(stmt, 0);
-    msg.sender = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1));
-    msg.body = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 2));
-    messages.push_back(msg);
+  std::vector<std::pair<std::string, uint64_t>> appended; // Recipient, id
+  bool ok = true;
+  while (ok && sqlite3_step(stmt) == SQLITE_ROW) {
+    const char *recipient = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1));
+    uint64_t id = m_offline.append(recipient,
+                                   reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0)),
+                                   reinterpret_cast<const char *>(sqlite3_column_text(stmt, 2)),
+                                   sqlite3_column_int64(stmt, 3));
+    ok = id != 0;
+    if (ok)
+      appended.emplace_back(recipient, id);
   }
-
   sqlite3_finalize(stmt);
-  return messages;
+
+  // Kept as history, with their sequence numbers
+  if (!ok || !m_offline.sync() ||
+      sqlite3_exec(m_db, "UPDATE messages SET is_delivered = 1 WHERE is_delivered = 0;",
+                   nullptr, nullptr, nullptr) != SQLITE_OK ||
+      sqlite3_exec(m_db, "COMMIT;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+    LOG_ERROR("[DB] Migration failed: {}", sqlite3_errmsg(m_db));
+    sqlite3_exec(m_db, "ROLLBACK;", nullptr, nullptr, nullptr);
+    // The rows are still undelivered and move again next start: not twice
+    dropOffline(appended);
+    return false;
+  }
+  if (!appended.empty())
+    LOG_INFO("[DB] Moved {} undelivered messages to the offline log", appended.size());
+  return true;
 }
 
-void DatabaseManager::markAsDelivered(int msgId) {
-  const char *sql = "UPDATE messages SET is_delivered = 1 WHERE id = ?;";
+uint32_t DatabaseManager::getLastMessageSeq(const std::string &sender) {
+  const char *sql =
+      "SELECT MAX(COALESCE((SELECT MAX(client_seq) FROM messages WHERE sender = ?1), 0), "
+      "COALESCE((SELECT last_seq FROM message_seqs WHERE sender = ?1), 0));";
   sqlite3_stmt *stmt;
-
+  uint32_t seq = 0;
   if (sqlite3_prepare_v2(m_db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-    sqlite3_bind_int(stmt, 1, msgId);
-    sqlite3_step(stmt);
+    sqlite3_bind_text(stmt, 1, sender.c_str(), -1, SQLITE_STATIC);
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+      seq = static_cast<uint32_t>(sqlite3_column_int64(stmt, 0));
+    }
     sqlite3_finalize(stmt);
   }
+  return seq;
+}
+
+std::vector<DatabaseManager::StoredMessage>
+DatabaseManager::fetchPendingMessages(const std::string &recipient) {
+  std::vector<StoredMessage> messages;
+  // 50 at a time to prevent freezing the server loop
+  for (OfflineLog::Message &msg : m_offline.pending(recipient, 50)) {
+    messages.push_back({msg.id, std::move(msg.sender), std::move(msg.body), msg.timestamp});
+  }
+  return messages;
+}
+
+void DatabaseManager::markAsDelivered(const std::string &recipient, uint64_t lastId) {
+  if (m_offline.markDelivered(recipient, lastId))
+    m_offline.sync();
+}
+
+void DatabaseManager::compactOfflineLog() {
+  uint64_t reclaimed = m_offline.compact();
+  if (reclaimed > 0)
+    LOG_INFO("[DB] Offline log compacted, {} bytes reclaimed", reclaimed);
 }
 
 bool DatabaseManager::createUser(const std::string &username,
@@ -394,7 +939,7 @@ bool DatabaseManager::createUser(const std::string &username,
   sqlite3_stmt *stmt;
 
   if (sqlite3_prepare_v2(m_db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-    std::cerr << "[DB] Prepare failed: " << sqlite3_errmsg(m_db) << std::endl;
+    LOG_ERROR("[DB] Prepare failed: {}", sqlite3_errmsg(m_db));
     return false;
   }
 
@@ -407,10 +952,9 @@ bool DatabaseManager::createUser(const std::string &username,
   bool success = false;
   if (sqlite3_step(stmt) == SQLITE_DONE) {
     success = true;
-    std::cout << "[DB] User Created: " << username << std::endl;
+    LOG_INFO("[DB] User Created: {}", username);
   } else {
-    std::cerr << "[DB] Insert failed (Duplicate user?): "
-              << sqlite3_errmsg(m_db) << std::endl;
+    LOG_ERROR("[DB] Insert failed (Duplicate user?): {}", sqlite3_errmsg(m_db));
   }
 
   sqlite3_finalize(stmt);
@@ -419,6 +963,7 @@ bool DatabaseManager::createUser(const std::string &username,
 
 bool DatabaseManager::checkCredentials(const std::string &username,
                                        const std::string &password) {
+  TraceSpan span("checkCredentials");
   if (!m_db)
     return false;
 
@@ -451,14 +996,17 @@ bool DatabaseManager::checkCredentials(const std::string &username,
 }
 
 bool DatabaseManager::updateUserAvatar(const std::string &username,
-                                       const std::string &avatarPath) {
-  const char *sql = "UPDATE users SET AVATAR_PATH = ? WHERE USERNAME = ?;";
+                                       const std::string &avatarPath,
+                                       const std::string &avatarHash) {
+  const char *sql =
+      "UPDATE users SET AVATAR_PATH = ?, AVATAR_HASH = ? WHERE USERNAME = ?;";
   sqlite3_stmt *stmt;
   if (sqlite3_prepare_v2(m_db, sql, -1, &stmt, nullptr) != SQLITE_OK)
     return false;
 
   sqlite3_bind_text(stmt, 1, avatarPath.c_str(), -1, SQLITE_STATIC);
-  sqlite3_bind_text(stmt, 2, username.c_str(), -1, SQLITE_STATIC);
+  sqlite3_bind_text(stmt, 2, avatarHash.c_str(), -1, SQLITE_STATIC);
+  sqlite3_bind_text(stmt, 3, username.c_str(), -1, SQLITE_STATIC);
 
   bool success = (sqlite3_step(stmt) == SQLITE_DONE);
   sqlite3_finalize(stmt);
@@ -483,6 +1031,66 @@ std::string DatabaseManager::getUserAvatar(const std::string &username) {
   return path;
 }
 
+std::string DatabaseManager::getAvatarHash(const std::string &username) {
+  const char *sql = "SELECT AVATAR_HASH FROM users WHERE USERNAME = ?;";
+  sqlite3_stmt *stmt;
+  if (sqlite3_prepare_v2(m_db, sql, -1, &stmt, nullptr) != SQLITE_OK)
+    return "";
+
+  sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_STATIC);
+
+  std::string hash;
+  if (sqlite3_step(stmt) == SQLITE_ROW) {
+    const unsigned char *text = sqlite3_column_text(stmt, 0);
+    if (text)
+      hash = reinterpret_cast<const char *>(text);
+  }
+  sqlite3_finalize(stmt);
+  return hash;
+}
+
+bool DatabaseManager::setAvatarHash(const std::string &username,
+                                    const std::string &avatarHash) {
+  const char *sql = "UPDATE users SET AVATAR_HASH = ? WHERE USERNAME = ?;";
+  sqlite3_stmt *stmt;
+  if (sqlite3_prepare_v2(m_db, sql, -1, &stmt, nullptr) != SQLITE_OK)
+    return false;
+
+  sqlite3_bind_text(stmt, 1, avatarHash.c_str(), -1, SQLITE_STATIC);
+  sqlite3_bind_text(stmt, 2, username.c_str(), -1, SQLITE_STATIC);
+
+  bool ok = (sqlite3_step(stmt) == SQLITE_DONE);
+  sqlite3_finalize(stmt);
+  return ok;
+}
+
+std::unordered_map<std::string, std::string>
+DatabaseManager::getFriendAvatarHashes(const std::string &username) {
+  std::unordered_map<std::string, std::string> hashes;
+  const char *sql =
+      "SELECT u.USERNAME, u.AVATAR_HASH FROM users u "
+      "JOIN friends f ON u.ID = f.friend_id "
+      "WHERE f.user_id = (SELECT ID FROM users WHERE USERNAME = ?);";
+
+  sqlite3_stmt *stmt;
+  if (sqlite3_prepare_v2(m_db, sql, -1, &stmt, nullptr) != SQLITE_OK)
+    return hashes;
+
+  sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_STATIC);
+
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    const char *name =
+        reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0));
+    const char *hash =
+        reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1));
+    if (name)
+      hashes.emplace(name, hash ? hash : "");
+  }
+
+  sqlite3_finalize(stmt);
+  return hashes;
+}
+
 bool DatabaseManager::updateCustomStatus(const std::string &username,
                                          const std::string &status) {
   const char *sql = "UPDATE users SET CUSTOM_STATUS = ? WHERE USERNAME = ?;";
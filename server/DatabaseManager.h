@@ -1,13 +1,20 @@
 #pragma once
 
+#include "Metrics.h"
+#include "OfflineLog.h"
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstdint>
 #include <functional>
 #include <mutex>
 #include <queue>
 #include <sqlite3.h>
 #include <string>
 #include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
 namespace wizz {
@@ -19,6 +26,12 @@ public:
 
   // Actor Model: Enqueue task for background DB thread
   void postTask(std::function<void()> task);
+  // Task wait/run times and queue depth; set before init()
+  void setMetrics(ServerMetrics *metrics) { m_metrics = metrics; }
+  // For draining: tasks the worker has picked up so far, and tasks waiting.
+  // An empty queue and an unchanged count mean nothing ran in between.
+  uint64_t tasksStarted();
+  size_t queuedTasks();
 
   // Prevent copy (Single connection ideally, or manage strictly)
   DatabaseManager(const DatabaseManager &) = delete;
@@ -34,26 +47,98 @@ public:
 
   // Avatar Management
   bool updateUserAvatar(const std::string &username,
-                        const std::string &avatarPath);
+                        const std::string &avatarPath,
+                        const std::string &avatarHash);
   std::string getUserAvatar(const std::string &username);
-
-  // Message Persistence
+  std::string getAvatarHash(const std::string &username);
+  bool setAvatarHash(const std::string &username, const std::string &avatarHash);
+  // Friend username -> avatar hash ("" when no avatar), for ContactList
+  std::unordered_map<std::string, std::string>
+  getFriendAvatarHashes(const std::string &username);
+
+  // Message Persistence. Delivered messages go to the `messages` table
+  // (history); undelivered ones to the offline log (OfflineLog.h), in
+  // `<dbPath>.offline`.
   struct StoredMessage {
-    int id;
+    uint64_t id; // In the offline log
     std::string sender;
     std::string body;
-    std::string timestamp;
+    int64_t timestamp; // Unix seconds
   };
 
-  // Stores a message (Offline or History)
+  // Stores a message (History, or Offline until the recipient logs in)
   bool storeMessage(const std::string &sender, const std::string &recipient,
                     const std::string &body, bool isDelivered);
 
-  // Retrieves undelivered messages for a user
+  // A direct message waiting for the next group commit. `seq` is the
+  // sender's sequence number (0 = client does not number messages).
+  struct QueuedMessage {
+    std::string sender;
+    std::string recipient;
+    std::string body;
+    bool isDelivered = false;
+    int sessionId = 0; // Where it came from, for the acknowledgment
+    uint32_t seq = 0;
+  };
+  // Called on the DB thread with every batch; `committed` is false when it
+  // could not be written. Nothing of a failed batch may be acknowledged,
+  // and later messages from the sessions that sent it are dropped until
+  // forgetFailedSessions(): an ack for them would cover the lost ones.
+  using CommitHandler =
+      std::function<void(std::vector<QueuedMessage> &&, bool committed)>;
+  void setCommitHandler(CommitHandler handler);
+  // Session id -> highest seq in a committed batch: one cumulative
+  // MessageSent each
+  static std::unordered_map<int, uint32_t>
+  acknowledgments(const std::vector<QueuedMessage> &batch);
+  // The sessions behind a failed batch were told to reconnect and resend,
+  // and nothing more of theirs is queued. Post it as a task.
+  void forgetFailedSessions(const std::vector<int> &sessionIds);
+
+  // Group commit: messages queued while a batch is being written go into
+  // the next one, so under load one transaction (and one fsync) covers
+  // many messages. Callable from any thread; ordered with postTask.
+  void queueMessage(QueuedMessage message);
+
+  // Highest sequence number stored for messages from `sender`
+  uint32_t getLastMessageSeq(const std::string &sender);
+
+  // Retrieves undelivered messages for a user (the oldest 50)
   std::vector<StoredMessage> fetchPendingMessages(const std::string &recipient);
 
-  // Marks a list of message IDs as delivered
-  void markAsDelivered(int msgId);
+  // Everything fetched for `recipient` up to `lastId` was sent
+  void markAsDelivered(const std::string &recipient, uint64_t lastId);
+
+  // Reclaims offline log space taken by delivered messages
+  void compactOfflineLog();
+
+  // Group Chats
+  struct StoredGroup {
+    uint32_t id = 0; // 0 = not created
+    std::string name;
+    std::vector<std::string> members;
+  };
+  // Members that do not exist are skipped
+  StoredGroup createGroup(const std::string &name,
+                          const std::vector<std::string> &members);
+  std::vector<StoredGroup> loadGroups();
+  bool addGroupMember(uint32_t groupId, const std::string &username);
+  bool removeGroupMember(uint32_t groupId, const std::string &username);
+
+  // One transaction for the message and a pending row per offline member
+  bool storeGroupMessage(uint32_t groupId, const std::string &sender,
+                         const std::string &body,
+                         const std::vector<std::string> &offlineMembers);
+  struct PendingGroupMessage {
+    uint64_t id;
+    uint32_t groupId;
+    std::string sender;
+    std::string body;
+  };
+  // Oldest first. They stay pending until marked delivered, once sent.
+  std::vector<PendingGroupMessage>
+  fetchPendingGroupMessages(const std::string &recipient);
+  void markGroupMessagesDelivered(const std::string &recipient, uint64_t lastId);
 
   // Contact Management (Day 6)
   bool addFriend(const std::string &username, const std::string &friendName);
@@ -61,12 +146,30 @@ public:
   std::vector<std::string> getFriends(const std::string &username);
   std::vector<std::string> getFollowers(const std::string &username);
 
+  // Contact lists are versioned: every add or remove that changes a list
+  // bumps its version and is logged (the last 256 per user), so a client
+  // holding an older version can be sent just the changes.
+  struct ContactChange {
+    std::string name;
+    bool added;
+  };
+  uint32_t getContactsVersion(const std::string &username);
+  // Net changes after version `since`, oldest first. False if the log does
+  // not reach back that far (or `since` is 0): send the whole list instead.
+  bool getContactChanges(const std::string &username, uint32_t since,
+                         std::vector<ContactChange> &changes);
+
   // Status Management
   bool updateCustomStatus(const std::string &username, const std::string &status);
   std::string getCustomStatus(const std::string &username);
 
 private:
   void workerLoop();
+  void commitMessages();
+  bool writeMessages(const std::vector<QueuedMessage> &batch);
+  // Takes back offline log appends (recipient, id) whose commit failed
+  void dropOffline(const std::vector<std::pair<std::string, uint64_t>> &appended);
+  bool migrateOfflineMessages();
 
   std::string hashPassword(const std::string &password,
                            const std::string &salt);
@@ -75,12 +178,28 @@ private:
 private:
   std::string m_dbPath;
   sqlite3 *m_db;
+  OfflineLog m_offline;
+
+  struct Task {
+    std::function<void()> run;
+    std::chrono::steady_clock::time_point queued;
+    uint64_t trace = 0; // Tracer::current() of the poster
+  };
 
   std::thread m_workerThread;
-  std::queue<std::function<void()>> m_tasks;
+  std::queue<Task> m_tasks;
   std::mutex m_mutex;
   std::condition_variable m_cv;
   std::atomic<bool> m_stopWorker;
+  uint64_t m_tasksStarted = 0; // Guarded by m_mutex
+
+  // Group commit (guarded by m_mutex)
+  std::vector<QueuedMessage> m_messageBatch;
+  bool m_commitQueued = false;
+  CommitHandler m_onCommit;
+  std::unordered_set<int> m_failedSessions; // DB thread only
+
+  ServerMetrics *m_metrics = nullptr;
 };
 
 } // namespace wizz
@@ -0,0 +1,68 @@
+#include "GroupManager.h"
+#include <algorithm>
+
+namespace wizz {
+
+void GroupManager::addGroup(GroupId id, std::string name, std::vector<UserId> members) {
+  std::sort(members.begin(), members.end());
+  members.erase(std::unique(members.begin(), members.end()), members.end());
+  for (UserId user : members) {
+    if (user >= m_userGroups.size()) m_userGroups.resize(user + 1);
+    m_userGroups[user].push_back(id);
+  }
+  m_groups[id] = {std::move(name), std::move(members)};
+}
+
+const GroupManager::Group* GroupManager::getGroup(GroupId id) const {
+  auto it = m_groups.find(id);
+  return (it != m_groups.end()) ? &it->second : nullptr;
+}
+
+bool GroupManager::isMember(GroupId id, UserId user) const {
+  const Group* group = getGroup(id);
+  return group && std::binary_search(group->members.begin(), group->members.end(), user);
+}
+
+bool GroupManager::addMember(GroupId id, UserId user) {
+  auto it = m_groups.find(id);
+  if (it == m_groups.end()) return false;
+  auto& members = it->second.members;
+  auto pos = std::lower_bound(members.begin(), members.end(), user);
+  if (pos != members.end() && *pos == user) return false;
+  members.insert(pos, user);
+  if (user >= m_userGroups.size()) m_userGroups.resize(user + 1);
+  m_userGroups[user].push_back(id);
+  return true;
+}
+
+bool GroupManager::removeMember(GroupId id, UserId user) {
+  auto it = m_groups.find(id);
+  if (it == m_groups.end()) return false;
+  auto& members = it->second.members;
+  auto pos = std::lower_bound(members.begin(), members.end(), user);
+  if (pos == members.end() || *pos != user) return false;
+  members.erase(pos);
+  auto& groups = m_userGroups[user];
+  groups.erase(std::find(groups.begin(), groups.end(), id));
+  if (members.empty()) m_groups.erase(it);
+  return true;
+}
+
+void GroupManager::replaceGroup(GroupId id, std::string name, std::vector<UserId> members) {
+  auto it = m_groups.find(id);
+  if (it != m_groups.end()) {
+    for (UserId user : it->second.members) {
+      auto& groups = m_userGroups[user];
+      groups.erase(std::find(groups.begin(), groups.end(), id));
+    }
+    m_groups.erase(it);
+  }
+  if (!members.empty()) addGroup(id, std::move(name), std::move(members));
+}
+
+const std::vector<GroupId>& GroupManager::groupsOf(UserId user) const {
+  static const std::vector<GroupId> none;
+  return user < m_userGroups.size() ? m_userGroups[user] : none;
+}
+
+} // namespace wizz
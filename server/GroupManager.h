@@ -0,0 +1,40 @@
+#pragma once
+
+#include "UserDirectory.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace wizz {
+
+using GroupId = uint32_t; // Row id in the groups table
+
+// Group chat membership, loaded at startup and kept in step with the DB.
+// Members are interned UserIds, so fan-out resolves them through the
+// session table without hashing names.
+class GroupManager {
+public:
+  struct Group {
+    std::string name;
+    std::vector<UserId> members; // Sorted
+  };
+
+  void addGroup(GroupId id, std::string name, std::vector<UserId> members);
+  const Group* getGroup(GroupId id) const;
+  bool isMember(GroupId id, UserId user) const;
+  bool addMember(GroupId id, UserId user);
+  // The group is dropped once its last member leaves
+  bool removeMember(GroupId id, UserId user);
+  // As another cluster node reports it; no members = dropped
+  void replaceGroup(GroupId id, std::string name, std::vector<UserId> members);
+
+  const std::vector<GroupId>& groupsOf(UserId user) const;
+  size_t size() const { return m_groups.size(); }
+
+private:
+  std::unordered_map<GroupId, Group> m_groups;
+  std::vector<std::vector<GroupId>> m_userGroups; // Indexed by UserId
+};
+
+} // namespace wizz
@@ -0,0 +1,118 @@
+#include "Handoff.h"
+#include "Logger.h"
+#include <cerrno>
+#include <cstring>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace wizz {
+namespace handoff {
+
+#ifndef _WIN32
+
+namespace {
+
+// One byte of payload carries the descriptor
+const char HANDOFF_TAG = 'L';
+
+} // namespace
+
+int receiveListener(const std::string &path) {
+  sockaddr_un address{};
+  if (path.size() >= sizeof(address.sun_path))
+    return -1;
+  address.sun_family = AF_UNIX;
+  std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+  int channel = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (channel < 0)
+    return -1;
+  if (::connect(channel, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+    ::close(channel); // Nobody there: first start, or a stale socket file
+    return -1;
+  }
+  if (!sameUser(channel)) {
+    LOG_ERROR("[Handoff] {} belongs to another user", path);
+    ::close(channel);
+    return -1;
+  }
+
+  char tag = 0;
+  iovec payload{&tag, 1};
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+  msghdr message{};
+  message.msg_iov = &payload;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+
+  ssize_t received;
+  do {
+    received = ::recvmsg(channel, &message, 0);
+  } while (received < 0 && errno == EINTR);
+  ::close(channel);
+
+  cmsghdr *header = CMSG_FIRSTHDR(&message);
+  if (received != 1 || tag != HANDOFF_TAG || !header || header->cmsg_level != SOL_SOCKET ||
+      header->cmsg_type != SCM_RIGHTS) {
+    LOG_ERROR("[Handoff] No listener received from {}", path);
+    return -1;
+  }
+  int listener;
+  std::memcpy(&listener, CMSG_DATA(header), sizeof(listener));
+  return listener;
+}
+
+bool sendListener(int channel, int listener) {
+  char tag = HANDOFF_TAG;
+  iovec payload{&tag, 1};
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+  msghdr message{};
+  message.msg_iov = &payload;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+
+  cmsghdr *header = CMSG_FIRSTHDR(&message);
+  header->cmsg_level = SOL_SOCKET;
+  header->cmsg_type = SCM_RIGHTS;
+  header->cmsg_len = CMSG_LEN(sizeof(int));
+  std::memcpy(CMSG_DATA(header), &listener, sizeof(listener));
+
+  ssize_t sent;
+  do {
+    sent = ::sendmsg(channel, &message, MSG_NOSIGNAL);
+  } while (sent < 0 && errno == EINTR);
+  return sent == 1;
+}
+
+bool sameUser(int channel) {
+#ifdef __linux__
+  ucred credentials{};
+  socklen_t length = sizeof(credentials);
+  if (::getsockopt(channel, SOL_SOCKET, SO_PEERCRED, &credentials, &length) != 0)
+    return false;
+  return credentials.uid == ::geteuid();
+#else
+  uid_t uid;
+  gid_t gid;
+  if (::getpeereid(channel, &uid, &gid) != 0)
+    return false;
+  return uid == ::geteuid();
+#endif
+}
+
+#else
+
+int receiveListener(const std::string &) { return -1; }
+bool sendListener(int, int) { return false; }
+bool sameUser(int) { return false; }
+
+#endif
+
+} // namespace handoff
+} // namespace wizz
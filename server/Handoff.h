@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+
+namespace wizz {
+
+// Hot restart: a new server process takes the listening socket over from
+// the running one through a UNIX socket (SCM_RIGHTS), so the port keeps
+// accepting while the old process drains. POSIX only; elsewhere there is
+// never a listener to take over.
+namespace handoff {
+
+// Asks the server listening at `path` for its TCP listener. Returns the
+// received descriptor, or -1 if no server is there.
+int receiveListener(const std::string &path);
+
+// Passes `listener` to the peer on the connected UNIX socket `channel`
+bool sendListener(int channel, int listener);
+
+// True if the process at the other end of the UNIX socket `channel` runs
+// as our effective user. The listener only goes to (and only comes from)
+// a server of the same user.
+bool sameUser(int channel);
+
+} // namespace handoff
+
+} // namespace wizz
@@ -0,0 +1,41 @@
+#include "HashRing.h"
+#include <algorithm>
+#include <string>
+
+namespace wizz {
+
+uint64_t HashRing::hash(std::string_view key) {
+  uint64_t h = 14695981039346656037ull;
+  for (unsigned char c : key) {
+    h ^= c;
+    h *= 1099511628211ull;
+  }
+  // FNV alone clusters similar keys ("node1#1", "node1#2"); mix the bits
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  return h;
+}
+
+void HashRing::addNode(uint32_t node) {
+  removeNode(node);
+  for (int i = 0; i < VNODES; ++i) {
+    std::string key = std::to_string(node) + "#" + std::to_string(i);
+    m_points.push_back({hash(key), node});
+  }
+  std::sort(m_points.begin(), m_points.end());
+}
+
+void HashRing::removeNode(uint32_t node) {
+  m_points.erase(std::remove_if(m_points.begin(), m_points.end(),
+                                [node](const Point &point) { return point.node == node; }),
+                 m_points.end());
+}
+
+uint32_t HashRing::nodeFor(std::string_view key) const {
+  if (m_points.empty()) return NO_NODE;
+  auto it = std::lower_bound(m_points.begin(), m_points.end(), Point{hash(key), 0});
+  return it != m_points.end() ? it->node : m_points.front().node;
+}
+
+} // namespace wizz
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace wizz {
+
+// Consistent hashing of usernames onto cluster nodes. Each node owns
+// VNODES points on a 64-bit ring and a user belongs to the node of the
+// first point at or after the hash of its name, so a node list that gains
+// or loses a node only moves the users of its arcs (about 1/N of them).
+// The hash is fixed (FNV-1a), so every node computes the same placement.
+class HashRing {
+public:
+  static constexpr int VNODES = 64;
+  static constexpr uint32_t NO_NODE = 0;
+
+  void addNode(uint32_t node);
+  void removeNode(uint32_t node);
+  // NO_NODE while the ring is empty
+  uint32_t nodeFor(std::string_view key) const;
+  bool empty() const { return m_points.empty(); }
+
+  static uint64_t hash(std::string_view key);
+
+private:
+  struct Point {
+    uint64_t position;
+    uint32_t node;
+    bool operator<(const Point &other) const {
+      return position != other.position ? position < other.position : node < other.node;
+    }
+  };
+  std::vector<Point> m_points; // Sorted
+};
+
+} // namespace wizz
@@ -0,0 +1,175 @@
+#include "Logger.h"
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+
+namespace wizz {
+
+void LogRecord::addNumber(ArgType type, const void *value) {
+  if (PAYLOAD_SIZE - size < 1 + sizeof(uint64_t)) {
+    size = PAYLOAD_SIZE; // Full: later arguments are left out too
+    return;
+  }
+  payload[size] = type;
+  std::memcpy(payload + size + 1, value, sizeof(uint64_t));
+  size += 1 + sizeof(uint64_t);
+  ++args;
+}
+
+void LogRecord::addString(std::string_view value) {
+  if (PAYLOAD_SIZE - size < 1 + sizeof(uint16_t)) {
+    size = PAYLOAD_SIZE;
+    return;
+  }
+  uint16_t length = static_cast<uint16_t>(
+      std::min(value.size(), PAYLOAD_SIZE - size - 1 - sizeof(uint16_t)));
+  payload[size] = Str;
+  std::memcpy(payload + size + 1, &length, sizeof(length));
+  std::memcpy(payload + size + 1 + sizeof(length), value.data(), length);
+  size += static_cast<uint16_t>(1 + sizeof(length) + length);
+  ++args;
+}
+
+std::string LogRecord::message() const {
+  std::string out;
+  size_t offset = 0;
+  uint8_t used = 0;
+  for (const char *p = format; *p; ++p) {
+    if (p[0] != '{' || p[1] != '}' || used == args) {
+      out += *p;
+      continue;
+    }
+    ++p;
+    ++used;
+    ArgType type = static_cast<ArgType>(payload[offset++]);
+    if (type == Str) {
+      uint16_t length;
+      std::memcpy(&length, payload + offset, sizeof(length));
+      out.append(reinterpret_cast<const char *>(payload + offset + sizeof(length)), length);
+      offset += sizeof(length) + length;
+      continue;
+    }
+    char number[32];
+    if (type == Int) {
+      int64_t v;
+      std::memcpy(&v, payload + offset, sizeof(v));
+      std::snprintf(number, sizeof(number), "%lld", static_cast<long long>(v));
+    } else if (type == Uint) {
+      uint64_t v;
+      std::memcpy(&v, payload + offset, sizeof(v));
+      std::snprintf(number, sizeof(number), "%llu", static_cast<unsigned long long>(v));
+    } else {
+      double v;
+      std::memcpy(&v, payload + offset, sizeof(v));
+      std::snprintf(number, sizeof(number), "%g", v);
+    }
+    offset += sizeof(uint64_t);
+    out += number;
+  }
+  return out;
+}
+
+std::string LogRecord::toString() const {
+  static const char LEVELS[] = {'D', 'I', 'W', 'E'};
+  std::time_t seconds = static_cast<std::time_t>(timestamp / 1000000000);
+  std::tm local;
+  localtime_r(&seconds, &local);
+  char prefix[32];
+  size_t n = std::strftime(prefix, sizeof(prefix), "%H:%M:%S", &local);
+  std::snprintf(prefix + n, sizeof(prefix) - n, ".%06u %c ",
+                static_cast<unsigned>(timestamp % 1000000000 / 1000),
+                LEVELS[static_cast<uint8_t>(level) & 3]);
+  return prefix + message() + '\n';
+}
+
+Logger &Logger::instance() {
+  static Logger logger;
+  return logger;
+}
+
+Logger::Logger() : m_thread([this] { run(); }) {}
+
+Logger::~Logger() {
+  m_stop = true;
+  if (m_thread.joinable())
+    m_thread.join();
+  drain();
+}
+
+LogRing &Logger::threadRing() {
+  thread_local std::shared_ptr<LogRing> ring;
+  if (!ring) {
+    ring = std::make_shared<LogRing>();
+    std::lock_guard<std::mutex> lock(m_ringsMutex);
+    m_rings.push_back(ring);
+  }
+  return *ring;
+}
+
+size_t Logger::drain() {
+  std::lock_guard<std::mutex> drainLock(m_drainMutex);
+  std::vector<std::shared_ptr<LogRing>> rings;
+  {
+    std::lock_guard<std::mutex> lock(m_ringsMutex);
+    rings = m_rings;
+  }
+
+  struct Line {
+    uint64_t timestamp;
+    bool error;
+    std::string text;
+  };
+  std::vector<Line> lines;
+  for (auto &ring : rings) {
+    while (const LogRecord *record = ring->peek()) {
+      lines.push_back({record->timestamp, record->level >= LogLevel::Warn, record->toString()});
+      ring->release();
+    }
+  }
+  if (lines.empty())
+    return 0;
+
+  // Rings are per thread: interleave them back into time order
+  std::stable_sort(lines.begin(), lines.end(),
+                   [](const Line &a, const Line &b) { return a.timestamp < b.timestamp; });
+  std::string out, err;
+  for (const Line &line : lines)
+    (line.error ? err : out) += line.text;
+
+  uint64_t dropped = 0;
+  for (auto &ring : rings)
+    dropped += ring->dropped();
+  if (dropped != m_reportedDropped) {
+    err += "[Log] " + std::to_string(dropped - m_reportedDropped) + " records dropped (ring full)\n";
+    m_reportedDropped = dropped;
+  }
+
+  if (!out.empty()) {
+    std::fwrite(out.data(), 1, out.size(), stdout);
+    std::fflush(stdout);
+  }
+  if (!err.empty()) {
+    std::fwrite(err.data(), 1, err.size(), stderr);
+    std::fflush(stderr);
+  }
+  return lines.size();
+}
+
+void Logger::run() {
+  while (!m_stop.load()) {
+    if (drain() == 0)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+void Logger::flush() { drain(); }
+
+uint64_t Logger::dropped() const {
+  std::lock_guard<std::mutex> lock(m_ringsMutex);
+  uint64_t total = 0;
+  for (const auto &ring : m_rings)
+    total += ring->dropped();
+  return total;
+}
+
+} // namespace wizz
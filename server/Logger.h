@@ -0,0 +1,176 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Lowest level compiled in: 0 = Debug, 1 = Info, 2 = Warn, 3 = Error.
+// Calls below it are removed by the preprocessor, arguments and all.
+#ifndef WIZZ_LOG_LEVEL
+#define WIZZ_LOG_LEVEL 1
+#endif
+
+namespace wizz {
+
+enum class LogLevel : uint8_t { Debug = 0, Info = 1, Warn = 2, Error = 3 };
+
+// One log call, filled in on the calling thread. `format` must be a string
+// literal (it is formatted later, on the logger thread); each {} in it takes
+// the next argument. Arguments are copied into `payload`: long strings are
+// cut short rather than spilling into another record.
+struct LogRecord {
+  static constexpr size_t PAYLOAD_SIZE = 224;
+
+  uint64_t timestamp; // Nanoseconds since the epoch
+  const char *format;
+  LogLevel level;
+  uint8_t args;
+  uint16_t size; // Payload bytes used
+  uint8_t payload[PAYLOAD_SIZE];
+
+  enum ArgType : uint8_t { Int, Uint, Double, Str };
+
+  template <typename T> void add(const T &value);
+  // "<time> <level> <message>\n"
+  std::string toString() const;
+  std::string message() const;
+
+private:
+  void addNumber(ArgType type, const void *value);
+  void addString(std::string_view value);
+};
+
+// Single-producer, single-consumer ring of records. A full ring drops the
+// record (and counts it) rather than making the producer wait.
+class LogRing {
+public:
+  static constexpr size_t CAPACITY = 1024; // Power of two
+
+  LogRing() : m_records(new LogRecord[CAPACITY]) {}
+
+  // Producer: a slot to fill, then publish(); nullptr when full
+  LogRecord *claim() {
+    uint64_t head = m_head.load(std::memory_order_relaxed);
+    if (head - m_tail.load(std::memory_order_acquire) == CAPACITY) {
+      m_dropped.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    return &m_records[head & (CAPACITY - 1)];
+  }
+  void publish() { m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+  // Consumer: the oldest record, then release() once it is formatted
+  const LogRecord *peek() const {
+    uint64_t tail = m_tail.load(std::memory_order_relaxed);
+    if (tail == m_head.load(std::memory_order_acquire))
+      return nullptr;
+    return &m_records[tail & (CAPACITY - 1)];
+  }
+  void release() { m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+  uint64_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+private:
+  std::unique_ptr<LogRecord[]> m_records;
+  alignas(64) std::atomic<uint64_t> m_head{0};
+  alignas(64) std::atomic<uint64_t> m_tail{0};
+  std::atomic<uint64_t> m_dropped{0};
+};
+
+// Asynchronous logger: each thread writes into its own ring, and a
+// background thread formats whatever is there and writes it in one batch
+// (Info/Debug to stdout, Warn/Error to stderr). Use the LOG_* macros.
+class Logger {
+public:
+  static Logger &instance();
+
+  template <typename... Args>
+  void log(LogLevel level, const char *format, const Args &...args) {
+    LogRing &ring = threadRing();
+    LogRecord *record = ring.claim();
+    if (!record)
+      return;
+    record->timestamp = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch())
+            .count());
+    record->format = format;
+    record->level = level;
+    record->args = 0;
+    record->size = 0;
+    (record->add(args), ...);
+    ring.publish();
+  }
+
+  // Writes everything logged so far (e.g. before exiting)
+  void flush();
+  uint64_t dropped() const;
+
+  ~Logger();
+
+private:
+  Logger();
+  LogRing &threadRing();
+  size_t drain(); // Formats and writes what is queued; returns records written
+  void run();
+
+  mutable std::mutex m_ringsMutex;
+  std::vector<std::shared_ptr<LogRing>> m_rings;
+  std::mutex m_drainMutex; // One consumer at a time
+  uint64_t m_reportedDropped = 0;
+  std::atomic<bool> m_stop{false};
+  std::thread m_thread;
+};
+
+template <typename T> void LogRecord::add(const T &value) {
+  using U = std::decay_t<T>;
+  if constexpr (std::is_same_v<U, bool>) {
+    uint64_t v = value ? 1 : 0;
+    addNumber(Uint, &v);
+  } else if constexpr (std::is_enum_v<U>) {
+    add(static_cast<std::underlying_type_t<U>>(value));
+  } else if constexpr (std::is_integral_v<U> && std::is_signed_v<U>) {
+    int64_t v = value;
+    addNumber(Int, &v);
+  } else if constexpr (std::is_integral_v<U>) {
+    uint64_t v = value;
+    addNumber(Uint, &v);
+  } else if constexpr (std::is_floating_point_v<U>) {
+    double v = value;
+    addNumber(Double, &v);
+  } else if constexpr (std::is_convertible_v<const T &, std::string_view>) {
+    addString(value);
+  } else {
+    static_assert(sizeof(T) == 0, "Unsupported log argument type");
+  }
+}
+
+} // namespace wizz
+
+#define WIZZ_LOG_AT(level, ...) ::wizz::Logger::instance().log(level, __VA_ARGS__)
+
+#if WIZZ_LOG_LEVEL <= 0
+#define LOG_DEBUG(...) WIZZ_LOG_AT(::wizz::LogLevel::Debug, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) ((void)0)
+#endif
+#if WIZZ_LOG_LEVEL <= 1
+#define LOG_INFO(...) WIZZ_LOG_AT(::wizz::LogLevel::Info, __VA_ARGS__)
+#else
+#define LOG_INFO(...) ((void)0)
+#endif
+#if WIZZ_LOG_LEVEL <= 2
+#define LOG_WARN(...) WIZZ_LOG_AT(::wizz::LogLevel::Warn, __VA_ARGS__)
+#else
+#define LOG_WARN(...) ((void)0)
+#endif
+#define LOG_ERROR(...) WIZZ_LOG_AT(::wizz::LogLevel::Error, __VA_ARGS__)
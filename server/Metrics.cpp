@@ -0,0 +1,185 @@
+#include "Metrics.h"
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+namespace wizz {
+
+unsigned Histogram::bucketOf(uint64_t value) {
+  if (value < SUB_BUCKETS)
+    return static_cast<unsigned>(value);
+  unsigned exponent = 63 - static_cast<unsigned>(__builtin_clzll(value));
+  unsigned sub = static_cast<unsigned>(value >> (exponent - SUB_BITS)) & (SUB_BUCKETS - 1);
+  return (exponent - SUB_BITS + 1) * SUB_BUCKETS + sub;
+}
+
+uint64_t Histogram::bucketUpperBound(unsigned bucket) {
+  if (bucket < SUB_BUCKETS)
+    return bucket;
+  unsigned exponent = bucket / SUB_BUCKETS + SUB_BITS - 1;
+  uint64_t sub = bucket % SUB_BUCKETS;
+  uint64_t width = uint64_t(1) << (exponent - SUB_BITS);
+  return ((SUB_BUCKETS + sub) << (exponent - SUB_BITS)) + (width - 1);
+}
+
+void Histogram::record(uint64_t value) {
+  m_buckets[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+  m_count.fetch_add(1, std::memory_order_relaxed);
+  m_sum.fetch_add(value, std::memory_order_relaxed);
+}
+
+uint64_t Histogram::quantile(double q) const {
+  // Buckets are read one by one while writers carry on: the total is taken
+  // from the buckets themselves so the walk always ends
+  std::array<uint64_t, BUCKETS> counts;
+  uint64_t total = 0;
+  for (unsigned i = 0; i < BUCKETS; ++i) {
+    counts[i] = m_buckets[i].load(std::memory_order_relaxed);
+    total += counts[i];
+  }
+  if (total == 0)
+    return 0;
+
+  uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(total));
+  if (rank >= total)
+    rank = total - 1;
+  uint64_t seen = 0;
+  for (unsigned i = 0; i < BUCKETS; ++i) {
+    seen += counts[i];
+    if (seen > rank)
+      return bucketUpperBound(i);
+  }
+  return bucketUpperBound(BUCKETS - 1);
+}
+
+void *MetricsRegistry::find(const std::string &name, Kind kind, const std::string &labels) {
+  for (Family &family : m_families) {
+    if (family.name != name || family.kind != kind)
+      continue;
+    for (Series &series : family.series) {
+      if (series.labels == labels)
+        return series.metric;
+    }
+  }
+  return nullptr;
+}
+
+void MetricsRegistry::add(const std::string &name, const std::string &help, Kind kind,
+                          double scale, const std::string &labels, void *metric) {
+  for (Family &family : m_families) {
+    if (family.name == name && family.kind == kind) {
+      family.series.push_back({labels, metric});
+      return;
+    }
+  }
+  m_families.push_back({name, help, kind, scale, {{labels, metric}}});
+}
+
+Counter &MetricsRegistry::counter(const std::string &name, const std::string &help,
+                                  const std::string &labels) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (void *existing = find(name, Kind::Counter, labels))
+    return *static_cast<Counter *>(existing);
+  Counter &counter = m_counters.emplace_back();
+  add(name, help, Kind::Counter, 1.0, labels, &counter);
+  return counter;
+}
+
+Gauge &MetricsRegistry::gauge(const std::string &name, const std::string &help,
+                              const std::string &labels) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (void *existing = find(name, Kind::Gauge, labels))
+    return *static_cast<Gauge *>(existing);
+  Gauge &gauge = m_gauges.emplace_back();
+  add(name, help, Kind::Gauge, 1.0, labels, &gauge);
+  return gauge;
+}
+
+Histogram &MetricsRegistry::histogram(const std::string &name, const std::string &help,
+                                      const std::string &labels, double scale) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (void *existing = find(name, Kind::Histogram, labels))
+    return *static_cast<Histogram *>(existing);
+  Histogram &histogram = m_histograms.emplace_back();
+  add(name, help, Kind::Histogram, scale, labels, &histogram);
+  return histogram;
+}
+
+namespace {
+
+std::string braces(const std::string &labels, const std::string &extra = "") {
+  if (labels.empty() && extra.empty())
+    return "";
+  if (labels.empty() || extra.empty())
+    return "{" + labels + extra + "}";
+  return "{" + labels + "," + extra + "}";
+}
+
+} // namespace
+
+std::string MetricsRegistry::exposition() const {
+  static const double QUANTILES[] = {0.5, 0.9, 0.99, 0.999};
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::ostringstream out;
+  for (const Family &family : m_families) {
+    out << "# HELP " << family.name << ' ' << family.help << '\n';
+    switch (family.kind) {
+    case Kind::Counter:
+      out << "# TYPE " << family.name << " counter\n";
+      for (const Series &s : family.series)
+        out << family.name << braces(s.labels) << ' '
+            << static_cast<const Counter *>(s.metric)->value() << '\n';
+      break;
+    case Kind::Gauge:
+      out << "# TYPE " << family.name << " gauge\n";
+      for (const Series &s : family.series)
+        out << family.name << braces(s.labels) << ' '
+            << static_cast<const Gauge *>(s.metric)->value() << '\n';
+      break;
+    case Kind::Histogram:
+      out << "# TYPE " << family.name << " summary\n";
+      for (const Series &s : family.series) {
+        const Histogram *h = static_cast<const Histogram *>(s.metric);
+        for (double q : QUANTILES) {
+          std::ostringstream label;
+          label << "quantile=\"" << q << '"';
+          out << family.name << braces(s.labels, label.str()) << ' '
+              << static_cast<double>(h->quantile(q)) * family.scale << '\n';
+        }
+        out << family.name << "_sum" << braces(s.labels) << ' '
+            << static_cast<double>(h->sum()) * family.scale << '\n';
+        out << family.name << "_count" << braces(s.labels) << ' ' << h->count() << '\n';
+      }
+      break;
+    }
+  }
+  return out.str();
+}
+
+bool MetricsRegistry::writeTextFile(const std::string &path) const {
+  std::string text = exposition();
+  std::string tmp = path + ".tmp";
+  {
+    std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+    if (!file.write(text.data(), static_cast<std::streamsize>(text.size())))
+      return false;
+  }
+  return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+ServerMetrics::ServerMetrics(MetricsRegistry &registry)
+    : bytesIn(registry.counter("wizz_bytes_received_total", "Bytes read from clients (after TLS)")),
+      bytesOut(registry.counter("wizz_bytes_sent_total", "Bytes written to clients (before TLS)")),
+      tlsHandshakes(registry.counter("wizz_tls_handshakes_total", "Completed TLS handshakes")),
+      tlsHandshakeFailures(
+          registry.counter("wizz_tls_handshake_failures_total", "Failed TLS handshakes")),
+      activeSessions(registry.gauge("wizz_sessions", "Open client connections")),
+      outboxBytes(registry.histogram("wizz_outbox_bytes",
+                                     "Bytes already queued to a client when another packet is sent")),
+      dbWait(registry.histogram("wizz_db_task_wait_seconds",
+                                "Time DB tasks spend queued before they run", "", 1e-9)),
+      dbRun(registry.histogram("wizz_db_task_run_seconds", "DB task run time", "", 1e-9)),
+      dbQueueDepth(registry.gauge("wizz_db_queue_depth", "DB tasks waiting to run")) {}
+
+} // namespace wizz
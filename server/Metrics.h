@@ -0,0 +1,126 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace wizz {
+
+// Metric primitives are updated with relaxed atomics from any thread
+// (io thread, DB thread); only registration and export take a lock.
+
+class Counter {
+public:
+  void add(uint64_t n = 1) { m_value.fetch_add(n, std::memory_order_relaxed); }
+  uint64_t value() const { return m_value.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<uint64_t> m_value{0};
+};
+
+class Gauge {
+public:
+  void set(int64_t v) { m_value.store(v, std::memory_order_relaxed); }
+  void add(int64_t n) { m_value.fetch_add(n, std::memory_order_relaxed); }
+  int64_t value() const { return m_value.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<int64_t> m_value{0};
+};
+
+// HDR-style log-linear histogram: each power of two is split into
+// SUB_BUCKETS linear buckets, so any recorded value is known to within
+// 1/SUB_BUCKETS (12.5%) over the full uint64_t range, at a fixed 4 KB.
+class Histogram {
+public:
+  static constexpr unsigned SUB_BITS = 3;
+  static constexpr unsigned SUB_BUCKETS = 1u << SUB_BITS;
+  static constexpr unsigned BUCKETS = (64 - SUB_BITS + 1) * SUB_BUCKETS;
+
+  void record(uint64_t value);
+  void recordSince(std::chrono::steady_clock::time_point start) {
+    record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                     std::chrono::steady_clock::now() - start)
+                                     .count()));
+  }
+
+  uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+  uint64_t sum() const { return m_sum.load(std::memory_order_relaxed); }
+  // Upper bound of the bucket holding the q-th quantile (0 when empty)
+  uint64_t quantile(double q) const;
+
+  static unsigned bucketOf(uint64_t value);
+  static uint64_t bucketUpperBound(unsigned bucket);
+
+private:
+  std::array<std::atomic<uint64_t>, BUCKETS> m_buckets{};
+  std::atomic<uint64_t> m_count{0};
+  std::atomic<uint64_t> m_sum{0};
+};
+
+// Named metrics, exported in the Prometheus text format. Metrics live as
+// long as the registry and never move, so callers keep references to them
+// and the hot path never looks anything up.
+class MetricsRegistry {
+public:
+  // `labels` is the inside of the braces, e.g. type="300". Asking again for
+  // the same name and labels returns the same metric.
+  Counter &counter(const std::string &name, const std::string &help,
+                   const std::string &labels = "");
+  Gauge &gauge(const std::string &name, const std::string &help,
+               const std::string &labels = "");
+  // Exported as a summary; `scale` converts recorded values to the exported
+  // unit (1e-9 for nanoseconds to seconds)
+  Histogram &histogram(const std::string &name, const std::string &help,
+                       const std::string &labels = "", double scale = 1.0);
+
+  std::string exposition() const;
+  // Written to a temporary file and renamed, so a scraper never sees half
+  bool writeTextFile(const std::string &path) const;
+
+private:
+  enum class Kind { Counter, Gauge, Histogram };
+  struct Series {
+    std::string labels;
+    void *metric;
+  };
+  struct Family {
+    std::string name;
+    std::string help;
+    Kind kind;
+    double scale;
+    std::vector<Series> series;
+  };
+
+  void *find(const std::string &name, Kind kind, const std::string &labels);
+  void add(const std::string &name, const std::string &help, Kind kind,
+           double scale, const std::string &labels, void *metric);
+
+  mutable std::mutex m_mutex;
+  std::vector<Family> m_families; // Registration order
+  std::deque<Counter> m_counters;
+  std::deque<Gauge> m_gauges;
+  std::deque<Histogram> m_histograms;
+};
+
+// The server's fixed metrics, resolved once
+struct ServerMetrics {
+  explicit ServerMetrics(MetricsRegistry &registry);
+
+  Counter &bytesIn;
+  Counter &bytesOut;
+  Counter &tlsHandshakes;
+  Counter &tlsHandshakeFailures;
+  Gauge &activeSessions;
+  Histogram &outboxBytes; // Sampled per packet sent
+  Histogram &dbWait;      // Queued until the DB thread picks it up
+  Histogram &dbRun;
+  Gauge &dbQueueDepth;
+};
+
+} // namespace wizz
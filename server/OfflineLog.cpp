@@ -0,0 +1,623 @@
+#include "OfflineLog.h"
+#include "Logger.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <unordered_map>
+#include <zlib.h>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace wizz {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const uint32_t LOG_MAGIC = 0x4c4f5a57; // "WZOL"
+const uint32_t LOG_VERSION = 1;
+const uint64_t INITIAL_SIZE = 1 << 20;
+// Delivered bytes worth rewriting a shard for (once they also outweigh the
+// pending ones)
+const uint64_t COMPACT_MIN = 1 << 20;
+const uint32_t MAX_RECORD = 64 << 20;
+
+const uint8_t KIND_MESSAGE = 1;
+const uint8_t KIND_DELIVERED = 2;
+const uint8_t KIND_DROPPED = 3;
+
+struct FileHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t retired; // Replaced by a compacted copy: open the path again
+  uint32_t reserved;
+  uint64_t tail; // End of the last complete record
+  uint64_t nextId;
+  uint8_t padding[32];
+};
+static_assert(sizeof(FileHeader) == 64, "The header is the first 64 bytes of a shard");
+const uint64_t HEADER_SIZE = sizeof(FileHeader);
+
+// A record is a u32 payload length, the payload's CRC-32 (u32), then the
+// payload: u8 kind, u64 id, then for a message i64 timestamp, recipient,
+// sender and body, for a cursor or a dropped message the recipient. Strings are a u32 length and
+// the bytes. Host byte order: the files never leave the machine.
+const uint64_t RECORD_HEADER = 8;
+
+struct Record {
+  uint8_t kind = 0;
+  uint64_t id = 0;
+  int64_t timestamp = 0;
+  std::string recipient;
+  std::string sender;
+  std::string body;
+};
+
+template <typename T> void putValue(std::vector<uint8_t> &out, T value) {
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&value);
+  out.insert(out.end(), bytes, bytes + sizeof(value));
+}
+
+void putString(std::vector<uint8_t> &out, const std::string &value) {
+  putValue(out, static_cast<uint32_t>(value.size()));
+  out.insert(out.end(), value.begin(), value.end());
+}
+
+// Bounds-checked, in case a record passes its CRC by chance
+class PayloadReader {
+public:
+  PayloadReader(const uint8_t *data, uint64_t size) : m_data(data), m_size(size) {}
+
+  template <typename T> bool read(T &value) {
+    if (m_size - m_pos < sizeof(value)) return false;
+    std::memcpy(&value, m_data + m_pos, sizeof(value));
+    m_pos += sizeof(value);
+    return true;
+  }
+
+  bool readString(std::string &value) {
+    uint32_t length;
+    if (!read(length) || m_size - m_pos < length) return false;
+    value.assign(reinterpret_cast<const char *>(m_data + m_pos), length);
+    m_pos += length;
+    return true;
+  }
+
+private:
+  const uint8_t *m_data;
+  uint64_t m_size;
+  uint64_t m_pos = 0;
+};
+
+// Replay needs the kind, id and recipient; `full` also reads the rest
+bool decode(const uint8_t *payload, uint64_t length, Record &record, bool full) {
+  PayloadReader reader(payload, length);
+  if (!reader.read(record.kind) || !reader.read(record.id)) return false;
+  if (record.kind == KIND_DELIVERED || record.kind == KIND_DROPPED) return reader.readString(record.recipient);
+  if (record.kind != KIND_MESSAGE || !reader.read(record.timestamp) || !reader.readString(record.recipient))
+    return false;
+  return !full || (reader.readString(record.sender) && reader.readString(record.body));
+}
+
+// A whole file, mapped shared and read-write
+struct MappedFile {
+  uint8_t *data = nullptr;
+  uint64_t size = 0;
+#ifdef _WIN32
+  HANDLE file = INVALID_HANDLE_VALUE;
+  HANDLE mapping = nullptr;
+#else
+  int fd = -1;
+#endif
+};
+
+// Advisory lock on a file of its own, which compaction never replaces
+struct LockFile {
+#ifdef _WIN32
+  HANDLE file = INVALID_HANDLE_VALUE;
+#else
+  int fd = -1;
+#endif
+};
+
+#ifdef _WIN32
+
+uint64_t fileSize(const MappedFile &file) {
+  LARGE_INTEGER size;
+  return GetFileSizeEx(file.file, &size) ? static_cast<uint64_t>(size.QuadPart) : 0;
+}
+
+// Mapping more than the file holds grows it, zero-filled
+bool mapView(MappedFile &file, uint64_t minSize) {
+  uint64_t size = std::max(fileSize(file), minSize);
+  file.mapping = CreateFileMappingA(file.file, nullptr, PAGE_READWRITE, static_cast<DWORD>(size >> 32),
+                                    static_cast<DWORD>(size), nullptr);
+  if (!file.mapping) return false;
+  file.data = static_cast<uint8_t *>(MapViewOfFile(file.mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0));
+  if (!file.data) {
+    CloseHandle(file.mapping);
+    file.mapping = nullptr;
+    return false;
+  }
+  file.size = size;
+  return true;
+}
+
+void unmapView(MappedFile &file) {
+  if (file.data) UnmapViewOfFile(file.data);
+  if (file.mapping) CloseHandle(file.mapping);
+  file.data = nullptr;
+  file.mapping = nullptr;
+  file.size = 0;
+}
+
+bool openHandle(MappedFile &file, const std::string &path) {
+  file.file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE,
+                          FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_ALWAYS,
+                          FILE_ATTRIBUTE_NORMAL, nullptr);
+  return file.file != INVALID_HANDLE_VALUE;
+}
+
+void closeHandle(MappedFile &file) {
+  if (file.file != INVALID_HANDLE_VALUE) CloseHandle(file.file);
+  file.file = INVALID_HANDLE_VALUE;
+}
+
+bool flushFile(MappedFile &file, uint64_t from, uint64_t to) {
+  return FlushViewOfFile(file.data + from, static_cast<SIZE_T>(to - from)) && FlushFileBuffers(file.file);
+}
+
+bool openLock(LockFile &lock, const std::string &path) {
+  lock.file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE,
+                          FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_ALWAYS,
+                          FILE_ATTRIBUTE_NORMAL, nullptr);
+  return lock.file != INVALID_HANDLE_VALUE;
+}
+
+void closeLock(LockFile &lock) {
+  if (lock.file != INVALID_HANDLE_VALUE) CloseHandle(lock.file);
+  lock.file = INVALID_HANDLE_VALUE;
+}
+
+void acquire(LockFile &lock) {
+  OVERLAPPED overlapped{};
+  LockFileEx(lock.file, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &overlapped);
+}
+
+void release(LockFile &lock) {
+  OVERLAPPED overlapped{};
+  UnlockFileEx(lock.file, 0, 1, 0, &overlapped);
+}
+
+#else
+
+uint64_t fileSize(const MappedFile &file) {
+  struct stat st;
+  return fstat(file.fd, &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+}
+
+bool mapView(MappedFile &file, uint64_t minSize) {
+  uint64_t size = fileSize(file);
+  if (size < minSize) {
+    if (ftruncate(file.fd, static_cast<off_t>(minSize)) != 0) return false; // Zero-filled
+    size = minSize;
+  }
+  void *data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file.fd, 0);
+  if (data == MAP_FAILED) return false;
+  file.data = static_cast<uint8_t *>(data);
+  file.size = size;
+  return true;
+}
+
+void unmapView(MappedFile &file) {
+  if (file.data) munmap(file.data, file.size);
+  file.data = nullptr;
+  file.size = 0;
+}
+
+bool openHandle(MappedFile &file, const std::string &path) {
+  file.fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  return file.fd >= 0;
+}
+
+void closeHandle(MappedFile &file) {
+  if (file.fd >= 0) ::close(file.fd);
+  file.fd = -1;
+}
+
+bool flushFile(MappedFile &file, uint64_t from, uint64_t to) {
+  uint64_t page = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+  uint64_t start = from / page * page;
+  return msync(file.data + start, to - start, MS_SYNC) == 0;
+}
+
+bool openLock(LockFile &lock, const std::string &path) {
+  lock.fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  return lock.fd >= 0;
+}
+
+void closeLock(LockFile &lock) {
+  if (lock.fd >= 0) ::close(lock.fd);
+  lock.fd = -1;
+}
+
+void acquire(LockFile &lock) {
+  while (flock(lock.fd, LOCK_EX) != 0 && errno == EINTR) {
+  }
+}
+
+void release(LockFile &lock) { flock(lock.fd, LOCK_UN); }
+
+#endif
+
+void closeFile(MappedFile &file) {
+  unmapView(file);
+  closeHandle(file);
+}
+
+// Growing is only safe under the shard's lock: another process could be
+// growing it too
+bool openFile(MappedFile &file, const std::string &path, uint64_t minSize) {
+  if (!openHandle(file, path)) return false;
+  if (mapView(file, minSize)) return true;
+  closeHandle(file);
+  return false;
+}
+
+bool remapFile(MappedFile &file, uint64_t minSize) {
+  unmapView(file);
+  return mapView(file, minSize);
+}
+
+class ShardLock {
+public:
+  explicit ShardLock(LockFile &lock) : m_lock(lock) { acquire(m_lock); }
+  ~ShardLock() { release(m_lock); }
+
+  ShardLock(const ShardLock &) = delete;
+  ShardLock &operator=(const ShardLock &) = delete;
+
+private:
+  LockFile &m_lock;
+};
+
+} // namespace
+
+struct OfflineLog::Shard {
+  struct Entry {
+    uint64_t id;
+    uint64_t offset;
+    uint64_t size; // With the record header
+  };
+
+  std::string path;
+  MappedFile file;
+  LockFile lock;
+  uint64_t replayed = HEADER_SIZE; // Records before this are indexed
+  uint64_t live = 0;               // Bytes of pending messages
+  uint64_t dirtyFrom = 0;          // First byte appended since sync() (0 = none)
+  std::unordered_map<std::string, std::deque<Entry>> pending;
+
+  ~Shard() {
+    closeFile(file);
+    closeLock(lock);
+  }
+
+  FileHeader *header() { return reinterpret_cast<FileHeader *>(file.data); }
+
+  void reset() {
+    pending.clear();
+    replayed = HEADER_SIZE;
+    live = 0;
+    dirtyFrom = 0;
+  }
+
+  void dropDelivered(const std::string &recipient, uint64_t id) {
+    auto it = pending.find(recipient);
+    if (it == pending.end()) return;
+    std::deque<Entry> &entries = it->second;
+    while (!entries.empty() && entries.front().id <= id) {
+      live -= entries.front().size;
+      entries.pop_front();
+    }
+    if (entries.empty()) pending.erase(it);
+  }
+
+  void dropOne(const std::string &recipient, uint64_t id) {
+    auto it = pending.find(recipient);
+    if (it == pending.end()) return;
+    std::deque<Entry> &entries = it->second;
+    auto entry = std::find_if(entries.begin(), entries.end(), [id](const Entry &e) { return e.id == id; });
+    if (entry == entries.end()) return;
+    live -= entry->size;
+    entries.erase(entry);
+    if (entries.empty()) pending.erase(it);
+  }
+
+  bool reserve(uint64_t end) {
+    if (end <= file.size) return true;
+    return remapFile(file, std::max(end, file.size * 2));
+  }
+
+  // Catches up with the appends and compactions of every process sharing
+  // the file. Under the lock.
+  bool refresh() {
+    if (!file.data || header()->retired) {
+      closeFile(file);
+      if (!openFile(file, path, INITIAL_SIZE)) return false;
+      header()->retired = 0; // Still set: a compaction crashed before its rename
+      reset();
+    }
+    FileHeader *h = header();
+    if (h->magic == 0) {
+      h->magic = LOG_MAGIC;
+      h->version = LOG_VERSION;
+      h->tail = HEADER_SIZE;
+      h->nextId = 1;
+    } else if (h->magic != LOG_MAGIC || h->version != LOG_VERSION) {
+      LOG_ERROR("[OfflineLog] {} is not an offline log this server can read", path);
+      return false;
+    }
+    if (h->tail > file.size) {
+      // Grown by another process
+      if (!remapFile(file, 0)) return false;
+      h = header();
+      h->tail = std::min(h->tail, file.size);
+    }
+
+    uint64_t pos = replayed;
+    Record record;
+    while (pos < h->tail) {
+      uint32_t length = 0;
+      uint32_t crc = 0;
+      bool valid = h->tail - pos >= RECORD_HEADER;
+      if (valid) {
+        std::memcpy(&length, file.data + pos, sizeof(length));
+        std::memcpy(&crc, file.data + pos + 4, sizeof(crc));
+        const uint8_t *payload = file.data + pos + RECORD_HEADER;
+        valid = length > 0 && length <= h->tail - pos - RECORD_HEADER &&
+                static_cast<uint32_t>(crc32(0, payload, length)) == crc && decode(payload, length, record, false);
+      }
+      if (!valid) {
+        LOG_ERROR("[OfflineLog] {}: bad record at byte {}, dropping the {} bytes from there", path, pos,
+                  h->tail - pos);
+        h->tail = pos;
+        break;
+      }
+      uint64_t size = RECORD_HEADER + length;
+      if (record.kind == KIND_MESSAGE) {
+        pending[record.recipient].push_back({record.id, pos, size});
+        live += size;
+      } else if (record.kind == KIND_DELIVERED) {
+        dropDelivered(record.recipient, record.id);
+      } else {
+        dropOne(record.recipient, record.id);
+      }
+      pos += size;
+    }
+    replayed = pos;
+    return true;
+  }
+
+  // Copies the pending messages to a new file and renames it over this
+  // one. Under the lock.
+  bool compact() {
+    std::vector<const Entry *> entries;
+    for (const auto &[recipient, queue] : pending) {
+      for (const Entry &entry : queue) entries.push_back(&entry);
+    }
+    // Each recipient's messages stay in order
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry *a, const Entry *b) { return a->offset < b->offset; });
+
+    std::string copyPath = path + ".tmp";
+    std::error_code ec;
+    fs::remove(copyPath, ec);
+    uint64_t tail = HEADER_SIZE + live;
+    MappedFile copy;
+    if (!openFile(copy, copyPath, std::max(INITIAL_SIZE, tail))) {
+      LOG_ERROR("[OfflineLog] Could not create {}", copyPath);
+      return false;
+    }
+    FileHeader *h = reinterpret_cast<FileHeader *>(copy.data);
+    h->magic = LOG_MAGIC;
+    h->version = LOG_VERSION;
+    h->tail = tail;
+    h->nextId = header()->nextId;
+    uint64_t at = HEADER_SIZE;
+    for (const Entry *entry : entries) {
+      std::memcpy(copy.data + at, file.data + entry->offset, entry->size);
+      at += entry->size;
+    }
+    bool written = flushFile(copy, 0, tail);
+    closeFile(copy);
+    if (!written) {
+      LOG_ERROR("[OfflineLog] Could not write {}", copyPath);
+      fs::remove(copyPath, ec);
+      return false;
+    }
+
+    // Other processes still map the old file; the flag sends them to the new one
+    header()->retired = 1;
+    closeFile(file);
+    fs::rename(copyPath, path, ec);
+    if (ec) {
+      // Windows will not replace a file another process maps. The old one
+      // is reopened (and unflagged) below.
+      LOG_WARN("[OfflineLog] Could not replace {}: {}", path, ec.message());
+      std::error_code removeEc;
+      fs::remove(copyPath, removeEc);
+    }
+    return refresh() && !ec;
+  }
+};
+
+OfflineLog::OfflineLog(std::string dir) : m_dir(std::move(dir)) {}
+
+OfflineLog::~OfflineLog() = default;
+
+bool OfflineLog::open() {
+  std::error_code ec;
+  fs::create_directories(m_dir, ec);
+  if (ec) {
+    LOG_ERROR("[OfflineLog] Could not create {}: {}", m_dir, ec.message());
+    return false;
+  }
+  m_shards.clear();
+  for (size_t i = 0; i < SHARDS; ++i) {
+    char name[16];
+    std::snprintf(name, sizeof(name), "shard-%02zu", i);
+    auto shard = std::make_unique<Shard>();
+    shard->path = (fs::path(m_dir) / (std::string(name) + ".log")).string();
+    if (!openLock(shard->lock, (fs::path(m_dir) / (std::string(name) + ".lock")).string())) {
+      LOG_ERROR("[OfflineLog] Could not open the lock of {}", shard->path);
+      return false;
+    }
+    ShardLock lock(shard->lock);
+    if (!shard->refresh()) {
+      LOG_ERROR("[OfflineLog] Could not open {}", shard->path);
+      return false;
+    }
+    m_shards.push_back(std::move(shard));
+  }
+  LOG_INFO("[OfflineLog] {} messages pending in {}", pendingCount(), m_dir);
+  return true;
+}
+
+OfflineLog::Shard &OfflineLog::shardFor(const std::string &recipient) {
+  // Part of the file format (every process must agree), so not shared
+  // with anything that might change its hash
+  uLong hash = crc32(0, reinterpret_cast<const Bytef *>(recipient.data()), static_cast<uInt>(recipient.size()));
+  return *m_shards[hash % SHARDS];
+}
+
+// Under the lock, after a refresh
+bool OfflineLog::appendRecord(Shard &shard, const std::vector<uint8_t> &payload) {
+  if (payload.size() > MAX_RECORD) {
+    LOG_WARN("[OfflineLog] Record of {} bytes refused", payload.size());
+    return false;
+  }
+  uint64_t at = shard.header()->tail;
+  if (!shard.reserve(at + RECORD_HEADER + payload.size())) {
+    LOG_ERROR("[OfflineLog] Could not grow {}", shard.path);
+    return false;
+  }
+  uint32_t length = static_cast<uint32_t>(payload.size());
+  uint32_t crc = static_cast<uint32_t>(crc32(0, payload.data(), length));
+  std::memcpy(shard.file.data + at, &length, sizeof(length));
+  std::memcpy(shard.file.data + at + 4, &crc, sizeof(crc));
+  std::memcpy(shard.file.data + at + RECORD_HEADER, payload.data(), payload.size());
+  // Only now part of the log for anyone replaying it
+  shard.header()->tail = at + RECORD_HEADER + payload.size();
+  if (shard.dirtyFrom == 0) shard.dirtyFrom = at;
+  return shard.refresh(); // Indexes it like another process's append
+}
+
+uint64_t OfflineLog::append(const std::string &recipient, const std::string &sender, const std::string &body,
+                            int64_t timestamp) {
+  Shard &shard = shardFor(recipient);
+  ShardLock lock(shard.lock);
+  if (!shard.refresh()) return 0;
+  uint64_t id = shard.header()->nextId++;
+  m_payload.clear();
+  putValue(m_payload, KIND_MESSAGE);
+  putValue(m_payload, id);
+  putValue(m_payload, timestamp);
+  putString(m_payload, recipient);
+  putString(m_payload, sender);
+  putString(m_payload, body);
+  return appendRecord(shard, m_payload) ? id : 0;
+}
+
+bool OfflineLog::drop(const std::string &recipient, uint64_t id) {
+  Shard &shard = shardFor(recipient);
+  ShardLock lock(shard.lock);
+  if (!shard.refresh()) return false;
+  m_payload.clear();
+  putValue(m_payload, KIND_DROPPED);
+  putValue(m_payload, id);
+  putString(m_payload, recipient);
+  return appendRecord(shard, m_payload);
+}
+
+bool OfflineLog::sync() {
+  bool ok = true;
+  for (auto &shard : m_shards) {
+    if (shard->dirtyFrom == 0) continue;
+    ShardLock lock(shard->lock);
+    // A compaction since wrote (and flushed) our records to a new file
+    if (shard->file.data && !shard->header()->retired) {
+      uint64_t tail = std::min(shard->header()->tail, shard->file.size);
+      if (tail > shard->dirtyFrom)
+        ok = flushFile(shard->file, shard->dirtyFrom, tail) && flushFile(shard->file, 0, HEADER_SIZE) && ok;
+    }
+    shard->dirtyFrom = 0;
+  }
+  if (!ok) LOG_ERROR("[OfflineLog] Flushing {} failed", m_dir);
+  return ok;
+}
+
+std::vector<OfflineLog::Message> OfflineLog::pending(const std::string &recipient, size_t limit) {
+  std::vector<Message> messages;
+  Shard &shard = shardFor(recipient);
+  ShardLock lock(shard.lock);
+  if (!shard.refresh()) return messages;
+  auto it = shard.pending.find(recipient);
+  if (it == shard.pending.end()) return messages;
+  for (const Shard::Entry &entry : it->second) {
+    if (messages.size() == limit) break;
+    Record record;
+    decode(shard.file.data + entry.offset + RECORD_HEADER, entry.size - RECORD_HEADER, record, true);
+    messages.push_back({entry.id, std::move(record.sender), std::move(record.body), record.timestamp});
+  }
+  return messages;
+}
+
+bool OfflineLog::markDelivered(const std::string &recipient, uint64_t id) {
+  Shard &shard = shardFor(recipient);
+  ShardLock lock(shard.lock);
+  if (!shard.refresh()) return false;
+  auto it = shard.pending.find(recipient);
+  if (it == shard.pending.end() || it->second.front().id > id) return true; // The cursor is past it
+  m_payload.clear();
+  putValue(m_payload, KIND_DELIVERED);
+  putValue(m_payload, id);
+  putString(m_payload, recipient);
+  return appendRecord(shard, m_payload);
+}
+
+uint64_t OfflineLog::compact() {
+  uint64_t reclaimed = 0;
+  for (auto &shard : m_shards) {
+    ShardLock lock(shard->lock);
+    if (!shard->refresh()) continue;
+    uint64_t dead = shard->header()->tail - HEADER_SIZE - shard->live;
+    if (dead < COMPACT_MIN || dead < shard->live) continue;
+    if (shard->compact()) reclaimed += dead;
+  }
+  return reclaimed;
+}
+
+size_t OfflineLog::pendingCount() {
+  size_t count = 0;
+  for (auto &shard : m_shards) {
+    ShardLock lock(shard->lock);
+    if (!shard->refresh()) continue;
+    for (const auto &[recipient, entries] : shard->pending) count += entries.size();
+  }
+  return count;
+}
+
+} // namespace wizz
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace wizz {
+
+// Direct messages waiting for their recipient to log in. Recipients are
+// hashed (CRC-32) onto SHARDS append-only files (a file per user would let anyone
+// create files by messaging made-up names). Each file is memory-mapped and
+// holds CRC-framed records:
+//  - Message: recipient, sender, body and an id, increasing per shard;
+//  - Delivered: the recipient got every message up to an id (its cursor);
+//  - Dropped: one message taken back (its batch failed to commit).
+// Queueing and delivery are appends. An index of the pending records per
+// recipient, rebuilt by replaying the files, serves fetches. compact()
+// rewrites a file to its pending messages once most of it is delivered.
+// A torn or corrupt record (a crash mid-append) ends the file where found.
+//
+// Processes can share the directory (the two servers of a hot restart,
+// cluster nodes): a lock file per shard serializes them, and each replays
+// what the others appended before it touches a shard. Not thread-safe; in
+// the server only the DB thread uses it.
+class OfflineLog {
+public:
+  static constexpr size_t SHARDS = 16;
+
+  struct Message {
+    uint64_t id;
+    std::string sender;
+    std::string body;
+    int64_t timestamp; // Unix seconds
+  };
+
+  explicit OfflineLog(std::string dir);
+  ~OfflineLog();
+
+  OfflineLog(const OfflineLog &) = delete;
+  OfflineLog &operator=(const OfflineLog &) = delete;
+
+  // Creates the directory and files as needed and replays them
+  bool open();
+
+  // The message's id; 0 if it could not be written
+  uint64_t append(const std::string &recipient, const std::string &sender, const std::string &body,
+                  int64_t timestamp);
+  // Takes back message `id` (from append()), pending or not
+  bool drop(const std::string &recipient, uint64_t id);
+  // Flushes what was appended since the last call (one msync per shard
+  // written), so it survives a crash. Once per batch, like a commit.
+  bool sync();
+
+  // Oldest first, at most `limit`
+  std::vector<Message> pending(const std::string &recipient, size_t limit);
+  // `recipient` got every message up to `id` (from pending())
+  bool markDelivered(const std::string &recipient, uint64_t id);
+
+  // Rewrites the shards that are mostly delivered messages; returns the
+  // bytes reclaimed
+  uint64_t compact();
+
+  // Across every recipient
+  size_t pendingCount();
+
+private:
+  struct Shard;
+
+  Shard &shardFor(const std::string &recipient);
+  bool appendRecord(Shard &shard, const std::vector<uint8_t> &payload);
+
+  std::string m_dir;
+  std::vector<std::unique_ptr<Shard>> m_shards;
+  std::vector<uint8_t> m_payload; // Reused for encoding
+};
+
+} // namespace wizz
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "../common/Packet.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace wizz {
+
+class ClientSession;
+
+// Where packets for an online user go: its ClientSession when the user is
+// connected to this server, or in cluster mode a RemotePeer that forwards
+// them to the node the user is connected to (ClusterLink.h).
+class Peer {
+public:
+  virtual ~Peer() = default;
+
+  virtual void sendPacket(const Packet &packet) = 0;
+  // Bytes that were already serialized (e.g. from the avatar cache)
+  virtual void sendSerialized(const std::vector<uint8_t> &data) = 0;
+  // Fan-out: `serialized` is packet.serialize(), shared by every recipient
+  virtual void sendPacket(const Packet &packet, const std::vector<uint8_t> &serialized) = 0;
+
+  // Presence and typing updates about contacts (coalesced by the session)
+  virtual void queueStatus(const std::string &username, uint32_t status, const std::string &customStatus) = 0;
+  virtual void queueTyping(const std::string &username, bool isTyping) = 0;
+
+  virtual bool hasCapability(Capability cap) const = 0;
+
+  // The session, if the user is connected here
+  virtual ClientSession *local() { return nullptr; }
+};
+
+} // namespace wizz
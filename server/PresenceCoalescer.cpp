@@ -0,0 +1,107 @@
+#include "PresenceCoalescer.h"
+
+namespace wizz {
+
+constexpr std::chrono::milliseconds PresenceCoalescer::WINDOW;
+
+bool PresenceCoalescer::addStatus(const std::string &username, uint32_t status,
+                                  const std::string &customStatus) {
+  bool wasEmpty = empty();
+  auto it = m_statusIndex.find(username);
+  if (it != m_statusIndex.end()) {
+    StatusUpdate &pending = m_statuses[it->second];
+    pending.status = status;
+    pending.customStatus = customStatus;
+  } else {
+    m_statusIndex.emplace(username, m_statuses.size());
+    m_statuses.push_back(StatusUpdate{username, status, customStatus});
+  }
+  return wasEmpty;
+}
+
+bool PresenceCoalescer::addTyping(const std::string &username, bool isTyping) {
+  bool wasEmpty = empty();
+  auto it = m_typingIndex.find(username);
+  if (it != m_typingIndex.end()) {
+    m_typing[it->second].isTyping = isTyping;
+  } else {
+    m_typingIndex.emplace(username, m_typing.size());
+    m_typing.push_back(TypingUpdate{username, isTyping});
+  }
+  return wasEmpty;
+}
+
+std::vector<Packet> PresenceCoalescer::flush(bool batched) {
+  std::vector<Packet> packets;
+  if (empty())
+    return packets;
+
+  if (batched) {
+    Packet batch(PacketType::PresenceBatch);
+    batch.writeInt(static_cast<uint32_t>(m_statuses.size()));
+    for (const auto &update : m_statuses) {
+      batch.writeString(update.username);
+      batch.writeInt(update.status);
+      batch.writeString(update.customStatus);
+    }
+    batch.writeInt(static_cast<uint32_t>(m_typing.size()));
+    for (const auto &update : m_typing) {
+      batch.writeString(update.username);
+      batch.writeInt(update.isTyping ? 1 : 0);
+    }
+    packets.push_back(std::move(batch));
+  } else {
+    for (const auto &update : m_statuses) {
+      Packet notify(PacketType::ContactStatusChange);
+      notify.writeInt(update.status);
+      notify.writeString(update.username);
+      notify.writeString(update.customStatus);
+      packets.push_back(std::move(notify));
+    }
+    for (const auto &update : m_typing) {
+      Packet typing(PacketType::TypingIndicator);
+      typing.writeString(update.username);
+      typing.writeInt(update.isTyping ? 1 : 0);
+      packets.push_back(std::move(typing));
+    }
+  }
+
+  m_statuses.clear();
+  m_typing.clear();
+  m_statusIndex.clear();
+  m_typingIndex.clear();
+  return packets;
+}
+
+std::vector<Packet> PresenceCoalescer::flushTyping(const std::string &username,
+                                                   bool batched) {
+  std::vector<Packet> packets;
+  auto it = m_typingIndex.find(username);
+  if (it == m_typingIndex.end())
+    return packets;
+  size_t index = it->second;
+  bool isTyping = m_typing[index].isTyping;
+  m_typingIndex.erase(it);
+  m_typing.erase(m_typing.begin() + static_cast<std::ptrdiff_t>(index));
+  for (auto &entry : m_typingIndex) {
+    if (entry.second > index)
+      --entry.second;
+  }
+
+  if (batched) {
+    Packet batch(PacketType::PresenceBatch);
+    batch.writeInt(0);
+    batch.writeInt(1);
+    batch.writeString(username);
+    batch.writeInt(isTyping ? 1 : 0);
+    packets.push_back(std::move(batch));
+  } else {
+    Packet typing(PacketType::TypingIndicator);
+    typing.writeString(username);
+    typing.writeInt(isTyping ? 1 : 0);
+    packets.push_back(std::move(typing));
+  }
+  return packets;
+}
+
+} // namespace wizz
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "../common/Packet.h"
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace wizz {
+
+// Per-recipient merge buffer for presence and typing updates. A newer update
+// about the same user replaces the pending one, so under churn a recipient
+// gets at most one entry per contact per window. Pure bookkeeping: the owning
+// ClientSession arms a timer when an add returns true and flushes on expiry.
+class PresenceCoalescer {
+public:
+  static constexpr std::chrono::milliseconds WINDOW{75};
+
+  // Return true if this is the first pending update (schedule a flush)
+  bool addStatus(const std::string &username, uint32_t status,
+                 const std::string &customStatus);
+  bool addTyping(const std::string &username, bool isTyping);
+
+  bool empty() const { return m_statuses.empty() && m_typing.empty(); }
+  bool hasStatus(const std::string &username) const {
+    return m_statusIndex.count(username) != 0;
+  }
+
+  // Drains the pending updates: one PresenceBatch packet, or for peers
+  // without CapPresenceBatch the equivalent individual packets.
+  std::vector<Packet> flush(bool batched);
+  // Drains only the typing update about `username`, if any: sent ahead of
+  // a direct message from them, so it can't arrive after the message.
+  std::vector<Packet> flushTyping(const std::string &username, bool batched);
+
+private:
+  struct StatusUpdate {
+    std::string username;
+    uint32_t status;
+    std::string customStatus;
+  };
+  struct TypingUpdate {
+    std::string username;
+    bool isTyping;
+  };
+
+  // Vectors keep first-seen order; the maps point into them
+  std::vector<StatusUpdate> m_statuses;
+  std::vector<TypingUpdate> m_typing;
+  std::unordered_map<std::string, size_t> m_statusIndex;
+  std::unordered_map<std::string, size_t> m_typingIndex;
+};
+
+} // namespace wizz
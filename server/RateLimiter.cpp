@@ -0,0 +1,82 @@
+#include "RateLimiter.h"
+#include <algorithm>
+
+namespace wizz {
+
+RateLimiter::Bucket &RateLimiter::refill(PacketType type, const RateLimit &limit,
+                                         Clock::time_point now) {
+  auto it = std::find_if(m_buckets.begin(), m_buckets.end(),
+                         [type](const Bucket &b) { return b.type == type; });
+  if (it == m_buckets.end()) {
+    m_buckets.push_back({type, limit.burst, now, false});
+    return m_buckets.back();
+  }
+  double elapsed = std::chrono::duration<double>(now - it->last).count();
+  it->tokens = std::min(limit.burst, it->tokens + elapsed * limit.perSecond);
+  it->last = now;
+  return *it;
+}
+
+bool RateLimiter::allow(PacketType type, const RateLimit &limit,
+                        Clock::time_point now) {
+  Bucket &bucket = refill(type, limit, now);
+
+  m_startedThrottling = false;
+  if (bucket.tokens >= 1.0) {
+    bucket.tokens -= 1.0;
+    bucket.throttling = false;
+    return true;
+  }
+  m_startedThrottling = !bucket.throttling;
+  bucket.throttling = true;
+  ++m_throttled;
+  return false;
+}
+
+bool RateLimiter::defer(Packet packet, const std::string &key,
+                        const RateLimit &limit) {
+  PacketType type = packet.type();
+  auto it = std::find_if(m_deferred.begin(), m_deferred.end(),
+                         [&](const Deferred &d) {
+                           return d.packet.type() == type && d.key == key;
+                         });
+  if (it != m_deferred.end()) {
+    // Keeps its place: the update it replaces was first in line
+    it->packet = std::move(packet);
+    it->limit = limit;
+    return true;
+  }
+  if (m_deferred.size() >= MAX_DEFERRED)
+    return false;
+  m_deferred.push_back({std::move(packet), key, limit});
+  return true;
+}
+
+void RateLimiter::supersede(PacketType type, const std::string &key) {
+  m_deferred.erase(std::remove_if(m_deferred.begin(), m_deferred.end(),
+                                  [&](const Deferred &d) {
+                                    return d.packet.type() == type &&
+                                           d.key == key;
+                                  }),
+                   m_deferred.end());
+}
+
+std::vector<Packet> RateLimiter::takeDeferred(Clock::time_point now) {
+  std::vector<Packet> ready;
+  auto waiting = m_deferred.begin();
+  for (auto it = m_deferred.begin(); it != m_deferred.end(); ++it) {
+    Bucket &bucket = refill(it->packet.type(), it->limit, now);
+    if (bucket.tokens >= 1.0) {
+      bucket.tokens -= 1.0;
+      ready.push_back(std::move(it->packet));
+    } else {
+      if (waiting != it)
+        *waiting = std::move(*it);
+      ++waiting;
+    }
+  }
+  m_deferred.erase(waiting, m_deferred.end());
+  return ready;
+}
+
+} // namespace wizz
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "../common/Packet.h"
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace wizz {
+
+// Token bucket parameters for one packet type: `burst` packets at once,
+// refilled at `perSecond`.
+struct RateLimit {
+  double perSecond;
+  double burst;
+};
+
+// Per-session token buckets, one per rate-limited packet type. Pure
+// bookkeeping: PacketRouter owns the limits and asks before dispatching.
+class RateLimiter {
+public:
+  using Clock = std::chrono::steady_clock;
+  // How long a session that just had packets dropped waits before its next
+  // read, so a flood backs up in TCP instead of costing decode time
+  static constexpr std::chrono::milliseconds READ_PAUSE{100};
+
+  // Takes a token for `type`. A bucket starts full the first time its type
+  // is seen.
+  bool allow(PacketType type, const RateLimit &limit, Clock::time_point now);
+
+  // True once per run of rejections (the first packet dropped after an
+  // allowed one), so floods are logged once rather than per packet
+  bool startedThrottling() const { return m_startedThrottling; }
+  uint64_t throttled() const { return m_throttled; }
+
+  // State updates (typing, status) are not dropped: the latest throttled
+  // one per type and key waits for a token, replacing any older one.
+  // False if MAX_DEFERRED are already waiting.
+  static constexpr size_t MAX_DEFERRED = 32;
+  bool defer(Packet packet, const std::string &key, const RateLimit &limit);
+  // An allowed update makes the waiting one for the same key stale
+  void supersede(PacketType type, const std::string &key);
+  bool hasDeferred() const { return !m_deferred.empty(); }
+  // Takes a token for each deferred packet it can; returns those, in the
+  // order they were deferred
+  std::vector<Packet> takeDeferred(Clock::time_point now);
+
+private:
+  struct Bucket {
+    PacketType type;
+    double tokens;
+    Clock::time_point last;
+    bool throttling;
+  };
+
+  struct Deferred {
+    Packet packet;
+    std::string key;
+    RateLimit limit;
+  };
+
+  Bucket &refill(PacketType type, const RateLimit &limit, Clock::time_point now);
+
+  // A handful of limited types: a linear scan beats hashing
+  std::vector<Bucket> m_buckets;
+  std::vector<Deferred> m_deferred;
+  uint64_t m_throttled = 0;
+  bool m_startedThrottling = false;
+};
+
+} // namespace wizz
@@ -0,0 +1,92 @@
+#include "ResumeRegistry.h"
+#include <algorithm>
+#include <openssl/rand.h>
+#include <stdexcept>
+
+namespace wizz {
+
+namespace {
+
+const size_t TOKEN_BYTES = 16; // 128 bits
+
+std::string randomToken() {
+  unsigned char bytes[TOKEN_BYTES];
+  if (RAND_bytes(bytes, TOKEN_BYTES) != 1)
+    throw std::runtime_error("RAND_bytes failed");
+  static const char digits[] = "0123456789abcdef";
+  std::string token;
+  token.reserve(TOKEN_BYTES * 2);
+  for (unsigned char byte : bytes) {
+    token += digits[byte >> 4];
+    token += digits[byte & 0x0F];
+  }
+  return token;
+}
+
+} // namespace
+
+bool ResumeRegistry::sawOnline(const Parked &parked, UserId id, int sessionId) {
+  auto it = std::lower_bound(parked.contacts.begin(), parked.contacts.end(), id,
+                             [](const SeenContact &contact, UserId value) { return contact.id < value; });
+  return it != parked.contacts.end() && it->id == id && it->sessionId == sessionId;
+}
+
+std::string ResumeRegistry::issue(UserId user) {
+  revoke(user);
+  std::string token = randomToken();
+  m_users[token] = user;
+  m_tokens[user] = token;
+  return token;
+}
+
+UserId ResumeRegistry::find(const std::string &token) const {
+  auto it = m_users.find(token);
+  return it != m_users.end() ? it->second : INVALID_USER;
+}
+
+void ResumeRegistry::park(Parked parked, Clock::time_point now) {
+  parked.expires = now + m_grace;
+  UserId user = parked.user;
+  m_parked[user] = std::move(parked);
+}
+
+const ResumeRegistry::Parked *ResumeRegistry::parked(UserId user) const {
+  auto it = m_parked.find(user);
+  return it != m_parked.end() ? &it->second : nullptr;
+}
+
+ResumeRegistry::Parked ResumeRegistry::take(UserId user) {
+  auto it = m_parked.find(user);
+  Parked parked = std::move(it->second);
+  m_parked.erase(it);
+  return parked;
+}
+
+std::vector<ResumeRegistry::Parked> ResumeRegistry::expire(Clock::time_point now) {
+  std::vector<Parked> expired;
+  for (auto it = m_parked.begin(); it != m_parked.end();) {
+    if (it->second.expires > now) {
+      ++it;
+      continue;
+    }
+    auto token = m_tokens.find(it->first);
+    if (token != m_tokens.end()) {
+      m_users.erase(token->second);
+      m_tokens.erase(token);
+    }
+    expired.push_back(std::move(it->second));
+    it = m_parked.erase(it);
+  }
+  return expired;
+}
+
+void ResumeRegistry::revoke(UserId user) {
+  auto token = m_tokens.find(user);
+  if (token != m_tokens.end()) {
+    m_users.erase(token->second);
+    m_tokens.erase(token);
+  }
+  m_parked.erase(user);
+}
+
+} // namespace wizz
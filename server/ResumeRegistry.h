@@ -0,0 +1,73 @@
+#pragma once
+
+#include "UserDirectory.h"
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace wizz {
+
+// Resumable sessions. Every login is issued a token. When a connection
+// drops without a clean TLS shutdown the user is parked here for a grace
+// window instead of going offline, and a Resume presenting the token picks
+// the session up again: no credential check, no contact list, only what
+// changed meanwhile. Pure bookkeeping, only touched from the io thread.
+class ResumeRegistry {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  // Status of a contact whose last update never reached the client
+  static constexpr uint32_t NOT_SEEN = UINT32_MAX;
+
+  // What the client had been told about one contact when it dropped
+  struct SeenContact {
+    UserId id;
+    int sessionId; // The contact's session then; 0 if offline
+    uint32_t status;
+    std::string customStatus;
+  };
+
+  struct Parked {
+    UserId user = INVALID_USER;
+    uint32_t status = 0;
+    std::string customStatus;
+    std::vector<SeenContact> contacts; // Sorted by id
+    Clock::time_point expires;
+  };
+
+  // Whether contact `id`, now on session `sessionId`, was already there
+  // when `parked` dropped, and so never heard it go offline
+  static bool sawOnline(const Parked &parked, UserId id, int sessionId);
+
+  // A zero grace window turns resumption off
+  explicit ResumeRegistry(Clock::duration grace = std::chrono::seconds(30)) : m_grace(grace) {}
+  void setGrace(Clock::duration grace) { m_grace = grace; }
+  bool enabled() const { return m_grace > Clock::duration::zero(); }
+
+  // A fresh token for `user`. Its previous token and any parked state are
+  // dropped.
+  std::string issue(UserId user);
+  // Owner of `token`, INVALID_USER if it is not current
+  UserId find(const std::string &token) const;
+
+  void park(Parked parked, Clock::time_point now);
+  const Parked *parked(UserId user) const;
+  // Removes and returns the parked state of `user` (which must be parked)
+  Parked take(UserId user);
+
+  // Parked users whose window has passed, removed along with their tokens
+  std::vector<Parked> expire(Clock::time_point now);
+  bool empty() const { return m_parked.empty(); }
+
+private:
+  void revoke(UserId user);
+
+  Clock::duration m_grace;
+  std::unordered_map<std::string, UserId> m_users; // By token
+  std::unordered_map<UserId, std::string> m_tokens;
+  std::unordered_map<UserId, Parked> m_parked;
+};
+
+} // namespace wizz
@@ -11,9 +11,10 @@ void SessionManager::removeSession(int sessionId) {
   auto it = m_sessions.find(sessionId);
   if (it != m_sessions.end()) {
     // If this session was tied to a user, remove them from the phonebook too
-    auto username = it->second->getUsername();
-    if (!username.empty()) {
-        setUserOffline(username);
+    // Unless a newer login for the same user has replaced it
+    UserId id = it->second->getUserId();
+    if (id != INVALID_USER && getSession(id) == it->second.get()) {
+        setUserOffline(id);
     }
     m_sessions.erase(it);
   }
@@ -24,65 +25,166 @@ ClientSession* SessionManager::getSessionById(int sessionId) const {
   return (it != m_sessions.end()) ? it->second.get() : nullptr;
 }
 
-void SessionManager::setUserOnline(const std::string& username, ClientSession* session, const std::string& customStatus) {
-  m_onlineUsers[username] = session;
-  m_userStatuses[username] = 0; // Default to Online
-  m_customStatuses[username] = customStatus;
+std::vector<UserId> SessionManager::internAll(const std::vector<std::string>& usernames) {
+  std::vector<UserId> ids;
+  ids.reserve(usernames.size());
+  for (const auto& name : usernames) ids.push_back(m_users.intern(name));
+  return ids;
+}
+
+std::vector<UserId> SessionManager::internUsers(const std::vector<std::string>& usernames) {
+  std::vector<UserId> ids = internAll(usernames);
+  growTables();
+  return ids;
+}
+
+// Newly interned names (the user or its contacts) get an offline row
+void SessionManager::growTables() {
+  if (m_userSessions.size() >= m_users.size()) return;
+  m_userSessions.resize(m_users.size(), nullptr);
+  m_userStatuses.resize(m_users.size(), 3);
+  m_customStatuses.resize(m_users.size());
+  m_remotePeers.resize(m_users.size());
+}
+
+UserId SessionManager::setUserOnline(const std::string& username, ClientSession* session, const std::string& customStatus,
+                                     const std::vector<std::string>& contacts) {
+  UserId id = m_users.intern(username);
+  std::vector<UserId> contactIds = internAll(contacts);
+
+  growTables();
+  m_remotePeers[id].reset(); // Moved here from another node
+  m_userSessions[id] = session;
+  m_userStatuses[id] = 0; // Default to Online
+  m_customStatuses[id] = customStatus;
+  m_subscribers.add(id, std::move(contactIds));
+  return id;
 }
 
 void SessionManager::setUserOffline(const std::string& username) {
-  m_onlineUsers.erase(username);
-  m_userStatuses.erase(username);
-  m_customStatuses.erase(username);
+  UserId id = m_users.find(username);
+  if (id != INVALID_USER) setUserOffline(id);
+}
+
+void SessionManager::setUserOffline(UserId id) {
+  if (!online(id)) return;
+  m_userSessions[id] = nullptr;
+  m_userStatuses[id] = 3;
+  m_customStatuses[id].clear();
+  m_customStatuses[id].shrink_to_fit();
+  m_subscribers.remove(id);
 }
 
-ClientSession* SessionManager::getSessionByUsername(const std::string& username) const {
-  auto it = m_onlineUsers.find(username);
-  return (it != m_onlineUsers.end()) ? it->second : nullptr;
+Peer* SessionManager::getSessionByUsername(const std::string& username) const {
+  return getPeer(m_users.find(username));
+}
+
+Peer* SessionManager::getPeer(UserId id) const {
+  if (online(id)) return m_userSessions[id];
+  return isRemote(id) ? m_remotePeers[id].get() : nullptr;
+}
+
+ClientSession* SessionManager::getSession(UserId id) const {
+  return online(id) ? m_userSessions[id] : nullptr;
 }
 
 bool SessionManager::isUserOnline(const std::string& username) const {
-  return m_onlineUsers.find(username) != m_onlineUsers.end();
+  return present(m_users.find(username));
+}
+
+void SessionManager::setUserRemote(const std::string& username, std::unique_ptr<Peer> forwarder, int status,
+                                   const std::string& customStatus) {
+  UserId id = m_users.intern(username);
+  growTables();
+  if (online(id)) return; // A stale report: the user is connected here
+  m_remotePeers[id] = std::move(forwarder);
+  m_userStatuses[id] = static_cast<uint8_t>(status);
+  m_customStatuses[id] = customStatus;
+}
+
+void SessionManager::setRemoteOffline(UserId id) {
+  if (!isRemote(id)) return;
+  m_remotePeers[id].reset();
+  m_userStatuses[id] = 3;
+  m_customStatuses[id].clear();
+  m_customStatuses[id].shrink_to_fit();
 }
 
 void SessionManager::updateStatus(const std::string& username, int status) {
-  if (isUserOnline(username)) {
-    m_userStatuses[username] = status;
+  UserId id = m_users.find(username);
+  if (online(id)) {
+    m_userStatuses[id] = static_cast<uint8_t>(status);
   }
 }
 
 int SessionManager::getStatus(const std::string& username) const {
-  auto it = m_userStatuses.find(username);
-  return (it != m_userStatuses.end()) ? it->second : 3; // 3 = Offline
+  return getStatus(m_users.find(username));
+}
+
+int SessionManager::getStatus(UserId id) const {
+  return present(id) ? m_userStatuses[id] : 3; // 3 = Offline
 }
 
 void SessionManager::updateCustomStatus(const std::string& username, const std::string& customStatus) {
-  if (isUserOnline(username)) {
-    m_customStatuses[username] = customStatus;
+  UserId id = m_users.find(username);
+  if (online(id)) {
+    m_customStatuses[id] = customStatus;
   }
 }
 
 std::string SessionManager::getCustomStatus(const std::string& username) const {
-  auto it = m_customStatuses.find(username);
-  return (it != m_customStatuses.end()) ? it->second : "";
+  return getCustomStatus(m_users.find(username));
 }
 
-std::vector<ClientSession*> SessionManager::getAllOnlineSessions() const {
+const std::string& SessionManager::getCustomStatus(UserId id) const {
+  static const std::string none;
+  return present(id) ? m_customStatuses[id] : none;
+}
+
+void SessionManager::updateContacts(UserId id, const std::vector<std::string>& contacts) {
+  std::vector<UserId> contactIds = internAll(contacts);
+  growTables();
+  m_subscribers.update(id, std::move(contactIds));
+}
+
+std::vector<ClientSession*> SessionManager::getSubscribers(UserId id) const {
   std::vector<ClientSession*> sessions;
-  sessions.reserve(m_onlineUsers.size());
-  for (const auto& [name, session] : m_onlineUsers) {
-    sessions.push_back(session);
+  if (id == INVALID_USER) return sessions;
+  const auto& subscribers = m_subscribers.subscribersOf(id);
+  sessions.reserve(subscribers.size());
+  for (UserId subscriber : subscribers) {
+    sessions.push_back(m_userSessions[subscriber]);
   }
   return sessions;
 }
 
-std::vector<std::string> SessionManager::getAllOnlineUsernames() const {
-  std::vector<std::string> names;
-  names.reserve(m_onlineUsers.size());
-  for (const auto& [name, session] : m_onlineUsers) {
-    names.push_back(name);
+std::vector<ClientSession*> SessionManager::getSubscribers(const std::string& username) const {
+  return getSubscribers(m_users.find(username));
+}
+
+std::vector<UserId> SessionManager::getOnlineContacts(UserId id) const {
+  std::vector<UserId> contacts;
+  if (id == INVALID_USER) return contacts;
+  contacts = m_subscribers.subscribersOf(id); // Online here, see SubscriberIndex
+  for (UserId contact : m_subscribers.contactsOf(id)) {
+    if (isRemote(contact)) contacts.push_back(contact);
+  }
+  return contacts;
+}
+
+std::vector<ClientSession*> SessionManager::getAllOnlineSessions() const {
+  std::vector<ClientSession*> sessions;
+  for (ClientSession* session : m_userSessions) {
+    if (session) sessions.push_back(session);
   }
-  return names;
+  return sessions;
+}
+
+std::vector<ClientSession*> SessionManager::getAllSessions() const {
+  std::vector<ClientSession*> sessions;
+  sessions.reserve(m_sessions.size());
+  for (const auto& [id, session] : m_sessions) sessions.push_back(session.get());
+  return sessions;
 }
 
 } // namespace wizz
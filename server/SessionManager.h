@@ -1,5 +1,8 @@
 #pragma once
 
+#include "Peer.h"
+#include "SubscriberIndex.h"
+#include "UserDirectory.h"
 #include <memory>
 #include <string>
 #include <unordered_map>
@@ -19,31 +22,70 @@ public:
   void removeSession(int sessionId);
   ClientSession* getSessionById(int sessionId) const;
 
+  // Usernames are interned to dense IDs; lookups by name hash once
+  UserId getUserId(const std::string& username) const { return m_users.find(username); }
+  const std::string& getUsername(UserId id) const { return m_users.name(id); }
+  // For users referenced before they log in (e.g. group members)
+  std::vector<UserId> internUsers(const std::vector<std::string>& usernames);
+
   // Online User Tracking (The "Phonebook")
-  void setUserOnline(const std::string& username, ClientSession* session, const std::string& customStatus);
+  UserId setUserOnline(const std::string& username, ClientSession* session, const std::string& customStatus,
+                       const std::vector<std::string>& contacts);
   void setUserOffline(const std::string& username);
-  ClientSession* getSessionByUsername(const std::string& username) const;
+  void setUserOffline(UserId id);
+  // The user's session here or, in cluster mode, the forwarder to its node
+  Peer* getSessionByUsername(const std::string& username) const;
+  Peer* getPeer(UserId id) const;
+  // Only sessions connected to this server
+  ClientSession* getSession(UserId id) const;
   bool isUserOnline(const std::string& username) const;
 
+  // Cluster mode: users online on other nodes, as the link reports them.
+  // Their status counts as online here; `forwarder` reaches them.
+  void setUserRemote(const std::string& username, std::unique_ptr<Peer> forwarder, int status,
+                     const std::string& customStatus);
+  void setRemoteOffline(UserId id);
+  bool isRemote(UserId id) const { return id < m_remotePeers.size() && m_remotePeers[id]; }
+
   // Status Management (0=Online, 1=Away, 2=Busy, 3=Offline)
   void updateStatus(const std::string& username, int status);
   int getStatus(const std::string& username) const;
+  int getStatus(UserId id) const;
 
   void updateCustomStatus(const std::string& username, const std::string& customStatus);
   std::string getCustomStatus(const std::string& username) const;
+  const std::string& getCustomStatus(UserId id) const;
+
+  // Contacts (cached at login) and the online sessions watching a user's presence
+  const std::vector<UserId>& getContacts(UserId id) const { return m_subscribers.contactsOf(id); }
+  void updateContacts(UserId id, const std::vector<std::string>& contacts);
+  std::vector<ClientSession*> getSubscribers(UserId id) const;
+  std::vector<ClientSession*> getSubscribers(const std::string& username) const;
+  // Contacts online here or on another node
+  std::vector<UserId> getOnlineContacts(UserId id) const;
 
   // Utilities for broadcasting
   std::vector<ClientSession*> getAllOnlineSessions() const;
-  std::vector<std::string> getAllOnlineUsernames() const;
+  // Every connection, logged in or not
+  std::vector<ClientSession*> getAllSessions() const;
+  size_t sessionCount() const { return m_sessions.size(); }
 
 private:
+  std::vector<UserId> internAll(const std::vector<std::string>& usernames);
+  void growTables();
+  bool online(UserId id) const { return id < m_userSessions.size() && m_userSessions[id]; }
+  bool present(UserId id) const { return online(id) || isRemote(id); }
+
   // Prevents shared_ptr lifecycle drops during async I/O
   std::unordered_map<int, std::shared_ptr<ClientSession>> m_sessions;
   
-  // Active user mapping
-  std::unordered_map<std::string, ClientSession*> m_onlineUsers;
-  std::unordered_map<std::string, int> m_userStatuses;
-  std::unordered_map<std::string, std::string> m_customStatuses;
+  // Active user mapping: presence as a struct of arrays indexed by UserId
+  UserDirectory m_users;
+  std::vector<ClientSession*> m_userSessions; // nullptr = offline
+  std::vector<uint8_t> m_userStatuses;
+  std::vector<std::string> m_customStatuses;
+  std::vector<std::unique_ptr<Peer>> m_remotePeers; // nullptr = not on another node
+  SubscriberIndex m_subscribers;
 };
 
 } // namespace wizz
@@ -0,0 +1,101 @@
+#include "SubscriberIndex.h"
+#include <algorithm>
+#include <iterator>
+
+namespace wizz {
+
+namespace {
+const std::vector<UserId> NONE;
+}
+
+bool SubscriberIndex::insertSorted(std::vector<UserId> &ids, UserId id) {
+  auto it = std::lower_bound(ids.begin(), ids.end(), id);
+  if (it != ids.end() && *it == id) return false;
+  ids.insert(it, id);
+  return true;
+}
+
+bool SubscriberIndex::eraseSorted(std::vector<UserId> &ids, UserId id) {
+  auto it = std::lower_bound(ids.begin(), ids.end(), id);
+  if (it == ids.end() || *it != id) return false;
+  ids.erase(it);
+  return true;
+}
+
+void SubscriberIndex::grow(UserId user) {
+  if (user < m_online.size()) return;
+  m_online.resize(user + 1, 0);
+  m_contacts.resize(user + 1);
+  m_subscribers.resize(user + 1);
+}
+
+void SubscriberIndex::link(UserId contact, UserId subscriber) {
+  grow(contact);
+  insertSorted(m_subscribers[contact], subscriber);
+}
+
+void SubscriberIndex::unlink(UserId contact, UserId subscriber) {
+  eraseSorted(m_subscribers[contact], subscriber);
+}
+
+void SubscriberIndex::add(UserId user, std::vector<UserId> contacts) {
+  remove(user); // Re-login replaces the previous session
+  grow(user);
+  std::sort(contacts.begin(), contacts.end());
+  contacts.erase(std::unique(contacts.begin(), contacts.end()), contacts.end());
+  eraseSorted(contacts, user);
+
+  for (UserId contact : contacts) {
+    link(contact, user);
+    // Heals a contact whose set was loaded before the relation existed
+    if (isOnline(contact) && insertSorted(m_contacts[contact], user))
+      link(user, contact);
+  }
+  m_online[user] = 1;
+  m_contacts[user] = std::move(contacts);
+}
+
+void SubscriberIndex::remove(UserId user) {
+  if (!isOnline(user)) return;
+  for (UserId contact : m_contacts[user])
+    unlink(contact, user);
+  m_contacts[user].clear();
+  m_contacts[user].shrink_to_fit();
+  m_online[user] = 0;
+}
+
+void SubscriberIndex::update(UserId user, std::vector<UserId> contacts) {
+  if (!isOnline(user)) return;
+  std::sort(contacts.begin(), contacts.end());
+  contacts.erase(std::unique(contacts.begin(), contacts.end()), contacts.end());
+  eraseSorted(contacts, user);
+
+  const std::vector<UserId> &current = m_contacts[user];
+  std::vector<UserId> dropped, added;
+  std::set_difference(current.begin(), current.end(), contacts.begin(), contacts.end(),
+                      std::back_inserter(dropped));
+  std::set_difference(contacts.begin(), contacts.end(), current.begin(), current.end(),
+                      std::back_inserter(added));
+
+  for (UserId contact : dropped) {
+    unlink(contact, user);
+    if (isOnline(contact) && eraseSorted(m_contacts[contact], user))
+      unlink(user, contact);
+  }
+  for (UserId contact : added) {
+    link(contact, user);
+    if (isOnline(contact) && insertSorted(m_contacts[contact], user))
+      link(user, contact);
+  }
+  m_contacts[user] = std::move(contacts);
+}
+
+const std::vector<UserId> &SubscriberIndex::subscribersOf(UserId user) const {
+  return user < m_subscribers.size() ? m_subscribers[user] : NONE;
+}
+
+const std::vector<UserId> &SubscriberIndex::contactsOf(UserId user) const {
+  return user < m_contacts.size() ? m_contacts[user] : NONE;
+}
+
+} // namespace wizz
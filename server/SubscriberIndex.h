@@ -0,0 +1,43 @@
+#pragma once
+
+#include "UserDirectory.h"
+#include <vector>
+
+namespace wizz {
+
+// Who is interested in whose presence. For every online user it keeps the
+// contact set loaded at login and, in reverse, the online users subscribed
+// to each user. Contact relations are symmetric (a follower of X is someone
+// X appears in the friend list of), so a user's online subscribers are also
+// exactly its online contacts. Login, logout and presence fan-out cost
+// O(contacts), independent of how many users are online.
+//
+// Both directions are sorted UserId vectors indexed by UserId.
+class SubscriberIndex {
+public:
+  // Registers an online user; its online contacts are linked both ways
+  void add(UserId user, std::vector<UserId> contacts);
+  void remove(UserId user);
+
+  // Replaces an online user's contacts (after add/remove contact) and
+  // updates the reverse links of the online contacts that changed.
+  void update(UserId user, std::vector<UserId> contacts);
+
+  bool isOnline(UserId user) const { return user < m_online.size() && m_online[user]; }
+  // Online users that should hear about `user`
+  const std::vector<UserId> &subscribersOf(UserId user) const;
+  const std::vector<UserId> &contactsOf(UserId user) const;
+
+private:
+  void grow(UserId user);
+  void link(UserId contact, UserId subscriber);
+  void unlink(UserId contact, UserId subscriber);
+  static bool insertSorted(std::vector<UserId> &ids, UserId id);
+  static bool eraseSorted(std::vector<UserId> &ids, UserId id);
+
+  std::vector<uint8_t> m_online;
+  std::vector<std::vector<UserId>> m_contacts;    // Empty while offline
+  std::vector<std::vector<UserId>> m_subscribers; // Online or not
+};
+
+} // namespace wizz
@@ -2,25 +2,47 @@
 #include "handlers/AuthHandlers.h"
 #include "handlers/SocialHandlers.h"
 #include "handlers/GameHandlers.h"
+#include "handlers/GroupHandlers.h"
+#include "Handoff.h"
+#include "Logger.h"
+#include <algorithm>
+#include <cerrno>
 #include <cstring>
-#include <iostream>
 #include <stdexcept>
 
 #include <ctime>
 #include <filesystem>
 #include <fstream>
+#include <random>
 #include <sstream>
+#include <unordered_set>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 namespace wizz {
 
 namespace fs = std::filesystem;
 
+// How long a client waits before resending after its messages could not be
+// stored; a failing disk is given a moment
+static const uint32_t COMMIT_RETRY_DELAY_MS = 2000;
+
 TcpServer::TcpServer(int port)
     : m_ioContext(),
       m_sslContext(asio::ssl::context::tlsv12),
-      m_acceptor(m_ioContext, asio::ip::tcp::endpoint(asio::ip::tcp::v4(), port)),
+      m_acceptor(m_ioContext),
       m_port(port),
-      m_isRunning(false), m_db("wizzmania.db") {
+      m_isRunning(false), m_metrics(m_metricsRegistry),
+      m_metricsTimer(m_ioContext), m_drainTimer(m_ioContext),
+#ifndef _WIN32
+      m_handoffAcceptor(m_ioContext),
+#endif
+      m_db("wizzmania.db"),
+      m_packetRouter(m_metricsRegistry), m_resumeTimer(m_ioContext),
+      m_compactTimer(m_ioContext) {
   m_sslContext.set_options(asio::ssl::context::default_workarounds |
                            asio::ssl::context::no_sslv2 |
                            asio::ssl::context::single_dh_use);
@@ -28,22 +50,67 @@ TcpServer::TcpServer(int port)
   m_sslContext.use_private_key_file("server/certs/server.key",
                                     asio::ssl::context::pem);
 
-  m_packetRouter.registerHandler(PacketType::Login, std::make_unique<LoginHandler>());
-  m_packetRouter.registerHandler(PacketType::Register, std::make_unique<RegisterHandler>());
-  m_packetRouter.registerHandler(PacketType::DirectMessage, std::make_unique<MessageHandler>());
-  m_packetRouter.registerHandler(PacketType::Nudge, std::make_unique<NudgeHandler>());
-  m_packetRouter.registerHandler(PacketType::VoiceMessage, std::make_unique<VoiceMessageHandler>());
-  m_packetRouter.registerHandler(PacketType::TypingIndicator, std::make_unique<TypingIndicatorHandler>());
-  m_packetRouter.registerHandler(PacketType::ContactStatusChange, std::make_unique<StatusChangeHandler>());
-  m_packetRouter.registerHandler(PacketType::UpdateStatus, std::make_unique<UpdateStatusHandler>());
-  m_packetRouter.registerHandler(PacketType::UpdateAvatar, std::make_unique<UpdateAvatarHandler>());
-  m_packetRouter.registerHandler(PacketType::GetAvatar, std::make_unique<GetAvatarHandler>());
-  m_packetRouter.registerHandler(PacketType::AddContact, std::make_unique<AddContactHandler>());
-  m_packetRouter.registerHandler(PacketType::RemoveContact, std::make_unique<RemoveContactHandler>());
-  m_packetRouter.registerHandler(PacketType::GameStatus, std::make_unique<GameStatusHandler>());
-  m_packetRouter.registerHandler(PacketType::GameInvite, std::make_unique<GameInviteHandler>());
-  m_packetRouter.registerHandler(PacketType::GameInviteResponse, std::make_unique<GameInviteResponseHandler>());
-  m_packetRouter.registerHandler(PacketType::GameMove, std::make_unique<GameMoveHandler>());
+  m_db.setMetrics(&m_metrics);
+
+  // Acknowledge each sender once per committed batch, up to its highest
+  // sequence number in it. When a batch could not be stored, its senders
+  // are sent away to reconnect, which replays what was not acknowledged.
+  m_db.setCommitHandler([this](std::vector<DatabaseManager::QueuedMessage> &&batch, bool committed) {
+    auto acks = DatabaseManager::acknowledgments(batch);
+    if (committed) {
+      std::unordered_set<std::string> recipients;
+      for (const auto &msg : batch) {
+        if (!msg.isDelivered) recipients.insert(msg.recipient);
+      }
+      if (acks.empty() && recipients.empty()) return;
+      postResponse([this, acks = std::move(acks), recipients = std::move(recipients)]() {
+        for (const auto &[sessionId, seq] : acks) {
+          if (ClientSession *s = getSession(sessionId)) s->acknowledgeMessages(seq);
+        }
+        for (const std::string &recipient : recipients) notifyPending(recipient);
+      });
+      return;
+    }
+    if (acks.empty()) return;
+    postResponse([this, acks = std::move(acks)]() {
+      std::vector<int> failed;
+      for (const auto &[sessionId, seq] : acks) {
+        failed.push_back(sessionId);
+        ClientSession *s = getSession(sessionId);
+        if (!s) continue;
+        Packet err(PacketType::Error);
+        err.writeString("Messages could not be saved, reconnecting");
+        s->sendPacket(err);
+        s->drain(COMMIT_RETRY_DELAY_MS); // Takes nothing more from it
+      }
+      // Everything those sessions sent is in the DB queue by now
+      m_db.postTask([this, failed]() { m_db.forgetFailedSessions(failed); });
+    });
+  });
+
+  m_packetRouter.registerHandler<PacketType::Hello, HelloHandler>();
+  m_packetRouter.registerHandler<PacketType::Login, LoginHandler>();
+  m_packetRouter.registerHandler<PacketType::Register, RegisterHandler>();
+  m_packetRouter.registerHandler<PacketType::Resume, ResumeHandler>();
+  m_packetRouter.registerHandler<PacketType::DirectMessage, MessageHandler>();
+  m_packetRouter.registerHandler<PacketType::Nudge, NudgeHandler>();
+  m_packetRouter.registerHandler<PacketType::VoiceMessage, VoiceMessageHandler>();
+  m_packetRouter.registerHandler<PacketType::TypingIndicator, TypingIndicatorHandler>();
+  m_packetRouter.registerHandler<PacketType::ContactStatusChange, StatusChangeHandler>();
+  m_packetRouter.registerHandler<PacketType::UpdateStatus, UpdateStatusHandler>();
+  m_packetRouter.registerHandler<PacketType::UpdateAvatar, UpdateAvatarHandler>();
+  m_packetRouter.registerHandler<PacketType::GetAvatar, GetAvatarHandler>();
+  m_packetRouter.registerHandler<PacketType::GetAvatarIfChanged, GetAvatarIfChangedHandler>();
+  m_packetRouter.registerHandler<PacketType::AddContact, AddContactHandler>();
+  m_packetRouter.registerHandler<PacketType::RemoveContact, RemoveContactHandler>();
+  m_packetRouter.registerHandler<PacketType::GameStatus, GameStatusHandler>();
+  m_packetRouter.registerHandler<PacketType::GameInvite, GameInviteHandler>();
+  m_packetRouter.registerHandler<PacketType::GameInviteResponse, GameInviteResponseHandler>();
+  m_packetRouter.registerHandler<PacketType::GameMove, GameMoveHandler>();
+  m_packetRouter.registerHandler<PacketType::GroupCreate, GroupCreateHandler>();
+  m_packetRouter.registerHandler<PacketType::GroupMessage, GroupMessageHandler>();
+  m_packetRouter.registerHandler<PacketType::GroupLeave, GroupLeaveHandler>();
+  m_packetRouter.registerHandler<PacketType::GroupAddMember, GroupAddMemberHandler>();
 }
 
 TcpServer::~TcpServer() { stop(); }
@@ -55,15 +122,21 @@ void TcpServer::start() {
     }
 
     setupVoiceStorage();
+    loadGroups();
 
-    std::cout << "[Server] Listening on port " << m_port << std::endl;
+    openListener();
+    LOG_INFO("[Server] Listening on port {}", m_acceptor.local_endpoint().port());
     m_isRunning = true;
 
     doAccept();
+    listenForHandoff();
+    if (m_cluster) m_cluster->start();
+    scheduleMetricsExport();
+    scheduleOfflineCompaction();
 
     run();
   } catch (const std::exception &e) {
-    std::cerr << "[Server] Fatal Error: " << e.what() << std::endl;
+    LOG_ERROR("[Server] Fatal Error: {}", e.what());
     stop();
     throw;
   }
@@ -72,20 +145,33 @@ void TcpServer::start() {
 void TcpServer::stop() {
   m_isRunning = false;
   m_ioContext.stop();
-  std::cout << "[Server] Stopped." << std::endl;
+  LOG_INFO("[Server] Stopped.");
 }
 
 ClientSession *TcpServer::getSession(int sessionId) {
   return m_sessionManager.getSessionById(sessionId);
 }
 
+void TcpServer::openListener() {
+  asio::ip::tcp::endpoint endpoint(asio::ip::tcp::v4(), m_port);
+  int inherited = m_handoffPath.empty() ? -1 : handoff::receiveListener(m_handoffPath);
+  if (inherited >= 0) {
+    m_acceptor.assign(endpoint.protocol(), inherited);
+    LOG_INFO("[Server] Took the listener over from the running server");
+    return;
+  }
+  m_acceptor.open(endpoint.protocol());
+  m_acceptor.set_option(asio::ip::tcp::acceptor::reuse_address(true));
+  m_acceptor.bind(endpoint);
+  m_acceptor.listen();
+}
+
 void TcpServer::doAccept() {
   m_acceptor.async_accept([this](asio::error_code ec,
                                  asio::ip::tcp::socket socket) {
     if (!ec) {
       int sessionId = m_nextSessionId++;
-      std::cout << "[Server] New Connection (Session ID: " << sessionId << ")"
-                << std::endl;
+      LOG_INFO("[Server] New Connection (Session ID: {})", sessionId);
 
       auto session = std::make_shared<ClientSession>(
           sessionId, std::move(socket), m_sslContext, this);
@@ -94,13 +180,14 @@ void TcpServer::doAccept() {
       session->start();
 
       doAccept();
-    } else {
-      std::cerr << "[Server] Accept Error: " << ec.message() << std::endl;
+    } else if (ec != asio::error::operation_aborted) { // Handed off
+      LOG_ERROR("[Server] Accept Error: {}", ec.message());
     }
   });
 }
 
 void TcpServer::run() {
+  Tracer::instance().nameThread("io");
   m_ioContext.run();
 }
 
@@ -114,42 +201,222 @@ void TcpServer::setupVoiceStorage() {
   }
 }
 
-void TcpServer::handleDisconnect(int sessionId) {
+void TcpServer::scheduleMetricsExport() {
+  if (m_metricsPath.empty() && m_tracePath.empty()) return;
+  m_metricsTimer.expires_after(m_metricsInterval);
+  m_metricsTimer.async_wait([this](const asio::error_code &ec) {
+    if (ec) return;
+    if (!m_metricsPath.empty() && !m_metricsRegistry.writeTextFile(m_metricsPath)) {
+      LOG_ERROR("[Server] Could not write metrics to {}", m_metricsPath);
+    }
+    if (!m_tracePath.empty() && !Tracer::instance().writeFile(m_tracePath)) {
+      LOG_ERROR("[Server] Could not write traces to {}", m_tracePath);
+    }
+    scheduleMetricsExport();
+  });
+}
+
+// Delivered messages leave dead records in the offline log; the DB thread
+// rewrites the shards where they dominate
+void TcpServer::scheduleOfflineCompaction() {
+  m_compactTimer.expires_after(std::chrono::minutes(1));
+  m_compactTimer.async_wait([this](const asio::error_code &ec) {
+    if (ec) return;
+    m_db.postTask([this] { m_db.compactOfflineLog(); });
+    scheduleOfflineCompaction();
+  });
+}
+
+// Before the accept loop starts, so the DB is still ours to query directly
+void TcpServer::loadGroups() {
+  for (auto &group : m_db.loadGroups()) {
+    m_groupManager.addGroup(group.id, std::move(group.name),
+                            m_sessionManager.internUsers(group.members));
+  }
+  LOG_INFO("[Server] Loaded {} groups", m_groupManager.size());
+}
+
+void TcpServer::handleDisconnect(int sessionId, bool clean) {
   ClientSession* session = m_sessionManager.getSessionById(sessionId);
   if (!session) return;
 
   std::string username = session->getUsername();
+  UserId userId = session->getUserId();
+  // A session replaced by a newer login of the same user goes quietly
+  bool wasOnline = userId != INVALID_USER && m_sessionManager.getSession(userId) == session;
+  bool park = wasOnline && !clean && !m_draining && m_resume.enabled();
+  if (park) parkSession(session); // While its contacts are still cached
   m_sessionManager.removeSession(sessionId);
-  if (!username.empty()) {
-    m_sessionManager.setUserOffline(username);
-    m_sessionManager.updateStatus(username, 3);
-    std::cout << "[Server] User Offline: " << username << std::endl;
-    
-    m_db.postTask([this, username]() {
-      auto followers = m_db.getFollowers(username);
-      auto friends = m_db.getFriends(username);
-
-      postResponse([
-          this, username, followers = std::move(followers),
-          friends = std::move(friends)]() {
-
-        Packet notify(PacketType::ContactStatusChange);
-        notify.writeInt(3);
-        notify.writeString(username);
-        notify.writeString("");
-
-        std::set<std::string> contacts;
-        for (const auto &f : followers) contacts.insert(f);
-        for (const auto &f : friends)   contacts.insert(f);
-
-        for (const auto &contactName : contacts) {
-          ClientSession *target = m_sessionManager.getSessionByUsername(contactName);
-          if (target) {
-            target->sendPacket(notify);
-          }
-        }
-      });
+  if (m_draining) {
+    // Moving to the new server, not going offline
+    finishDrainIfDone();
+    return;
+  }
+  if (park) {
+    LOG_INFO("[Server] Holding {} for resumption", username);
+    return;
+  }
+  if (wasOnline) {
+    LOG_INFO("[Server] User Offline: {}", username);
+    for (ClientSession *target : m_sessionManager.getSubscribers(userId)) {
+      target->queueStatus(username, 3, ""); // Offline
+    }
+    publishPresence(username, 3, "");
+  }
+}
+
+void TcpServer::parkSession(ClientSession *session) {
+  UserId user = session->getUserId();
+  ResumeRegistry::Parked parked;
+  parked.user = user;
+  parked.status = static_cast<uint32_t>(m_sessionManager.getStatus(user));
+  parked.customStatus = m_sessionManager.getCustomStatus(user);
+  for (UserId contact : m_sessionManager.getContacts(user)) {
+    ClientSession *contactSession = m_sessionManager.getSession(contact);
+    bool seen = !session->hasPendingStatus(m_sessionManager.getUsername(contact));
+    parked.contacts.push_back({contact, contactSession ? contactSession->getId() : 0,
+                               seen ? static_cast<uint32_t>(m_sessionManager.getStatus(contact))
+                                    : ResumeRegistry::NOT_SEEN,
+                               m_sessionManager.getCustomStatus(contact)});
+  }
+  m_resume.park(std::move(parked), ResumeRegistry::Clock::now());
+  scheduleResumeSweep();
+}
+
+void TcpServer::notifyPending(const std::string &username) {
+  UserId id = m_sessionManager.getUserId(username);
+  if (m_sessionManager.getSession(id)) {
+    deliverPendingMessages(this, username);
+  } else if (m_cluster && m_sessionManager.isRemote(id)) {
+    m_cluster->notifyMail(username);
+  }
+}
+
+void TcpServer::scheduleResumeSweep() {
+  if (m_resumeSweepArmed) return;
+  m_resumeSweepArmed = true;
+  m_resumeTimer.expires_after(std::chrono::seconds(1));
+  m_resumeTimer.async_wait([this](const asio::error_code &ec) {
+    m_resumeSweepArmed = false;
+    if (ec) return;
+    for (const auto &parked : m_resume.expire(ResumeRegistry::Clock::now())) {
+      expireParked(parked);
+    }
+    if (!m_resume.empty()) scheduleResumeSweep();
+  });
+}
+
+// The offline notice handleDisconnect held back, for the contacts that
+// still think the user is online
+void TcpServer::expireParked(const ResumeRegistry::Parked &parked) {
+  if (m_sessionManager.getSession(parked.user)) return; // Logged in again
+  const std::string &username = m_sessionManager.getUsername(parked.user);
+  LOG_INFO("[Server] User Offline: {} (not resumed)", username);
+  publishPresence(username, 3, "");
+  for (ClientSession *target : m_sessionManager.getSubscribers(parked.user)) {
+    if (ResumeRegistry::sawOnline(parked, target->getUserId(), target->getId())) {
+      target->queueStatus(username, 3, ""); // Offline
+    }
+  }
+}
+
+void TcpServer::listenForHandoff() {
+#ifndef _WIN32
+  if (m_handoffPath.empty()) return;
+  ::unlink(m_handoffPath.c_str()); // Left by the server we took over from
+  asio::local::stream_protocol::endpoint endpoint(m_handoffPath);
+  m_handoffAcceptor.open(endpoint.protocol());
+  m_handoffAcceptor.bind(endpoint);
+  // Whoever connects gets the port: only our user may, before listen()
+  // lets anyone in
+  if (::chmod(m_handoffPath.c_str(), S_IRUSR | S_IWUSR) != 0) {
+    LOG_ERROR("[Server] Cannot restrict {}: {}; hot restart disabled", m_handoffPath, std::strerror(errno));
+    asio::error_code closeEc;
+    m_handoffAcceptor.close(closeEc);
+    ::unlink(m_handoffPath.c_str());
+    return;
+  }
+  m_handoffAcceptor.listen();
+  acceptHandoff();
+#endif
+}
+
+void TcpServer::acceptHandoff() {
+#ifndef _WIN32
+  m_handoffAcceptor.async_accept([this](asio::error_code ec,
+                                        asio::local::stream_protocol::socket successor) {
+    if (ec) return;
+    if (!handoff::sameUser(successor.native_handle())) {
+      LOG_WARN("[Server] Refused a handoff to a process of another user");
+      acceptHandoff();
+      return;
+    }
+    if (!handoff::sendListener(successor.native_handle(), m_acceptor.native_handle())) {
+      LOG_ERROR("[Server] Could not hand the listener off; still serving");
+      acceptHandoff();
+      return;
+    }
+    beginDrain();
+  });
+#endif
+}
+
+void TcpServer::beginDrain() {
+  asio::error_code ec;
+  m_acceptor.close(ec); // The successor accepts from now on
+#ifndef _WIN32
+  m_handoffAcceptor.close(ec); // The path is the successor's now
+#endif
+  m_draining = true;
+  // The successor links as this node; its users follow the sessions there
+  if (m_cluster) m_cluster->stop();
+
+  // Random delays across a window sized for m_reconnectRate, so the
+  // successor is not hit by every handshake and login at once
+  std::vector<ClientSession *> sessions = m_sessionManager.getAllSessions();
+  uint32_t window = std::max<uint32_t>(
+      1000, static_cast<uint32_t>(sessions.size() * 1000 / m_reconnectRate));
+  std::mt19937 random(std::random_device{}());
+  std::uniform_int_distribution<uint32_t> delay(0, window);
+  for (ClientSession *session : sessions) {
+    session->drain(delay(random));
+  }
+  LOG_INFO("[Server] Handed off; {} sessions reconnect within {} ms", sessions.size(), window);
+
+  // Clients that ignore the hint are dropped once everyone else is gone
+  m_drainTimer.expires_after(std::chrono::milliseconds(window) + std::chrono::seconds(10));
+  m_drainTimer.async_wait([this](const asio::error_code &ec) {
+    if (ec) return;
+    LOG_WARN("[Server] {} sessions still open after the reconnect window", m_sessionManager.sessionCount());
+    stop();
+  });
+
+  drainDatabase();
+}
+
+// The DB queue is FIFO: when a marker task runs, everything queued before it
+// has run, and their responses are ahead of the marker's on the io thread.
+// Those may queue follow-up tasks, so repeat until no task was picked up
+// after the marker.
+void TcpServer::drainDatabase() {
+  m_db.postTask([this] {
+    uint64_t marker = m_db.tasksStarted();
+    postResponse([this, marker] {
+      if (m_db.queuedTasks() > 0 || m_db.tasksStarted() != marker) {
+        drainDatabase();
+        return;
+      }
+      LOG_INFO("[Server] Database work drained");
+      m_dbDrained = true;
+      finishDrainIfDone();
     });
+  });
+}
+
+void TcpServer::finishDrainIfDone() {
+  if (m_dbDrained && m_sessionManager.sessionCount() == 0) {
+    LOG_INFO("[Server] All sessions moved; exiting");
+    stop();
   }
 }
 
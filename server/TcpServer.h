@@ -1,5 +1,7 @@
 #pragma once
 
+#include <algorithm>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <set>
@@ -10,11 +12,17 @@
 #include <asio/ssl.hpp>
 
 #include "../common/Types.h"
+#include "AvatarCache.h"
 #include "ClientSession.h"
+#include "ClusterLink.h"
 #include "handlers/PacketRouter.h"
 #include "DatabaseManager.h"
 #include "SessionManager.h"
 #include "GameRoomManager.h"
+#include "GroupManager.h"
+#include "Metrics.h"
+#include "ResumeRegistry.h"
+#include "Tracer.h"
 
 namespace wizz {
 
@@ -33,18 +41,84 @@ public:
   void stop();
 
   // Thread-safe Response Queue for passing work from DB Thread back to Main Thread
+  // Carries the poster's trace (if any) over to the io thread
   template <typename F> void postResponse(F &&responseTask) {
-    asio::post(m_ioContext, std::forward<F>(responseTask));
+    uint64_t trace = Tracer::current();
+    if (!trace) {
+      asio::post(m_ioContext, std::forward<F>(responseTask));
+      return;
+    }
+    auto queued = Tracer::Clock::now();
+    asio::post(m_ioContext, [trace, queued, task = std::forward<F>(responseTask)]() mutable {
+      Tracer::instance().record("io.queue", trace, queued, Tracer::Clock::now());
+      TraceScope scope(trace);
+      TraceSpan span("response");
+      task();
+    });
   }
 
   // Safe lookup for async callbacks using Session ID
   ClientSession *getSession(int sessionId);
-  void handleDisconnect(int sessionId);
+  // `clean`: the client shut TLS down itself, so it is not coming back
+  void handleDisconnect(int sessionId, bool clean = false);
+  // Records what `session`'s client knows, so a Resume can send only what
+  // changed. Its user stays online to contacts until the grace window ends.
+  void parkSession(ClientSession *session);
 
   DatabaseManager &getDb() { return m_db; }
   SessionManager &getSessionManager() { return m_sessionManager; }
   GameRoomManager &getGameRoomManager() { return m_gameRoomManager; }
+  GroupManager &getGroupManager() { return m_groupManager; }
   PacketRouter &getPacketRouter() { return m_packetRouter; }
+  AvatarCache &getAvatarCache() { return m_avatarCache; }
+  ResumeRegistry &getResumeRegistry() { return m_resume; }
+  ServerMetrics &getMetrics() { return m_metrics; }
+  MetricsRegistry &getMetricsRegistry() { return m_metricsRegistry; }
+
+  // Prometheus text file, rewritten every `interval` while running
+  void setMetricsFile(const std::string &path, std::chrono::seconds interval) {
+    m_metricsPath = path;
+    m_metricsInterval = interval;
+  }
+  // Chrome trace JSON of the sampled traces, written with the metrics (one
+  // interval for both)
+  void setTraceFile(const std::string &path, std::chrono::seconds interval) {
+    m_tracePath = path;
+    m_metricsInterval = interval;
+  }
+
+  // Hot restart (Handoff.h). With a handoff path, start() takes the
+  // listener over from the server listening there, if any, then listens
+  // there itself for the next one. Once handed off, sessions are told to
+  // reconnect, spread so the successor sees about `perSecond` logins a
+  // second, and the process exits when they and the DB queue are done.
+  void setHandoffPath(const std::string &path) { m_handoffPath = path; }
+  void setReconnectRate(uint32_t perSecond) { m_reconnectRate = std::max(1u, perSecond); }
+
+  // How long a dropped session can be resumed (0 = always log in again)
+  void setResumeGrace(std::chrono::seconds grace) { m_resume.setGrace(grace); }
+
+  // Cluster mode (ClusterLink.h): this server is node `self` of `nodes`,
+  // linked through the broker at `broker`
+  void enableCluster(uint32_t self, std::vector<ClusterLink::Node> nodes, asio::ip::tcp::endpoint broker,
+                     std::string secret) {
+    m_cluster = std::make_unique<ClusterLink>(*this, m_ioContext, self, std::move(nodes), broker,
+                                              std::move(secret));
+  }
+  // nullptr unless in cluster mode
+  ClusterLink *getCluster() { return m_cluster.get(); }
+  // A local user's presence changed; tells the other nodes, if any
+  void publishPresence(const std::string &username, uint32_t status, const std::string &customStatus,
+                       uint32_t capabilities = 0) {
+    if (m_cluster) m_cluster->publishPresence(username, status, customStatus, capabilities);
+  }
+  // Direct messages for `username` were committed to the offline log: sent
+  // now if they are online after all, here or on another node. io thread.
+  void notifyPending(const std::string &username);
+
+  // Upper bound offered to clients during Hello negotiation
+  uint32_t getMaxFrameSize() const { return m_maxFrameSize; }
+  void setMaxFrameSize(uint32_t size) { m_maxFrameSize = size; }
 
 private:
   // Boost.Asio Core
@@ -55,23 +129,62 @@ private:
   int m_port;
   bool m_isRunning;
   int m_nextSessionId = 1;
+  uint32_t m_maxFrameSize = DEFAULT_MAX_FRAME_SIZE;
 
   std::mutex m_responseMutex;
   std::vector<std::function<void()>> m_responses;
 
+  // Metrics (before anything that records into them)
+  MetricsRegistry m_metricsRegistry;
+  ServerMetrics m_metrics;
+  std::string m_metricsPath;
+  std::chrono::seconds m_metricsInterval{10};
+  std::string m_tracePath;
+  asio::steady_timer m_metricsTimer;
+
+  // Hot restart
+  std::string m_handoffPath;
+  uint32_t m_reconnectRate = 200;
+  bool m_draining = false;
+  bool m_dbDrained = false;
+  asio::steady_timer m_drainTimer;
+#ifndef _WIN32
+  asio::local::stream_protocol::acceptor m_handoffAcceptor;
+#endif
+
   // Database
   DatabaseManager m_db;
 
   // Core Component Managers
   SessionManager m_sessionManager;
   GameRoomManager m_gameRoomManager;
+  GroupManager m_groupManager;
   PacketRouter m_packetRouter;
+  AvatarCache m_avatarCache;
+  ResumeRegistry m_resume;
+  asio::steady_timer m_resumeTimer;
+  bool m_resumeSweepArmed = false;
+  asio::steady_timer m_compactTimer;
+  std::unique_ptr<ClusterLink> m_cluster;
 
   // Asio Accept Loop
+  void openListener();
   void doAccept();
 
+  void listenForHandoff();
+  void acceptHandoff();
+  void beginDrain();
+  void drainDatabase();
+  void finishDrainIfDone();
+
+  void scheduleResumeSweep();
+  void expireParked(const ResumeRegistry::Parked &parked);
+
   void cleanup();
   void setupVoiceStorage();
+  void loadGroups();
+  void scheduleMetricsExport();
+  void scheduleOfflineCompaction();
 };
 
 } // namespace wizz
@@ -0,0 +1,168 @@
+#include "Tracer.h"
+#include <cstdio>
+#include <fstream>
+#include <limits>
+
+namespace wizz {
+
+namespace {
+
+uint64_t mix(uint64_t x) {
+  // splitmix64 finalizer: consecutive packets land far apart
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+uint64_t nanos(Tracer::Clock::time_point t) {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count());
+}
+
+void appendMicros(std::string &out, uint64_t ns) {
+  char buf[32];
+  std::snprintf(buf, sizeof(buf), "%llu.%03u",
+                static_cast<unsigned long long>(ns / 1000), static_cast<unsigned>(ns % 1000));
+  out += buf;
+}
+
+void appendEscaped(std::string &out, const std::string &s) {
+  for (char c : s) {
+    if (c == '"' || c == '\\')
+      out += '\\';
+    if (static_cast<unsigned char>(c) >= 0x20)
+      out += c;
+  }
+}
+
+} // namespace
+
+Tracer &Tracer::instance() {
+  static Tracer tracer;
+  return tracer;
+}
+
+void Tracer::setSampleRate(double rate) {
+  uint64_t threshold = 0;
+  if (rate >= 1.0)
+    threshold = std::numeric_limits<uint64_t>::max();
+  else if (rate > 0.0)
+    threshold = static_cast<uint64_t>(rate * 18446744073709551616.0);
+  m_threshold.store(threshold, std::memory_order_relaxed);
+}
+
+uint64_t Tracer::sample() {
+  uint64_t threshold = m_threshold.load(std::memory_order_relaxed);
+  if (threshold == 0)
+    return 0;
+  if (mix(m_sequence.fetch_add(1, std::memory_order_relaxed)) > threshold)
+    return 0;
+  return m_nextTrace.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint32_t Tracer::threadIndex() {
+  static std::atomic<uint32_t> next{1};
+  static thread_local uint32_t index = next.fetch_add(1, std::memory_order_relaxed);
+  return index;
+}
+
+void Tracer::nameThread(const char *name) {
+  uint32_t thread = threadIndex();
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (auto &entry : m_threadNames) {
+    if (entry.first == thread) {
+      entry.second = name;
+      return;
+    }
+  }
+  m_threadNames.emplace_back(thread, name);
+}
+
+void Tracer::record(const char *name, uint64_t trace, Clock::time_point start,
+                    Clock::time_point end, uint32_t arg) {
+  uint64_t begin = nanos(start);
+  uint64_t finish = nanos(end);
+  TraceEvent event{name, trace, begin, finish > begin ? finish - begin : 0, threadIndex(), arg};
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_events.size() < CAPACITY) {
+    m_events.push_back(event);
+  } else {
+    m_events[m_next] = event;
+    m_next = (m_next + 1) % CAPACITY;
+  }
+}
+
+std::vector<TraceEvent> Tracer::events() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::vector<TraceEvent> ordered;
+  ordered.reserve(m_events.size());
+  ordered.insert(ordered.end(), m_events.begin() + m_next, m_events.end());
+  ordered.insert(ordered.end(), m_events.begin(), m_events.begin() + m_next);
+  return ordered;
+}
+
+std::string Tracer::chromeJson() const {
+  std::vector<std::pair<uint32_t, std::string>> threads;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    threads = m_threadNames;
+  }
+  std::vector<TraceEvent> spans = events();
+
+  std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  bool first = true;
+  auto separate = [&] {
+    if (!first)
+      out += ",\n";
+    first = false;
+  };
+  for (const auto &thread : threads) {
+    separate();
+    out += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":";
+    out += std::to_string(thread.first);
+    out += ",\"args\":{\"name\":\"";
+    appendEscaped(out, thread.second);
+    out += "\"}}";
+  }
+  for (const TraceEvent &span : spans) {
+    separate();
+    out += "{\"name\":\"";
+    appendEscaped(out, span.name);
+    out += "\",\"ph\":\"X\",\"pid\":1,\"tid\":";
+    out += std::to_string(span.thread);
+    out += ",\"ts\":";
+    appendMicros(out, span.start);
+    out += ",\"dur\":";
+    appendMicros(out, span.duration);
+    out += ",\"args\":{\"trace\":";
+    out += std::to_string(span.trace);
+    if (span.arg) {
+      out += ",\"arg\":";
+      out += std::to_string(span.arg);
+    }
+    out += "}}";
+  }
+  out += "]}\n";
+  return out;
+}
+
+bool Tracer::writeFile(const std::string &path) const {
+  std::string json = chromeJson();
+  std::string tmp = path + ".tmp";
+  {
+    std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+    if (!file.write(json.data(), static_cast<std::streamsize>(json.size())))
+      return false;
+  }
+  return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+void Tracer::clear() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_events.clear();
+  m_next = 0;
+}
+
+} // namespace wizz
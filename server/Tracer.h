@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace wizz {
+
+// Sampled request tracing. A sampled inbound packet gets a trace id that
+// follows it through DatabaseManager::postTask and TcpServer::postResponse,
+// so every span recorded under that id (decode, handler, DB queue, DB run,
+// response, outbox write) shows where a slow request spent its time.
+// Spans go to a bounded in-memory ring and are exported as Chrome
+// trace-event JSON, which Perfetto and chrome://tracing open directly.
+
+struct TraceEvent {
+  const char *name; // String literal
+  uint64_t trace;
+  uint64_t start;    // Nanoseconds, steady clock
+  uint64_t duration; // Nanoseconds
+  uint32_t thread;
+  uint32_t arg; // Packet type, byte count, ... (0 = none)
+};
+
+class Tracer {
+public:
+  using Clock = std::chrono::steady_clock;
+  static constexpr size_t CAPACITY = 64 * 1024; // Most recent spans kept
+
+  static Tracer &instance();
+
+  // Fraction of inbound packets traced, 0 (off, the default) to 1
+  void setSampleRate(double rate);
+  // A fresh trace id if this packet is sampled, else 0
+  uint64_t sample();
+
+  // The trace the calling thread is working for (0 = none)
+  static uint64_t current() { return t_current; }
+  static void setCurrent(uint64_t trace) { t_current = trace; }
+  // Track name shown for the calling thread
+  void nameThread(const char *name);
+
+  void record(const char *name, uint64_t trace, Clock::time_point start,
+              Clock::time_point end, uint32_t arg = 0);
+
+  std::vector<TraceEvent> events() const; // Oldest first
+  std::string chromeJson() const;
+  bool writeFile(const std::string &path) const; // Atomic replace
+  void clear();
+
+private:
+  Tracer() = default;
+  static uint32_t threadIndex();
+
+  static inline thread_local uint64_t t_current = 0;
+
+  std::atomic<uint64_t> m_threshold{0}; // Sample when hash <= threshold
+  std::atomic<uint64_t> m_sequence{0};
+  std::atomic<uint64_t> m_nextTrace{1};
+
+  mutable std::mutex m_mutex;
+  std::vector<TraceEvent> m_events; // Ring once CAPACITY is reached
+  size_t m_next = 0;
+  std::vector<std::pair<uint32_t, std::string>> m_threadNames;
+};
+
+// Makes `trace` current on this thread until the end of the scope
+class TraceScope {
+public:
+  explicit TraceScope(uint64_t trace) : m_previous(Tracer::current()) {
+    Tracer::setCurrent(trace);
+  }
+  ~TraceScope() { Tracer::setCurrent(m_previous); }
+
+  TraceScope(const TraceScope &) = delete;
+  TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+  uint64_t m_previous;
+};
+
+// Times the enclosing block as part of the current trace; costs one
+// thread-local read when the thread is not tracing
+class TraceSpan {
+public:
+  explicit TraceSpan(const char *name, uint32_t arg = 0)
+      : m_name(name), m_trace(Tracer::current()), m_arg(arg) {
+    if (m_trace)
+      m_start = Tracer::Clock::now();
+  }
+  ~TraceSpan() {
+    if (m_trace)
+      Tracer::instance().record(m_name, m_trace, m_start, Tracer::Clock::now(), m_arg);
+  }
+
+  TraceSpan(const TraceSpan &) = delete;
+  TraceSpan &operator=(const TraceSpan &) = delete;
+
+private:
+  const char *m_name;
+  uint64_t m_trace;
+  uint32_t m_arg;
+  Tracer::Clock::time_point m_start;
+};
+
+} // namespace wizz
@@ -0,0 +1,322 @@
+#include "UploadStream.h"
+#include "../common/Frame.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+// Needed for ntohl
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <netinet/in.h>
+#endif
+
+namespace wizz {
+
+namespace {
+
+const uint32_t MAGIC_NUMBER = 0xCAFEBABE;
+
+bool isStreamable(PacketType type) {
+  return type == PacketType::VoiceMessage || type == PacketType::UpdateAvatar;
+}
+
+// Reads the fields in front of the blob and returns the blob length.
+// Must mirror msg::VoiceMessage and msg::UpdateAvatar (handlers/Messages.h).
+uint32_t readBlobLength(PacketType type, Packet &prefix) {
+  if (type == PacketType::VoiceMessage) {
+    prefix.readString(); // Target
+    prefix.readInt();    // Duration
+  }
+  return prefix.readInt();
+}
+
+} // namespace
+
+// --- UploadSink ---
+
+struct UploadSink::File {
+  std::string path;
+  std::ofstream stream;
+  bool failed = false;
+
+  void discard() {
+    stream.close();
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+  }
+};
+
+UploadSink::UploadSink(const std::string &directory, FileExecutor executor)
+    : m_file(std::make_shared<File>()), m_executor(std::move(executor)) {
+  static std::atomic<uint64_t> counter{0};
+
+  std::filesystem::path dir(directory);
+  m_file->path = (dir / ("upload_" + std::to_string(std::time(nullptr)) + "_" +
+                         std::to_string(counter++) + ".part"))
+                     .string();
+  run([file = m_file, dir]() {
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    file->stream.open(file->path, std::ios::binary | std::ios::trunc);
+    file->failed = !file->stream.is_open();
+  });
+}
+
+UploadSink::~UploadSink() {
+  if (!m_finished) {
+    auto discard = [file = m_file]() { file->discard(); };
+    if (m_executor)
+      m_executor(discard);
+    else
+      discard();
+  }
+}
+
+void UploadSink::write(const uint8_t *data, size_t length) {
+  m_pending.insert(m_pending.end(), data, data + length);
+  m_hash.update(data, length);
+  m_size += length;
+  if (m_pending.size() >= FLUSH_SIZE || !m_executor)
+    flush();
+}
+
+StoredUpload UploadSink::finish() {
+  flush();
+  run([file = m_file]() {
+    if (file->failed)
+      file->discard();
+    else
+      file->stream.close();
+  });
+  m_finished = true;
+  StoredUpload upload;
+  upload.path = m_file->path;
+  upload.hash = m_hash.finalHex();
+  upload.size = m_size;
+  return upload;
+}
+
+void UploadSink::flush() {
+  if (m_pending.empty())
+    return;
+  run([file = m_file, chunk = std::move(m_pending)]() {
+    if (file->failed)
+      return;
+    file->stream.write(reinterpret_cast<const char *>(chunk.data()),
+                       static_cast<std::streamsize>(chunk.size()));
+    file->failed = !file->stream;
+  });
+  m_pending.clear();
+}
+
+void UploadSink::run(std::function<void()> task) {
+  if (m_executor) {
+    m_executor(std::move(task));
+    return;
+  }
+  task();
+  if (m_file->failed) {
+    throw std::runtime_error("Cannot write upload file " + m_file->path);
+  }
+}
+
+// --- InboundPacket ---
+
+InboundPacket::InboundPacket(std::string uploadDirectory, CompactCodec *codec,
+                             FileExecutor executor)
+    : m_uploadDirectory(std::move(uploadDirectory)), m_codec(codec),
+      m_executor(std::move(executor)) {}
+
+InboundPacket::~InboundPacket() {
+  if (!m_upload.path.empty()) {
+    auto remove = [path = m_upload.path]() {
+      std::error_code ec;
+      std::filesystem::remove(path, ec);
+    };
+    if (m_executor)
+      m_executor(remove);
+    else
+      remove();
+  }
+}
+
+size_t InboundPacket::feed(const uint8_t *data, size_t length) {
+  size_t used = 0;
+  while (used < length && m_state != State::Done) {
+    const uint8_t *chunk = data + used;
+    size_t available = length - used;
+
+    switch (m_state) {
+    case State::Header: {
+      size_t take = std::min(available, headerSize() - m_bytes.size());
+      m_bytes.insert(m_bytes.end(), chunk, chunk + take);
+      used += take;
+      if (m_bytes.size() == headerSize())
+        onHeader();
+      break;
+    }
+    case State::Body: {
+      size_t take = std::min<size_t>(available, m_bodyLength - m_bodyReceived);
+      m_bytes.insert(m_bytes.end(), chunk, chunk + take);
+      m_bodyReceived += take;
+      used += take;
+      if (m_bodyReceived == m_bodyLength)
+        m_state = State::Done;
+      break;
+    }
+    case State::Prefix: {
+      size_t limit = std::min<size_t>(MAX_PREFIX, m_bodyLength);
+      size_t take = std::min(available, limit - m_bodyReceived);
+      m_bytes.insert(m_bytes.end(), chunk, chunk + take);
+      m_bodyReceived += take;
+      used += take;
+      if (!tryParsePrefix() && m_bodyReceived == limit) {
+        throw std::runtime_error("Upload metadata too large");
+      }
+      break;
+    }
+    case State::Blob: {
+      size_t take = std::min<size_t>(available, m_blobRemaining);
+      writeBlob(chunk, take);
+      used += take;
+      break;
+    }
+    case State::Suffix: {
+      size_t take = std::min(available, m_suffixRemaining);
+      m_suffix.insert(m_suffix.end(), chunk, chunk + take);
+      m_suffixRemaining -= take;
+      used += take;
+      if (m_suffixRemaining == 0)
+        m_state = State::Done;
+      break;
+    }
+    case State::Done:
+      break;
+    }
+  }
+  return used;
+}
+
+// Bytes to read before onHeader(). v2 headers grow by four when the
+// length is escaped, which the first word tells us.
+size_t InboundPacket::headerSize() const {
+  if (!m_codec)
+    return sizeof(PacketHeader);
+  if (m_bytes.size() < COMPACT_HEADER_SIZE)
+    return COMPACT_HEADER_SIZE;
+  return compactHeaderSize(m_bytes.data());
+}
+
+void InboundPacket::onHeader() {
+  if (m_codec) {
+    CompactHeader header;
+    parseCompactHeader(m_bytes.data(), m_bytes.size(), header);
+    m_type = header.type;
+    m_flags = header.flags;
+    m_bodyLength = header.length;
+    m_headerSize = header.size;
+  } else {
+    PacketHeader header;
+    std::memcpy(&header, m_bytes.data(), sizeof(PacketHeader));
+    if (ntohl(header.magic) != MAGIC_NUMBER) {
+      throw std::runtime_error("Invalid Magic Number");
+    }
+    m_type = static_cast<PacketType>(ntohl(header.type));
+    m_bodyLength = ntohl(header.length);
+    m_headerSize = sizeof(PacketHeader);
+  }
+  if (m_bodyLength > MAX_PACKET_SIZE) {
+    throw std::runtime_error("Packet exceeds max packet size");
+  }
+
+  if (m_bodyLength == 0) {
+    m_state = State::Done;
+  } else if (isStreamable(m_type) && m_bodyLength >= STREAM_THRESHOLD &&
+             m_flags == 0) { // Compressed bodies are buffered (and small)
+    if (m_uploadDirectory.empty()) {
+      throw std::runtime_error("Upload refused");
+    }
+    m_state = State::Prefix;
+  } else {
+    m_state = State::Body;
+  }
+}
+
+bool InboundPacket::tryParsePrefix() {
+  const uint8_t *body = m_bytes.data() + m_headerSize;
+  uint32_t blobLength;
+  try {
+    if (m_codec) {
+      m_meta.emplace(m_type);
+      m_prefixLength =
+          m_codec->decodePrefix(m_type, body, m_bodyReceived, *m_meta, blobLength);
+    } else {
+      Packet probe(m_type);
+      probe.writeData(body, m_bodyReceived);
+      blobLength = readBlobLength(m_type, probe);
+      m_prefixLength = m_bodyReceived - probe.remaining();
+      m_meta.emplace(m_type);
+      m_meta->writeData(body, m_prefixLength);
+    }
+  } catch (const std::out_of_range &) {
+    m_meta.reset();
+    return false; // Metadata not complete yet
+  }
+
+  if (m_prefixLength + blobLength > m_bodyLength) {
+    throw std::runtime_error("Upload blob exceeds packet body");
+  }
+  m_suffixRemaining = m_bodyLength - m_prefixLength - blobLength;
+  if (m_suffixRemaining > MAX_SUFFIX) {
+    throw std::runtime_error("Upload trailer too large");
+  }
+
+  m_streamed = true;
+  m_sink = std::make_unique<UploadSink>(m_uploadDirectory, m_executor);
+  m_blobRemaining = blobLength;
+  m_state = State::Blob;
+
+  // Whatever was read past the metadata already belongs to the blob
+  std::vector<uint8_t> extra(m_bytes.begin() + m_headerSize + m_prefixLength,
+                             m_bytes.end());
+  m_bytes.resize(m_headerSize + m_prefixLength);
+
+  size_t blobPart = std::min<size_t>(extra.size(), m_blobRemaining);
+  writeBlob(extra.data(), blobPart);
+  if (blobPart < extra.size()) {
+    feed(extra.data() + blobPart, extra.size() - blobPart);
+  }
+  return true;
+}
+
+void InboundPacket::writeBlob(const uint8_t *data, size_t length) {
+  m_sink->write(data, length);
+  m_blobRemaining -= static_cast<uint32_t>(length);
+  if (m_blobRemaining == 0) {
+    m_upload = m_sink->finish();
+    m_sink.reset();
+    m_state = m_suffixRemaining > 0 ? State::Suffix : State::Done;
+  }
+}
+
+Packet InboundPacket::takePacket() {
+  if (!m_streamed) {
+    if (m_codec)
+      return m_codec->decode(m_type, m_bytes.data() + m_headerSize,
+                             m_bodyLength, m_flags);
+    return Packet(m_bytes);
+  }
+  if (m_codec) {
+    m_codec->decodeSuffix(m_type, m_suffix.data(), m_suffix.size(), *m_meta);
+  } else {
+    m_meta->writeData(m_suffix.data(), m_suffix.size());
+  }
+  return std::move(*m_meta);
+}
+
+} // namespace wizz
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "../common/CompactCodec.h"
+#include "../common/Packet.h"
+#include "ContentHash.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace wizz {
+
+// Where a streamed blob ended up. The handler owns the file from here on:
+// it should move it to its final place; anything left behind is deleted.
+struct StoredUpload {
+  std::string path;
+  std::string hash; // ContentHash fingerprint of the blob
+  uint64_t size = 0;
+};
+
+// Runs file work elsewhere (the server's DB thread), in posting order.
+// Empty: inline, on the caller's thread.
+using FileExecutor = std::function<void(std::function<void()>)>;
+
+// Writes a blob to a temporary file while hashing it. Removes the file
+// unless finish() was called. With an executor, bytes are buffered up to
+// FLUSH_SIZE and written there, so a slow disk never blocks the caller;
+// a failed write then shows as a missing file after finish().
+class UploadSink {
+public:
+  static constexpr size_t FLUSH_SIZE = 256 * 1024;
+
+  explicit UploadSink(const std::string &directory, FileExecutor executor = {});
+  ~UploadSink();
+
+  UploadSink(const UploadSink &) = delete;
+  UploadSink &operator=(const UploadSink &) = delete;
+
+  void write(const uint8_t *data, size_t length);
+  StoredUpload finish();
+
+private:
+  struct File;
+
+  void flush();
+  // Inline failures throw, as the caller can still react to them
+  void run(std::function<void()> task);
+
+  std::shared_ptr<File> m_file; // Shared with the queued writes
+  FileExecutor m_executor;
+  std::vector<uint8_t> m_pending;
+  ContentHash m_hash;
+  uint64_t m_size = 0;
+  bool m_finished = false;
+};
+
+/**
+ * @brief Parses one inbound packet incrementally.
+ * Small packets are buffered as usual. Large bodies of upload packet types
+ * (VoiceMessage, UpdateAvatar) are split instead: the fields in front of and
+ * behind the blob are kept, the blob itself goes straight to an UploadSink.
+ * Peak memory per upload is the metadata plus one read buffer (plus what
+ * the executor has yet to write: ClientSession stops reading while more
+ * than a few writes are queued). An empty upload directory refuses
+ * uploads: a streamed body then throws, as from a client not logged in.
+ * With a CompactCodec the packet is read in the v2 format and handed out
+ * as a v1 Packet.
+ */
+class InboundPacket {
+public:
+  // Bodies at least this big are streamed (if the type supports it)
+  static constexpr uint32_t STREAM_THRESHOLD = 64 * 1024;
+
+  explicit InboundPacket(std::string uploadDirectory,
+                         CompactCodec *codec = nullptr,
+                         FileExecutor executor = {});
+  ~InboundPacket(); // Deletes the upload file unless a handler moved it
+
+  InboundPacket(const InboundPacket &) = delete;
+  InboundPacket &operator=(const InboundPacket &) = delete;
+
+  // Consumes bytes belonging to this packet and returns how many were used.
+  // Stops at the end of the packet. Throws std::runtime_error on bad input.
+  size_t feed(const uint8_t *data, size_t length);
+
+  bool complete() const { return m_state == State::Done; }
+  bool streamed() const { return m_streamed; }
+
+  // Once complete: the whole packet, or for streamed packets the metadata
+  // fields only (the blob is skipped; its length field is still there).
+  Packet takePacket();
+  const StoredUpload &upload() const { return m_upload; }
+
+private:
+  // Caps on what we keep in memory around a streamed blob
+  static constexpr size_t MAX_PREFIX = 4 * 1024;
+  static constexpr size_t MAX_SUFFIX = 4 * 1024;
+
+  enum class State { Header, Body, Prefix, Blob, Suffix, Done };
+
+  size_t headerSize() const;
+  void onHeader();
+  bool tryParsePrefix();
+  void writeBlob(const uint8_t *data, size_t length);
+
+  std::string m_uploadDirectory;
+  CompactCodec *m_codec;
+  FileExecutor m_executor;
+  State m_state = State::Header;
+  bool m_streamed = false;
+
+  PacketType m_type = PacketType::Error;
+  uint8_t m_flags = 0; // v2 header flags (compression)
+  uint32_t m_bodyLength = 0;
+  size_t m_bodyReceived = 0;
+
+  std::vector<uint8_t> m_bytes; // Header + body, or header + prefix
+  size_t m_headerSize = 0;      // Known once the header is parsed
+  size_t m_prefixLength = 0;
+  std::optional<Packet> m_meta; // v1 form of the prefix
+  uint32_t m_blobRemaining = 0;
+  size_t m_suffixRemaining = 0;
+  std::vector<uint8_t> m_suffix;
+
+  std::unique_ptr<UploadSink> m_sink;
+  StoredUpload m_upload;
+};
+
+} // namespace wizz
@@ -0,0 +1,20 @@
+#include "UserDirectory.h"
+
+namespace wizz {
+
+UserId UserDirectory::intern(const std::string &username) {
+  auto it = m_ids.find(username);
+  if (it != m_ids.end()) return it->second;
+
+  UserId id = static_cast<UserId>(m_names.size());
+  m_names.push_back(username);
+  m_ids.emplace(m_names.back(), id);
+  return id;
+}
+
+UserId UserDirectory::find(std::string_view username) const {
+  auto it = m_ids.find(username);
+  return it != m_ids.end() ? it->second : INVALID_USER;
+}
+
+} // namespace wizz
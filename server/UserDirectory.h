@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace wizz {
+
+// Dense per-process user number. Assigned the first time a name is seen
+// (at login, or as someone's contact) and stable until shutdown, so tables
+// indexed by it can be plain vectors.
+using UserId = uint32_t;
+constexpr UserId INVALID_USER = UINT32_MAX;
+
+class UserDirectory {
+public:
+  UserId intern(const std::string &username);
+  UserId find(std::string_view username) const; // INVALID_USER if never seen
+  const std::string &name(UserId id) const { return m_names[id]; }
+  size_t size() const { return m_names.size(); }
+
+private:
+  // deque: names never move, so the map can key on views into them
+  std::deque<std::string> m_names;
+  std::unordered_map<std::string_view, UserId> m_ids;
+};
+
+} // namespace wizz
@@ -0,0 +1,46 @@
+#include "ClusterBroker.h"
+#include "Logger.h"
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+int main(int argc, char **argv) {
+  int port = 8090;
+  // Only the nodes talk to the broker: keep it off public interfaces
+  // unless told otherwise
+  std::string bind = "127.0.0.1";
+  std::string secretPath;
+  for (int i = 1; i + 1 < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--port")
+      port = std::atoi(argv[++i]);
+    else if (arg == "--bind")
+      bind = argv[++i];
+    else if (arg == "--secret-file") // Shared with the nodes' --cluster-secret-file
+      secretPath = argv[++i];
+  }
+
+  std::string secret = secretPath.empty() ? "" : wizz::readClusterSecret(secretPath);
+  if (secret.empty()) {
+    std::cerr << "The broker needs the cluster secret: --secret-file PATH" << std::endl;
+    return 1;
+  }
+  asio::error_code ec;
+  asio::ip::address address = asio::ip::make_address(bind, ec);
+  if (ec) {
+    std::cerr << "Bad --bind address: " << bind << std::endl;
+    return 1;
+  }
+
+  try {
+    asio::io_context io;
+    wizz::ClusterBroker broker(io, address, static_cast<uint16_t>(port), std::move(secret));
+    broker.start();
+    LOG_INFO("[Broker] Listening on {}:{}", bind, broker.port());
+    io.run();
+  } catch (const std::exception &e) {
+    std::cerr << "Broker Crashed: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -1,29 +1,195 @@
 #include "AuthHandlers.h"
+#include "SocialHandlers.h"
+#include "GroupHandlers.h"
 #include "../TcpServer.h"
 #include "../ClientSession.h"
 #include "../../common/Packet.h"
-#include <iostream>
+#include "../Logger.h"
 #include <sstream>
 #include <fstream>
 #include <vector>
 
 namespace wizz {
 
-void LoginHandler::handle(ClientSession* session, Packet& packet) {
-    std::string username, password, customStatus;
-    try {
-        username = packet.readString();
-        password = packet.readString();
-    } catch (const std::exception &e) {
-        std::cerr << "[LoginHandler] Protocol Error: " << e.what() << std::endl;
-        return;
+namespace {
+
+// Presence of every online contact, for a user who just logged in. One
+// PresenceSnapshot packet if the client supports it, otherwise a
+// ContactStatusChange (+ GameStatus) per contact as before. Contacts are
+// symmetric, so the user's subscribers are exactly its online contacts
+// (plus, in cluster mode, those online on other nodes).
+void sendPresenceSnapshot(TcpServer* server, ClientSession* s) {
+    SessionManager& sessions = server->getSessionManager();
+    bool batched = s->hasCapability(CapPresenceBatch);
+
+    std::vector<UserId> online = sessions.getOnlineContacts(s->getUserId());
+
+    Packet snapshot(PacketType::PresenceSnapshot);
+    snapshot.writeInt(static_cast<uint32_t>(online.size()));
+
+    for (UserId contact : online) {
+        const std::string& onlineUser = sessions.getUsername(contact);
+        uint32_t status = static_cast<uint32_t>(sessions.getStatus(contact));
+        const std::string& customStatus = sessions.getCustomStatus(contact);
+        std::string gameName;
+        uint32_t score = 0;
+        bool playing = server->getGameRoomManager().getGameStatus(onlineUser, gameName, score);
+
+        if (batched) {
+            snapshot.writeString(onlineUser);
+            snapshot.writeInt(status);
+            snapshot.writeString(customStatus);
+            snapshot.writeString(playing ? gameName : ""); // Empty = not playing
+            snapshot.writeInt(playing ? score : 0);
+            continue;
+        }
+
+        Packet notify(PacketType::ContactStatusChange);
+        notify.writeInt(status);
+        notify.writeString(onlineUser);
+        notify.writeString(customStatus);
+        s->sendPacket(notify);
+
+        if (playing) {
+            Packet gamePkt(PacketType::GameStatus);
+            gamePkt.writeString(onlineUser);
+            gamePkt.writeString(gameName);
+            gamePkt.writeInt(score);
+            s->sendPacket(gamePkt);
+        }
     }
 
+    if (batched) s->sendPacket(snapshot);
+}
+
+// A message stored while the user was away. Voice notes are stored as
+// "VOICE:<duration>:<file>" proxy messages; their file is read along with
+// the fetch, so the io thread never waits for the disk.
+struct PendingMessage {
+    uint64_t id;
+    std::string sender;
+    std::string body;
+    bool voice = false;
+    uint16_t duration = 0;
+    VoiceCodec codec = VoiceCodec::Wav;
+    std::vector<uint8_t> data; // Empty if the file is gone
+};
+
+// Runs on the DB thread
+std::vector<PendingMessage> fetchPendingMessages(TcpServer* server, const std::string& username) {
+    std::vector<PendingMessage> pending;
+    for (auto &stored : server->getDb().fetchPendingMessages(username)) {
+        PendingMessage msg;
+        msg.id = stored.id;
+        msg.sender = std::move(stored.sender);
+        if (stored.body.rfind("VOICE:", 0) == 0) {
+            msg.voice = true;
+            std::vector<std::string> parts;
+            std::stringstream ss(stored.body);
+            std::string item;
+            while (std::getline(ss, item, ':')) {
+                parts.push_back(item);
+            }
+            if (parts.size() >= 3) {
+                msg.duration = static_cast<uint16_t>(std::stoi(parts[1]));
+                const std::string& filename = parts[2];
+                std::ifstream infile(filename, std::ios::binary | std::ios::ate);
+                if (infile.is_open()) {
+                    std::streamsize size = infile.tellg();
+                    infile.seekg(0, std::ios::beg);
+                    msg.data.resize(size);
+                    if (!infile.read(reinterpret_cast<char *>(msg.data.data()), size)) msg.data.clear();
+                }
+                bool adpcm = filename.size() > 4 && filename.compare(filename.size() - 4, 4, ".ima") == 0;
+                msg.codec = adpcm ? VoiceCodec::ImaAdpcm : VoiceCodec::Wav;
+            }
+        } else {
+            msg.body = std::move(stored.body);
+        }
+        pending.push_back(std::move(msg));
+    }
+    return pending;
+}
+
+void sendPendingMessages(ClientSession* s, const std::vector<PendingMessage>& pending) {
+    if (pending.empty()) return;
+    LOG_INFO("[Server] Flushing {} offline messages to {}", pending.size(), s->getUsername());
+    for (const auto &msg : pending) {
+        if (!s->takePendingMessage(msg.id)) continue;
+        s->flushTyping(msg.sender); // As for a live message
+        if (msg.voice) {
+            if (!msg.data.empty())
+                s->sendPacket(makeVoicePacket(s, msg.sender, msg.duration, msg.codec, msg.data));
+        } else {
+            Packet outPacket(PacketType::DirectMessage);
+            outPacket.writeString(msg.sender);
+            outPacket.writeString(msg.body);
+            s->sendPacket(outPacket);
+        }
+    }
+}
+
+void sendPendingGroupMessages(ClientSession* s,
+                              const std::vector<DatabaseManager::PendingGroupMessage>& pending) {
+    for (const auto &msg : pending) {
+        Packet outPacket(PacketType::GroupMessage);
+        outPacket.writeInt(msg.groupId);
+        outPacket.writeString(msg.sender);
+        outPacket.writeString(msg.body);
+        s->sendPacket(outPacket);
+    }
+}
+
+void sendResumeFailed(ClientSession* s) {
+    Packet failPkt(PacketType::ResumeFailed);
+    failPkt.writeString("Session expired, please log in again");
+    s->sendPacket(failPkt);
+}
+
+} // namespace
+
+void deliverPendingMessages(TcpServer* server, const std::string& username) {
+    SessionManager& sessions = server->getSessionManager();
+    if (!sessions.getSession(sessions.getUserId(username))) return;
+    server->getDb().postTask([server, username]() {
+        auto pending = fetchPendingMessages(server, username);
+        if (pending.empty()) return;
+        server->postResponse([server, username, pending = std::move(pending)]() {
+            SessionManager& sessions = server->getSessionManager();
+            ClientSession* s = sessions.getSession(sessions.getUserId(username));
+            if (!s) return; // Gone again: they stay pending for the next login
+            sendPendingMessages(s, pending);
+            uint64_t lastId = pending.back().id;
+            server->getDb().postTask([server, username, lastId]() {
+                server->getDb().markAsDelivered(username, lastId);
+            });
+            deliverPendingMessages(server, username); // The next page, if any
+        });
+    });
+}
+
+void HelloHandler::handle(ClientSession* session, msg::Hello& hello) {
+    session->negotiate(hello.capabilities, hello.maxFrameSize);
+}
+
+void LoginHandler::handle(ClientSession* session, msg::Login& login) {
     TcpServer* server = session->getServer();
     if (!server) return;
+    // Cluster mode: each user is served by one node
+    if (ClusterLink* cluster = server->getCluster()) {
+        if (const ClusterLink::Node* node = cluster->redirectFor(login.username)) {
+            Packet redirect(PacketType::Redirect);
+            redirect.writeString(node->host);
+            redirect.writeInt(node->port);
+            session->sendPacket(redirect);
+            return;
+        }
+    }
     int sessionId = session->getId();
+    uint32_t knownVersion = session->hasCapability(CapContactDeltas) ? login.contactsVersion : 0;
 
-    server->getDb().postTask([server, username, password, sessionId]() {
+    server->getDb().postTask([server, username = std::move(login.username),
+                              password = std::move(login.password), sessionId, knownVersion]() {
         bool ok = server->getDb().checkCredentials(username, password);
         if (!ok) {
             server->postResponse([server, sessionId]() {
@@ -37,140 +203,187 @@ void LoginHandler::handle(ClientSession* session, Packet& packet) {
             return;
         }
 
-        auto pending = server->getDb().fetchPendingMessages(username);
-        for (const auto &msg : pending) {
-            server->getDb().markAsDelivered(msg.id);
-        }
+        auto pending = fetchPendingMessages(server, username);
         auto followers = server->getDb().getFollowers(username);
         auto friends = server->getDb().getFriends(username);
         auto dbCustomStatus = server->getDb().getCustomStatus(username);
+        auto avatarHashes = server->getDb().getFriendAvatarHashes(username);
+        uint32_t lastSeq = server->getDb().getLastMessageSeq(username);
+        auto groupPending = server->getDb().fetchPendingGroupMessages(username);
+        uint32_t contactsVersion = server->getDb().getContactsVersion(username);
+        std::vector<DatabaseManager::ContactChange> contactChanges;
+        bool delta = server->getDb().getContactChanges(username, knownVersion, contactChanges);
 
-        server->postResponse([server, username, sessionId, 
+        server->postResponse([server, username, sessionId, contactsVersion, delta,
+                              contactChanges = std::move(contactChanges),
                               customStatus = std::move(dbCustomStatus),
                               pending = std::move(pending),
                               followers = std::move(followers),
-                              friends = std::move(friends)]() {
+                              friends = std::move(friends),
+                              avatarHashes = std::move(avatarHashes), lastSeq,
+                              groupPending = std::move(groupPending)]() {
             ClientSession *s = server->getSession(sessionId);
             if (!s) return;
 
             s->setLoggedIn(true);
             s->setUsername(username);
-            std::cout << "[Server] User Online: " << username << std::endl;
-            server->getSessionManager().setUserOnline(username, s, customStatus);
+            LOG_INFO("[Server] User Online: {}", username);
 
-            // Cache the full contact list in the session for fast broadcasts (avoids repeated DB queries)
-            std::set<std::string> contactSet;
-            for (const auto &f : followers) contactSet.insert(f);
-            for (const auto &f : friends) contactSet.insert(f);
-            s->setContacts(std::move(contactSet));
+            // Cache the full contact list for fast broadcasts (avoids repeated DB queries)
+            std::vector<std::string> contacts = followers;
+            contacts.insert(contacts.end(), friends.begin(), friends.end());
+            s->setUserId(server->getSessionManager().setUserOnline(username, s, customStatus, contacts));
 
+            // The client resends anything it numbered above lastSeq. A new
+            // token also ends any parked session of this user: contacts
+            // hear it is online below either way.
+            s->setLastMessageSeq(lastSeq);
+            ResumeRegistry& resume = server->getResumeRegistry();
             Packet resp(PacketType::LoginSuccess);
+            resp.writeInt(lastSeq);
+            resp.writeString(resume.enabled() ? resume.issue(s->getUserId()) : "");
             s->sendPacket(resp);
 
-            std::set<std::string> contacts;
-            for (const auto &f : followers) contacts.insert(f);
-            for (const auto &f : friends) contacts.insert(f);
-
-            for (const auto &contactName : contacts) {
-                ClientSession* targetSession = server->getSessionManager().getSessionByUsername(contactName);
-                if (targetSession) {
-                    std::cout << "[Server] Broadcasting Online Status of " << username
-                              << " to contact " << contactName << std::endl;
-                    Packet notify(PacketType::ContactStatusChange);
-                    notify.writeInt(0); // Online
-                    notify.writeString(username);
-                    notify.writeString(customStatus);
-                    targetSession->sendPacket(notify);
-                }
+            for (ClientSession* targetSession : server->getSessionManager().getSubscribers(s->getUserId())) {
+                targetSession->queueStatus(username, 0, customStatus); // Online
             }
+            server->publishPresence(username, 0, customStatus, s->capabilities());
 
-            if (!friends.empty()) {
-                Packet contactList(PacketType::ContactList);
-                contactList.writeInt(static_cast<uint32_t>(friends.size()));
-                for (const auto &friendName : friends) {
-                    contactList.writeString(friendName);
-                    contactList.writeInt(static_cast<uint32_t>(server->getSessionManager().getStatus(friendName)));
-                    contactList.writeString(server->getSessionManager().getCustomStatus(friendName));
-                }
-                s->sendPacket(contactList);
+            // A client still holding a recent version only hears what changed
+            // since; the presence snapshot below covers statuses either way
+            SessionManager& sessions = server->getSessionManager();
+            if (delta) {
+                if (!contactChanges.empty())
+                    s->sendPacket(makeContactListDelta(sessions, contactChanges, avatarHashes, contactsVersion));
+            } else if (!friends.empty() || contactsVersion != 0) {
+                s->sendPacket(makeContactList(sessions, friends, avatarHashes, contactsVersion));
             }
 
-            for (const auto& onlineUser : server->getSessionManager().getAllOnlineUsernames()) {
-                if (onlineUser == username) continue;
-                bool isInterested = (contacts.find(onlineUser) != contacts.end());
-                
-                if (isInterested) {
-                    int status = server->getSessionManager().getStatus(onlineUser);
-                    Packet notify(PacketType::ContactStatusChange);
-                    notify.writeInt(status);
-                    notify.writeString(onlineUser);
-                    notify.writeString(server->getSessionManager().getCustomStatus(onlineUser));
-                    s->sendPacket(notify);
-
-                    std::string gameName;
-                    uint32_t score = 0;
-                    if (server->getGameRoomManager().getGameStatus(onlineUser, gameName, score)) {
-                        Packet gamePkt(PacketType::GameStatus);
-                        gamePkt.writeString(onlineUser);
-                        gamePkt.writeString(gameName);
-                        gamePkt.writeInt(score);
-                        s->sendPacket(gamePkt);
-                    }
-                }
+            sendPresenceSnapshot(server, s);
+
+            sendPendingMessages(s, pending);
+
+            GroupManager& groups = server->getGroupManager();
+            for (GroupId id : groups.groupsOf(s->getUserId())) {
+                s->sendPacket(makeGroupInfo(server->getSessionManager(), id, *groups.getGroup(id)));
             }
+            sendPendingGroupMessages(s, groupPending);
 
+            // Only once sent: had the client left meanwhile, they stay pending
             if (!pending.empty()) {
-                std::cout << "[Server] Flushing " << pending.size()
-                          << " offline messages to " << username << std::endl;
-                for (const auto &msg : pending) {
-                    if (msg.body.rfind("VOICE:", 0) == 0) {
-                        std::vector<std::string> parts;
-                        std::stringstream ss(msg.body);
-                        std::string item;
-                        while (std::getline(ss, item, ':')) {
-                            parts.push_back(item);
-                        }
-                        if (parts.size() >= 3) {
-                            uint16_t duration = static_cast<uint16_t>(std::stoi(parts[1]));
-                            std::string filename = parts[2];
-                            std::ifstream infile(filename, std::ios::binary | std::ios::ate);
-                            if (infile.is_open()) {
-                                std::streamsize size = infile.tellg();
-                                infile.seekg(0, std::ios::beg);
-                                std::vector<uint8_t> buffer(size);
-                                if (infile.read(reinterpret_cast<char *>(buffer.data()), size)) {
-                                    Packet outPacket(PacketType::VoiceMessage);
-                                    outPacket.writeString(msg.sender);
-                                    outPacket.writeInt(static_cast<uint32_t>(duration));
-                                    outPacket.writeInt(static_cast<uint32_t>(buffer.size()));
-                                    outPacket.writeData(buffer.data(), buffer.size());
-                                    s->sendPacket(outPacket);
-                                }
-                            }
-                        }
-                    } else {
-                        Packet outPacket(PacketType::DirectMessage);
-                        outPacket.writeString(msg.sender);
-                        outPacket.writeString(msg.body);
-                        s->sendPacket(outPacket);
-                    }
-                }
+                uint64_t lastId = pending.back().id;
+                server->getDb().postTask([server, username, lastId]() {
+                    server->getDb().markAsDelivered(username, lastId);
+                });
+            }
+            if (!groupPending.empty()) {
+                uint64_t lastId = groupPending.back().id;
+                server->getDb().postTask([server, username, lastId]() {
+                    server->getDb().markGroupMessagesDelivered(username, lastId);
+                });
             }
         });
     });
 }
 
-void RegisterHandler::handle(ClientSession* session, Packet& packet) {
-    std::string username, password;
-    try {
-        username = packet.readString();
-        password = packet.readString();
-    } catch (const std::exception &e) {
-        std::cerr << "[Session] Register Protocol Error: " << e.what() << std::endl;
+// No password, contact list or presence snapshot: the client still has
+// those. It gets a fresh token, the presence that changed and the messages
+// that arrived while it was away. Contacts that saw it online never hear
+// it left; those who logged in meanwhile are told it is back.
+void ResumeHandler::handle(ClientSession* session, msg::Resume& resume) {
+    TcpServer* server = session->getServer();
+    if (!server || session->isLoggedIn()) return;
+    ResumeRegistry& registry = server->getResumeRegistry();
+
+    UserId user = registry.find(resume.token);
+    if (user != INVALID_USER && !registry.parked(user)) {
+        // The old connection is gone, we just have not noticed yet: drop it
+        // as if we had, so it is parked and can no longer act as the user
+        if (ClientSession* old = server->getSessionManager().getSession(user)) {
+            int oldId = old->getId();
+            old->close();
+            server->handleDisconnect(oldId);
+        }
+    }
+    if (user == INVALID_USER || !registry.parked(user)) {
+        sendResumeFailed(session);
         return;
     }
 
-    std::cout << "[Session] Register Attempt: " << username << std::endl;
+    std::string username = server->getSessionManager().getUsername(user);
+    int sessionId = session->getId();
+    server->getDb().postTask([server, username, user, sessionId]() {
+        auto pending = fetchPendingMessages(server, username);
+        uint32_t lastSeq = server->getDb().getLastMessageSeq(username);
+        auto groupPending = server->getDb().fetchPendingGroupMessages(username);
+
+        server->postResponse([server, username, user, sessionId, lastSeq,
+                              pending = std::move(pending),
+                              groupPending = std::move(groupPending)]() {
+            ClientSession *s = server->getSession(sessionId);
+            if (!s) return; // Still parked; messages stay pending
+            SessionManager& sessions = server->getSessionManager();
+            ResumeRegistry& registry = server->getResumeRegistry();
+            if (!registry.parked(user)) {
+                sendResumeFailed(s); // Expired, or logged in elsewhere meanwhile
+                return;
+            }
+            ResumeRegistry::Parked parked = registry.take(user);
+
+            std::vector<std::string> contacts;
+            contacts.reserve(parked.contacts.size());
+            for (const auto& contact : parked.contacts) contacts.push_back(sessions.getUsername(contact.id));
+
+            s->setLoggedIn(true);
+            s->setUsername(username);
+            s->setUserId(sessions.setUserOnline(username, s, parked.customStatus, contacts));
+            sessions.updateStatus(username, static_cast<int>(parked.status));
+            LOG_INFO("[Server] User Resumed: {}", username);
+
+            s->setLastMessageSeq(lastSeq);
+            Packet resp(PacketType::ResumeSuccess);
+            resp.writeInt(lastSeq);
+            resp.writeString(registry.issue(user));
+            s->sendPacket(resp);
+
+            for (ClientSession* target : sessions.getSubscribers(user)) {
+                if (!ResumeRegistry::sawOnline(parked, target->getUserId(), target->getId())) {
+                    target->queueStatus(username, parked.status, parked.customStatus);
+                }
+            }
+            server->publishPresence(username, parked.status, parked.customStatus, s->capabilities());
+            for (const auto& contact : parked.contacts) {
+                uint32_t status = static_cast<uint32_t>(sessions.getStatus(contact.id));
+                const std::string& customStatus = sessions.getCustomStatus(contact.id);
+                if (status != contact.status || customStatus != contact.customStatus) {
+                    s->queueStatus(sessions.getUsername(contact.id), status, customStatus);
+                }
+            }
+
+            sendPendingMessages(s, pending);
+            sendPendingGroupMessages(s, groupPending);
+
+            // Only now: had the client dropped again, they would still be pending
+            if (!pending.empty()) {
+                uint64_t lastId = pending.back().id;
+                server->getDb().postTask([server, username, lastId]() {
+                    server->getDb().markAsDelivered(username, lastId);
+                });
+            }
+            if (!groupPending.empty()) {
+                uint64_t lastId = groupPending.back().id;
+                server->getDb().postTask([server, username, lastId]() {
+                    server->getDb().markGroupMessagesDelivered(username, lastId);
+                });
+            }
+        });
+    });
+}
+
+void RegisterHandler::handle(ClientSession* session, msg::Register& registration) {
+    const std::string& username = registration.username;
+    const std::string& password = registration.password;
+    LOG_DEBUG("[Session] Register Attempt: {}", username);
 
     TcpServer* server = session->getServer();
     if (!server) return;
@@ -184,12 +397,12 @@ void RegisterHandler::handle(ClientSession* session, Packet& packet) {
             if (!s) return;
 
             if (ok) {
-                std::cout << "[Server] Registered: " << username << std::endl;
+                LOG_INFO("[Server] Registered: {}", username);
                 Packet resp(PacketType::RegisterSuccess);
                 resp.writeString("Registration Successful!");
                 s->sendPacket(resp);
             } else {
-                std::cout << "[Server] Registration Failed: " << username << std::endl;
+                LOG_INFO("[Server] Registration Failed: {}", username);
                 Packet resp(PacketType::RegisterFailed);
                 resp.writeString("Username already taken.");
                 s->sendPacket(resp);
@@ -1,17 +1,37 @@
 #pragma once
 
-#include "IPacketHandler.h"
+#include "Messages.h"
 
 namespace wizz {
 
-class LoginHandler : public IPacketHandler {
-public:
-    void handle(ClientSession* session, Packet& packet) override;
+class ClientSession;
+class TcpServer;
+
+struct HelloHandler {
+    using Message = msg::Hello;
+    static void handle(ClientSession* session, msg::Hello& hello);
+};
+
+struct LoginHandler {
+    using Message = msg::Login;
+    static void handle(ClientSession* session, msg::Login& login);
 };
 
-class RegisterHandler : public IPacketHandler {
-public:
-    void handle(ClientSession* session, Packet& packet) override;
+// Picks up a session parked by TcpServer::handleDisconnect
+struct ResumeHandler {
+    using Message = msg::Resume;
+    static void handle(ClientSession* session, msg::Resume& resume);
 };
 
+struct RegisterHandler {
+    using Message = msg::Register;
+    static void handle(ClientSession* session, msg::Register& registration);
+};
+
+// Sends the direct messages pending for `username` to their session on
+// this server, if any, and marks them delivered once sent. For messages
+// stored while the user was online: sent from another cluster node, or
+// committed after the login fetched its own.
+void deliverPendingMessages(TcpServer* server, const std::string& username);
+
 }
@@ -2,18 +2,14 @@
 #include "../TcpServer.h"
 #include "../ClientSession.h"
 #include "../../common/Packet.h"
-#include <iostream>
+#include "../Logger.h"
 
 namespace wizz {
 
-void GameStatusHandler::handle(ClientSession* session, Packet& packet) {
+void GameStatusHandler::handle(ClientSession* session, msg::GameStatus& status) {
     if (!session->isLoggedIn()) return;
-    std::string gameName;
-    uint32_t score;
-    try {
-        gameName = packet.readString();
-        score = packet.readInt();
-    } catch (...) { return; }
+    const std::string& gameName = status.game;
+    uint32_t score = status.score;
 
     TcpServer* server = session->getServer();
     if (!server) return;
@@ -25,60 +21,58 @@ void GameStatusHandler::handle(ClientSession* session, Packet& packet) {
         server->getGameRoomManager().updateGameStatus(username, gameName, score);
     }
 
-    // Use the cached contact list from the session — no DB round-trip needed.
+    // Use the subscriber index — no DB round-trip needed.
     // This runs on the server's IO thread which is the same thread that processes
-    // all session callbacks, so the contact cache is safe to read directly.
+    // all session callbacks, so the index is safe to read directly.
     Packet pkt(PacketType::GameStatus);
     pkt.writeString(username);
     pkt.writeString(gameName);
     pkt.writeInt(score);
 
-    for (const auto& contactName : session->getContacts()) {
-        ClientSession* targetSession = server->getSessionManager().getSessionByUsername(contactName);
-        if (targetSession) {
-            targetSession->sendPacket(pkt);
-        }
+    for (ClientSession* targetSession : server->getSessionManager().getSubscribers(session->getUserId())) {
+        targetSession->sendPacket(pkt);
     }
+    if (ClusterLink* cluster = server->getCluster()) cluster->fanout(username, pkt);
 }
 
 
-void GameInviteHandler::handle(ClientSession* session, Packet& packet) {
+void GameInviteHandler::handle(ClientSession* session, msg::GameInvite& invite) {
     if (!session->isLoggedIn()) return;
-    std::string target, gameName;
-    try {
-        target = packet.readString();
-        gameName = packet.readString();
-    } catch (...) { return; }
+    const std::string& target = invite.recipient;
+    const std::string& gameName = invite.game;
 
     TcpServer* server = session->getServer();
     if (!server) return;
 
     std::string senderName = session->getUsername();
-    ClientSession *targetSession = server->getSessionManager().getSessionByUsername(target);
+    Peer *targetSession = server->getSessionManager().getSessionByUsername(target);
     if (targetSession) {
         Packet pkt(PacketType::GameInvite);
         pkt.writeString(senderName);
         pkt.writeString(gameName);
         targetSession->sendPacket(pkt);
-        std::cout << "[Server] Routed GameInvite from " << senderName << " to " << target << std::endl;
+        LOG_DEBUG("[Server] Routed GameInvite from {} to {}", senderName, target);
     }
 }
 
-void GameInviteResponseHandler::handle(ClientSession* session, Packet& packet) {
+void GameInviteResponseHandler::handle(ClientSession* session, msg::GameInviteResponse& response) {
     if (!session->isLoggedIn()) return;
-    std::string originalSender, gameName;
-    bool accepted;
-    try {
-        originalSender = packet.readString();
-        gameName = packet.readString();
-        accepted = (packet.readInt() != 0);
-    } catch (...) { return; }
+    const std::string& originalSender = response.inviter;
+    const std::string& gameName = response.game;
+    bool accepted = response.accepted;
 
     TcpServer* server = session->getServer();
     if (!server) return;
 
     std::string acceptorName = session->getUsername();
-    ClientSession *originalSenderSession = server->getSessionManager().getSessionByUsername(originalSender);
+    Peer *originalSenderSession = server->getSessionManager().getSessionByUsername(originalSender);
+    // Rooms live on one server: across cluster nodes the invite is declined
+    if (accepted && originalSenderSession && !originalSenderSession->local()) {
+        accepted = false;
+        Packet err(PacketType::Error);
+        err.writeString("User " + originalSender + " is on another server; games need both players on one.");
+        session->sendPacket(err);
+    }
     if (originalSenderSession) {
         Packet respPkt(PacketType::GameInviteResponse);
         respPkt.writeString(acceptorName);
@@ -89,7 +83,7 @@ void GameInviteResponseHandler::handle(ClientSession* session, Packet& packet) {
 
     if (accepted && originalSenderSession) {
         std::string roomId = std::to_string(std::time(nullptr)) + "_" + originalSender + "_" + acceptorName;
-        server->getGameRoomManager().createRoom(roomId, originalSenderSession, session);
+        server->getGameRoomManager().createRoom(roomId, originalSenderSession->local(), session);
 
         Packet startUser1(PacketType::GameStart);
         startUser1.writeString(gameName);
@@ -107,14 +101,10 @@ void GameInviteResponseHandler::handle(ClientSession* session, Packet& packet) {
     }
 }
 
-void GameMoveHandler::handle(ClientSession* session, Packet& packet) {
+void GameMoveHandler::handle(ClientSession* session, msg::GameMove& move) {
     if (!session->isLoggedIn()) return;
-    std::string roomId;
-    uint8_t cellIndex;
-    try {
-        roomId = packet.readString();
-        cellIndex = static_cast<uint8_t>(packet.readInt());
-    } catch (...) { return; }
+    const std::string& roomId = move.roomId;
+    uint8_t cellIndex = static_cast<uint8_t>(move.cell);
 
     TcpServer* server = session->getServer();
     if (!server) return;
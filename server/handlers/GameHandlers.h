@@ -1,11 +1,13 @@
 #pragma once
-#include "IPacketHandler.h"
+#include "Messages.h"
 
 namespace wizz {
 
-class GameStatusHandler : public IPacketHandler { public: void handle(ClientSession* session, Packet& packet) override; };
-class GameInviteHandler : public IPacketHandler { public: void handle(ClientSession* session, Packet& packet) override; };
-class GameInviteResponseHandler : public IPacketHandler { public: void handle(ClientSession* session, Packet& packet) override; };
-class GameMoveHandler : public IPacketHandler { public: void handle(ClientSession* session, Packet& packet) override; };
+class ClientSession;
+
+struct GameStatusHandler { using Message = msg::GameStatus; static void handle(ClientSession* session, msg::GameStatus& status); };
+struct GameInviteHandler { using Message = msg::GameInvite; static void handle(ClientSession* session, msg::GameInvite& invite); };
+struct GameInviteResponseHandler { using Message = msg::GameInviteResponse; static void handle(ClientSession* session, msg::GameInviteResponse& response); };
+struct GameMoveHandler { using Message = msg::GameMove; static void handle(ClientSession* session, msg::GameMove& move); };
 
 }
@@ -0,0 +1,153 @@
+#include "GroupHandlers.h"
+#include "../TcpServer.h"
+#include "../ClientSession.h"
+#include "../Logger.h"
+
+namespace wizz {
+
+namespace {
+
+void sendError(ClientSession* session, const std::string& message) {
+    Packet err(PacketType::Error);
+    err.writeString(message);
+    session->sendPacket(err);
+}
+
+// Current membership to every online member, and to the other cluster
+// nodes (which hold a copy of every group)
+void broadcastGroupInfo(TcpServer* server, GroupId id) {
+    SessionManager& sessions = server->getSessionManager();
+    const GroupManager::Group* group = server->getGroupManager().getGroup(id);
+    if (ClusterLink* cluster = server->getCluster()) cluster->publishGroup(id, group);
+    if (!group) return;
+
+    Packet info = makeGroupInfo(sessions, id, *group);
+    std::vector<uint8_t> serialized = info.serialize();
+    for (UserId member : group->members) {
+        if (Peer* peer = sessions.getPeer(member)) peer->sendPacket(info, serialized);
+    }
+}
+
+} // namespace
+
+Packet makeGroupInfo(const SessionManager& sessions, GroupId id, const GroupManager::Group& group) {
+    Packet info(PacketType::GroupInfo);
+    info.writeInt(id);
+    info.writeString(group.name);
+    info.writeInt(static_cast<uint32_t>(group.members.size()));
+    for (UserId member : group.members) {
+        info.writeString(sessions.getUsername(member));
+    }
+    return info;
+}
+
+void GroupCreateHandler::handle(ClientSession* session, msg::GroupCreate& create) {
+    if (!session->isLoggedIn()) return;
+    std::string name = std::move(create.name);
+    std::vector<std::string> members = std::move(create.members);
+    members.push_back(session->getUsername());
+
+    TcpServer* server = session->getServer();
+    if (!server) return;
+    int sessionId = session->getId();
+
+    server->getDb().postTask([server, sessionId, name, members]() {
+        auto group = server->getDb().createGroup(name, members);
+        server->postResponse([server, sessionId, group = std::move(group)]() mutable {
+            if (group.id == 0) {
+                if (ClientSession* s = server->getSession(sessionId)) sendError(s, "Could not create group.");
+                return;
+            }
+            LOG_INFO("[Server] Group {} created with {} members", group.id, group.members.size());
+            server->getGroupManager().addGroup(group.id, std::move(group.name),
+                                               server->getSessionManager().internUsers(group.members));
+            broadcastGroupInfo(server, group.id);
+        });
+    });
+}
+
+// Serialized once; online members get it straight from the session table
+// and the offline ones are stored for login with one DB task.
+void GroupMessageHandler::handle(ClientSession* session, msg::GroupMessage& message) {
+    if (!session->isLoggedIn()) return;
+    GroupId id = message.group;
+    std::string& messageBody = message.body;
+
+    TcpServer* server = session->getServer();
+    if (!server) return;
+
+    UserId sender = session->getUserId();
+    const GroupManager::Group* group = server->getGroupManager().getGroup(id);
+    if (!group || !server->getGroupManager().isMember(id, sender)) {
+        sendError(session, "You are not a member of this group.");
+        return;
+    }
+
+    Packet outPacket(PacketType::GroupMessage);
+    outPacket.writeInt(id);
+    outPacket.writeString(session->getUsername());
+    outPacket.writeString(messageBody);
+    std::vector<uint8_t> serialized = outPacket.serialize();
+
+    SessionManager& sessions = server->getSessionManager();
+    std::vector<std::string> offline;
+    for (UserId member : group->members) {
+        if (member == sender) continue;
+        if (Peer* target = sessions.getPeer(member)) {
+            target->sendPacket(outPacket, serialized);
+        } else {
+            offline.push_back(sessions.getUsername(member));
+        }
+    }
+
+    server->getDb().postTask([server, id, senderName = session->getUsername(),
+                              messageBody = std::move(messageBody), offline = std::move(offline)]() {
+        server->getDb().storeGroupMessage(id, senderName, messageBody, offline);
+    });
+}
+
+void GroupLeaveHandler::handle(ClientSession* session, msg::GroupLeave& leave) {
+    if (!session->isLoggedIn()) return;
+    GroupId id = leave.group;
+
+    TcpServer* server = session->getServer();
+    if (!server) return;
+    if (!server->getGroupManager().removeMember(id, session->getUserId())) return;
+
+    std::string username = session->getUsername();
+    server->getDb().postTask([server, id, username]() {
+        server->getDb().removeGroupMember(id, username);
+    });
+    Packet confirm(PacketType::GroupLeave);
+    confirm.writeInt(id);
+    session->sendPacket(confirm);
+    broadcastGroupInfo(server, id);
+}
+
+void GroupAddMemberHandler::handle(ClientSession* session, msg::GroupAddMember& add) {
+    if (!session->isLoggedIn()) return;
+    GroupId id = add.group;
+    std::string username = std::move(add.username);
+
+    TcpServer* server = session->getServer();
+    if (!server) return;
+    if (!server->getGroupManager().isMember(id, session->getUserId())) {
+        sendError(session, "You are not a member of this group.");
+        return;
+    }
+    int sessionId = session->getId();
+
+    server->getDb().postTask([server, sessionId, id, username]() {
+        bool ok = server->getDb().addGroupMember(id, username);
+        server->postResponse([server, sessionId, id, username, ok]() {
+            if (!ok) {
+                if (ClientSession* s = server->getSession(sessionId)) sendError(s, "User " + username + " not found.");
+                return;
+            }
+            UserId member = server->getSessionManager().internUsers({username}).front();
+            if (server->getGroupManager().addMember(id, member)) broadcastGroupInfo(server, id);
+        });
+    });
+}
+
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include "Messages.h"
+#include "../GroupManager.h"
+#include "../../common/Packet.h"
+
+namespace wizz {
+
+class ClientSession;
+class SessionManager;
+
+// GroupInfo for `id`. Sent to every member whenever membership changes,
+// and for each of a user's groups at login.
+Packet makeGroupInfo(const SessionManager& sessions, GroupId id, const GroupManager::Group& group);
+
+struct GroupCreateHandler { using Message = msg::GroupCreate; static void handle(ClientSession* session, msg::GroupCreate& create); };
+struct GroupMessageHandler { using Message = msg::GroupMessage; static void handle(ClientSession* session, msg::GroupMessage& message); };
+struct GroupLeaveHandler { using Message = msg::GroupLeave; static void handle(ClientSession* session, msg::GroupLeave& leave); };
+struct GroupAddMemberHandler { using Message = msg::GroupAddMember; static void handle(ClientSession* session, msg::GroupAddMember& add); };
+
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "../../common/Packet.h"
+#include "../../common/VoiceCodec.h"
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <arpa/inet.h>
+#endif
+
+namespace wizz {
+
+// Bounds-checked reads of a packet body that fail instead of throwing.
+// Message structs (Messages.h) list their fields as `in(a) && in(b) && ...`;
+// everything here is inline, so each message type compiles to its own
+// straight-line decoder.
+class MessageReader {
+public:
+    explicit MessageReader(const Packet& packet)
+        : m_data(packet.body().data()), m_size(packet.body().size()) {}
+
+    bool operator()(uint32_t& value) {
+        if (left() < sizeof(uint32_t)) return false;
+        uint32_t network;
+        std::memcpy(&network, m_data + m_offset, sizeof(network));
+        value = ntohl(network);
+        m_offset += sizeof(uint32_t);
+        return true;
+    }
+
+    bool operator()(bool& value) {
+        uint32_t raw;
+        if (!(*this)(raw)) return false;
+        value = (raw != 0);
+        return true;
+    }
+
+    bool operator()(std::string& value) {
+        uint32_t length;
+        if (!(*this)(length) || length > left()) return false;
+        value.assign(reinterpret_cast<const char*>(m_data + m_offset), length);
+        m_offset += length;
+        return true;
+    }
+
+    // Size-prefixed blob
+    bool operator()(std::vector<uint8_t>& value) {
+        uint32_t length;
+        if (!(*this)(length) || length > left()) return false;
+        value.assign(m_data + m_offset, m_data + m_offset + length);
+        m_offset += length;
+        return true;
+    }
+
+    // Count-prefixed. Every entry takes at least its length prefix, so a
+    // count the body cannot hold is rejected before anything is allocated.
+    bool operator()(std::vector<std::string>& values) {
+        uint32_t count;
+        if (!(*this)(count) || count > left() / sizeof(uint32_t)) return false;
+        values.resize(count);
+        for (std::string& value : values) {
+            if (!(*this)(value)) return false;
+        }
+        return true;
+    }
+
+    bool operator()(VoiceCodec& codec) {
+        uint32_t raw;
+        if (!(*this)(raw) || raw > static_cast<uint32_t>(VoiceCodec::ImaAdpcm)) return false;
+        codec = static_cast<VoiceCodec>(raw);
+        return true;
+    }
+
+    // A 4-byte field appended in a later protocol revision: older clients
+    // leave it out and `value` keeps its default
+    template <typename T>
+    bool optional(T& value) {
+        return left() < sizeof(uint32_t) || (*this)(value);
+    }
+
+private:
+    size_t left() const { return m_size - m_offset; }
+
+    const uint8_t* m_data;
+    size_t m_size;
+    size_t m_offset = 0;
+};
+
+}
@@ -0,0 +1,174 @@
+#pragma once
+
+#include "../GroupManager.h"
+#include "../../common/VoiceCodec.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace wizz {
+
+// What each client -> server packet carries, in wire order. `read` is
+// instantiated with a MessageReader by PacketRouter::registerHandler; a
+// packet that does not decode never reaches its handler.
+namespace msg {
+
+struct Hello {
+    uint32_t capabilities;
+    uint32_t maxFrameSize;
+    template <typename Reader> bool read(Reader& in) { return in(capabilities) && in(maxFrameSize); }
+};
+
+struct Login {
+    std::string username;
+    std::string password;
+    uint32_t contactsVersion = 0; // Contact list the client holds; 0 = none
+    template <typename Reader> bool read(Reader& in) {
+        return in(username) && in(password) && in.optional(contactsVersion);
+    }
+};
+
+struct Register {
+    std::string username;
+    std::string password;
+    template <typename Reader> bool read(Reader& in) { return in(username) && in(password); }
+};
+
+struct Resume {
+    std::string token;
+    template <typename Reader> bool read(Reader& in) { return in(token); }
+};
+
+struct DirectMessage {
+    std::string recipient;
+    std::string body;
+    uint32_t seq = 0; // Older clients do not number their messages
+    template <typename Reader> bool read(Reader& in) {
+        return in(recipient) && in(body) && in.optional(seq);
+    }
+};
+
+struct Nudge {
+    std::string recipient;
+    template <typename Reader> bool read(Reader& in) { return in(recipient); }
+};
+
+struct VoiceMessage {
+    std::string recipient;
+    uint32_t duration;
+    std::vector<uint8_t> data;
+    VoiceCodec codec = VoiceCodec::Wav; // Absent from older clients
+    template <typename Reader> bool read(Reader& in) {
+        return in(recipient) && in(duration) && in(data) && in.optional(codec);
+    }
+};
+
+// A streamed VoiceMessage: the blob is already on disk (see InboundPacket)
+struct VoiceUpload {
+    std::string recipient;
+    uint32_t duration;
+    uint32_t size;
+    VoiceCodec codec = VoiceCodec::Wav;
+    template <typename Reader> bool read(Reader& in) {
+        return in(recipient) && in(duration) && in(size) && in.optional(codec);
+    }
+};
+
+struct TypingIndicator {
+    std::string recipient;
+    bool typing;
+    template <typename Reader> bool read(Reader& in) { return in(recipient) && in(typing); }
+};
+
+struct ContactStatusChange {
+    uint32_t status;
+    template <typename Reader> bool read(Reader& in) { return in(status); }
+};
+
+struct UpdateStatus {
+    std::string text;
+    template <typename Reader> bool read(Reader& in) { return in(text); }
+};
+
+struct UpdateAvatar {
+    std::vector<uint8_t> data;
+    template <typename Reader> bool read(Reader& in) { return in(data); }
+};
+
+// A streamed UpdateAvatar: nothing but the blob, which is already on disk
+struct AvatarUpload {
+    template <typename Reader> bool read(Reader&) { return true; }
+};
+
+struct GetAvatar {
+    std::string username;
+    template <typename Reader> bool read(Reader& in) { return in(username); }
+};
+
+struct GetAvatarIfChanged {
+    std::string username;
+    std::string knownHash;
+    template <typename Reader> bool read(Reader& in) { return in(username) && in(knownHash); }
+};
+
+struct AddContact {
+    std::string username;
+    template <typename Reader> bool read(Reader& in) { return in(username); }
+};
+
+struct RemoveContact {
+    std::string username;
+    template <typename Reader> bool read(Reader& in) { return in(username); }
+};
+
+struct GameStatus {
+    std::string game; // Empty = stopped playing
+    uint32_t score;
+    template <typename Reader> bool read(Reader& in) { return in(game) && in(score); }
+};
+
+struct GameInvite {
+    std::string recipient;
+    std::string game;
+    template <typename Reader> bool read(Reader& in) { return in(recipient) && in(game); }
+};
+
+struct GameInviteResponse {
+    std::string inviter;
+    std::string game;
+    bool accepted;
+    template <typename Reader> bool read(Reader& in) { return in(inviter) && in(game) && in(accepted); }
+};
+
+struct GameMove {
+    std::string roomId;
+    uint32_t cell;
+    template <typename Reader> bool read(Reader& in) { return in(roomId) && in(cell); }
+};
+
+struct GroupCreate {
+    std::string name;
+    std::vector<std::string> members;
+    template <typename Reader> bool read(Reader& in) { return in(name) && in(members); }
+};
+
+struct GroupMessage {
+    GroupId group;
+    std::string body;
+    template <typename Reader> bool read(Reader& in) { return in(group) && in(body); }
+};
+
+struct GroupLeave {
+    GroupId group;
+    template <typename Reader> bool read(Reader& in) { return in(group); }
+};
+
+struct GroupAddMember {
+    GroupId group;
+    std::string username;
+    template <typename Reader> bool read(Reader& in) { return in(group) && in(username); }
+};
+
+} // namespace msg
+
+}
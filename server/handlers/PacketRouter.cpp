@@ -1,23 +1,146 @@
 #include "PacketRouter.h"
+#include "Messages.h"
 #include "../ClientSession.h"
-#include <iostream>
+#include "../UploadStream.h"
+#include "../Logger.h"
+#include "../Tracer.h"
+#include <chrono>
+#include <string>
 
 namespace wizz {
 
-PacketRouter::PacketRouter() {}
+namespace {
 
-void PacketRouter::registerHandler(PacketType type, std::unique_ptr<IPacketHandler> handler) {
-    m_handlers[type] = std::move(handler);
+std::string typeLabel(PacketType type) {
+    return "type=\"" + std::to_string(static_cast<uint32_t>(type)) + "\"";
+}
+
+// Packets that set a state, where a newer one makes older ones moot. `key`
+// is what the state belongs to: typing is per recipient.
+bool isStateUpdate(const Packet& packet, std::string& key) {
+    key.clear();
+    switch (packet.type()) {
+    case PacketType::TypingIndicator: {
+        msg::TypingIndicator typing;
+        MessageReader in(packet);
+        if (!typing.read(in)) return false;
+        key = typing.recipient;
+        return true;
+    }
+    case PacketType::ContactStatusChange:
+    case PacketType::UpdateStatus:
+    case PacketType::GameStatus:
+        return true;
+    default:
+        return false;
+    }
+}
+
+} // namespace
+
+PacketRouter::PacketRouter(MetricsRegistry& metrics) : m_metrics(metrics) {
+    // Generous enough for any real client (a login fetches every contact's
+    // avatar), tight enough that a flood cannot starve other sessions
+    setRateLimit(PacketType::TypingIndicator, {10, 20});
+    setRateLimit(PacketType::GameStatus, {5, 10});
+    setRateLimit(PacketType::GetAvatar, {50, 500});
+    setRateLimit(PacketType::GetAvatarIfChanged, {50, 500});
+    setRateLimit(PacketType::Nudge, {1, 3});
+    setRateLimit(PacketType::ContactStatusChange, {5, 10});
+    setRateLimit(PacketType::UpdateStatus, {5, 10});
+    setRateLimit(PacketType::GroupMessage, {20, 50});
+}
+
+void PacketRouter::instrument(Route& route, PacketType type) {
+    route.latency = &m_metrics.histogram("wizz_handler_seconds", "Packet handler run time by packet type",
+                                         typeLabel(type), 1e-9);
+    route.malformed = &m_metrics.counter("wizz_packets_malformed_total",
+                                         "Packets dropped because their body did not decode", typeLabel(type));
+}
+
+void PacketRouter::setRateLimit(PacketType type, RateLimit limit) {
+    Route* r = route(type);
+    if (!r) {
+        LOG_WARN("[Router] Cannot rate limit unknown packet type {}", type);
+        return;
+    }
+    r->throttled = &m_metrics.counter("wizz_packets_throttled_total",
+                                      "Packets dropped by per-session rate limits", typeLabel(type));
+    r->limit = limit;
+}
+
+void PacketRouter::clearRateLimit(PacketType type) {
+    if (Route* r = route(type)) r->throttled = nullptr;
+}
+
+uint64_t PacketRouter::throttledCount(PacketType type) const {
+    const Route* r = route(type);
+    return (r && r->throttled) ? r->throttled->value() : 0;
+}
+
+uint64_t PacketRouter::malformedCount(PacketType type) const {
+    const Route* r = route(type);
+    return (r && r->malformed) ? r->malformed->value() : 0;
 }
 
 void PacketRouter::handle(ClientSession* session, Packet& packet) {
-    auto it = m_handlers.find(packet.type());
-    if (it != m_handlers.end()) {
-        it->second->handle(session, packet);
-    } else {
-        std::cout << "[Router] No handler registered for packet type: " 
-                  << static_cast<int>(packet.type()) << std::endl;
+    Route* r = route(packet.type());
+    if (!r || !r->dispatch) {
+        LOG_WARN("[Router] No handler registered for packet type: {}", packet.type());
+        return;
+    }
+
+    if (r->throttled) {
+        RateLimiter& limiter = session->getRateLimiter();
+        std::string key;
+        bool stateUpdate = isStateUpdate(packet, key);
+        if (!limiter.allow(packet.type(), r->limit, RateLimiter::Clock::now())) {
+            r->throttled->add();
+            if (limiter.startedThrottling()) {
+                LOG_WARN("[Router] Throttling packet type {} from session {}", packet.type(), session->getId());
+            }
+            if (stateUpdate) {
+                if (limiter.defer(std::move(packet), key, r->limit)) session->scheduleDeferred();
+            } else if (packet.type() == PacketType::GroupMessage) {
+                // Unlike a lost typing update, a lost message goes noticed
+                Packet err(PacketType::Error);
+                err.writeString("Sending too fast: group message not delivered");
+                session->sendPacket(err);
+            }
+            return;
+        }
+        if (stateUpdate) limiter.supersede(packet.type(), key);
+    }
+
+    dispatch(*r, session, packet);
+}
+
+void PacketRouter::replayDeferred(ClientSession* session) {
+    for (Packet& packet : session->getRateLimiter().takeDeferred(RateLimiter::Clock::now())) {
+        if (Route* r = route(packet.type())) dispatch(*r, session, packet);
     }
 }
 
+void PacketRouter::dispatch(Route& route, ClientSession* session, Packet& packet) {
+    auto start = std::chrono::steady_clock::now();
+    TraceSpan span("handler", static_cast<uint32_t>(packet.type()));
+    if (!route.dispatch(session, packet)) {
+        route.malformed->add();
+        LOG_DEBUG("[Router] Malformed packet type {} from session {}", packet.type(), session->getId());
+    }
+    route.latency->recordSince(start);
+}
+
+void PacketRouter::handleUpload(ClientSession* session, Packet& packet, const StoredUpload& upload) {
+    Route* r = route(packet.type());
+    if (!r || !r->upload) {
+        LOG_WARN("[Router] No handler registered for upload type: {}", packet.type());
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    if (!r->upload(session, packet, upload)) r->malformed->add();
+    r->latency->recordSince(start);
+}
+
 }
@@ -1,23 +1,154 @@
 #pragma once
 
-#include <unordered_map>
-#include <memory>
+#include <array>
+#include <cstdint>
+#include <type_traits>
 #include "../../common/Types.h"
 #include "../../common/Packet.h"
-#include "IPacketHandler.h"
+#include "MessageReader.h"
+#include "../Metrics.h"
+#include "../RateLimiter.h"
 
 namespace wizz {
 
+class ClientSession;
+struct StoredUpload;
+
+// Each protocol area numbers its packets consecutively (see PacketType).
+// The router keeps one dense slot per number in these ranges.
+struct PacketRange {
+    PacketType first;
+    PacketType last;
+};
+
+inline constexpr PacketRange PACKET_RANGES[] = {
+    {PacketType::Hello, PacketType::Reconnect},
+    {PacketType::Login, PacketType::ResumeFailed},
+    {PacketType::AddContact, PacketType::ContactListDelta},
+    {PacketType::DirectMessage, PacketType::TypingIndicator},
+    {PacketType::GroupCreate, PacketType::GroupAddMember},
+    {PacketType::UpdateAvatar, PacketType::AvatarNotModified},
+    {PacketType::GameStatus, PacketType::GameMove},
+    {PacketType::Error, PacketType::Error},
+};
+
+inline constexpr uint8_t NO_SLOT = 0xFF;
+
+// Slot of every type number up to Error; NO_SLOT outside the ranges
+inline constexpr auto PACKET_SLOTS = [] {
+    std::array<uint8_t, static_cast<uint32_t>(PacketType::Error) + 1> slots{};
+    for (uint8_t& slot : slots) slot = NO_SLOT;
+    uint8_t next = 0;
+    for (const PacketRange& range : PACKET_RANGES) {
+        for (uint32_t t = static_cast<uint32_t>(range.first); t <= static_cast<uint32_t>(range.last); ++t)
+            slots[t] = next++;
+    }
+    return slots;
+}();
+
+inline constexpr size_t PACKET_SLOT_COUNT = [] {
+    size_t count = 0;
+    for (const PacketRange& range : PACKET_RANGES)
+        count += static_cast<uint32_t>(range.last) - static_cast<uint32_t>(range.first) + 1;
+    return count;
+}();
+
+constexpr uint8_t packetSlot(PacketType type) {
+    uint32_t value = static_cast<uint32_t>(type);
+    return value < PACKET_SLOTS.size() ? PACKET_SLOTS[value] : NO_SLOT;
+}
+
+static_assert(PACKET_SLOT_COUNT < NO_SLOT, "Packet slots must fit in a byte");
+
 class PacketRouter {
 public:
-    PacketRouter();
+    // Handler latency and throttling are recorded per packet type
+    explicit PacketRouter(MetricsRegistry& metrics);
     ~PacketRouter() = default;
 
-    void registerHandler(PacketType type, std::unique_ptr<IPacketHandler> handler);
+    // A handler is a type with
+    //   using Message = msg::...;  (Messages.h)
+    //   static void handle(ClientSession*, Message&);
+    // and, for streamed packets, `using Upload = msg::...;` with
+    //   static void handleUpload(ClientSession*, Upload&, const StoredUpload&);
+    // The decoder and the call are generated here, so dispatch is one slot
+    // lookup and a direct call into the handler.
+    template <PacketType Type, typename Handler>
+    void registerHandler() {
+        static_assert(packetSlot(Type) != NO_SLOT, "Packet type has no slot");
+        Route& route = m_routes[packetSlot(Type)];
+        route.dispatch = &dispatch<Handler>;
+        if constexpr (HasUpload<Handler>::value) route.upload = &dispatchUpload<Handler>;
+        instrument(route, Type);
+    }
+
     void handle(ClientSession* session, Packet& packet);
+    void handleUpload(ClientSession* session, Packet& packet, const StoredUpload& upload);
+
+    // Per-session token buckets for packets that cost a fan-out or a DB task.
+    // Packets over the limit are dropped before dispatch, except state
+    // updates (typing, status), which wait for a token with only the latest
+    // one kept, and group messages, which the sender is told about.
+    void setRateLimit(PacketType type, RateLimit limit);
+    void clearRateLimit(PacketType type);
+    uint64_t throttledCount(PacketType type) const;
+    // Packets of `type` whose body did not decode
+    uint64_t malformedCount(PacketType type) const;
+
+    // Dispatches the deferred state updates a token has freed up for
+    void replayDeferred(ClientSession* session);
 
 private:
-    std::unordered_map<PacketType, std::unique_ptr<IPacketHandler>> m_handlers;
+    // False if the body did not decode
+    using Dispatch = bool (*)(ClientSession*, Packet&);
+    using UploadDispatch = bool (*)(ClientSession*, Packet&, const StoredUpload&);
+
+    // One cache line per packet type
+    struct alignas(64) Route {
+        Dispatch dispatch = nullptr;
+        UploadDispatch upload = nullptr;
+        Histogram* latency = nullptr;
+        Counter* malformed = nullptr;
+        Counter* throttled = nullptr; // Set while rate limited
+        RateLimit limit{};
+    };
+
+    template <typename Handler, typename = void>
+    struct HasUpload : std::false_type {};
+    template <typename Handler>
+    struct HasUpload<Handler, std::void_t<typename Handler::Upload>> : std::true_type {};
+
+    template <typename Handler>
+    static bool dispatch(ClientSession* session, Packet& packet) {
+        typename Handler::Message message;
+        MessageReader in(packet);
+        if (!message.read(in)) return false;
+        Handler::handle(session, message);
+        return true;
+    }
+
+    template <typename Handler>
+    static bool dispatchUpload(ClientSession* session, Packet& packet, const StoredUpload& upload) {
+        typename Handler::Upload message;
+        MessageReader in(packet);
+        if (!message.read(in)) return false;
+        Handler::handleUpload(session, message, upload);
+        return true;
+    }
+
+    Route* route(PacketType type) {
+        uint8_t slot = packetSlot(type);
+        return slot != NO_SLOT ? &m_routes[slot] : nullptr;
+    }
+    const Route* route(PacketType type) const {
+        uint8_t slot = packetSlot(type);
+        return slot != NO_SLOT ? &m_routes[slot] : nullptr;
+    }
+    void instrument(Route& route, PacketType type);
+    void dispatch(Route& route, ClientSession* session, Packet& packet);
+
+    MetricsRegistry& m_metrics;
+    std::array<Route, PACKET_SLOT_COUNT> m_routes{};
 };
 
 }
@@ -2,6 +2,9 @@
 #include "../TcpServer.h"
 #include "../ClientSession.h"
 #include "../../common/Packet.h"
+#include "../ContentHash.h"
+#include "../UploadStream.h"
+#include "../../common/VoiceCodec.h"
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -9,42 +12,326 @@
 
 namespace wizz {
 
-void MessageHandler::handle(ClientSession* session, Packet& packet) {
+namespace {
+
+struct StoredAvatar {
+    std::vector<uint8_t> bytes;
+    std::string hash;
+};
+
+// File helpers; they block, so they run on the DB thread
+bool writeFile(const std::string& path, const std::vector<uint8_t>& data) {
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+    std::ofstream outfile(path, std::ios::binary);
+    if (!outfile.is_open()) return false;
+    outfile.write(reinterpret_cast<const char *>(data.data()), data.size());
+    return static_cast<bool>(outfile);
+}
+
+// Claims a streamed upload (see StoredUpload)
+bool moveFile(const std::string& from, const std::string& to) {
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(to).parent_path(), ec);
+    std::filesystem::rename(from, to, ec);
+    return !ec;
+}
+
+std::vector<uint8_t> readFile(const std::string& path) {
+    std::vector<uint8_t> data;
+    std::ifstream infile(path, std::ios::binary | std::ios::ate);
+    if (!infile.is_open()) return data;
+    std::streamsize size = infile.tellg();
+    infile.seekg(0, std::ios::beg);
+    data.resize(size);
+    if (!infile.read(reinterpret_cast<char *>(data.data()), size)) data.clear();
+    return data;
+}
+
+// Runs on the DB thread. Backfills the hash of avatars uploaded before
+// hashes were tracked.
+StoredAvatar loadAvatar(TcpServer* server, const std::string& username) {
+    StoredAvatar avatar;
+    std::string filepath = server->getDb().getUserAvatar(username);
+    if (filepath.empty() || !std::filesystem::exists(std::filesystem::path(filepath))) {
+        return avatar;
+    }
+
+    avatar.bytes = readFile(filepath);
+    avatar.hash = server->getDb().getAvatarHash(username);
+    if (avatar.hash.empty() && !avatar.bytes.empty()) {
+        avatar.hash = ContentHash::of(avatar.bytes.data(), avatar.bytes.size());
+        server->getDb().setAvatarHash(username, avatar.hash);
+    }
+    return avatar;
+}
+
+// Runs on the io thread. Serializes the AvatarData packet once and keeps it
+// in the cache; an empty entry remembers "no avatar" so we skip the DB next time.
+AvatarCache::Bytes cacheAvatar(TcpServer* server, const std::string& username,
+                               const StoredAvatar& avatar, uint64_t generation) {
+    auto serialized = std::make_shared<std::vector<uint8_t>>();
+    if (!avatar.bytes.empty()) {
+        Packet resp(PacketType::AvatarData);
+        resp.writeString(username);
+        resp.writeInt(static_cast<uint32_t>(avatar.bytes.size()));
+        resp.writeData(avatar.bytes.data(), avatar.bytes.size());
+        resp.writeString(avatar.hash);
+        *serialized = resp.serialize();
+    }
+    server->getAvatarCache().put(username, serialized, avatar.hash, generation);
+    return serialized;
+}
+
+void sendNotModified(ClientSession* session, const std::string& username) {
+    Packet resp(PacketType::AvatarNotModified);
+    resp.writeString(username);
+    session->sendPacket(resp);
+}
+
+// An empty AvatarData: the user has no avatar. Every request gets an answer,
+// or the client would keep waiting for one.
+void sendNoAvatar(ClientSession* session, const std::string& username) {
+    Packet resp(PacketType::AvatarData);
+    resp.writeString(username);
+    resp.writeInt(0);
+    resp.writeString("");
+    session->sendPacket(resp);
+}
+
+// Shared by GetAvatar (knownHash empty) and GetAvatarIfChanged.
+void serveAvatar(ClientSession* session, const std::string& targetUser, const std::string& knownHash) {
+    TcpServer* server = session->getServer();
+    if (!server) return;
+
+    // Fast path: served from memory, no DB or disk access
+    if (const AvatarCache::Avatar *cached = server->getAvatarCache().get(targetUser)) {
+        if (!knownHash.empty() && cached->hash == knownHash) {
+            sendNotModified(session, targetUser);
+        } else if (!cached->packet->empty()) {
+            session->sendSerialized(*cached->packet);
+        } else {
+            sendNoAvatar(session, targetUser);
+        }
+        return;
+    }
+
+    int sessionId = session->getId();
+    uint64_t generation = server->getAvatarCache().generation(targetUser);
+
+    server->getDb().postTask([server, sessionId, targetUser, knownHash, generation]() {
+        // Cheap check first: an unchanged avatar never gets read from disk
+        if (!knownHash.empty() && server->getDb().getAvatarHash(targetUser) == knownHash) {
+            server->postResponse([server, sessionId, targetUser]() {
+                ClientSession *s = server->getSession(sessionId);
+                if (s) sendNotModified(s, targetUser);
+            });
+            return;
+        }
+
+        StoredAvatar avatar = loadAvatar(server, targetUser);
+        server->postResponse([server, sessionId, targetUser, generation, avatar = std::move(avatar)]() {
+            auto serialized = cacheAvatar(server, targetUser, avatar, generation);
+            ClientSession *s = server->getSession(sessionId);
+            if (!s) return;
+            if (serialized->empty()) {
+                sendNoAvatar(s, targetUser);
+            } else {
+                s->sendSerialized(*serialized);
+            }
+        });
+    });
+}
+
+// The extension records the codec, so offline delivery knows what it holds
+std::string voiceFilePath(const std::string& username, VoiceCodec codec) {
+    long long timestamp = std::time(nullptr);
+    std::filesystem::path storageDir = std::filesystem::path("server") / "storage";
+    std::string filename = "voice_" + username + "_" + std::to_string(timestamp) +
+                           (codec == VoiceCodec::ImaAdpcm ? ".ima" : ".wav");
+    return (storageDir / filename).string();
+}
+
+// Runs on the DB thread. The offline form of a voice note: a "VOICE:" proxy
+// message pointing at the stored file. Like a direct message, a note for a
+// user on another node goes this way and their node sends it on.
+void storeVoice(TcpServer* server, const std::string& senderName, const std::string& targetUser,
+                uint32_t duration, const std::string& filepath) {
+    std::string proxyMsg = "VOICE:" + std::to_string(duration) + ":" + filepath;
+    if (!server->getDb().storeMessage(senderName, targetUser, proxyMsg, false)) return;
+    server->postResponse([server, targetUser]() { server->notifyPending(targetUser); });
+}
+
+// Runs on the DB thread once a streamed voice note is stored: read back for
+// live delivery, or stored offline if the target left in the meantime.
+void deliverVoice(TcpServer* server, const std::string& senderName, const std::string& targetUser,
+                  uint32_t duration, VoiceCodec codec, const std::string& filepath) {
+    std::vector<uint8_t> data = readFile(filepath);
+    if (data.empty()) return;
+    server->postResponse([server, senderName, targetUser, duration, codec, filepath, data = std::move(data)]() {
+        Peer *targetSession = server->getSessionManager().getSessionByUsername(targetUser);
+        if (ClientSession *local = targetSession ? targetSession->local() : nullptr) {
+            local->sendPacket(makeVoicePacket(local, senderName, duration, codec, data));
+            return;
+        }
+        server->getDb().postTask([server, senderName, targetUser, duration, filepath]() {
+            storeVoice(server, senderName, targetUser, duration, filepath);
+        });
+    });
+}
+
+std::string avatarFilePath(const std::string& username) {
+    long long timestamp = std::time(nullptr);
+    std::filesystem::path storageDir = std::filesystem::path("server") / "storage" / "avatars";
+    std::string filename = "avatar_" + username + "_" + std::to_string(timestamp) + ".png";
+    return (storageDir / filename).string();
+}
+
+// Stores the new avatar file, records it and pushes it to online friends.
+// `avatar.bytes` is empty for streamed uploads: `uploadPath` is moved into
+// place and read back instead. Runs on the io thread, which owns the avatar
+// cache; the file and database work is posted to the DB thread.
+void publishAvatar(TcpServer* server, const std::string& username, const std::string& filepath,
+                   StoredAvatar avatar, const std::string& uploadPath = "") {
+    // Drop the stale copy now; the DB queue is FIFO so any GetAvatar posted
+    // after this point reads the new path.
+    server->getAvatarCache().invalidate(username);
+    uint64_t generation = server->getAvatarCache().generation(username);
+
+    server->getDb().postTask([server, username, filepath, avatar = std::move(avatar), uploadPath,
+                              generation]() mutable {
+        bool stored = uploadPath.empty() ? writeFile(filepath, avatar.bytes) : moveFile(uploadPath, filepath);
+        if (!stored) return;
+        if (server->getDb().updateUserAvatar(username, filepath, avatar.hash)) {
+            if (avatar.bytes.empty()) avatar = loadAvatar(server, username);
+            auto friends = server->getDb().getFriends(username);
+            server->postResponse([server, username, friends = std::move(friends),
+                                  avatar = std::move(avatar), generation]() {
+                // Only now: the other nodes read the new path once told
+                if (ClusterLink* cluster = server->getCluster()) cluster->publishAvatarChange(username);
+                auto serialized = cacheAvatar(server, username, avatar, generation);
+                for (const auto &friendName : friends) {
+                    Peer *targetSession = server->getSessionManager().getSessionByUsername(friendName);
+                    if (targetSession) targetSession->sendSerialized(*serialized);
+                }
+            });
+        }
+    });
+}
+
+// Re-indexes presence subscriptions after the contact list changed
+void refreshContacts(TcpServer* server, ClientSession* session, const std::vector<std::string>& friends,
+                     const std::vector<std::string>& followers) {
+    if (server->getSessionManager().getSession(session->getUserId()) != session) return;
+    std::vector<std::string> contacts = friends;
+    contacts.insert(contacts.end(), followers.begin(), followers.end());
+    server->getSessionManager().updateContacts(session->getUserId(), contacts);
+}
+
+} // namespace
+
+Packet makeContactList(const SessionManager& sessions, const std::vector<std::string>& friends,
+                       const std::unordered_map<std::string, std::string>& avatarHashes, uint32_t version) {
+    Packet list(PacketType::ContactList);
+    list.writeInt(static_cast<uint32_t>(friends.size()));
+    for (const auto& name : friends) {
+        list.writeString(name);
+        list.writeInt(static_cast<uint32_t>(sessions.getStatus(name)));
+        list.writeString(sessions.getCustomStatus(name));
+        auto hashIt = avatarHashes.find(name);
+        list.writeString(hashIt != avatarHashes.end() ? hashIt->second : "");
+    }
+    list.writeInt(version);
+    return list;
+}
+
+// Removed friends carry no presence or avatar
+Packet makeContactListDelta(const SessionManager& sessions,
+                            const std::vector<DatabaseManager::ContactChange>& changes,
+                            const std::unordered_map<std::string, std::string>& avatarHashes, uint32_t version) {
+    Packet delta(PacketType::ContactListDelta);
+    delta.writeInt(version);
+    delta.writeInt(static_cast<uint32_t>(changes.size()));
+    for (const auto& change : changes) {
+        delta.writeString(change.name);
+        delta.writeInt(change.added ? 1 : 0);
+        delta.writeInt(change.added ? static_cast<uint32_t>(sessions.getStatus(change.name)) : 3);
+        delta.writeString(change.added ? sessions.getCustomStatus(change.name) : "");
+        auto hashIt = avatarHashes.find(change.name);
+        delta.writeString(change.added && hashIt != avatarHashes.end() ? hashIt->second : "");
+    }
+    return delta;
+}
+
+Packet makeVoicePacket(const Peer* target, const std::string& sender, uint32_t duration,
+                       VoiceCodec codec, const std::vector<uint8_t>& data) {
+    Packet p(PacketType::VoiceMessage);
+    p.writeString(sender);
+    p.writeInt(duration);
+
+    if (codec == VoiceCodec::ImaAdpcm && !target->hasCapability(CapVoiceAdpcm)) {
+        // Older client: hand it plain WAV so the note still plays
+        std::vector<int16_t> pcm;
+        uint32_t sampleRate = 0;
+        std::vector<uint8_t> wav;
+        if (decodeImaAdpcm(data.data(), data.size(), pcm, sampleRate)) {
+            wav = encodeWav(pcm.data(), pcm.size(), 1, sampleRate);
+        }
+        p.writeInt(static_cast<uint32_t>(wav.size()));
+        p.writeData(wav.data(), wav.size());
+        p.writeInt(static_cast<uint32_t>(VoiceCodec::Wav));
+        return p;
+    }
+
+    p.writeInt(static_cast<uint32_t>(data.size()));
+    p.writeData(data.data(), data.size());
+    p.writeInt(static_cast<uint32_t>(codec));
+    return p;
+}
+
+void MessageHandler::handle(ClientSession* session, msg::DirectMessage& message) {
     if (!session->isLoggedIn()) return;
-    std::string targetUser, messageBody;
-    try {
-        targetUser = packet.readString();
-        messageBody = packet.readString();
-    } catch (...) { return; }
+    std::string& targetUser = message.recipient;
+    std::string& messageBody = message.body;
+    uint32_t seq = message.seq;
 
     TcpServer* server = session->getServer();
     if (!server) return;
+    if (seq != 0 && !session->acceptMessageSeq(seq)) return; // Retry
 
+    // Only sent straight to a session here. For a user on another node it
+    // goes to the offline log, and their node sends it from there once told
+    // (TcpServer's commit handler): nothing lost on the link is lost for good.
     bool delivered = false;
-    ClientSession *targetSession = server->getSessionManager().getSessionByUsername(targetUser);
-    if (targetSession) {
+    Peer *targetSession = server->getSessionManager().getSessionByUsername(targetUser);
+    if (ClientSession *local = targetSession ? targetSession->local() : nullptr) {
+        local->flushTyping(session->getUsername());
         Packet outPacket(PacketType::DirectMessage);
         outPacket.writeString(session->getUsername());
         outPacket.writeString(messageBody);
-        targetSession->sendPacket(outPacket);
+        local->sendPacket(outPacket);
         delivered = true;
     }
     
-    server->getDb().postTask([server, senderName = session->getUsername(), targetUser, messageBody, delivered]() {
-        server->getDb().storeMessage(senderName, targetUser, messageBody, delivered);
-    });
+    DatabaseManager::QueuedMessage stored;
+    stored.sender = session->getUsername();
+    stored.recipient = std::move(targetUser);
+    stored.body = std::move(messageBody);
+    stored.isDelivered = delivered;
+    stored.sessionId = session->getId();
+    stored.seq = seq;
+    server->getDb().queueMessage(std::move(stored));
 }
 
-void NudgeHandler::handle(ClientSession* session, Packet& packet) {
+void NudgeHandler::handle(ClientSession* session, msg::Nudge& nudge) {
     if (!session->isLoggedIn()) return;
-    std::string targetUser;
-    try { targetUser = packet.readString(); } catch (...) { return; }
+    const std::string& targetUser = nudge.recipient;
 
     TcpServer* server = session->getServer();
     if (!server) return;
 
     int status = server->getSessionManager().getStatus(targetUser);
-    ClientSession *targetSession = server->getSessionManager().getSessionByUsername(targetUser);
+    Peer *targetSession = server->getSessionManager().getSessionByUsername(targetUser);
     bool isOnline = (targetSession != nullptr);
 
     if (!isOnline) {
@@ -64,248 +351,175 @@ void NudgeHandler::handle(ClientSession* session, Packet& packet) {
     targetSession->sendPacket(p);
 }
 
-void VoiceMessageHandler::handle(ClientSession* session, Packet& packet) {
+void VoiceMessageHandler::handle(ClientSession* session, msg::VoiceMessage& voice) {
     if (!session->isLoggedIn()) return;
-    std::string targetUser;
-    uint32_t duration;
-    std::vector<uint8_t> data;
-    try {
-        targetUser = packet.readString();
-        duration = packet.readInt();
-        uint32_t size = packet.readInt();
-        data = packet.readBytes(size);
-    } catch (...) { return; }
-
     TcpServer* server = session->getServer();
     if (!server) return;
 
-    long long timestamp = std::time(nullptr);
-    std::filesystem::path storageDir = std::filesystem::path("server") / "storage";
-    std::string filename = "voice_" + session->getUsername() + "_" + std::to_string(timestamp) + ".wav";
-    std::string filepath = (storageDir / filename).string();
-
-    std::ofstream outfile(filepath, std::ios::binary);
-    if (outfile.is_open()) {
-        outfile.write(reinterpret_cast<const char *>(data.data()), data.size());
-        outfile.close();
+    std::string senderName = session->getUsername();
+    std::string filepath = voiceFilePath(senderName, voice.codec);
+    // Only a session here counts as online: see storeVoice
+    Peer *targetSession = server->getSessionManager().getSessionByUsername(voice.recipient);
+    ClientSession *local = targetSession ? targetSession->local() : nullptr;
+    if (local) {
+        local->sendPacket(makeVoicePacket(local, senderName, voice.duration, voice.codec, voice.data));
     }
 
-    ClientSession *targetSession = server->getSessionManager().getSessionByUsername(targetUser);
-    if (targetSession) {
-        Packet p(PacketType::VoiceMessage);
-        p.writeString(session->getUsername());
-        p.writeInt(static_cast<uint32_t>(duration));
-        p.writeInt(static_cast<uint32_t>(data.size()));
-        p.writeData(data.data(), data.size());
-        targetSession->sendPacket(p);
-    } else {
-        std::string proxyMsg = "VOICE:" + std::to_string(duration) + ":" + filepath;
-        server->getDb().postTask([server, senderName = session->getUsername(), targetUser, proxyMsg]() {
-            server->getDb().storeMessage(senderName, targetUser, proxyMsg, false);
-        });
-    }
+    server->getDb().postTask([server, senderName, targetUser = voice.recipient, duration = voice.duration,
+                              filepath, data = std::move(voice.data), online = local != nullptr]() {
+        if (!writeFile(filepath, data)) return;
+        if (!online) storeVoice(server, senderName, targetUser, duration, filepath);
+    });
 }
 
-void TypingIndicatorHandler::handle(ClientSession* session, Packet& packet) {
+void VoiceMessageHandler::handleUpload(ClientSession* session, msg::VoiceUpload& voice, const StoredUpload& upload) {
     if (!session->isLoggedIn()) return;
-    std::string targetUser;
-    bool isTyping;
-    try {
-        targetUser = packet.readString();
-        isTyping = (packet.readInt() != 0);
-    } catch (...) { return; }
+    TcpServer* server = session->getServer();
+    if (!server) return;
+
+    std::string senderName = session->getUsername();
+    std::string filepath = voiceFilePath(senderName, voice.codec);
+    Peer *targetSession = server->getSessionManager().getSessionByUsername(voice.recipient);
+    bool online = targetSession && targetSession->local();
+
+    // Queued behind the upload's own writes, so the file is complete here
+    server->getDb().postTask([server, senderName, targetUser = voice.recipient, duration = voice.duration,
+                              codec = voice.codec, filepath, uploadPath = upload.path, online]() {
+        if (!moveFile(uploadPath, filepath)) return;
+        if (online) {
+            deliverVoice(server, senderName, targetUser, duration, codec, filepath);
+        } else {
+            storeVoice(server, senderName, targetUser, duration, filepath);
+        }
+    });
+}
+
+void TypingIndicatorHandler::handle(ClientSession* session, msg::TypingIndicator& typing) {
+    if (!session->isLoggedIn()) return;
+    const std::string& targetUser = typing.recipient;
+    bool isTyping = typing.typing;
 
     TcpServer* server = session->getServer();
     if (!server) return;
 
-    ClientSession *targetSession = server->getSessionManager().getSessionByUsername(targetUser);
+    Peer *targetSession = server->getSessionManager().getSessionByUsername(targetUser);
     if (targetSession) {
-        Packet p(PacketType::TypingIndicator);
-        p.writeString(session->getUsername());
-        p.writeInt(isTyping ? 1 : 0);
-        targetSession->sendPacket(p);
+        targetSession->queueTyping(session->getUsername(), isTyping);
     }
 }
 
-void StatusChangeHandler::handle(ClientSession* session, Packet& packet) {
+void StatusChangeHandler::handle(ClientSession* session, msg::ContactStatusChange& change) {
     if (!session->isLoggedIn()) return;
-    int newStatus;
-    try {
-        newStatus = static_cast<int>(packet.readInt());
-    } catch (...) { return; }
+    int newStatus = static_cast<int>(change.status);
 
     TcpServer* server = session->getServer();
     if (!server) return;
 
     std::string username = session->getUsername();
-    server->getSessionManager().updateStatus(username, newStatus);
-
-    server->getDb().postTask([server, username, newStatus]() {
-        auto followers = server->getDb().getFollowers(username);
-        auto friends = server->getDb().getFriends(username);
-
-        server->postResponse([server, username, newStatus, followers = std::move(followers), friends = std::move(friends)]() {
-            std::string customStatus = server->getSessionManager().getCustomStatus(username);
-            std::set<std::string> contacts;
-            for (const auto &f : followers) contacts.insert(f);
-            for (const auto &f : friends) contacts.insert(f);
-
-            for (const auto &contactName : contacts) {
-                ClientSession *targetSession = server->getSessionManager().getSessionByUsername(contactName);
-                if (targetSession) {
-                    Packet notify(PacketType::ContactStatusChange);
-                    notify.writeInt(static_cast<uint32_t>(newStatus));
-                    notify.writeString(username);
-                    notify.writeString(customStatus);
-                    targetSession->sendPacket(notify);
-                }
-            }
-        });
-    });
+    SessionManager& sessions = server->getSessionManager();
+    sessions.updateStatus(username, newStatus);
+
+    const std::string& customStatus = sessions.getCustomStatus(session->getUserId());
+    for (ClientSession *targetSession : sessions.getSubscribers(session->getUserId())) {
+        targetSession->queueStatus(username, static_cast<uint32_t>(newStatus), customStatus);
+    }
+    server->publishPresence(username, static_cast<uint32_t>(newStatus), customStatus, session->capabilities());
 }
 
-void UpdateStatusHandler::handle(ClientSession* session, Packet& packet) {
+void UpdateStatusHandler::handle(ClientSession* session, msg::UpdateStatus& update) {
     if (!session->isLoggedIn()) return;
-    std::string statusMsg;
-    try { statusMsg = packet.readString(); } catch (...) { return; }
+    const std::string& statusMsg = update.text;
 
     TcpServer* server = session->getServer();
     if (!server) return;
 
     std::string username = session->getUsername();
-    server->getSessionManager().updateCustomStatus(username, statusMsg);
+    SessionManager& sessions = server->getSessionManager();
+    sessions.updateCustomStatus(username, statusMsg);
 
     server->getDb().postTask([server, username, statusMsg]() {
         server->getDb().updateCustomStatus(username, statusMsg);
-        auto followers = server->getDb().getFollowers(username);
-        auto friends = server->getDb().getFriends(username);
-
-        server->postResponse([server, username, statusMsg, followers = std::move(followers), friends = std::move(friends)]() {
-            std::set<std::string> contacts;
-            for (const auto &f : followers) contacts.insert(f);
-            for (const auto &f : friends) contacts.insert(f);
-
-            int currentStatus = server->getSessionManager().getStatus(username);
-            Packet notify(PacketType::ContactStatusChange);
-            notify.writeInt(static_cast<uint32_t>(currentStatus));
-            notify.writeString(username);
-            notify.writeString(statusMsg);
-
-            for (const auto &contactName : contacts) {
-                ClientSession *targetSession = server->getSessionManager().getSessionByUsername(contactName);
-                if (targetSession) targetSession->sendPacket(notify);
-            }
-        });
     });
+
+    int currentStatus = sessions.getStatus(session->getUserId());
+    for (ClientSession *targetSession : sessions.getSubscribers(session->getUserId())) {
+        targetSession->queueStatus(username, static_cast<uint32_t>(currentStatus), statusMsg);
+    }
+    server->publishPresence(username, static_cast<uint32_t>(currentStatus), statusMsg, session->capabilities());
 }
 
-void UpdateAvatarHandler::handle(ClientSession* session, Packet& packet) {
+void UpdateAvatarHandler::handle(ClientSession* session, msg::UpdateAvatar& avatar) {
     if (!session->isLoggedIn()) return;
-    std::vector<uint8_t> data;
-    try {
-        uint32_t size = packet.readInt();
-        data = packet.readBytes(size);
-    } catch (...) { return; }
+    std::vector<uint8_t>& data = avatar.data;
 
     TcpServer* server = session->getServer();
     if (!server) return;
 
     std::string username = session->getUsername();
-    long long timestamp = std::time(nullptr);
-    std::filesystem::path storageDir = std::filesystem::path("server") / "storage" / "avatars";
-
-    if (!std::filesystem::exists(storageDir)) std::filesystem::create_directories(storageDir);
-
-    std::string filename = "avatar_" + username + "_" + std::to_string(timestamp) + ".png";
-    std::string filepath = (storageDir / filename).string();
-
-    std::ofstream outfile(filepath, std::ios::binary);
-    if (!outfile.is_open()) return;
-    outfile.write(reinterpret_cast<const char *>(data.data()), data.size());
-    outfile.close();
-
-    server->getDb().postTask([server, username, filepath, data]() {
-        if (server->getDb().updateUserAvatar(username, filepath)) {
-            auto friends = server->getDb().getFriends(username);
-            server->postResponse([server, username, friends = std::move(friends), data]() {
-                for (const auto &friendName : friends) {
-                    ClientSession *targetSession = server->getSessionManager().getSessionByUsername(friendName);
-                    if (targetSession) {
-                        Packet resp(PacketType::AvatarData);
-                        resp.writeString(username);
-                        resp.writeInt(static_cast<uint32_t>(data.size()));
-                        resp.writeData(data.data(), data.size());
-                        targetSession->sendPacket(resp);
-                    }
-                }
-            });
-        }
-    });
+    std::string filepath = avatarFilePath(username);
+    std::string hash = ContentHash::of(data.data(), data.size());
+    publishAvatar(server, username, filepath, StoredAvatar{std::move(data), std::move(hash)});
 }
 
-void GetAvatarHandler::handle(ClientSession* session, Packet& packet) {
-    if (!session->isLoggedIn()) return;
-    std::string targetUser;
-    try { targetUser = packet.readString(); } catch (...) { return; }
-
+void UpdateAvatarHandler::handleUpload(ClientSession* session, msg::AvatarUpload& /*avatar*/,
+                                       const StoredUpload& upload) {
+    if (!session->isLoggedIn() || upload.size == 0) return;
     TcpServer* server = session->getServer();
     if (!server) return;
-    int sessionId = session->getId();
 
-    server->getDb().postTask([server, sessionId, targetUser]() {
-        std::string filepath = server->getDb().getUserAvatar(targetUser);
-        std::vector<uint8_t> buffer;
-        if (!filepath.empty() && std::filesystem::exists(std::filesystem::path(filepath))) {
-            std::ifstream infile(filepath, std::ios::binary | std::ios::ate);
-            if (infile.is_open()) {
-                std::streamsize size = infile.tellg();
-                infile.seekg(0, std::ios::beg);
-                buffer.resize(size);
-                infile.read(reinterpret_cast<char *>(buffer.data()), size);
-            }
-        }
+    std::string username = session->getUsername();
+    publishAvatar(server, username, avatarFilePath(username), StoredAvatar{{}, upload.hash}, upload.path);
+}
 
-        server->postResponse([server, sessionId, targetUser, filepath, buffer = std::move(buffer)]() {
-            ClientSession *s = server->getSession(sessionId);
-            if (!s || filepath.empty() || buffer.empty()) return;
+void GetAvatarHandler::handle(ClientSession* session, msg::GetAvatar& request) {
+    if (!session->isLoggedIn()) return;
+    serveAvatar(session, request.username, "");
+}
 
-            Packet resp(PacketType::AvatarData);
-            resp.writeString(targetUser);
-            resp.writeInt(static_cast<uint32_t>(buffer.size()));
-            resp.writeData(buffer.data(), buffer.size());
-            s->sendPacket(resp);
-        });
-    });
+void GetAvatarIfChangedHandler::handle(ClientSession* session, msg::GetAvatarIfChanged& request) {
+    if (!session->isLoggedIn()) return;
+    serveAvatar(session, request.username, request.knownHash);
 }
 
-void AddContactHandler::handle(ClientSession* session, Packet& packet) {
+// Contact edits by CapContactDeltas clients are answered with the one change
+// and the new version; older clients get the whole list again
+void AddContactHandler::handle(ClientSession* session, msg::AddContact& add) {
     if (!session->isLoggedIn()) return;
-    std::string targetUser;
-    try { targetUser = packet.readString(); } catch (...) { return; }
+    const std::string& targetUser = add.username;
 
     TcpServer* server = session->getServer();
     if (!server) return;
     int sessionId = session->getId();
     std::string username = session->getUsername();
+    bool deltas = session->hasCapability(CapContactDeltas);
 
-    server->getDb().postTask([server, sessionId, username, targetUser]() {
+    server->getDb().postTask([server, sessionId, username, targetUser, deltas]() {
         bool ok = server->getDb().addFriend(username, targetUser);
-        std::vector<std::string> friends;
-        if (ok) friends = server->getDb().getFriends(username);
+        std::vector<std::string> friends, followers;
+        std::unordered_map<std::string, std::string> avatarHashes;
+        uint32_t version = 0;
+        if (ok) {
+            friends = server->getDb().getFriends(username);
+            followers = server->getDb().getFollowers(username);
+            if (deltas) {
+                avatarHashes[targetUser] = server->getDb().getAvatarHash(targetUser);
+            } else {
+                avatarHashes = server->getDb().getFriendAvatarHashes(username);
+            }
+            version = server->getDb().getContactsVersion(username);
+        }
 
-        server->postResponse([server, sessionId, ok, friends = std::move(friends)]() {
+        server->postResponse([server, sessionId, ok, targetUser, deltas, version,
+                              friends = std::move(friends), followers = std::move(followers),
+                              avatarHashes = std::move(avatarHashes)]() {
             ClientSession *s = server->getSession(sessionId);
             if (!s) return;
 
             if (ok) {
-                Packet resp(PacketType::ContactList);
-                resp.writeInt(static_cast<uint32_t>(friends.size()));
-                for (const auto &name : friends) {
-                    resp.writeString(name);
-                    resp.writeInt(static_cast<uint32_t>(server->getSessionManager().getStatus(name)));
-                    resp.writeString(server->getSessionManager().getCustomStatus(name));
-                }
-                s->sendPacket(resp);
+                refreshContacts(server, s, friends, followers);
+                SessionManager& sessions = server->getSessionManager();
+                s->sendPacket(deltas ? makeContactListDelta(sessions, {{targetUser, true}}, avatarHashes, version)
+                                     : makeContactList(sessions, friends, avatarHashes, version));
             } else {
                 Packet err(PacketType::Error);
                 err.writeString("Failed to add contact: User not found.");
@@ -315,34 +529,39 @@ void AddContactHandler::handle(ClientSession* session, Packet& packet) {
     });
 }
 
-void RemoveContactHandler::handle(ClientSession* session, Packet& packet) {
+void RemoveContactHandler::handle(ClientSession* session, msg::RemoveContact& remove) {
     if (!session->isLoggedIn()) return;
-    std::string targetUser;
-    try { targetUser = packet.readString(); } catch (...) { return; }
+    const std::string& targetUser = remove.username;
 
     TcpServer* server = session->getServer();
     if (!server) return;
     int sessionId = session->getId();
     std::string username = session->getUsername();
+    bool deltas = session->hasCapability(CapContactDeltas);
 
-    server->getDb().postTask([server, sessionId, username, targetUser]() {
+    server->getDb().postTask([server, sessionId, username, targetUser, deltas]() {
         bool ok = server->getDb().removeFriend(username, targetUser);
-        std::vector<std::string> friends;
-        if (ok) friends = server->getDb().getFriends(username);
+        std::vector<std::string> friends, followers;
+        std::unordered_map<std::string, std::string> avatarHashes;
+        uint32_t version = 0;
+        if (ok) {
+            friends = server->getDb().getFriends(username);
+            followers = server->getDb().getFollowers(username);
+            if (!deltas) avatarHashes = server->getDb().getFriendAvatarHashes(username);
+            version = server->getDb().getContactsVersion(username);
+        }
 
-        server->postResponse([server, sessionId, ok, friends = std::move(friends)]() {
+        server->postResponse([server, sessionId, ok, targetUser, deltas, version,
+                              friends = std::move(friends), followers = std::move(followers),
+                              avatarHashes = std::move(avatarHashes)]() {
             ClientSession *s = server->getSession(sessionId);
             if (!s) return;
 
             if (ok) {
-                Packet resp(PacketType::ContactList);
-                resp.writeInt(static_cast<uint32_t>(friends.size()));
-                for (const auto &name : friends) {
-                    resp.writeString(name);
-                    resp.writeInt(static_cast<uint32_t>(server->getSessionManager().getStatus(name)));
-                    resp.writeString(server->getSessionManager().getCustomStatus(name));
-                }
-                s->sendPacket(resp);
+                refreshContacts(server, s, friends, followers);
+                SessionManager& sessions = server->getSessionManager();
+                s->sendPacket(deltas ? makeContactListDelta(sessions, {{targetUser, false}}, avatarHashes, version)
+                                     : makeContactList(sessions, friends, avatarHashes, version));
             }
         });
     });
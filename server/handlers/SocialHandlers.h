@@ -1,17 +1,52 @@
 #pragma once
-#include "IPacketHandler.h"
+#include "Messages.h"
+#include "../DatabaseManager.h"
+#include "../../common/Packet.h"
+#include "../../common/VoiceCodec.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace wizz {
 
-class MessageHandler : public IPacketHandler { public: void handle(ClientSession* session, Packet& packet) override; };
-class NudgeHandler : public IPacketHandler { public: void handle(ClientSession* session, Packet& packet) override; };
-class VoiceMessageHandler : public IPacketHandler { public: void handle(ClientSession* session, Packet& packet) override; };
-class TypingIndicatorHandler : public IPacketHandler { public: void handle(ClientSession* session, Packet& packet) override; };
-class StatusChangeHandler : public IPacketHandler { public: void handle(ClientSession* session, Packet& packet) override; };
-class UpdateStatusHandler : public IPacketHandler { public: void handle(ClientSession* session, Packet& packet) override; };
-class UpdateAvatarHandler : public IPacketHandler { public: void handle(ClientSession* session, Packet& packet) override; };
-class GetAvatarHandler : public IPacketHandler { public: void handle(ClientSession* session, Packet& packet) override; };
-class AddContactHandler : public IPacketHandler { public: void handle(ClientSession* session, Packet& packet) override; };
-class RemoveContactHandler : public IPacketHandler { public: void handle(ClientSession* session, Packet& packet) override; };
+class ClientSession;
+class Peer;
+class SessionManager;
+struct StoredUpload;
+
+// VoiceMessage for `target`, transcoded to WAV if it lacks CapVoiceAdpcm.
+// Shared by live relay and offline delivery at login.
+Packet makeVoicePacket(const Peer* target, const std::string& sender, uint32_t duration,
+                       VoiceCodec codec, const std::vector<uint8_t>& data);
+
+// Every friend with its presence and avatar hash, then `version`
+Packet makeContactList(const SessionManager& sessions, const std::vector<std::string>& friends,
+                       const std::unordered_map<std::string, std::string>& avatarHashes, uint32_t version);
+// The changes that bring a CapContactDeltas client to `version`
+Packet makeContactListDelta(const SessionManager& sessions,
+                            const std::vector<DatabaseManager::ContactChange>& changes,
+                            const std::unordered_map<std::string, std::string>& avatarHashes, uint32_t version);
+
+struct MessageHandler { using Message = msg::DirectMessage; static void handle(ClientSession* session, msg::DirectMessage& message); };
+struct NudgeHandler { using Message = msg::Nudge; static void handle(ClientSession* session, msg::Nudge& nudge); };
+struct VoiceMessageHandler {
+    using Message = msg::VoiceMessage;
+    using Upload = msg::VoiceUpload;
+    static void handle(ClientSession* session, msg::VoiceMessage& voice);
+    static void handleUpload(ClientSession* session, msg::VoiceUpload& voice, const StoredUpload& upload);
+};
+struct TypingIndicatorHandler { using Message = msg::TypingIndicator; static void handle(ClientSession* session, msg::TypingIndicator& typing); };
+struct StatusChangeHandler { using Message = msg::ContactStatusChange; static void handle(ClientSession* session, msg::ContactStatusChange& change); };
+struct UpdateStatusHandler { using Message = msg::UpdateStatus; static void handle(ClientSession* session, msg::UpdateStatus& update); };
+struct UpdateAvatarHandler {
+    using Message = msg::UpdateAvatar;
+    using Upload = msg::AvatarUpload;
+    static void handle(ClientSession* session, msg::UpdateAvatar& avatar);
+    static void handleUpload(ClientSession* session, msg::AvatarUpload& avatar, const StoredUpload& upload);
+};
+struct GetAvatarHandler { using Message = msg::GetAvatar; static void handle(ClientSession* session, msg::GetAvatar& request); };
+struct GetAvatarIfChangedHandler { using Message = msg::GetAvatarIfChanged; static void handle(ClientSession* session, msg::GetAvatarIfChanged& request); };
+struct AddContactHandler { using Message = msg::AddContact; static void handle(ClientSession* session, msg::AddContact& add); };
+struct RemoveContactHandler { using Message = msg::RemoveContact; static void handle(ClientSession* session, msg::RemoveContact& remove); };
 
 }
@@ -1,9 +1,116 @@
+#include "ClusterBroker.h"
 #include "TcpServer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
 #include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
 
-int main() {
+int main(int argc, char **argv) {
   // Default to port 8080
-  wizz::TcpServer server(8080);
+  int port = 8080;
+  for (int i = 1; i + 1 < argc; ++i) {
+    if (std::string(argv[i]) == "--port")
+      port = std::atoi(argv[i + 1]);
+  }
+  wizz::TcpServer server(port);
+
+  std::string metricsPath;
+  std::string tracePath;
+  long metricsInterval = 10; // Seconds
+  uint32_t clusterNode = 0;
+  std::vector<wizz::ClusterLink::Node> clusterNodes;
+  std::string brokerAddress;
+  std::string clusterSecretPath;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--port" && i + 1 < argc) {
+      ++i; // Already applied
+    } else if (arg == "--max-frame-size" && i + 1 < argc) {
+      server.setMaxFrameSize(wizz::clampFrameSize(
+          static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10))));
+    } else if (arg == "--metrics-file" && i + 1 < argc) {
+      metricsPath = argv[++i];
+    } else if (arg == "--metrics-interval" && i + 1 < argc) {
+      metricsInterval = std::max(1L, std::strtol(argv[++i], nullptr, 10));
+    } else if (arg == "--trace-file" && i + 1 < argc) {
+      tracePath = argv[++i];
+    } else if (arg == "--trace-sample" && i + 1 < argc) {
+      // Fraction of inbound packets traced, e.g. 0.001
+      wizz::Tracer::instance().setSampleRate(std::strtod(argv[++i], nullptr));
+    } else if (arg == "--handoff" && i + 1 < argc) {
+      // UNIX socket for hot restarts: start the new binary with the same
+      // path and it takes over from the one running
+      server.setHandoffPath(argv[++i]);
+    } else if (arg == "--reconnect-rate" && i + 1 < argc) {
+      // Logins per second to spread reconnects for after a handoff
+      server.setReconnectRate(static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10)));
+    } else if (arg == "--resume-grace" && i + 1 < argc) {
+      // Seconds a dropped session can be resumed in; 0 = off
+      server.setResumeGrace(std::chrono::seconds(std::max(0L, std::strtol(argv[++i], nullptr, 10))));
+    } else if (arg == "--cluster-node" && i + 1 < argc) {
+      // This server's id in --cluster-nodes
+      clusterNode = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+    } else if (arg == "--cluster-nodes" && i + 1 < argc) {
+      // Every node as clients reach it: <id>=<host>:<port>,...
+      std::stringstream list(argv[++i]);
+      std::string entry;
+      while (std::getline(list, entry, ',')) {
+        size_t eq = entry.find('=');
+        size_t colon = entry.rfind(':');
+        if (eq == std::string::npos || colon == std::string::npos || colon < eq) {
+          std::cerr << "Bad --cluster-nodes entry: " << entry << std::endl;
+          return 1;
+        }
+        clusterNodes.push_back({static_cast<uint32_t>(std::strtoul(entry.c_str(), nullptr, 10)),
+                                entry.substr(eq + 1, colon - eq - 1),
+                                static_cast<uint16_t>(std::atoi(entry.c_str() + colon + 1))});
+      }
+    } else if (arg == "--broker" && i + 1 < argc) {
+      // <host>:<port> of wizz_broker
+      brokerAddress = argv[++i];
+    } else if (arg == "--cluster-secret-file" && i + 1 < argc) {
+      // The secret wizz_broker was given with --secret-file
+      clusterSecretPath = argv[++i];
+    } else if (arg == "--rate-limit" && i + 1 < argc) {
+      // <packet type>=<per second>/<burst>, e.g. 304=10/20; 0/0 = unlimited
+      char *end;
+      const char *spec = argv[++i];
+      auto type = static_cast<wizz::PacketType>(std::strtoul(spec, &end, 10));
+      double perSecond = *end == '=' ? std::strtod(end + 1, &end) : -1;
+      double burst = *end == '/' ? std::strtod(end + 1, &end) : -1;
+      if (perSecond < 0 || burst < 0 || *end != '\0') {
+        std::cerr << "Bad --rate-limit: " << spec << std::endl;
+        return 1;
+      }
+      if (burst == 0)
+        server.getPacketRouter().clearRateLimit(type);
+      else
+        server.getPacketRouter().setRateLimit(type, {perSecond, burst});
+    }
+  }
+
+  if (!metricsPath.empty())
+    server.setMetricsFile(metricsPath, std::chrono::seconds(metricsInterval));
+  if (!tracePath.empty())
+    server.setTraceFile(tracePath, std::chrono::seconds(metricsInterval));
+
+  if (clusterNode != 0) {
+    size_t colon = brokerAddress.rfind(':');
+    asio::error_code ec;
+    auto brokerHost = asio::ip::make_address(brokerAddress.substr(0, colon), ec);
+    std::string secret = clusterSecretPath.empty() ? "" : wizz::readClusterSecret(clusterSecretPath);
+    if (colon == std::string::npos || ec || clusterNodes.empty() || secret.empty()) {
+      std::cerr << "Cluster mode needs --cluster-nodes, --broker <ip>:<port> and --cluster-secret-file"
+                << std::endl;
+      return 1;
+    }
+    server.enableCluster(clusterNode, std::move(clusterNodes),
+                         {brokerHost, static_cast<uint16_t>(std::atoi(brokerAddress.c_str() + colon + 1))},
+                         std::move(secret));
+  }
 
   try {
     // This will block until the server stops
@@ -0,0 +1,15 @@
+#include "bench_support.h"
+
+namespace wizz {
+namespace bench {
+
+ClientSession &idleSession() {
+  static asio::io_context io;
+  static asio::ssl::context ssl(asio::ssl::context::tlsv12);
+  static auto session =
+      std::make_shared<ClientSession>(1, asio::ip::tcp::socket(io), ssl, nullptr);
+  return *session;
+}
+
+} // namespace bench
+} // namespace wizz
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "../../server/ClientSession.h"
+#include <cstdint>
+
+namespace wizz {
+namespace bench {
+
+// A real, never-connected session (no server) for code that only needs a
+// ClientSession pointer or its per-session state
+ClientSession &idleSession();
+
+// xorshift64: cheap pseudo-random indexes that defeat the prefetcher
+inline uint64_t nextRandom(uint64_t &state) {
+  state ^= state << 13;
+  state ^= state >> 7;
+  state ^= state << 17;
+  return state;
+}
+
+} // namespace bench
+} // namespace wizz
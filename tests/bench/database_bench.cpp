@@ -0,0 +1,159 @@
+#include "../../server/DatabaseManager.h"
+#include <benchmark/benchmark.h>
+#include <condition_variable>
+#include <cstdio>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using wizz::DatabaseManager;
+
+namespace {
+
+const int USERS = 1000;
+const int FRIENDS = 20;
+const int PENDING = 50; // Undelivered messages waiting for user_0
+
+// Removed again (with its offline log) after the manager (declared after
+// it) has closed it
+struct TempFile {
+  std::string path = (std::filesystem::temp_directory_path() / "wizz_bench.db").string();
+  TempFile() { clear(); }
+  ~TempFile() { clear(); }
+  void clear() {
+    std::remove(path.c_str());
+    std::filesystem::remove_all(path + ".offline");
+  }
+};
+
+void exec(sqlite3 *db, const std::string &sql) {
+  sqlite3_exec(db, sql.c_str(), nullptr, nullptr, nullptr);
+}
+
+// A synthetic database next to a live DatabaseManager (worker running).
+// Bulk rows go in through a second connection in one transaction.
+struct BenchDb {
+  TempFile file;
+  DatabaseManager db;
+
+  BenchDb() : db(file.path) {
+    db.init();
+    sqlite3 *raw;
+    sqlite3_open(file.path.c_str(), &raw);
+    exec(raw, "BEGIN;");
+    for (int i = 0; i < USERS; ++i)
+      exec(raw, "INSERT INTO users (USERNAME, PASSWORD_HASH, SALT) VALUES ('user_" +
+                    std::to_string(i) + "', 'x', 'x');");
+    for (int i = 0; i < USERS; ++i) {
+      for (int f = 1; f <= FRIENDS; ++f) {
+        exec(raw, "INSERT INTO friends (user_id, friend_id) SELECT a.ID, b.ID FROM users a, users b "
+                  "WHERE a.USERNAME = 'user_" + std::to_string(i) + "' AND b.USERNAME = 'user_" +
+                      std::to_string((i + f) % USERS) + "';");
+      }
+    }
+    exec(raw, "COMMIT;");
+    sqlite3_close(raw);
+    for (int m = 0; m < PENDING; ++m)
+      db.storeMessage("user_1", "user_0", "see you at eight", false);
+    db.createUser("bench", "bench-password");
+  }
+};
+
+BenchDb &benchDb() {
+  static BenchDb instance;
+  return instance;
+}
+
+} // namespace
+
+static void BM_DbCheckCredentials(benchmark::State &state) {
+  DatabaseManager &db = benchDb().db;
+  for (auto _ : state)
+    benchmark::DoNotOptimize(db.checkCredentials("bench", "bench-password"));
+}
+BENCHMARK(BM_DbCheckCredentials);
+
+// Runs at every login and contact change
+static void BM_DbGetFriends(benchmark::State &state) {
+  DatabaseManager &db = benchDb().db;
+  int i = 0;
+  for (auto _ : state) {
+    std::vector<std::string> friends = db.getFriends("user_" + std::to_string(i++ % USERS));
+    benchmark::DoNotOptimize(friends.data());
+  }
+}
+BENCHMARK(BM_DbGetFriends);
+
+static void BM_DbFetchPending(benchmark::State &state) {
+  DatabaseManager &db = benchDb().db;
+  for (auto _ : state) {
+    std::vector<DatabaseManager::StoredMessage> pending = db.fetchPendingMessages("user_0");
+    benchmark::DoNotOptimize(pending.data());
+  }
+  state.SetItemsProcessed(state.iterations() * PENDING);
+}
+BENCHMARK(BM_DbFetchPending);
+
+// One message, one transaction
+static void BM_DbStoreMessage(benchmark::State &state) {
+  DatabaseManager &db = benchDb().db;
+  for (auto _ : state)
+    benchmark::DoNotOptimize(db.storeMessage("user_2", "user_3", "hello there", true));
+}
+BENCHMARK(BM_DbStoreMessage)->UseRealTime();
+
+// `range(0)` messages queued at once, timed until their batch is committed:
+// to history, or for an offline recipient to the offline log
+static void groupCommit(benchmark::State &state, bool delivered) {
+  DatabaseManager &db = benchDb().db;
+  std::mutex mutex;
+  std::condition_variable committed;
+  int64_t done = 0;
+  db.setCommitHandler([&](std::vector<DatabaseManager::QueuedMessage> &&batch, bool) {
+    std::lock_guard<std::mutex> lock(mutex);
+    done += static_cast<int64_t>(batch.size());
+    committed.notify_one();
+  });
+
+  int64_t queued = 0;
+  for (auto _ : state) {
+    for (int64_t i = 0; i < state.range(0); ++i) {
+      DatabaseManager::QueuedMessage message;
+      message.sender = "user_4";
+      message.recipient = "user_5";
+      message.body = "hello there";
+      message.isDelivered = delivered;
+      db.queueMessage(std::move(message));
+    }
+    queued += state.range(0);
+    std::unique_lock<std::mutex> lock(mutex);
+    committed.wait(lock, [&] { return done == queued; });
+  }
+  db.setCommitHandler(nullptr);
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+static void BM_DbGroupCommit(benchmark::State &state) { groupCommit(state, true); }
+BENCHMARK(BM_DbGroupCommit)->RangeMultiplier(16)->Range(1, 256)->UseRealTime();
+
+static void BM_DbQueueOffline(benchmark::State &state) { groupCommit(state, false); }
+BENCHMARK(BM_DbQueueOffline)->RangeMultiplier(16)->Range(1, 256)->UseRealTime();
+
+// The actor hop every DB-backed handler pays: postTask to the worker and back
+static void BM_DbPostTaskRoundTrip(benchmark::State &state) {
+  DatabaseManager &db = benchDb().db;
+  std::mutex mutex;
+  std::condition_variable ran;
+  for (auto _ : state) {
+    bool done = false;
+    db.postTask([&] {
+      std::lock_guard<std::mutex> lock(mutex);
+      done = true;
+      ran.notify_one();
+    });
+    std::unique_lock<std::mutex> lock(mutex);
+    ran.wait(lock, [&] { return done; });
+  }
+}
+BENCHMARK(BM_DbPostTaskRoundTrip)->UseRealTime();
@@ -0,0 +1,101 @@
+#include "../../common/CompactCodec.h"
+#include "../../common/Packet.h"
+#include <benchmark/benchmark.h>
+#include <string>
+#include <vector>
+
+using wizz::CompactCodec;
+using wizz::CompactHeader;
+using wizz::Direction;
+using wizz::Packet;
+using wizz::PacketType;
+
+namespace {
+
+Packet makeMessage(const std::string &body) {
+  Packet packet(PacketType::DirectMessage);
+  packet.writeString("recipient_user");
+  packet.writeString(body);
+  packet.writeInt(42);
+  return packet;
+}
+
+} // namespace
+
+// What every send does: build a DirectMessage and serialize it
+static void BM_PacketWriteSerialize(benchmark::State &state) {
+  std::string body(static_cast<size_t>(state.range(0)), 'x');
+  for (auto _ : state) {
+    std::vector<uint8_t> bytes = makeMessage(body).serialize();
+    benchmark::DoNotOptimize(bytes.data());
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_PacketWriteSerialize)->RangeMultiplier(16)->Range(16, 1 << 20);
+
+// What every receive does: rehydrate and read the fields back
+static void BM_PacketParse(benchmark::State &state) {
+  std::vector<uint8_t> raw =
+      makeMessage(std::string(static_cast<size_t>(state.range(0)), 'x')).serialize();
+  for (auto _ : state) {
+    Packet packet(raw);
+    benchmark::DoNotOptimize(packet.readString());
+    benchmark::DoNotOptimize(packet.readString());
+    benchmark::DoNotOptimize(packet.readInt());
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_PacketParse)->RangeMultiplier(16)->Range(16, 1 << 20);
+
+// Many small fields: a ContactList of `range(0)` contacts
+static void BM_PacketContactList(benchmark::State &state) {
+  for (auto _ : state) {
+    Packet packet(PacketType::ContactList);
+    packet.writeInt(static_cast<uint32_t>(state.range(0)));
+    for (int64_t i = 0; i < state.range(0); ++i) {
+      packet.writeString("contact_" + std::to_string(i));
+      packet.writeInt(0);
+      packet.writeString("Busy coding");
+      packet.writeString("0123456789abcdef0123456789abcdef");
+    }
+    std::vector<uint8_t> bytes = packet.serialize();
+    benchmark::DoNotOptimize(bytes.data());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_PacketContactList)->RangeMultiplier(8)->Range(8, 512);
+
+// v2 (CapCompact) encoding of the same DirectMessage; the recipient name is
+// aliased after the first packet, as on a live connection
+static void BM_CompactEncode(benchmark::State &state) {
+  Packet packet = makeMessage(std::string(static_cast<size_t>(state.range(0)), 'x'));
+  CompactCodec codec(Direction::ToServer);
+  codec.encode(packet);
+  for (auto _ : state) {
+    std::vector<uint8_t> bytes = codec.encode(packet);
+    benchmark::DoNotOptimize(bytes.data());
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_CompactEncode)->RangeMultiplier(16)->Range(16, 1 << 20);
+
+static void BM_CompactDecode(benchmark::State &state) {
+  Packet packet = makeMessage(std::string(static_cast<size_t>(state.range(0)), 'x'));
+  CompactCodec sender(Direction::ToServer);
+  CompactCodec receiver(Direction::ToClient);
+  CompactHeader header;
+
+  std::vector<uint8_t> first = sender.encode(packet); // Defines the alias
+  wizz::parseCompactHeader(first.data(), first.size(), header);
+  receiver.decode(header.type, first.data() + header.size, header.length, header.flags);
+
+  std::vector<uint8_t> wire = sender.encode(packet);
+  wizz::parseCompactHeader(wire.data(), wire.size(), header);
+  for (auto _ : state) {
+    Packet decoded = receiver.decode(header.type, wire.data() + header.size, header.length,
+                                     header.flags);
+    benchmark::DoNotOptimize(decoded.bodySize());
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_CompactDecode)->RangeMultiplier(16)->Range(16, 1 << 20);
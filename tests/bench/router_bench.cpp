@@ -0,0 +1,110 @@
+#include "../../server/handlers/Messages.h"
+#include "../../server/handlers/PacketRouter.h"
+#include "bench_support.h"
+#include <benchmark/benchmark.h>
+#include <vector>
+
+using wizz::ClientSession;
+using wizz::MetricsRegistry;
+using wizz::Packet;
+using wizz::PacketRouter;
+using wizz::PacketType;
+
+namespace {
+
+struct NoFields {
+  template <typename Reader> bool read(Reader &) { return true; }
+};
+
+struct NoopHandler {
+  using Message = NoFields;
+  static void handle(ClientSession *, NoFields &message) { benchmark::DoNotOptimize(&message); }
+};
+
+// Decodes for real, then does nothing
+struct DecodeOnlyHandler {
+  using Message = wizz::msg::DirectMessage;
+  static void handle(ClientSession *, wizz::msg::DirectMessage &message) {
+    benchmark::DoNotOptimize(message.body.data());
+  }
+};
+
+template <PacketType... Types> struct TypeList {
+  static constexpr PacketType values[] = {Types...};
+  static void registerNoops(PacketRouter &router) {
+    (router.registerHandler<Types, NoopHandler>(), ...);
+  }
+};
+
+// Every type a logged-in client sends
+using ClientTypes = TypeList<
+    PacketType::Login, PacketType::Register, PacketType::AddContact, PacketType::RemoveContact,
+    PacketType::UpdateStatus, PacketType::ContactStatusChange, PacketType::DirectMessage,
+    PacketType::Nudge, PacketType::VoiceMessage, PacketType::TypingIndicator,
+    PacketType::GroupCreate, PacketType::GroupMessage, PacketType::GroupLeave,
+    PacketType::GroupAddMember, PacketType::UpdateAvatar, PacketType::GetAvatar,
+    PacketType::GetAvatarIfChanged, PacketType::GameStatus, PacketType::GameInvite,
+    PacketType::GameInviteResponse, PacketType::GameMove>;
+
+} // namespace
+
+// Slot lookup + handler call + latency histogram, for a type without a rate limit
+static void BM_RouterDispatch(benchmark::State &state) {
+  MetricsRegistry metrics;
+  PacketRouter router(metrics);
+  ClientTypes::registerNoops(router);
+  Packet packet(PacketType::DirectMessage);
+  ClientSession &session = wizz::bench::idleSession();
+
+  for (auto _ : state)
+    router.handle(&session, packet);
+}
+BENCHMARK(BM_RouterDispatch);
+
+// Same, through the per-session token bucket (never empty here)
+static void BM_RouterDispatchRateLimited(benchmark::State &state) {
+  MetricsRegistry metrics;
+  PacketRouter router(metrics);
+  ClientTypes::registerNoops(router);
+  router.setRateLimit(PacketType::TypingIndicator, {1e12, 1e12});
+  Packet packet(PacketType::TypingIndicator);
+  ClientSession &session = wizz::bench::idleSession();
+
+  for (auto _ : state)
+    router.handle(&session, packet);
+}
+BENCHMARK(BM_RouterDispatchRateLimited);
+
+// A realistic mix: the type changes on every packet
+static void BM_RouterDispatchMixed(benchmark::State &state) {
+  MetricsRegistry metrics;
+  PacketRouter router(metrics);
+  ClientTypes::registerNoops(router);
+  for (PacketType type : ClientTypes::values)
+    router.setRateLimit(type, {1e12, 1e12});
+  std::vector<Packet> packets;
+  for (PacketType type : ClientTypes::values)
+    packets.emplace_back(type);
+  ClientSession &session = wizz::bench::idleSession();
+
+  uint64_t random = 88172645463325252ULL;
+  for (auto _ : state)
+    router.handle(&session, packets[wizz::bench::nextRandom(random) % packets.size()]);
+}
+BENCHMARK(BM_RouterDispatchMixed);
+
+// Dispatch including the generated DirectMessage decoder
+static void BM_RouterDecodeDirectMessage(benchmark::State &state) {
+  MetricsRegistry metrics;
+  PacketRouter router(metrics);
+  router.registerHandler<PacketType::DirectMessage, DecodeOnlyHandler>();
+  Packet packet(PacketType::DirectMessage);
+  packet.writeString("recipient_user");
+  packet.writeString("see you at eight");
+  packet.writeInt(42);
+  ClientSession &session = wizz::bench::idleSession();
+
+  for (auto _ : state)
+    router.handle(&session, packet);
+}
+BENCHMARK(BM_RouterDecodeDirectMessage);
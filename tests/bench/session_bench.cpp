@@ -0,0 +1,96 @@
+#include "../../server/SessionManager.h"
+#include "bench_support.h"
+#include <benchmark/benchmark.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+using wizz::ClientSession;
+using wizz::SessionManager;
+using wizz::UserId;
+
+namespace {
+
+const int CONTACTS = 8;
+
+// `users` online users, each with the next CONTACTS users as contacts.
+// Built once per size and shared by every benchmark below.
+struct Population {
+  SessionManager sessions;
+  std::vector<std::string> names;
+  std::vector<UserId> ids;
+
+  std::vector<std::string> contactsOf(size_t i) const {
+    std::vector<std::string> contacts;
+    for (size_t c = 1; c <= CONTACTS; ++c)
+      contacts.push_back(names[(i + c) % names.size()]);
+    return contacts;
+  }
+};
+
+Population &population(int64_t users) {
+  static std::map<int64_t, std::unique_ptr<Population>> cache;
+  std::unique_ptr<Population> &entry = cache[users];
+  if (!entry) {
+    entry = std::make_unique<Population>();
+    for (int64_t i = 0; i < users; ++i)
+      entry->names.push_back("user_" + std::to_string(i));
+    ClientSession *session = &wizz::bench::idleSession();
+    for (size_t i = 0; i < entry->names.size(); ++i)
+      entry->ids.push_back(
+          entry->sessions.setUserOnline(entry->names[i], session, "", entry->contactsOf(i)));
+  }
+  return *entry;
+}
+
+} // namespace
+
+// Handlers resolving a target named in a packet
+static void BM_SessionLookupByName(benchmark::State &state) {
+  Population &p = population(state.range(0));
+  uint64_t random = 88172645463325252ULL;
+  for (auto _ : state) {
+    const std::string &name = p.names[wizz::bench::nextRandom(random) % p.names.size()];
+    benchmark::DoNotOptimize(p.sessions.getSessionByUsername(name));
+  }
+}
+BENCHMARK(BM_SessionLookupByName)->Arg(10000)->Arg(100000)->Arg(1000000);
+
+// Code that already holds an interned UserId
+static void BM_SessionLookupById(benchmark::State &state) {
+  Population &p = population(state.range(0));
+  uint64_t random = 88172645463325252ULL;
+  for (auto _ : state) {
+    UserId id = p.ids[wizz::bench::nextRandom(random) % p.ids.size()];
+    benchmark::DoNotOptimize(p.sessions.getSession(id));
+    benchmark::DoNotOptimize(p.sessions.getStatus(id));
+  }
+}
+BENCHMARK(BM_SessionLookupById)->Arg(10000)->Arg(100000)->Arg(1000000);
+
+// Presence fan-out: who is watching this user
+static void BM_SessionSubscribers(benchmark::State &state) {
+  Population &p = population(state.range(0));
+  uint64_t random = 88172645463325252ULL;
+  for (auto _ : state) {
+    UserId id = p.ids[wizz::bench::nextRandom(random) % p.ids.size()];
+    std::vector<ClientSession *> watchers = p.sessions.getSubscribers(id);
+    benchmark::DoNotOptimize(watchers.data());
+  }
+}
+BENCHMARK(BM_SessionSubscribers)->Arg(10000)->Arg(100000)->Arg(1000000);
+
+// Logout + login of one user, contacts and all
+static void BM_SessionOnlineChurn(benchmark::State &state) {
+  Population &p = population(state.range(0));
+  ClientSession *session = &wizz::bench::idleSession();
+  uint64_t random = 88172645463325252ULL;
+  for (auto _ : state) {
+    size_t i = wizz::bench::nextRandom(random) % p.names.size();
+    std::vector<std::string> contacts = p.contactsOf(i);
+    p.sessions.setUserOffline(p.ids[i]);
+    p.sessions.setUserOnline(p.names[i], session, "", contacts);
+  }
+}
+BENCHMARK(BM_SessionOnlineChurn)->Arg(10000)->Arg(100000)->Arg(1000000);
@@ -0,0 +1,250 @@
+// Payload compression on typical traffic: wire size before and after
+// deflate (on top of the v2 encoding) and the CPU it costs, per MB of
+// uncompressed v2 body, at a few zlib levels.
+#include "../../common/CompactCodec.h"
+#include "../../common/Compression.h"
+#include "../../common/VoiceCodec.h"
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace wizz;
+
+static const char *WORDS[] = {
+    "hey",   "are",  "you",   "there", "lol",    "the",   "game",  "tonight",
+    "i",     "just", "got",   "home",  "what",   "about", "new",   "level",
+    "ok",    "see",  "at",    "eight", "haha",   "did",   "watch", "it",
+    "yes",   "no",   "maybe", "later", "coming", "wait",  "for",   "me",
+    "thanks", "nice", "score", "beat", "my",     "record", "send", "voice"};
+
+static std::string chatLine(std::mt19937 &rng) {
+  std::uniform_int_distribution<size_t> word(0, std::size(WORDS) - 1);
+  std::uniform_int_distribution<int> length(2, 12);
+  std::string text;
+  for (int i = length(rng); i > 0; --i) {
+    text += WORDS[word(rng)];
+    text += i > 1 ? " " : "";
+  }
+  return text;
+}
+
+static std::string userName(size_t i) { return "user" + std::to_string(i); }
+
+// Contact list at login (200 contacts)
+static std::vector<Packet> contactLists(std::mt19937 &rng) {
+  static const char *moods[] = {"", "", "", "at work", "Playing Tile Twister",
+                                "brb", "listening to music"};
+  std::vector<Packet> packets;
+  for (int login = 0; login < 50; ++login) {
+    Packet list(PacketType::ContactList);
+    list.writeInt(200);
+    for (size_t i = 0; i < 200; ++i) {
+      list.writeString(userName(rng() % 100000));
+      list.writeInt(rng() % 4);
+      list.writeString(moods[rng() % std::size(moods)]);
+      list.writeString(rng() % 3 ? "" : "3f2a9c0d81e4b7a6"); // Avatar hash
+    }
+    packets.push_back(std::move(list));
+  }
+  return packets;
+}
+
+// Coalesced presence (a few statuses plus typing)
+static std::vector<Packet> presenceBatches(std::mt19937 &rng) {
+  std::vector<Packet> packets;
+  for (int n = 0; n < 2000; ++n) {
+    Packet batch(PacketType::PresenceBatch);
+    uint32_t statuses = 1 + rng() % 8;
+    batch.writeInt(statuses);
+    for (uint32_t i = 0; i < statuses; ++i) {
+      batch.writeString(userName(rng() % 500));
+      batch.writeInt(rng() % 4);
+      batch.writeString(rng() % 2 ? "" : "Playing Brick Breaker");
+    }
+    batch.writeInt(1);
+    batch.writeString(userName(rng() % 500));
+    batch.writeInt(1);
+    packets.push_back(std::move(batch));
+  }
+  return packets;
+}
+
+// Offline flush: a backlog of direct messages from a handful of friends
+static std::vector<Packet> offlineFlush(std::mt19937 &rng) {
+  std::vector<Packet> packets;
+  for (int n = 0; n < 5000; ++n) {
+    Packet dm(PacketType::DirectMessage);
+    dm.writeString(userName(rng() % 6));
+    dm.writeString(chatLine(rng));
+    packets.push_back(std::move(dm));
+  }
+  return packets;
+}
+
+// Speech-like audio: voiced syllables with a wandering pitch, pauses and
+// a little background noise
+static std::vector<int16_t> speech(std::mt19937 &rng, uint32_t rate,
+                                   double seconds) {
+  std::normal_distribution<double> noise(0.0, 60.0);
+  std::vector<int16_t> samples(static_cast<size_t>(rate * seconds));
+  double phase = 0.0;
+  for (size_t i = 0; i < samples.size(); ++i) {
+    double t = double(i) / rate;
+    double syllable = std::fmod(t, 0.25) / 0.25;
+    bool voiced = std::fmod(t, 1.7) < 1.3;
+    double envelope = voiced ? std::sin(M_PI * syllable) : 0.0;
+    double pitch = 140.0 + 30.0 * std::sin(2 * M_PI * 0.7 * t);
+    phase += 2 * M_PI * pitch / rate;
+    double v = 0.0;
+    for (int h = 1; h <= 6; ++h)
+      v += std::sin(h * phase) / h;
+    samples[i] = static_cast<int16_t>(6000.0 * envelope * v + noise(rng));
+  }
+  return samples;
+}
+
+static Packet voiceNote(std::vector<uint8_t> blob, VoiceCodec codec) {
+  Packet voice(PacketType::VoiceMessage);
+  voice.writeString("user1");
+  voice.writeInt(10);
+  voice.writeInt(static_cast<uint32_t>(blob.size()));
+  voice.writeData(blob.data(), blob.size());
+  voice.writeInt(static_cast<uint32_t>(codec));
+  return voice;
+}
+
+static std::vector<Packet> wavNotes(std::mt19937 &rng) {
+  std::vector<Packet> packets;
+  for (int n = 0; n < 4; ++n) {
+    std::vector<int16_t> mono = speech(rng, 44100, 10.0);
+    std::vector<int16_t> stereo;
+    for (int16_t s : mono) {
+      stereo.push_back(s);
+      stereo.push_back(s);
+    }
+    packets.push_back(voiceNote(
+        encodeWav(stereo.data(), mono.size(), 2, 44100), VoiceCodec::Wav));
+  }
+  return packets;
+}
+
+static std::vector<Packet> adpcmNotes(std::mt19937 &rng) {
+  std::vector<Packet> packets;
+  for (int n = 0; n < 16; ++n) {
+    packets.push_back(voiceNote(
+        encodeImaAdpcm(speech(rng, VOICE_SAMPLE_RATE, 10.0), VOICE_SAMPLE_RATE),
+        VoiceCodec::ImaAdpcm));
+  }
+  return packets;
+}
+
+// Already-compressed images: incompressible
+static std::vector<Packet> avatars(std::mt19937 &rng) {
+  std::vector<Packet> packets;
+  for (int n = 0; n < 32; ++n) {
+    std::vector<uint8_t> png(40 * 1024);
+    for (auto &b : png)
+      b = static_cast<uint8_t>(rng());
+    Packet avatar(PacketType::AvatarData);
+    avatar.writeString(userName(n));
+    avatar.writeInt(static_cast<uint32_t>(png.size()));
+    avatar.writeData(png.data(), png.size());
+    avatar.writeString("3f2a9c0d81e4b7a6");
+    packets.push_back(std::move(avatar));
+  }
+  return packets;
+}
+
+struct Body {
+  PacketType type;
+  std::vector<uint8_t> bytes; // v2 body, not compressed
+};
+
+// The v2 bodies the compressor would see (header stripped)
+static std::vector<Body> encodeV2(const std::vector<Packet> &packets) {
+  CompactCodec codec(Direction::ToClient);
+  std::vector<Body> bodies;
+  for (const Packet &packet : packets) {
+    std::vector<uint8_t> wire = codec.encode(packet);
+    CompactHeader header;
+    parseCompactHeader(wire.data(), wire.size(), header);
+    bodies.push_back({packet.type(), std::vector<uint8_t>(
+                                         wire.begin() + header.size, wire.end())});
+  }
+  return bodies;
+}
+
+static void run(const std::string &name, const std::vector<Packet> &packets) {
+  using Clock = std::chrono::steady_clock;
+  std::vector<Body> bodies = encodeV2(packets);
+  size_t v1 = 0, v2 = 0;
+  for (const Packet &p : packets)
+    v1 += sizeof(PacketHeader) + p.bodySize();
+  for (const Body &b : bodies)
+    v2 += COMPACT_HEADER_SIZE + b.bytes.size();
+  double mb = double(v2) / (1024 * 1024);
+
+  for (int level : {1, 3, 6}) {
+    Deflater deflater(level);
+    Inflater inflater;
+    std::vector<std::vector<uint8_t>> wire;
+    std::vector<uint8_t> flags;
+    wire.reserve(bodies.size());
+
+    auto start = Clock::now();
+    for (const Body &b : bodies) {
+      std::vector<uint8_t> copy = b.bytes;
+      flags.push_back(
+          deflater.compress(copy, priorityFor(b.type) == FramePriority::Chat));
+      wire.push_back(std::move(copy));
+    }
+    auto mid = Clock::now();
+    size_t compressed = 0;
+    for (size_t i = 0; i < wire.size(); ++i) {
+      compressed += COMPACT_HEADER_SIZE + wire[i].size();
+      if (flags[i]) {
+        std::vector<uint8_t> back = inflater.decompress(
+            flags[i], wire[i].data(), wire[i].size(), MAX_PACKET_SIZE);
+        if (back != bodies[i].bytes) {
+          std::cerr << "Round trip mismatch in " << name << std::endl;
+          std::exit(1);
+        }
+      }
+    }
+    auto end = Clock::now();
+
+    double deflateMs =
+        std::chrono::duration<double, std::milli>(mid - start).count();
+    double inflateMs =
+        std::chrono::duration<double, std::milli>(end - mid).count();
+    std::cout << std::left << std::setw(18) << name << std::right
+              << std::setw(3) << level << std::setw(12) << v1 << std::setw(12)
+              << v2 << std::setw(12) << compressed << std::fixed
+              << std::setprecision(2) << std::setw(8)
+              << double(v2) / compressed << std::setw(12) << deflateMs / mb
+              << std::setw(12) << inflateMs / mb << std::endl;
+  }
+}
+
+int main() {
+  std::mt19937 rng(42);
+  std::cout << std::left << std::setw(18) << "traffic" << std::right
+            << std::setw(3) << "lvl" << std::setw(12) << "v1 bytes"
+            << std::setw(12) << "v2 bytes" << std::setw(12) << "deflated"
+            << std::setw(8) << "ratio" << std::setw(12) << "deflate ms"
+            << std::setw(12) << "inflate ms" << std::endl;
+  std::cout << "(ratio = v2 / deflated; ms per MB of v2 body)" << std::endl;
+
+  run("contact lists", contactLists(rng));
+  run("presence batches", presenceBatches(rng));
+  run("offline flush", offlineFlush(rng));
+  run("voice wav", wavNotes(rng));
+  run("voice adpcm", adpcmNotes(rng));
+  run("avatars", avatars(rng));
+  return 0;
+}
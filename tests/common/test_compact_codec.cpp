@@ -0,0 +1,302 @@
+#include "../../common/CompactCodec.h"
+#include <cassert>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+using namespace wizz;
+
+// Client encodes, server decodes (or the other way round)
+static Packet roundTrip(CompactCodec &sender, CompactCodec &receiver,
+                        const Packet &packet) {
+  std::vector<uint8_t> wire = sender.encode(packet);
+  CompactHeader header;
+  assert(parseCompactHeader(wire.data(), wire.size(), header));
+  assert(header.type == packet.type());
+  assert(header.size + header.length == wire.size());
+  return receiver.decode(header.type, wire.data() + header.size,
+                         header.length);
+}
+
+void test_varints() {
+  std::cout << "Running test_varints..." << std::endl;
+
+  for (uint32_t value : {0u, 1u, 127u, 128u, 300u, 16384u, 0xFFFFFFFFu}) {
+    std::vector<uint8_t> out;
+    writeVarint(out, value);
+    size_t offset = 0;
+    assert(readVarint(out.data(), out.size(), offset) == value);
+    assert(offset == out.size());
+  }
+  std::vector<uint8_t> small;
+  writeVarint(small, 127);
+  assert(small.size() == 1);
+
+  // Truncated: needs more data; too long: malformed
+  uint8_t partial[] = {0x80, 0x80};
+  size_t offset = 0;
+  try {
+    readVarint(partial, sizeof(partial), offset);
+    assert(false);
+  } catch (const std::out_of_range &) {
+  }
+  uint8_t overflow[] = {0xFF, 0xFF, 0xFF, 0xFF, 0x7F};
+  offset = 0;
+  try {
+    readVarint(overflow, sizeof(overflow), offset);
+    assert(false);
+  } catch (const std::runtime_error &) {
+  }
+
+  std::cout << "[PASS] test_varints" << std::endl;
+}
+
+void test_header() {
+  std::cout << "Running test_header..." << std::endl;
+
+  std::vector<uint8_t> out;
+  writeCompactHeader(out, PacketType::GameMove, 1234);
+  assert(out.size() == COMPACT_HEADER_SIZE);
+  CompactHeader header;
+  assert(parseCompactHeader(out.data(), out.size(), header));
+  assert(header.type == PacketType::GameMove && header.length == 1234);
+
+  // Bodies past 20 bits use the escape
+  out.clear();
+  writeCompactHeader(out, PacketType::VoiceMessage, 5000000);
+  assert(out.size() == COMPACT_HEADER_SIZE + 4);
+  assert(!parseCompactHeader(out.data(), COMPACT_HEADER_SIZE, header));
+  assert(parseCompactHeader(out.data(), out.size(), header));
+  assert(header.length == 5000000 && header.size == 8);
+
+  // One compression flag at a time
+  out[0] |= 0x80;
+  assert(parseCompactHeader(out.data(), out.size(), header));
+  assert(header.flags == CompactFlagStream && header.length == 5000000);
+  out[0] |= 0x40;
+  try {
+    parseCompactHeader(out.data(), out.size(), header);
+    assert(false);
+  } catch (const std::runtime_error &) {
+  }
+
+  std::cout << "[PASS] test_header" << std::endl;
+}
+
+void test_chat_round_trip_and_aliases() {
+  std::cout << "Running test_chat_round_trip_and_aliases..." << std::endl;
+
+  CompactCodec client(Direction::ToServer);
+  CompactCodec server(Direction::ToClient);
+
+  Packet msg(PacketType::DirectMessage);
+  msg.writeString("bob_the_builder");
+  msg.writeString("hello");
+  size_t first = client.encode(msg).size();
+
+  // Same target again: the name goes out as a one-byte alias
+  Packet again(PacketType::DirectMessage);
+  again.writeString("bob_the_builder");
+  again.writeString("hello");
+  std::vector<uint8_t> wire = client.encode(again);
+  assert(wire.size() == COMPACT_HEADER_SIZE + 1 + 1 + 5);
+  assert(wire.size() < first);
+  assert(wire.size() * 3 < again.serialize().size());
+
+  // A fresh pair decodes the same sequence
+  CompactCodec sender(Direction::ToServer);
+  for (int i = 0; i < 3; ++i) {
+    Packet out = roundTrip(sender, server, msg);
+    assert(out.readString() == "bob_the_builder");
+    assert(out.readString() == "hello");
+    assert(out.remaining() == 0);
+  }
+
+  // Numbered message: the sequence number is a varint
+  Packet numbered(PacketType::DirectMessage);
+  numbered.writeString("bob_the_builder");
+  numbered.writeString("hello");
+  numbered.writeInt(300);
+  assert(sender.encode(numbered).size() == COMPACT_HEADER_SIZE + 1 + 6 + 2);
+  CompactCodec receiver(Direction::ToClient);
+  CompactCodec numberedSender(Direction::ToServer);
+  Packet seqOut = roundTrip(numberedSender, receiver, numbered);
+  assert(seqOut.body() == numbered.body());
+
+  Packet typing(PacketType::TypingIndicator);
+  typing.writeString("bob_the_builder");
+  typing.writeInt(1);
+  Packet typed = roundTrip(sender, server, typing);
+  assert(typed.readString() == "bob_the_builder");
+  assert(typed.readInt() == 1);
+
+  std::cout << "[PASS] test_chat_round_trip_and_aliases" << std::endl;
+}
+
+void test_repeats_truncation_and_raw_types() {
+  std::cout << "Running test_repeats_truncation_and_raw_types..." << std::endl;
+
+  CompactCodec server(Direction::ToClient);
+  CompactCodec client(Direction::ToServer);
+
+  Packet batch(PacketType::PresenceBatch);
+  batch.writeInt(2);
+  for (const char *name : {"alice", "carl"}) {
+    batch.writeString(name);
+    batch.writeInt(1);
+    batch.writeString("brb");
+  }
+  batch.writeInt(1);
+  batch.writeString("alice");
+  batch.writeInt(0);
+  Packet out = roundTrip(server, client, batch);
+  assert(out.body() == batch.body());
+
+  // Older senders leave trailing fields off
+  Packet status(PacketType::ContactStatusChange);
+  status.writeInt(2);
+  Packet shortOut = roundTrip(client, server, status);
+  assert(shortOut.body() == status.body());
+
+  // No layout: the v1 body rides along unchanged
+  Packet ack(PacketType::HelloAck);
+  ack.writeInt(7);
+  ack.writeString("x");
+  Packet raw = roundTrip(server, client, ack);
+  assert(raw.body() == ack.body());
+
+  Packet redirect(PacketType::Redirect);
+  redirect.writeString("10.0.0.2");
+  redirect.writeInt(8080);
+  assert(roundTrip(server, client, redirect).body() == redirect.body());
+
+  // GameStatus has a different layout in each direction
+  Packet gameUp(PacketType::GameStatus);
+  gameUp.writeString("TicTacToe");
+  gameUp.writeInt(3);
+  assert(roundTrip(client, server, gameUp).body() == gameUp.body());
+  Packet gameDown(PacketType::GameStatus);
+  gameDown.writeString("alice");
+  gameDown.writeString("TicTacToe");
+  gameDown.writeInt(3);
+  assert(roundTrip(server, client, gameDown).body() == gameDown.body());
+
+  // So does GroupMessage; GroupInfo repeats its member names
+  Packet groupUp(PacketType::GroupMessage);
+  groupUp.writeInt(4);
+  groupUp.writeString("hello all");
+  assert(roundTrip(client, server, groupUp).body() == groupUp.body());
+  Packet groupDown(PacketType::GroupMessage);
+  groupDown.writeInt(4);
+  groupDown.writeString("alice");
+  groupDown.writeString("hello all");
+  assert(roundTrip(server, client, groupDown).body() == groupDown.body());
+  Packet info(PacketType::GroupInfo);
+  info.writeInt(4);
+  info.writeString("Friday night");
+  info.writeInt(2);
+  info.writeString("alice");
+  info.writeString("bob");
+  assert(roundTrip(server, client, info).body() == info.body());
+
+  // A field after a repeat: the contact list version, absent from old servers
+  Packet contacts(PacketType::ContactList);
+  contacts.writeInt(1);
+  contacts.writeString("alice");
+  contacts.writeInt(0);
+  contacts.writeString("");
+  contacts.writeString("ab12");
+  assert(roundTrip(server, client, contacts).body() == contacts.body());
+  contacts.writeInt(9);
+  assert(roundTrip(server, client, contacts).body() == contacts.body());
+  Packet delta(PacketType::ContactListDelta);
+  delta.writeInt(10);
+  delta.writeInt(2);
+  delta.writeString("alice");
+  delta.writeInt(0);
+  delta.writeInt(3);
+  delta.writeString("");
+  delta.writeString("");
+  delta.writeString("bob");
+  delta.writeInt(1);
+  delta.writeInt(1);
+  delta.writeString("brb");
+  delta.writeString("cd34");
+  assert(roundTrip(server, client, delta).body() == delta.body());
+
+  std::cout << "[PASS] test_repeats_truncation_and_raw_types" << std::endl;
+}
+
+void test_streamed_prefix() {
+  std::cout << "Running test_streamed_prefix..." << std::endl;
+
+  CompactCodec client(Direction::ToServer);
+  CompactCodec server(Direction::ToClient);
+
+  std::vector<uint8_t> blob(1000, 0xAB);
+  Packet voice(PacketType::VoiceMessage);
+  voice.writeString("bob");
+  voice.writeInt(12);
+  voice.writeInt(static_cast<uint32_t>(blob.size()));
+  voice.writeData(blob.data(), blob.size());
+  voice.writeInt(1);
+  std::vector<uint8_t> wire = client.encode(voice);
+  CompactHeader header;
+  parseCompactHeader(wire.data(), wire.size(), header);
+  const uint8_t *body = wire.data() + header.size;
+
+  // Incomplete metadata: nothing is bound, so a retry parses cleanly
+  Packet meta(PacketType::VoiceMessage);
+  uint32_t blobLength = 0;
+  try {
+    server.decodePrefix(header.type, body, 4, meta, blobLength);
+    assert(false);
+  } catch (const std::out_of_range &) {
+  }
+  size_t used =
+      server.decodePrefix(header.type, body, header.length, meta, blobLength);
+  assert(blobLength == blob.size());
+  assert(used + blobLength + 1 == header.length);
+  server.decodeSuffix(header.type, body + used + blobLength, 1, meta);
+
+  assert(meta.readString() == "bob");
+  assert(meta.readInt() == 12);
+  assert(meta.readInt() == blob.size());
+  assert(meta.readInt() == 1);
+
+  // The alias bound by the prefix is usable afterwards
+  Packet msg(PacketType::VoiceMessage);
+  msg.writeString("bob");
+  std::vector<uint8_t> next = client.encode(msg);
+  parseCompactHeader(next.data(), next.size(), header);
+  assert(server.decode(header.type, next.data() + header.size, header.length)
+             .readString() == "bob");
+
+  std::cout << "[PASS] test_streamed_prefix" << std::endl;
+}
+
+void test_bad_alias() {
+  std::cout << "Running test_bad_alias..." << std::endl;
+
+  CompactCodec server(Direction::ToClient);
+  uint8_t body[] = {(5 << 1) | 1, 0};
+  try {
+    server.decode(PacketType::TypingIndicator, body, sizeof(body));
+    assert(false);
+  } catch (const std::runtime_error &) {
+  }
+
+  std::cout << "[PASS] test_bad_alias" << std::endl;
+}
+
+int main() {
+  test_varints();
+  test_header();
+  test_chat_round_trip_and_aliases();
+  test_repeats_truncation_and_raw_types();
+  test_streamed_prefix();
+  test_bad_alias();
+
+  std::cout << "All tests passed!" << std::endl;
+  return 0;
+}
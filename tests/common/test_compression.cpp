@@ -0,0 +1,176 @@
+#include "../../common/CompactCodec.h"
+#include "../../common/Compression.h"
+#include <cassert>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace wizz;
+
+static std::vector<uint8_t> bytesOf(const std::string &text) {
+  return std::vector<uint8_t>(text.begin(), text.end());
+}
+
+static std::vector<uint8_t> contactListBody(int contacts) {
+  std::string text;
+  for (int i = 0; i < contacts; ++i) {
+    text += "user" + std::to_string(i) + "\x01Playing Tile Twister|";
+  }
+  return bytesOf(text);
+}
+
+void test_one_shot() {
+  std::cout << "Running test_one_shot..." << std::endl;
+
+  Deflater deflater;
+  Inflater inflater;
+
+  std::vector<uint8_t> original = contactListBody(100);
+  std::vector<uint8_t> body = original;
+  uint8_t flags = deflater.compress(body, false);
+  assert(flags == CompactFlagDeflate);
+  assert(body.size() < original.size() / 4);
+  assert(inflater.decompress(flags, body.data(), body.size(), 1 << 20) ==
+         original);
+
+  // Small bodies are not worth it
+  std::vector<uint8_t> small = bytesOf("status: away");
+  assert(deflater.compress(small, false) == 0);
+  assert(small == bytesOf("status: away"));
+
+  // Neither is noise (already compressed media); sent unchanged
+  std::mt19937 rng(7);
+  std::vector<uint8_t> noise(64 * 1024);
+  for (auto &b : noise)
+    b = static_cast<uint8_t>(rng());
+  std::vector<uint8_t> copy = noise;
+  assert(deflater.compress(copy, false) == 0);
+  assert(copy == noise);
+
+  std::cout << "[PASS] test_one_shot" << std::endl;
+}
+
+void test_chat_stream() {
+  std::cout << "Running test_chat_stream..." << std::endl;
+
+  Deflater deflater;
+  Inflater inflater;
+
+  const std::string line = "are we still on for the game tonight? ";
+  size_t firstSize = 0;
+  for (int i = 0; i < 20; ++i) {
+    std::vector<uint8_t> original = bytesOf(line + std::to_string(i));
+    std::vector<uint8_t> body = original;
+    uint8_t flags = deflater.compress(body, true);
+    assert(flags == CompactFlagStream);
+    if (i == 0)
+      firstSize = body.size();
+    assert(inflater.decompress(flags, body.data(), body.size(), 4096) ==
+           original);
+    // Later messages refer back to earlier ones
+    if (i > 0)
+      assert(body.size() < firstSize / 2);
+  }
+
+  // Short messages skip the stream (and leave it untouched)
+  std::vector<uint8_t> hi = bytesOf("hi");
+  assert(deflater.compress(hi, true) == 0);
+
+  std::cout << "[PASS] test_chat_stream" << std::endl;
+}
+
+void test_bad_input() {
+  std::cout << "Running test_bad_input..." << std::endl;
+
+  Deflater deflater;
+  Inflater inflater;
+
+  std::vector<uint8_t> body = contactListBody(100);
+  size_t originalSize = body.size();
+  uint8_t flags = deflater.compress(body, false);
+
+  // Output cap (decompression bombs)
+  try {
+    inflater.decompress(flags, body.data(), body.size(), originalSize / 2);
+    assert(false);
+  } catch (const std::runtime_error &) {
+  }
+
+  // Truncated
+  try {
+    inflater.decompress(flags, body.data(), body.size() / 2, 1 << 20);
+    assert(false);
+  } catch (const std::runtime_error &) {
+  }
+
+  // Garbage
+  std::vector<uint8_t> garbage(64, 0xFF);
+  try {
+    inflater.decompress(CompactFlagDeflate, garbage.data(), garbage.size(),
+                        1 << 20);
+    assert(false);
+  } catch (const std::runtime_error &) {
+  }
+
+  std::cout << "[PASS] test_bad_input" << std::endl;
+}
+
+void test_codec_integration() {
+  std::cout << "Running test_codec_integration..." << std::endl;
+
+  CompactCodec server(Direction::ToClient);
+  CompactCodec client(Direction::ToServer);
+  server.enableCompression();
+  client.enableCompression();
+
+  Packet list(PacketType::ContactList);
+  list.writeInt(200);
+  for (int i = 0; i < 200; ++i) {
+    list.writeString("user" + std::to_string(i));
+    list.writeInt(i % 4);
+    list.writeString("Playing Brick Breaker");
+    list.writeString("");
+  }
+  std::vector<uint8_t> wire = server.encode(list);
+  CompactHeader header;
+  assert(parseCompactHeader(wire.data(), wire.size(), header));
+  assert(header.flags == CompactFlagDeflate);
+  Packet decoded = client.decode(header.type, wire.data() + header.size,
+                                 header.length, header.flags);
+  assert(decoded.serialize() == list.serialize());
+
+  for (int i = 0; i < 3; ++i) {
+    Packet dm(PacketType::DirectMessage);
+    dm.writeString("alice");
+    dm.writeString("see you at the usual place after work, around seven");
+    wire = client.encode(dm);
+    assert(parseCompactHeader(wire.data(), wire.size(), header));
+    assert(header.flags == CompactFlagStream);
+    decoded = server.decode(header.type, wire.data() + header.size,
+                            header.length, header.flags);
+    assert(decoded.serialize() == dm.serialize());
+  }
+
+  // A peer that did not negotiate compression rejects compressed bodies
+  CompactCodec plain(Direction::ToServer);
+  try {
+    plain.decode(header.type, wire.data() + header.size, header.length,
+                 header.flags);
+    assert(false);
+  } catch (const std::runtime_error &) {
+  }
+
+  std::cout << "[PASS] test_codec_integration" << std::endl;
+}
+
+int main() {
+  test_one_shot();
+  test_chat_stream();
+  test_bad_input();
+  test_codec_integration();
+
+  std::cout << "All tests passed!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,130 @@
+#include "../../common/Frame.h"
+#include <cassert>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+using namespace wizz;
+
+static std::vector<uint8_t> makePacket(PacketType type, size_t payloadSize) {
+  Packet p(type);
+  std::vector<uint8_t> payload(payloadSize, 0x5A);
+  p.writeData(payload.data(), payload.size());
+  return p.serialize();
+}
+
+void test_roundtrip_split() {
+  std::cout << "Running test_roundtrip_split..." << std::endl;
+
+  FrameScheduler scheduler(1024);
+  FrameAssembler assembler(1024);
+
+  std::vector<uint8_t> big = makePacket(PacketType::VoiceMessage, 10000);
+  scheduler.enqueue(big, FramePriority::Bulk);
+
+  std::vector<std::vector<uint8_t>> out;
+  int frames = 0;
+  while (!scheduler.empty()) {
+    std::vector<uint8_t> frame = scheduler.nextFrame();
+    assert(frame.size() <= sizeof(FrameHeader) + 1024);
+    assembler.feed(frame.data(), frame.size(), out);
+    ++frames;
+  }
+
+  assert(frames == 10); // 10012 bytes / 1024 per frame
+  assert(out.size() == 1);
+  assert(out[0] == big);
+
+  std::cout << "[PASS] test_roundtrip_split" << std::endl;
+}
+
+void test_chat_overtakes_bulk() {
+  std::cout << "Running test_chat_overtakes_bulk..." << std::endl;
+
+  FrameScheduler scheduler(1024);
+  FrameAssembler assembler(1024);
+
+  scheduler.enqueue(makePacket(PacketType::VoiceMessage, 64 * 1024),
+                    FramePriority::Bulk);
+
+  std::vector<std::vector<uint8_t>> out;
+  // A couple of bulk frames go out...
+  for (int i = 0; i < 2; ++i) {
+    auto frame = scheduler.nextFrame();
+    assembler.feed(frame.data(), frame.size(), out);
+  }
+  assert(out.empty());
+
+  // ...then a chat message arrives and must be next on the wire
+  scheduler.enqueue(makePacket(PacketType::DirectMessage, 20),
+                    priorityFor(PacketType::DirectMessage));
+  auto frame = scheduler.nextFrame();
+  assembler.feed(frame.data(), frame.size(), out);
+  assert(out.size() == 1);
+  assert(Packet(out[0]).type() == PacketType::DirectMessage);
+
+  while (!scheduler.empty()) {
+    frame = scheduler.nextFrame();
+    assembler.feed(frame.data(), frame.size(), out);
+  }
+  assert(out.size() == 2);
+  assert(Packet(out[1]).type() == PacketType::VoiceMessage);
+
+  std::cout << "[PASS] test_chat_overtakes_bulk" << std::endl;
+}
+
+void test_byte_at_a_time() {
+  std::cout << "Running test_byte_at_a_time..." << std::endl;
+
+  FrameScheduler scheduler(1024);
+  FrameAssembler assembler(1024);
+  std::vector<uint8_t> pkt = makePacket(PacketType::AvatarData, 3000);
+  scheduler.enqueue(pkt, FramePriority::Bulk);
+
+  std::vector<uint8_t> wire;
+  while (!scheduler.empty()) {
+    auto frame = scheduler.nextFrame();
+    wire.insert(wire.end(), frame.begin(), frame.end());
+  }
+
+  std::vector<std::vector<uint8_t>> out;
+  for (uint8_t b : wire) {
+    assembler.feed(&b, 1, out);
+  }
+  assert(out.size() == 1 && out[0] == pkt);
+
+  std::cout << "[PASS] test_byte_at_a_time" << std::endl;
+}
+
+void test_oversized_frame_rejected() {
+  std::cout << "Running test_oversized_frame_rejected..." << std::endl;
+
+  FrameScheduler sender(4096);
+  FrameAssembler receiver(1024); // Peer ignores our negotiated limit
+  sender.enqueue(makePacket(PacketType::AvatarData, 3000), FramePriority::Bulk);
+  auto frame = sender.nextFrame();
+
+  std::vector<std::vector<uint8_t>> out;
+  try {
+    receiver.feed(frame.data(), frame.size(), out);
+    assert(false && "Should have thrown runtime_error");
+  } catch (const std::runtime_error &) {
+    // Expected
+  }
+
+  std::cout << "[PASS] test_oversized_frame_rejected" << std::endl;
+}
+
+int main() {
+  try {
+    test_roundtrip_split();
+    test_chat_overtakes_bulk();
+    test_byte_at_a_time();
+    test_oversized_frame_rejected();
+    std::cout << "All tests passed!" << std::endl;
+  } catch (const std::exception &e) {
+    std::cerr << "Test Failed: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
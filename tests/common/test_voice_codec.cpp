@@ -0,0 +1,112 @@
+#include "../../common/VoiceCodec.h"
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+using namespace wizz;
+
+static const double PI = 3.14159265358979323846;
+
+static std::vector<int16_t> makeTone(size_t count, uint32_t rate, double hz) {
+  std::vector<int16_t> tone(count);
+  for (size_t i = 0; i < count; ++i)
+    tone[i] = static_cast<int16_t>(
+        8000.0 * std::sin(2.0 * PI * hz * static_cast<double>(i) / rate));
+  return tone;
+}
+
+static double snrDb(const std::vector<int16_t> &ref,
+                    const std::vector<int16_t> &test) {
+  double signal = 0, noise = 0;
+  for (size_t i = 0; i < ref.size(); ++i) {
+    signal += double(ref[i]) * ref[i];
+    double d = double(ref[i]) - test[i];
+    noise += d * d;
+  }
+  return 10.0 * std::log10(signal / std::max(noise, 1.0));
+}
+
+void test_adpcm_roundtrip() {
+  std::cout << "Running test_adpcm_roundtrip..." << std::endl;
+
+  // Odd length, not a multiple of the block size
+  std::vector<int16_t> tone = makeTone(16000 + 123, 16000, 440.0);
+  std::vector<uint8_t> encoded = encodeImaAdpcm(tone, 16000);
+
+  // 4 bits per sample plus small block headers
+  assert(encoded.size() < tone.size() * 2 / 3);
+
+  std::vector<int16_t> decoded;
+  uint32_t rate = 0;
+  assert(decodeImaAdpcm(encoded.data(), encoded.size(), decoded, rate));
+  assert(rate == 16000);
+  assert(decoded.size() == tone.size());
+  assert(snrDb(tone, decoded) > 20.0);
+
+  std::cout << "[PASS] test_adpcm_roundtrip" << std::endl;
+}
+
+void test_adpcm_rejects_truncated() {
+  std::cout << "Running test_adpcm_rejects_truncated..." << std::endl;
+
+  std::vector<uint8_t> encoded = encodeImaAdpcm(makeTone(4000, 16000, 300.0),
+                                                16000);
+  std::vector<int16_t> decoded;
+  uint32_t rate = 0;
+  assert(!decodeImaAdpcm(encoded.data(), encoded.size() - 10, decoded, rate));
+  assert(!decodeImaAdpcm(encoded.data(), 5, decoded, rate));
+
+  std::cout << "[PASS] test_adpcm_rejects_truncated" << std::endl;
+}
+
+void test_downmix_and_resample() {
+  std::cout << "Running test_downmix_and_resample..." << std::endl;
+
+  std::vector<int16_t> stereo = {100, 300, -50, 50, 32767, 32767};
+  std::vector<int16_t> mono = downmixToMono(stereo.data(), 3, 2);
+  assert(mono.size() == 3);
+  assert(mono[0] == 200 && mono[1] == 0 && mono[2] == 32767);
+
+  // 48 kHz -> 16 kHz keeps duration and a speech-band tone
+  std::vector<int16_t> tone48 = makeTone(48000, 48000, 440.0);
+  std::vector<int16_t> tone16 = resample(tone48, 48000, 16000);
+  assert(tone16.size() == 16000);
+  std::vector<int16_t> ref16 = makeTone(16000, 16000, 440.0);
+  // Allow for the box filter's one-sample delay and slight attenuation
+  std::vector<int16_t> aligned(ref16.begin(), ref16.end() - 1);
+  std::vector<int16_t> shifted(tone16.begin() + 1, tone16.end());
+  assert(snrDb(aligned, shifted) > 15.0);
+
+  std::cout << "[PASS] test_downmix_and_resample" << std::endl;
+}
+
+void test_wav_roundtrip() {
+  std::cout << "Running test_wav_roundtrip..." << std::endl;
+
+  std::vector<int16_t> pcm = {1, -2, 300, -32768, 32767, 0};
+  std::vector<uint8_t> wav = encodeWav(pcm.data(), 3, 2, 44100);
+  assert(wav.size() == 44 + pcm.size() * 2);
+
+  const uint8_t *data = nullptr;
+  size_t bytes = 0;
+  int channels = 0;
+  uint32_t rate = 0;
+  assert(parseWav(wav.data(), wav.size(), data, bytes, channels, rate));
+  assert(bytes == pcm.size() * 2 && channels == 2 && rate == 44100);
+  assert(data[4] == (300 & 0xFF) && data[5] == (300 >> 8));
+
+  assert(!parseWav(wav.data(), 20, data, bytes, channels, rate));
+
+  std::cout << "[PASS] test_wav_roundtrip" << std::endl;
+}
+
+int main() {
+  test_adpcm_roundtrip();
+  test_adpcm_rejects_truncated();
+  test_downmix_and_resample();
+  test_wav_roundtrip();
+
+  std::cout << "All tests passed!" << std::endl;
+  return 0;
+}
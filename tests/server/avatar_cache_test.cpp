@@ -0,0 +1,101 @@
+#include "../../server/AvatarCache.h"
+#include <cassert>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+using wizz::AvatarCache;
+
+static AvatarCache::Bytes makeBytes(size_t n) {
+  return std::make_shared<const std::vector<uint8_t>>(n, 0xAB);
+}
+
+void test_hit_and_miss() {
+  std::cout << "Running test_hit_and_miss..." << std::endl;
+
+  AvatarCache cache(1024 * 1024);
+  assert(cache.get("alice") == nullptr);
+
+  cache.put("alice", makeBytes(100), "h", cache.generation("alice"));
+  auto hit = cache.get("alice");
+  assert(hit != nullptr);
+  assert(hit->packet->size() == 100);
+  assert(hit->hash == "h");
+
+  // "No avatar" is cached as an empty buffer, distinct from a miss
+  cache.put("bob", makeBytes(0), "h", cache.generation("bob"));
+  auto empty = cache.get("bob");
+  assert(empty != nullptr && empty->packet->empty());
+
+  std::cout << "[PASS] test_hit_and_miss" << std::endl;
+}
+
+void test_lru_eviction_by_bytes() {
+  std::cout << "Running test_lru_eviction_by_bytes..." << std::endl;
+
+  // Room for roughly two 1000-byte avatars
+  AvatarCache cache(2600);
+  cache.put("a", makeBytes(1000), "h", cache.generation("a"));
+  cache.put("b", makeBytes(1000), "h", cache.generation("b"));
+
+  // Touch "a" so "b" becomes least recently used
+  assert(cache.get("a") != nullptr);
+
+  cache.put("c", makeBytes(1000), "h", cache.generation("c"));
+  assert(cache.get("b") == nullptr);
+  assert(cache.get("a") != nullptr);
+  assert(cache.get("c") != nullptr);
+  assert(cache.sizeBytes() <= 2600);
+
+  // Larger than the whole budget: never cached
+  cache.put("huge", makeBytes(5000), "h", cache.generation("huge"));
+  assert(cache.get("huge") == nullptr);
+
+  std::cout << "[PASS] test_lru_eviction_by_bytes" << std::endl;
+}
+
+void test_invalidate_blocks_stale_put() {
+  std::cout << "Running test_invalidate_blocks_stale_put..." << std::endl;
+
+  AvatarCache cache;
+  cache.put("alice", makeBytes(10), "h", cache.generation("alice"));
+
+  // A slow fetch starts, then an upload invalidates
+  uint64_t staleGen = cache.generation("alice");
+  cache.invalidate("alice");
+  assert(cache.get("alice") == nullptr);
+
+  cache.put("alice", makeBytes(10), "h", staleGen);
+  assert(cache.get("alice") == nullptr);
+
+  cache.put("alice", makeBytes(20), "h", cache.generation("alice"));
+  assert(cache.get("alice")->packet->size() == 20);
+
+  std::cout << "[PASS] test_invalidate_blocks_stale_put" << std::endl;
+}
+
+void test_invalidate_is_per_user() {
+  std::cout << "Running test_invalidate_is_per_user..." << std::endl;
+
+  AvatarCache cache;
+  // Fetches for two users start, then only bob's avatar changes
+  uint64_t aliceGen = cache.generation("alice");
+  uint64_t bobGen = cache.generation("bob");
+  cache.invalidate("bob");
+
+  cache.put("alice", makeBytes(10), "h", aliceGen);
+  assert(cache.get("alice") != nullptr);
+  cache.put("bob", makeBytes(10), "h", bobGen);
+  assert(cache.get("bob") == nullptr);
+
+  std::cout << "[PASS] test_invalidate_is_per_user" << std::endl;
+}
+
+int main() {
+  test_hit_and_miss();
+  test_lru_eviction_by_bytes();
+  test_invalidate_blocks_stale_put();
+  test_invalidate_is_per_user();
+  std::cout << "All tests passed!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,407 @@
+// Cluster mode integration test. Starts wizz_broker and three wizz_server
+// nodes in the current directory (which needs server/certs), then checks
+// over TLS that a login at the wrong node is redirected and that messages
+// and presence cross nodes.
+//
+//   cluster_test --server PATH --broker PATH [--port N]
+//
+// The nodes listen on --port + 1..3 and the broker on --port + 10.
+
+#include <asio.hpp>
+#include <asio/ssl.hpp>
+
+#include <cassert>
+#include <chrono>
+#include <csignal>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include <arpa/inet.h>
+
+#include "../../common/Packet.h"
+#include "../../server/HashRing.h"
+
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+
+using wizz::HashRing;
+using wizz::Packet;
+using wizz::PacketHeader;
+using wizz::PacketType;
+
+namespace {
+
+std::vector<pid_t> g_children;
+
+void killChildren() {
+  for (pid_t pid : g_children) {
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+  }
+  g_children.clear();
+}
+
+// Never hang CI: a lost packet fails the test instead
+void onTimeout(int) {
+  for (pid_t pid : g_children)
+    kill(pid, SIGKILL);
+  const char message[] = "Timed out waiting for the cluster\n";
+  (void)!write(STDERR_FILENO, message, sizeof(message) - 1);
+  _exit(1);
+}
+
+pid_t spawn(const std::string &log, std::vector<std::string> args) {
+  pid_t pid = fork();
+  if (pid == 0) {
+    int fd = open(log.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0) {
+      dup2(fd, STDOUT_FILENO);
+      dup2(fd, STDERR_FILENO);
+    }
+    std::vector<char *> argv;
+    for (std::string &arg : args)
+      argv.push_back(arg.data());
+    argv.push_back(nullptr);
+    execv(argv[0], argv.data());
+    _exit(127);
+  }
+  g_children.push_back(pid);
+  return pid;
+}
+
+bool waitForPort(int port) {
+  asio::io_context io;
+  asio::ip::tcp::endpoint endpoint(asio::ip::make_address("127.0.0.1"), static_cast<unsigned short>(port));
+  for (int i = 0; i < 150; ++i) {
+    asio::ip::tcp::socket socket(io);
+    asio::error_code ec;
+    socket.connect(endpoint, ec);
+    if (!ec)
+      return true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  return false;
+}
+
+// Blocking v1 client
+class Client {
+public:
+  Client(asio::io_context &io, asio::ssl::context &ssl, int port) : m_socket(io, ssl) {
+    m_socket.lowest_layer().connect(
+        asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), static_cast<unsigned short>(port)));
+    m_socket.handshake(asio::ssl::stream_base::client);
+  }
+
+  void send(const Packet &packet) { asio::write(m_socket, asio::buffer(packet.serialize())); }
+
+  // Skips everything else
+  Packet waitFor(PacketType type) {
+    for (;;) {
+      std::vector<uint8_t> raw(sizeof(PacketHeader));
+      asio::read(m_socket, asio::buffer(raw));
+      uint32_t length;
+      std::memcpy(&length, raw.data() + offsetof(PacketHeader, length), sizeof(length));
+      raw.resize(sizeof(PacketHeader) + ntohl(length));
+      asio::read(m_socket, asio::buffer(raw.data() + sizeof(PacketHeader), ntohl(length)));
+      Packet packet(raw);
+      if (packet.type() == type)
+        return packet;
+    }
+  }
+
+  void close() {
+    asio::error_code ec;
+    m_socket.lowest_layer().close(ec);
+  }
+
+private:
+  asio::ssl::stream<asio::ip::tcp::socket> m_socket;
+};
+
+Packet credentials(PacketType type, const std::string &username) {
+  Packet packet(type);
+  packet.writeString(username);
+  packet.writeString("cluster-pw");
+  return packet;
+}
+
+struct Cluster {
+  int basePort;
+  asio::io_context io;
+  asio::ssl::context ssl{asio::ssl::context::tls_client};
+  HashRing ring;
+
+  int portOf(uint32_t node) const { return basePort + static_cast<int>(node); }
+  Client connect(uint32_t node) { return Client(io, ssl, portOf(node)); }
+};
+
+void test_redirect(Cluster &cluster, const std::string &user) {
+  std::cout << "Running test_redirect..." << std::endl;
+
+  uint32_t home = cluster.ring.nodeFor(user);
+  uint32_t wrong = home % 3 + 1;
+  Client client = cluster.connect(wrong);
+  client.send(credentials(PacketType::Login, user));
+  Packet redirect = client.waitFor(PacketType::Redirect);
+  std::string host = redirect.readString();
+  uint32_t port = redirect.readInt();
+  assert(host == "127.0.0.1");
+  assert(static_cast<int>(port) == cluster.portOf(home));
+  client.close();
+
+  std::cout << "[PASS] test_redirect" << std::endl;
+}
+
+void test_cross_node(Cluster &cluster, const std::string &alice, const std::string &bob) {
+  std::cout << "Running test_cross_node..." << std::endl;
+
+  Client a = cluster.connect(cluster.ring.nodeFor(alice));
+  a.send(credentials(PacketType::Login, alice));
+  a.waitFor(PacketType::LoginSuccess);
+  Packet add(PacketType::AddContact);
+  add.writeString(bob);
+  a.send(add);
+  a.waitFor(PacketType::ContactList);
+
+  // Bob logs in on his node: each sees the other online
+  Client b = cluster.connect(cluster.ring.nodeFor(bob));
+  b.send(credentials(PacketType::Login, bob));
+  b.waitFor(PacketType::LoginSuccess);
+  Packet seen = b.waitFor(PacketType::ContactStatusChange);
+  uint32_t status = seen.readInt();
+  std::string name = seen.readString();
+  assert(name == alice && status == 0);
+  seen = a.waitFor(PacketType::ContactStatusChange);
+  status = seen.readInt();
+  name = seen.readString();
+  assert(name == bob && status == 0);
+
+  Packet message(PacketType::DirectMessage);
+  message.writeString(bob);
+  message.writeString("across the cluster");
+  a.send(message);
+  Packet delivered = b.waitFor(PacketType::DirectMessage);
+  std::string sender = delivered.readString();
+  std::string body = delivered.readString();
+  assert(sender == alice && body == "across the cluster");
+
+  // Gone from his node: gone everywhere
+  b.close();
+  seen = a.waitFor(PacketType::ContactStatusChange);
+  status = seen.readInt();
+  name = seen.readString();
+  assert(name == bob && status == 3);
+
+  // Kept for his next login, which gets it and nothing delivered before
+  Packet away(PacketType::DirectMessage);
+  away.writeString(bob);
+  away.writeString("while you were away");
+  a.send(away);
+  std::this_thread::sleep_for(std::chrono::milliseconds(200)); // Committed
+  Client back = cluster.connect(cluster.ring.nodeFor(bob));
+  back.send(credentials(PacketType::Login, bob));
+  delivered = back.waitFor(PacketType::DirectMessage);
+  assert(delivered.readString() == alice && delivered.readString() == "while you were away");
+  seen = a.waitFor(PacketType::ContactStatusChange);
+  assert(seen.readInt() == 0 && seen.readString() == bob);
+
+  // Each message exactly once: the next one is the next one sent
+  Packet again(PacketType::DirectMessage);
+  again.writeString(bob);
+  again.writeString("once more");
+  a.send(again);
+  delivered = back.waitFor(PacketType::DirectMessage);
+  assert(delivered.readString() == alice && delivered.readString() == "once more");
+
+  // Voice notes cross the same way
+  std::vector<uint8_t> note(64, 0x2a);
+  Packet voice(PacketType::VoiceMessage);
+  voice.writeString(bob);
+  voice.writeInt(3);
+  voice.writeInt(static_cast<uint32_t>(note.size()));
+  voice.writeData(note.data(), note.size());
+  a.send(voice);
+  delivered = back.waitFor(PacketType::VoiceMessage);
+  assert(delivered.readString() == alice && delivered.readInt() == 3);
+  assert(delivered.readBytes(delivered.readInt()) == note);
+  back.close();
+  a.close();
+
+  std::cout << "[PASS] test_cross_node" << std::endl;
+}
+
+// A raw link connection to the broker, as a node would open
+class Link {
+public:
+  Link(asio::io_context &io, int port) : m_socket(io) {
+    m_socket.connect(
+        asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), static_cast<unsigned short>(port)));
+  }
+
+  void send(const std::vector<uint8_t> &raw) { asio::write(m_socket, asio::buffer(raw)); }
+
+  Packet read() {
+    std::vector<uint8_t> raw(sizeof(PacketHeader));
+    asio::read(m_socket, asio::buffer(raw));
+    uint32_t length;
+    std::memcpy(&length, raw.data() + offsetof(PacketHeader, length), sizeof(length));
+    raw.resize(sizeof(PacketHeader) + ntohl(length));
+    asio::read(m_socket, asio::buffer(raw.data() + sizeof(PacketHeader), ntohl(length)));
+    return Packet(raw);
+  }
+
+  // The blob of the broker's ClusterHello
+  std::vector<uint8_t> readHello() {
+    Packet hello = read();
+    assert(hello.type() == PacketType::ClusterHello && hello.readInt() == 0);
+    return hello.readBytes(hello.readInt());
+  }
+
+  bool closed() {
+    uint8_t byte;
+    asio::error_code ec;
+    return asio::read(m_socket, asio::buffer(&byte, 1), ec) == 0 && ec;
+  }
+
+private:
+  asio::ip::tcp::socket m_socket;
+};
+
+// HMAC-SHA256 of `label`, a zero byte and `nonce` (ClusterBroker.h)
+std::vector<uint8_t> proof(const std::string &secret, const std::string &label, const std::vector<uint8_t> &nonce) {
+  std::vector<uint8_t> message(label.begin(), label.end());
+  message.push_back(0);
+  message.insert(message.end(), nonce.begin(), nonce.end());
+  std::vector<uint8_t> mac(EVP_MAX_MD_SIZE);
+  unsigned int length = 0;
+  HMAC(EVP_sha256(), secret.data(), static_cast<int>(secret.size()), message.data(), message.size(), mac.data(),
+       &length);
+  mac.resize(length);
+  return mac;
+}
+
+std::vector<uint8_t> hello(uint32_t node, const std::vector<uint8_t> &nonce, const std::vector<uint8_t> &mac) {
+  Packet packet(PacketType::ClusterHello);
+  packet.writeInt(node);
+  packet.writeInt(static_cast<uint32_t>(nonce.size()));
+  packet.writeData(nonce.data(), nonce.size());
+  packet.writeInt(static_cast<uint32_t>(mac.size()));
+  packet.writeData(mac.data(), mac.size());
+  return packet.serialize();
+}
+
+// The broker only relays for nodes that know the cluster secret, and only
+// over the challenge it just sent
+void test_broker_refuses_strangers(int brokerPort, const std::string &secret) {
+  std::cout << "Running test_broker_refuses_strangers..." << std::endl;
+
+  asio::io_context io;
+  std::vector<uint8_t> nonce(16, 7);
+  {
+    Link stranger(io, brokerPort);
+    stranger.readHello();
+    stranger.send(hello(2, nonce, std::vector<uint8_t>(32, 0)));
+    assert(stranger.closed()); // Without an answer
+  }
+
+  // A node that knows it is let in (as an unused id, not to bump a real node)
+  Link node(io, brokerPort);
+  std::vector<uint8_t> challenge = node.readHello();
+  assert(challenge.size() == 16);
+  std::vector<uint8_t> joined = hello(7, nonce, proof(secret, "node 7", challenge));
+  node.send(joined);
+  assert(node.readHello() == proof(secret, "broker", nonce));
+
+  // Its hello replayed on another connection is not
+  Link replay(io, brokerPort);
+  assert(replay.readHello() != challenge);
+  replay.send(joined);
+  assert(replay.closed());
+
+  std::cout << "[PASS] test_broker_refuses_strangers" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::string serverPath, brokerPath;
+  int basePort = 18280;
+  for (int i = 1; i + 1 < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--server")
+      serverPath = argv[++i];
+    else if (arg == "--broker")
+      brokerPath = argv[++i];
+    else if (arg == "--port")
+      basePort = std::atoi(argv[++i]);
+  }
+  if (serverPath.empty() || brokerPath.empty()) {
+    std::cerr << "Usage: cluster_test --server PATH --broker PATH [--port N]" << std::endl;
+    return 2;
+  }
+  std::signal(SIGPIPE, SIG_IGN);
+  std::signal(SIGALRM, onTimeout);
+  alarm(60);
+
+  Cluster cluster;
+  cluster.basePort = basePort;
+  cluster.ssl.set_verify_mode(asio::ssl::verify_none); // Test certificate
+
+  std::string brokerPort = std::to_string(basePort + 10);
+  std::string secret = "cluster-test-" + std::to_string(std::random_device{}());
+  std::ofstream("cluster_secret") << secret << "\n";
+  std::string nodes;
+  for (uint32_t node = 1; node <= 3; ++node) {
+    nodes += (node > 1 ? "," : "") + std::to_string(node) + "=127.0.0.1:" + std::to_string(cluster.portOf(node));
+    cluster.ring.addNode(node);
+  }
+  spawn("cluster_broker.log", {brokerPath, "--port", brokerPort, "--secret-file", "cluster_secret"});
+  for (uint32_t node = 1; node <= 3; ++node) {
+    spawn("cluster_node" + std::to_string(node) + ".log",
+          {serverPath, "--port", std::to_string(cluster.portOf(node)), "--cluster-node", std::to_string(node),
+           "--cluster-nodes", nodes, "--broker", "127.0.0.1:" + brokerPort,
+           "--cluster-secret-file", "cluster_secret", "--resume-grace", "0"});
+  }
+  bool up = waitForPort(basePort + 10);
+  for (uint32_t node = 1; node <= 3; ++node)
+    up = up && waitForPort(cluster.portOf(node));
+  if (!up) {
+    std::cerr << "Cluster did not come up" << std::endl;
+    killChildren();
+    return 1;
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(500)); // Nodes link to the broker
+
+  // Fresh names (the database outlives the run), on two different nodes
+  std::string tag = std::to_string(std::random_device{}() % 1000000);
+  std::string alice = "ca" + tag, bob;
+  for (int i = 0; bob.empty(); ++i) {
+    std::string candidate = "cb" + tag + "_" + std::to_string(i);
+    if (cluster.ring.nodeFor(candidate) != cluster.ring.nodeFor(alice))
+      bob = candidate;
+  }
+  Client registrar = cluster.connect(1);
+  for (const std::string &user : {alice, bob}) {
+    registrar.send(credentials(PacketType::Register, user));
+    registrar.waitFor(PacketType::RegisterSuccess);
+  }
+  registrar.close();
+
+  test_redirect(cluster, alice);
+  test_cross_node(cluster, alice, bob);
+  test_broker_refuses_strangers(basePort + 10, secret);
+
+  killChildren();
+  std::cout << "All tests passed!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,351 @@
+#include "../../server/DatabaseManager.h"
+#include <cassert>
+#include <condition_variable>
+#include <filesystem>
+#include <future>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using wizz::DatabaseManager;
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// A fresh database (and offline log) per test
+std::string freshDb(const std::string &name) {
+  fs::path path = fs::temp_directory_path() / ("wizz_db_test_" + name + ".db");
+  fs::remove(path);
+  fs::remove_all(path.string() + ".offline");
+  return path.string();
+}
+
+// Runs `fn` on the DB thread and waits for it
+template <typename Fn> auto onDb(DatabaseManager &db, Fn fn) -> decltype(fn()) {
+  std::packaged_task<decltype(fn())()> task(fn);
+  auto result = task.get_future();
+  db.postTask([&task]() { task(); });
+  return result.get();
+}
+
+// What the commit handler was called with
+struct Batches {
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::vector<std::pair<std::vector<DatabaseManager::QueuedMessage>, bool>> seen;
+
+  explicit Batches(DatabaseManager &db) {
+    db.setCommitHandler([this](std::vector<DatabaseManager::QueuedMessage> &&batch, bool committed) {
+      std::lock_guard<std::mutex> lock(mutex);
+      seen.emplace_back(std::move(batch), committed);
+      cv.notify_one();
+    });
+  }
+
+  void waitFor(size_t count) {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [&] { return seen.size() >= count; });
+  }
+};
+
+DatabaseManager::QueuedMessage message(const std::string &sender, const std::string &recipient,
+                                       int sessionId, uint32_t seq, bool delivered = true) {
+  DatabaseManager::QueuedMessage msg;
+  msg.sender = sender;
+  msg.recipient = recipient;
+  msg.body = sender + " #" + std::to_string(seq);
+  msg.isDelivered = delivered;
+  msg.sessionId = sessionId;
+  msg.seq = seq;
+  return msg;
+}
+
+// Holds the DB thread until released, so messages pile up into one batch
+struct Blocker {
+  std::promise<void> release;
+
+  explicit Blocker(DatabaseManager &db) {
+    std::shared_future<void> released = release.get_future().share();
+    db.postTask([released]() { released.wait(); });
+  }
+};
+
+} // namespace
+
+void test_group_commit_and_acks() {
+  std::cout << "Running test_group_commit_and_acks..." << std::endl;
+
+  DatabaseManager db(freshDb("group_commit"));
+  assert(db.init());
+  Batches batches(db);
+
+  {
+    Blocker blocker(db);
+    db.queueMessage(message("alice", "bob", 1, 1));
+    db.queueMessage(message("alice", "bob", 1, 2));
+    db.queueMessage(message("carol", "dave", 2, 5, false)); // Offline
+    db.queueMessage(message("erin", "bob", 3, 0));          // Not numbered
+    blocker.release.set_value();
+  }
+  batches.waitFor(1);
+
+  // One transaction for all of them
+  assert(batches.seen.size() == 1);
+  assert(batches.seen[0].second);
+  assert(batches.seen[0].first.size() == 4);
+
+  // One cumulative ack per numbering session
+  auto acks = DatabaseManager::acknowledgments(batches.seen[0].first);
+  assert(acks.size() == 2);
+  assert(acks[1] == 2 && acks[2] == 5);
+
+  assert(onDb(db, [&] { return db.getLastMessageSeq("alice"); }) == 2);
+  assert(onDb(db, [&] { return db.getLastMessageSeq("carol"); }) == 5);
+  assert(onDb(db, [&] { return db.fetchPendingMessages("dave"); }).size() == 1);
+
+  std::cout << "[PASS] test_group_commit_and_acks" << std::endl;
+}
+
+void test_retried_seq_never_lowers() {
+  std::cout << "Running test_retried_seq_never_lowers..." << std::endl;
+
+  DatabaseManager db(freshDb("retry"));
+  assert(db.init());
+  Batches batches(db);
+
+  // A session only hands over seqs above the last one the DB reports, so
+  // that must be the highest ever stored, whichever batch stored it
+  db.queueMessage(message("carol", "dave", 1, 7, false));
+  batches.waitFor(1);
+  db.queueMessage(message("carol", "dave", 2, 4, false));
+  db.queueMessage(message("carol", "bob", 2, 6));
+  batches.waitFor(2);
+  assert(onDb(db, [&] { return db.getLastMessageSeq("carol"); }) == 7);
+  assert(onDb(db, [&] { return db.getLastMessageSeq("nobody"); }) == 0);
+
+  std::cout << "[PASS] test_retried_seq_never_lowers" << std::endl;
+}
+
+void test_commit_failure() {
+  std::cout << "Running test_commit_failure..." << std::endl;
+
+  std::string path = freshDb("failure");
+  DatabaseManager db(path);
+  assert(db.init());
+  Batches batches(db);
+
+  db.queueMessage(message("alice", "bob", 1, 1));
+  batches.waitFor(1);
+
+  // History inserts fail from here on, as on a full disk
+  sqlite3 *other;
+  assert(sqlite3_open(path.c_str(), &other) == SQLITE_OK);
+  auto exec = [other](const char *sql) {
+    assert(sqlite3_exec(other, sql, nullptr, nullptr, nullptr) == SQLITE_OK);
+  };
+  exec("CREATE TRIGGER fail_history BEFORE INSERT ON messages "
+       "BEGIN SELECT RAISE(ABORT, 'disk full'); END;");
+
+  {
+    Blocker blocker(db);
+    db.queueMessage(message("alice", "dave", 1, 2, false)); // Offline
+    db.queueMessage(message("alice", "bob", 1, 3));
+    blocker.release.set_value();
+  }
+  batches.waitFor(2);
+  assert(!batches.seen[1].second);
+  assert(DatabaseManager::acknowledgments(batches.seen[1].first)[1] == 3);
+  exec("DROP TRIGGER fail_history;");
+  // Taken back out of the offline log: the client resends it
+  assert(onDb(db, [&] { return db.fetchPendingMessages("dave"); }).empty());
+
+  // Later messages from that session are dropped: acknowledging seq 4
+  // would tell the client seqs 2 and 3 were stored. Other sessions carry on.
+  {
+    Blocker blocker(db);
+    db.queueMessage(message("alice", "bob", 1, 4));
+    db.queueMessage(message("bob", "alice", 4, 1));
+    blocker.release.set_value();
+  }
+  batches.waitFor(3);
+  assert(batches.seen[2].second);
+  assert(batches.seen[2].first.size() == 1 && batches.seen[2].first[0].sender == "bob");
+  assert(onDb(db, [&] { return db.getLastMessageSeq("alice"); }) == 1);
+
+  // Once the session is gone, the client's replay is stored, once
+  db.postTask([&db]() { db.forgetFailedSessions({1}); });
+  {
+    Blocker blocker(db);
+    db.queueMessage(message("alice", "dave", 5, 2, false));
+    db.queueMessage(message("alice", "bob", 5, 3));
+    db.queueMessage(message("alice", "bob", 5, 4));
+    blocker.release.set_value();
+  }
+  batches.waitFor(4);
+  assert(batches.seen[3].second);
+  assert(onDb(db, [&] { return db.getLastMessageSeq("alice"); }) == 4);
+  assert(onDb(db, [&] { return db.fetchPendingMessages("dave"); }).size() == 1);
+
+  sqlite3_close(other);
+  std::cout << "[PASS] test_commit_failure" << std::endl;
+}
+
+void test_migration_failure() {
+  std::cout << "Running test_migration_failure..." << std::endl;
+
+  // An undelivered row, as databases from before the offline log kept them
+  std::string path = freshDb("migration");
+  { DatabaseManager db(path); assert(db.init()); }
+  sqlite3 *other;
+  assert(sqlite3_open(path.c_str(), &other) == SQLITE_OK);
+  auto exec = [other](const char *sql) {
+    assert(sqlite3_exec(other, sql, nullptr, nullptr, nullptr) == SQLITE_OK);
+  };
+  exec("INSERT INTO messages (sender, recipient, body, is_delivered) "
+       "VALUES ('alice', 'bob', 'from before', 0);");
+
+  // Marking it moved fails: it stays a row, and out of the log
+  exec("CREATE TRIGGER fail_update BEFORE UPDATE ON messages "
+       "BEGIN SELECT RAISE(ABORT, 'disk full'); END;");
+  { DatabaseManager db(path); assert(!db.init()); }
+  {
+    wizz::OfflineLog log(path + ".offline");
+    assert(log.open() && log.pending("bob", 50).empty());
+  }
+
+  // Moved once it can be, and only once
+  exec("DROP TRIGGER fail_update;");
+  sqlite3_close(other);
+  DatabaseManager db(path);
+  assert(db.init());
+  auto pending = onDb(db, [&] { return db.fetchPendingMessages("bob"); });
+  assert(pending.size() == 1 && pending[0].body == "from before");
+
+  std::cout << "[PASS] test_migration_failure" << std::endl;
+}
+
+void test_group_pending_until_marked() {
+  std::cout << "Running test_group_pending_until_marked..." << std::endl;
+
+  DatabaseManager db(freshDb("group_pending"));
+  assert(db.init());
+  onDb(db, [&] {
+    assert(db.createUser("alice", "pw") && db.createUser("bob", "pw"));
+    auto group = db.createGroup("Friday night", {"alice", "bob"});
+    assert(group.id != 0);
+    assert(db.storeGroupMessage(group.id, "alice", "one", {"bob"}));
+    assert(db.storeGroupMessage(group.id, "alice", "two", {"bob"}));
+
+    // Fetching alone changes nothing: the login may not get to send them
+    auto pending = db.fetchPendingGroupMessages("bob");
+    assert(pending.size() == 2 && pending[0].body == "one" && pending[1].body == "two");
+    assert(db.fetchPendingGroupMessages("bob").size() == 2);
+
+    // Arrived after the fetch, so not sent with it
+    assert(db.storeGroupMessage(group.id, "alice", "three", {"bob"}));
+    db.markGroupMessagesDelivered("bob", pending.back().id);
+    pending = db.fetchPendingGroupMessages("bob");
+    assert(pending.size() == 1 && pending[0].body == "three");
+    assert(db.fetchPendingGroupMessages("alice").empty());
+    return true;
+  });
+
+  std::cout << "[PASS] test_group_pending_until_marked" << std::endl;
+}
+
+void test_contact_changes() {
+  std::cout << "Running test_contact_changes..." << std::endl;
+
+  DatabaseManager db(freshDb("contacts"));
+  assert(db.init());
+  onDb(db, [&] {
+    for (const char *name : {"alice", "bob", "carol"})
+      assert(db.createUser(name, "pw"));
+    assert(db.getContactsVersion("alice") == 0);
+
+    // The triggers log each add and remove as the next version
+    assert(db.addFriend("alice", "bob"));
+    assert(db.addFriend("alice", "carol"));
+    assert(db.removeFriend("alice", "bob"));
+    assert(db.getContactsVersion("alice") == 3);
+    assert(db.getContactsVersion("bob") == 0); // Only the list that changed
+
+    // Nothing happened, so nothing logged
+    db.addFriend("alice", "carol");
+    db.removeFriend("alice", "bob");
+    assert(db.getContactsVersion("alice") == 3);
+
+    // Net changes since version 1: bob's add and remove leave "removed"
+    std::vector<DatabaseManager::ContactChange> changes;
+    assert(db.getContactChanges("alice", 1, changes));
+    assert(changes.size() == 2);
+    assert(changes[0].name == "carol" && changes[0].added);
+    assert(changes[1].name == "bob" && !changes[1].added);
+
+    assert(db.getContactChanges("alice", 3, changes) && changes.empty()); // Up to date
+    assert(!db.getContactChanges("alice", 0, changes)); // Never synced
+
+    // A version from the future: the database was reset under the client
+    assert(!db.getContactChanges("alice", 4, changes));
+    assert(!db.getContactChanges("bob", 1, changes));
+    return true;
+  });
+
+  std::cout << "[PASS] test_contact_changes" << std::endl;
+}
+
+void test_contact_log_pruned() {
+  std::cout << "Running test_contact_log_pruned..." << std::endl;
+
+  std::string path = freshDb("contact_prune");
+  DatabaseManager db(path);
+  assert(db.init());
+  onDb(db, [&] {
+    assert(db.createUser("alice", "pw") && db.createUser("bob", "pw"));
+    for (int i = 0; i < 150; ++i) {
+      assert(db.addFriend("alice", "bob"));
+      assert(db.removeFriend("alice", "bob"));
+    }
+    assert(db.getContactsVersion("alice") == 300);
+    return true;
+  });
+
+  // Only the last 256 are kept: versions 45 to 300
+  sqlite3 *other;
+  assert(sqlite3_open(path.c_str(), &other) == SQLITE_OK);
+  sqlite3_stmt *stmt;
+  assert(sqlite3_prepare_v2(other, "SELECT COUNT(*), MIN(version) FROM contact_changes;", -1,
+                            &stmt, nullptr) == SQLITE_OK);
+  assert(sqlite3_step(stmt) == SQLITE_ROW);
+  assert(sqlite3_column_int(stmt, 0) == 256 && sqlite3_column_int(stmt, 1) == 45);
+  sqlite3_finalize(stmt);
+  sqlite3_close(other);
+
+  onDb(db, [&] {
+    std::vector<DatabaseManager::ContactChange> changes;
+    // The change right after 44 is still there...
+    assert(db.getContactChanges("alice", 44, changes));
+    assert(changes.size() == 1 && changes[0].name == "bob" && !changes[0].added);
+    // ...the one after 43 was pruned: the whole list has to be sent
+    assert(!db.getContactChanges("alice", 43, changes));
+    assert(!db.getContactChanges("alice", 1, changes));
+    return true;
+  });
+
+  std::cout << "[PASS] test_contact_log_pruned" << std::endl;
+}
+
+int main() {
+  test_group_commit_and_acks();
+  test_retried_seq_never_lowers();
+  test_commit_failure();
+  test_migration_failure();
+  test_group_pending_until_marked();
+  test_contact_changes();
+  test_contact_log_pruned();
+
+  std::cout << "All tests passed!" << std::endl;
+  return 0;
+}
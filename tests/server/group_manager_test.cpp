@@ -0,0 +1,87 @@
+#include "../../server/GroupManager.h"
+#include <cassert>
+#include <iostream>
+
+using wizz::GroupId;
+using wizz::GroupManager;
+using wizz::UserId;
+
+void test_membership() {
+  std::cout << "Running test_membership..." << std::endl;
+
+  GroupManager groups;
+  groups.addGroup(7, "Friday night", {5, 2, 9, 2});
+  const GroupManager::Group* group = groups.getGroup(7);
+  assert(group && group->name == "Friday night");
+  assert((group->members == std::vector<UserId>{2, 5, 9})); // Sorted, deduped
+  assert(groups.isMember(7, 5) && !groups.isMember(7, 3));
+  assert(!groups.isMember(8, 5) && !groups.getGroup(8));
+
+  assert(groups.addMember(7, 3));
+  assert(!groups.addMember(7, 3));
+  assert(!groups.addMember(8, 3)); // No such group
+  assert((groups.getGroup(7)->members == std::vector<UserId>{2, 3, 5, 9}));
+
+  assert(groups.removeMember(7, 5));
+  assert(!groups.removeMember(7, 5));
+  assert(!groups.isMember(7, 5));
+
+  std::cout << "[PASS] test_membership" << std::endl;
+}
+
+void test_groups_of_user() {
+  std::cout << "Running test_groups_of_user..." << std::endl;
+
+  GroupManager groups;
+  groups.addGroup(1, "a", {0, 1});
+  groups.addGroup(2, "b", {1, 2});
+  assert((groups.groupsOf(1) == std::vector<GroupId>{1, 2}));
+  assert(groups.groupsOf(0).size() == 1);
+  assert(groups.groupsOf(1000).empty()); // Never seen
+
+  groups.addMember(1, 40);
+  assert((groups.groupsOf(40) == std::vector<GroupId>{1}));
+
+  // The last member out drops the group
+  groups.removeMember(2, 1);
+  groups.removeMember(2, 2);
+  assert(!groups.getGroup(2) && groups.size() == 1);
+  assert((groups.groupsOf(1) == std::vector<GroupId>{1}));
+  assert(groups.groupsOf(2).empty());
+
+  std::cout << "[PASS] test_groups_of_user" << std::endl;
+}
+
+void test_replace_group() {
+  std::cout << "Running test_replace_group..." << std::endl;
+
+  GroupManager groups;
+  groups.addGroup(1, "a", {0, 1});
+  groups.addGroup(2, "b", {1});
+
+  groups.replaceGroup(1, "renamed", {1, 3});
+  assert(groups.getGroup(1)->name == "renamed");
+  assert(groups.groupsOf(0).empty());
+  assert((groups.groupsOf(1) == std::vector<GroupId>{2, 1}));
+  assert(groups.isMember(1, 3));
+
+  // Unknown here until now
+  groups.replaceGroup(7, "new", {2});
+  assert(groups.isMember(7, 2));
+
+  // No members: dropped
+  groups.replaceGroup(1, "", {});
+  assert(!groups.getGroup(1) && groups.size() == 2);
+  assert(groups.groupsOf(3).empty());
+
+  std::cout << "[PASS] test_replace_group" << std::endl;
+}
+
+int main() {
+  test_membership();
+  test_groups_of_user();
+  test_replace_group();
+
+  std::cout << "All tests passed!" << std::endl;
+  return 0;
+}
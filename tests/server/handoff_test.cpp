@@ -0,0 +1,92 @@
+#include "../../server/Handoff.h"
+#include <arpa/inet.h>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+namespace handoff = wizz::handoff;
+
+namespace {
+
+const char *PATH = "/tmp/wizz_handoff_test.sock";
+
+uint16_t localPort(int fd) {
+  sockaddr_in addr{};
+  socklen_t len = sizeof(addr);
+  assert(getsockname(fd, reinterpret_cast<sockaddr *>(&addr), &len) == 0);
+  return ntohs(addr.sin_port);
+}
+
+} // namespace
+
+void test_no_server() {
+  std::cout << "Running test_no_server..." << std::endl;
+
+  unlink(PATH);
+  assert(handoff::receiveListener(PATH) == -1);
+
+  std::cout << "[PASS] test_no_server" << std::endl;
+}
+
+void test_listener_handed_over() {
+  std::cout << "Running test_listener_handed_over..." << std::endl;
+
+  // The "old server": a TCP listener on an ephemeral port
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  assert(bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0);
+  assert(listen(listener, 8) == 0);
+  uint16_t port = localPort(listener);
+
+  unlink(PATH);
+  int channel = socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un local{};
+  local.sun_family = AF_UNIX;
+  std::strncpy(local.sun_path, PATH, sizeof(local.sun_path) - 1);
+  assert(bind(channel, reinterpret_cast<sockaddr *>(&local), sizeof(local)) == 0);
+  assert(listen(channel, 1) == 0);
+
+  std::thread oldServer([&] {
+    int peer = accept(channel, nullptr, nullptr);
+    assert(peer >= 0);
+    assert(handoff::sameUser(peer)); // Both ends are this process
+    assert(handoff::sendListener(peer, listener));
+    close(peer);
+  });
+
+  int received = handoff::receiveListener(PATH);
+  oldServer.join();
+  assert(received >= 0 && received != listener);
+  assert(localPort(received) == port);
+
+  // The old process lets go; connections still land on the new descriptor
+  close(listener);
+  int client = socket(AF_INET, SOCK_STREAM, 0);
+  addr.sin_port = htons(port);
+  assert(connect(client, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0);
+  int accepted = accept(received, nullptr, nullptr);
+  assert(accepted >= 0);
+
+  close(accepted);
+  close(client);
+  close(received);
+  close(channel);
+  unlink(PATH);
+
+  std::cout << "[PASS] test_listener_handed_over" << std::endl;
+}
+
+int main() {
+  test_no_server();
+  test_listener_handed_over();
+  std::cout << "All tests passed!" << std::endl;
+  return 0;
+}
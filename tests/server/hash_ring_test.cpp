@@ -0,0 +1,86 @@
+#include "../../server/HashRing.h"
+#include <cassert>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using wizz::HashRing;
+
+static std::vector<std::string> users(int count) {
+  std::vector<std::string> names;
+  for (int i = 0; i < count; ++i)
+    names.push_back("user" + std::to_string(i));
+  return names;
+}
+
+void test_placement() {
+  std::cout << "Running test_placement..." << std::endl;
+
+  HashRing ring;
+  assert(ring.empty() && ring.nodeFor("alice") == HashRing::NO_NODE);
+
+  for (uint32_t node : {1u, 2u, 3u})
+    ring.addNode(node);
+  // Every node computes the same placement, whatever order it added them in
+  HashRing other;
+  for (uint32_t node : {3u, 1u, 2u})
+    other.addNode(node);
+
+  std::unordered_map<uint32_t, int> counts;
+  for (const std::string &name : users(30000)) {
+    uint32_t node = ring.nodeFor(name);
+    assert(node == other.nodeFor(name));
+    ++counts[node];
+  }
+  // Spread within a loose bound of the fair share
+  assert(counts.size() == 3);
+  for (const auto &[node, count] : counts)
+    assert(count > 10000 * 0.7 && count < 10000 * 1.3);
+
+  std::cout << "[PASS] test_placement" << std::endl;
+}
+
+void test_membership_changes() {
+  std::cout << "Running test_membership_changes..." << std::endl;
+
+  HashRing ring;
+  for (uint32_t node : {1u, 2u, 3u})
+    ring.addNode(node);
+  std::vector<std::string> names = users(30000);
+  std::vector<uint32_t> before;
+  for (const std::string &name : names)
+    before.push_back(ring.nodeFor(name));
+
+  // A fourth node takes about a quarter, and only onto itself
+  ring.addNode(4);
+  int moved = 0;
+  for (size_t i = 0; i < names.size(); ++i) {
+    uint32_t node = ring.nodeFor(names[i]);
+    if (node != before[i]) {
+      assert(node == 4);
+      ++moved;
+    }
+  }
+  assert(moved > 30000 / 4 * 0.7 && moved < 30000 / 4 * 1.3);
+
+  // Removing it puts everyone back
+  ring.removeNode(4);
+  for (size_t i = 0; i < names.size(); ++i)
+    assert(ring.nodeFor(names[i]) == before[i]);
+
+  ring.removeNode(1);
+  ring.removeNode(2);
+  ring.removeNode(3);
+  assert(ring.empty());
+
+  std::cout << "[PASS] test_membership_changes" << std::endl;
+}
+
+int main() {
+  test_placement();
+  test_membership_changes();
+
+  std::cout << "All tests passed!" << std::endl;
+  return 0;
+}
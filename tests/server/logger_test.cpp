@@ -0,0 +1,95 @@
+#include "../../server/Logger.h"
+#include <cassert>
+#include <iostream>
+#include <string>
+
+using wizz::LogLevel;
+using wizz::LogRecord;
+using wizz::LogRing;
+
+enum class Kind : uint32_t { Chat = 300 };
+
+static LogRecord make(const char *format) {
+  LogRecord record;
+  record.timestamp = 0;
+  record.format = format;
+  record.level = LogLevel::Info;
+  record.args = 0;
+  record.size = 0;
+  return record;
+}
+
+void test_formatting() {
+  std::cout << "Running test_formatting..." << std::endl;
+
+  LogRecord record = make("[Session {}] {} sent {} bytes ({}%), ok={} type={}");
+  std::string name = "alice";
+  record.add(-7);
+  record.add(name);
+  record.add(uint64_t(1) << 40);
+  record.add(12.5);
+  record.add(true);
+  record.add(Kind::Chat);
+  assert(record.message() ==
+         "[Session -7] alice sent 1099511627776 bytes (12.5%), ok=1 type=300");
+
+  // Missing arguments leave the placeholder
+  LogRecord few = make("{} and {}");
+  few.add("one");
+  assert(few.message() == "one and {}");
+
+  // Level letter after the time of day
+  std::string line = record.toString();
+  assert(line.size() > 18 && line[15] == ' ' && line[16] == 'I' && line.back() == '\n');
+
+  std::cout << "[PASS] test_formatting" << std::endl;
+}
+
+void test_truncation() {
+  std::cout << "Running test_truncation..." << std::endl;
+
+  // Long strings are cut to fit; arguments after a full record are dropped
+  LogRecord record = make("{}|{}");
+  record.add(std::string(1000, 'x'));
+  record.add(42);
+  assert(record.args == 1);
+  std::string cut(LogRecord::PAYLOAD_SIZE - 3, 'x'); // Type + length
+  assert(record.message() == cut + "|{}");
+
+  std::cout << "[PASS] test_truncation" << std::endl;
+}
+
+void test_ring() {
+  std::cout << "Running test_ring..." << std::endl;
+
+  LogRing ring;
+  assert(!ring.peek());
+  for (size_t i = 0; i < LogRing::CAPACITY; ++i) {
+    LogRecord *slot = ring.claim();
+    assert(slot);
+    slot->timestamp = i;
+    ring.publish();
+  }
+  // Full: the producer drops rather than waits
+  assert(!ring.claim());
+  assert(ring.dropped() == 1);
+
+  for (size_t i = 0; i < LogRing::CAPACITY; ++i) {
+    const LogRecord *record = ring.peek();
+    assert(record && record->timestamp == i);
+    ring.release();
+  }
+  assert(!ring.peek());
+  assert(ring.claim()); // Space again
+
+  std::cout << "[PASS] test_ring" << std::endl;
+}
+
+int main() {
+  test_formatting();
+  test_truncation();
+  test_ring();
+
+  std::cout << "All tests passed!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,148 @@
+#include "../../server/handlers/MessageReader.h"
+#include "../../server/handlers/Messages.h"
+#include "../../server/handlers/PacketRouter.h"
+#include <cassert>
+#include <iostream>
+
+using wizz::MessageReader;
+using wizz::Packet;
+using wizz::PacketType;
+namespace msg = wizz::msg;
+
+template <typename Message> bool decode(const Packet &packet, Message &message) {
+  MessageReader in(packet);
+  return message.read(in);
+}
+
+void test_fields_in_order() {
+  std::cout << "Running test_fields_in_order..." << std::endl;
+
+  Packet packet(PacketType::GroupAddMember);
+  packet.writeInt(7);
+  packet.writeString("bob");
+  msg::GroupAddMember add;
+  assert(decode(packet, add));
+  assert(add.group == 7 && add.username == "bob");
+
+  Packet typing(PacketType::TypingIndicator);
+  typing.writeString("alice");
+  typing.writeInt(2);
+  msg::TypingIndicator indicator;
+  assert(decode(typing, indicator));
+  assert(indicator.recipient == "alice" && indicator.typing);
+
+  std::cout << "[PASS] test_fields_in_order" << std::endl;
+}
+
+void test_truncated_bodies_are_rejected() {
+  std::cout << "Running test_truncated_bodies_are_rejected..." << std::endl;
+
+  msg::Login login;
+  Packet empty(PacketType::Login);
+  assert(!decode(empty, login));
+
+  Packet oneField(PacketType::Login);
+  oneField.writeString("alice");
+  assert(!decode(oneField, login));
+
+  // String length past the end of the body
+  Packet shortString(PacketType::Login);
+  shortString.writeInt(100);
+  shortString.writeData("abc", 3);
+  assert(!decode(shortString, login));
+
+  msg::UpdateAvatar avatar;
+  Packet shortBlob(PacketType::UpdateAvatar);
+  shortBlob.writeInt(1000);
+  shortBlob.writeData("png", 3);
+  assert(!decode(shortBlob, avatar));
+
+  std::cout << "[PASS] test_truncated_bodies_are_rejected" << std::endl;
+}
+
+void test_bogus_count_allocates_nothing() {
+  std::cout << "Running test_bogus_count_allocates_nothing..." << std::endl;
+
+  Packet packet(PacketType::GroupCreate);
+  packet.writeString("team");
+  packet.writeInt(0xFFFFFFFF);
+  msg::GroupCreate create;
+  assert(!decode(packet, create));
+  assert(create.members.capacity() == 0);
+
+  Packet valid(PacketType::GroupCreate);
+  valid.writeString("team");
+  valid.writeInt(2);
+  valid.writeString("alice");
+  valid.writeString("bob");
+  assert(decode(valid, create));
+  assert(create.members.size() == 2 && create.members[1] == "bob");
+
+  std::cout << "[PASS] test_bogus_count_allocates_nothing" << std::endl;
+}
+
+void test_optional_trailing_fields() {
+  std::cout << "Running test_optional_trailing_fields..." << std::endl;
+
+  // Older clients send no seq
+  Packet legacy(PacketType::DirectMessage);
+  legacy.writeString("bob");
+  legacy.writeString("hi");
+  msg::DirectMessage message;
+  assert(decode(legacy, message));
+  assert(message.seq == 0);
+
+  Packet numbered(PacketType::DirectMessage);
+  numbered.writeString("bob");
+  numbered.writeString("hi");
+  numbered.writeInt(42);
+  msg::DirectMessage second;
+  assert(decode(numbered, second));
+  assert(second.seq == 42);
+
+  // Codec: absent means WAV, out of range is malformed
+  Packet voice(PacketType::VoiceMessage);
+  voice.writeString("bob");
+  voice.writeInt(3);
+  voice.writeInt(2);
+  voice.writeData("ab", 2);
+  msg::VoiceMessage note;
+  assert(decode(voice, note));
+  assert(note.codec == wizz::VoiceCodec::Wav && note.data.size() == 2);
+
+  voice.writeInt(99);
+  msg::VoiceMessage bad;
+  assert(!decode(voice, bad));
+
+  std::cout << "[PASS] test_optional_trailing_fields" << std::endl;
+}
+
+void test_packet_slots() {
+  std::cout << "Running test_packet_slots..." << std::endl;
+
+  // Dense and in enum order
+  assert(wizz::packetSlot(PacketType::Hello) == 0);
+  assert(wizz::packetSlot(PacketType::HelloAck) == 1);
+  assert(wizz::packetSlot(PacketType::Reconnect) == 2);
+  assert(wizz::packetSlot(PacketType::Login) == 3);
+  assert(wizz::packetSlot(PacketType::Error) == wizz::PACKET_SLOT_COUNT - 1);
+  assert(wizz::PACKET_SLOT_COUNT == 41);
+
+  // Gaps between areas and anything past the table have no slot
+  assert(wizz::packetSlot(static_cast<PacketType>(0)) == wizz::NO_SLOT);
+  assert(wizz::packetSlot(static_cast<PacketType>(109)) == wizz::NO_SLOT);
+  assert(wizz::packetSlot(static_cast<PacketType>(305)) == wizz::NO_SLOT);
+  assert(wizz::packetSlot(static_cast<PacketType>(0xFFFFFFFF)) == wizz::NO_SLOT);
+
+  std::cout << "[PASS] test_packet_slots" << std::endl;
+}
+
+int main() {
+  test_fields_in_order();
+  test_truncated_bodies_are_rejected();
+  test_bogus_count_allocates_nothing();
+  test_optional_trailing_fields();
+  test_packet_slots();
+  std::cout << "All tests passed!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,127 @@
+#include "../../server/Metrics.h"
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+using wizz::Counter;
+using wizz::Histogram;
+using wizz::MetricsRegistry;
+
+void test_histogram_buckets() {
+  std::cout << "Running test_histogram_buckets..." << std::endl;
+
+  // Small values are exact; every bucket covers its values and no others
+  for (uint64_t v = 0; v < 8; ++v)
+    assert(Histogram::bucketOf(v) == v && Histogram::bucketUpperBound(v) == v);
+  const uint64_t samples[] = {8, 9, 15, 16, 17, 1000, 123456789,
+                              (uint64_t(1) << 40) + 5, UINT64_MAX};
+  for (uint64_t v : samples) {
+    unsigned b = Histogram::bucketOf(v);
+    assert(b < Histogram::BUCKETS);
+    assert(v <= Histogram::bucketUpperBound(b));
+    assert(v > Histogram::bucketUpperBound(b - 1));
+    // Within 1/8 of the value
+    assert(Histogram::bucketUpperBound(b) - v <= v / 8);
+  }
+  assert(Histogram::bucketOf(UINT64_MAX) == Histogram::BUCKETS - 1);
+
+  std::cout << "[PASS] test_histogram_buckets" << std::endl;
+}
+
+void test_quantiles() {
+  std::cout << "Running test_quantiles..." << std::endl;
+
+  Histogram h;
+  assert(h.quantile(0.5) == 0);
+  for (uint64_t v = 1; v <= 10000; ++v)
+    h.record(v * 1000); // 1 us .. 10 ms
+  assert(h.count() == 10000);
+  assert(h.sum() == 1000ull * 10000 * 10001 / 2);
+
+  auto near = [](uint64_t got, uint64_t want) {
+    return got >= want && got - want <= want / 8;
+  };
+  assert(near(h.quantile(0.5), 5000000));
+  assert(near(h.quantile(0.99), 9900000));
+  assert(near(h.quantile(0.999), 9990000));
+  assert(near(h.quantile(1.0), 10000000));
+
+  std::cout << "[PASS] test_quantiles" << std::endl;
+}
+
+void test_concurrent_updates() {
+  std::cout << "Running test_concurrent_updates..." << std::endl;
+
+  Counter counter;
+  Histogram h;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&] {
+      for (int i = 0; i < 100000; ++i) {
+        counter.add();
+        h.record(static_cast<uint64_t>(i));
+      }
+    });
+  }
+  for (auto &t : threads)
+    t.join();
+  assert(counter.value() == 400000);
+  assert(h.count() == 400000);
+
+  std::cout << "[PASS] test_concurrent_updates" << std::endl;
+}
+
+void test_exposition() {
+  std::cout << "Running test_exposition..." << std::endl;
+
+  MetricsRegistry registry;
+  registry.counter("wizz_bytes_sent_total", "Bytes sent").add(42);
+  Counter &typed = registry.counter("wizz_throttled_total", "Dropped", "type=\"304\"");
+  assert(&typed == &registry.counter("wizz_throttled_total", "Dropped", "type=\"304\""));
+  typed.add(3);
+  registry.counter("wizz_throttled_total", "Dropped", "type=\"302\"").add(1);
+  registry.gauge("wizz_sessions", "Open connections").set(7);
+  Histogram &latency = registry.histogram("wizz_handler_seconds", "Handler time",
+                                          "type=\"300\"", 1e-9);
+  latency.record(2000);
+  latency.record(2000);
+
+  std::string text = registry.exposition();
+  auto has = [&](const std::string &line) {
+    return text.find(line + "\n") != std::string::npos;
+  };
+  assert(has("# TYPE wizz_bytes_sent_total counter"));
+  assert(has("wizz_bytes_sent_total 42"));
+  assert(has("wizz_throttled_total{type=\"304\"} 3"));
+  assert(has("wizz_throttled_total{type=\"302\"} 1"));
+  assert(text.find("# HELP wizz_throttled_total") == text.rfind("# HELP wizz_throttled_total"));
+  assert(has("# TYPE wizz_sessions gauge"));
+  assert(has("wizz_sessions 7"));
+  assert(has("# TYPE wizz_handler_seconds summary"));
+  assert(has("wizz_handler_seconds{type=\"300\",quantile=\"0.5\"} 2.047e-06"));
+  assert(has("wizz_handler_seconds_count{type=\"300\"} 2"));
+
+  const char *path = "metrics_test.prom";
+  assert(registry.writeTextFile(path));
+  std::ifstream file(path);
+  std::stringstream read;
+  read << file.rdbuf();
+  assert(read.str() == text);
+  std::remove(path);
+
+  std::cout << "[PASS] test_exposition" << std::endl;
+}
+
+int main() {
+  test_histogram_buckets();
+  test_quantiles();
+  test_concurrent_updates();
+  test_exposition();
+
+  std::cout << "All tests passed!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,226 @@
+#include "../../server/OfflineLog.h"
+#include <cassert>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using wizz::OfflineLog;
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// A fresh directory per test
+std::string freshDir(const std::string &name) {
+  fs::path dir = fs::temp_directory_path() / ("wizz_offline_log_" + name);
+  fs::remove_all(dir);
+  return dir.string();
+}
+
+// The shard holding the only records in `dir`
+fs::path usedShard(const std::string &dir) {
+  for (const auto &entry : fs::directory_iterator(dir)) {
+    if (entry.path().extension() != ".log") continue;
+    std::ifstream in(entry.path(), std::ios::binary);
+    char header[64];
+    in.read(header, sizeof(header));
+    uint64_t tail;
+    std::memcpy(&tail, header + 16, sizeof(tail));
+    if (tail > sizeof(header)) return entry.path();
+  }
+  return {};
+}
+
+std::vector<std::string> bodies(const std::vector<OfflineLog::Message> &messages) {
+  std::vector<std::string> result;
+  for (const auto &message : messages) result.push_back(message.body);
+  return result;
+}
+
+} // namespace
+
+void test_append_and_deliver() {
+  std::cout << "Running test_append_and_deliver..." << std::endl;
+
+  OfflineLog log(freshDir("deliver"));
+  assert(log.open());
+  assert(log.append("bob", "alice", "one", 100));
+  assert(log.append("bob", "carol", "two", 101));
+  assert(log.append("carol", "alice", "hi carol", 102));
+  assert(log.append("bob", "alice", "three", 103));
+  assert(log.sync());
+  assert(log.pendingCount() == 4);
+
+  auto pending = log.pending("bob", 50);
+  assert((bodies(pending) == std::vector<std::string>{"one", "two", "three"}));
+  assert(pending[1].sender == "carol" && pending[1].timestamp == 101);
+  assert(pending[0].id < pending[1].id && pending[1].id < pending[2].id);
+  assert(log.pending("bob", 2).size() == 2);
+  assert(log.pending("nobody", 50).empty());
+
+  // The cursor moves past what was sent, and only that
+  assert(log.markDelivered("bob", pending[1].id));
+  assert((bodies(log.pending("bob", 50)) == std::vector<std::string>{"three"}));
+  assert(log.markDelivered("bob", pending[0].id)); // Already past it
+  assert(log.markDelivered("bob", pending[2].id));
+  assert(log.pending("bob", 50).empty());
+  assert(log.pendingCount() == 1);
+
+  std::cout << "[PASS] test_append_and_deliver" << std::endl;
+}
+
+void test_drop() {
+  std::cout << "Running test_drop..." << std::endl;
+
+  std::string dir = freshDir("drop");
+  {
+    OfflineLog log(dir);
+    assert(log.open());
+    uint64_t first = log.append("bob", "alice", "one", 1);
+    uint64_t second = log.append("bob", "alice", "two", 2);
+    assert(log.append("bob", "alice", "three", 3));
+    assert(first != 0 && second > first);
+
+    // Only that message goes; the cursor is untouched
+    assert(log.drop("bob", second));
+    assert((bodies(log.pending("bob", 50)) == std::vector<std::string>{"one", "three"}));
+    assert(log.drop("bob", second)); // Already gone
+    assert(log.sync());
+  }
+
+  OfflineLog reopened(dir);
+  assert(reopened.open());
+  assert((bodies(reopened.pending("bob", 50)) == std::vector<std::string>{"one", "three"}));
+  assert(reopened.pendingCount() == 2);
+
+  std::cout << "[PASS] test_drop" << std::endl;
+}
+
+void test_replay_and_sharing() {
+  std::cout << "Running test_replay_and_sharing..." << std::endl;
+
+  std::string dir = freshDir("replay");
+  uint64_t lastId;
+  {
+    OfflineLog log(dir);
+    assert(log.open());
+    assert(log.append("bob", "alice", "kept", 1));
+    assert(log.append("bob", "alice", "delivered", 2));
+    assert(log.append("dave", "alice", "for dave", 3));
+    auto pending = log.pending("dave", 50);
+    assert(log.markDelivered("dave", pending[0].id));
+    lastId = log.pending("bob", 50).back().id;
+    assert(log.sync());
+  }
+
+  // Replayed from the files
+  OfflineLog first(dir);
+  assert(first.open());
+  assert((bodies(first.pending("bob", 50)) == std::vector<std::string>{"kept", "delivered"}));
+  assert(first.pending("dave", 50).empty());
+
+  // Two instances on one directory (as two processes would be) see each
+  // other's appends and cursors
+  OfflineLog second(dir);
+  assert(second.open());
+  assert(second.append("bob", "erin", "from the other one", 4));
+  auto pending = first.pending("bob", 50);
+  assert(pending.size() == 3 && pending[2].body == "from the other one");
+  assert(pending[2].id > lastId); // Ids never repeat within a shard
+  assert(first.markDelivered("bob", pending[1].id));
+  assert((bodies(second.pending("bob", 50)) == std::vector<std::string>{"from the other one"}));
+
+  std::cout << "[PASS] test_replay_and_sharing" << std::endl;
+}
+
+void test_torn_tail() {
+  std::cout << "Running test_torn_tail..." << std::endl;
+
+  std::string dir = freshDir("torn");
+  {
+    OfflineLog log(dir);
+    assert(log.open());
+    assert(log.append("bob", "alice", "whole", 1));
+    assert(log.append("bob", "alice", "torn", 2));
+    assert(log.sync());
+  }
+
+  // A crash halfway through the last append: its CRC no longer matches
+  fs::path shard = usedShard(dir);
+  assert(!shard.empty());
+  std::fstream file(shard, std::ios::in | std::ios::out | std::ios::binary);
+  char header[64];
+  file.read(header, sizeof(header));
+  uint64_t tail;
+  std::memcpy(&tail, header + 16, sizeof(tail));
+  file.seekp(static_cast<std::streamoff>(tail - 1));
+  file.put('\x7f');
+  file.close();
+
+  OfflineLog log(dir);
+  assert(log.open());
+  assert((bodies(log.pending("bob", 50)) == std::vector<std::string>{"whole"}));
+  // Appends go where the bad record was
+  assert(log.append("bob", "alice", "after", 3));
+  assert(log.sync());
+  OfflineLog reopened(dir);
+  assert(reopened.open());
+  assert((bodies(reopened.pending("bob", 50)) == std::vector<std::string>{"whole", "after"}));
+
+  std::cout << "[PASS] test_torn_tail" << std::endl;
+}
+
+void test_compaction() {
+  std::cout << "Running test_compaction..." << std::endl;
+
+  std::string dir = freshDir("compact");
+  OfflineLog log(dir);
+  assert(log.open());
+  OfflineLog other(dir); // Maps the files before they are replaced
+  assert(other.open());
+
+  std::string body(1000, 'x');
+  for (int i = 0; i < 3000; ++i) assert(log.append("bob", "alice", body + std::to_string(i), i));
+  assert(log.sync());
+  fs::path shard = usedShard(dir);
+  uintmax_t before = fs::file_size(shard);
+
+  // Nothing delivered yet: nothing to reclaim
+  assert(log.compact() == 0);
+
+  auto pending = log.pending("bob", 2990);
+  assert(log.markDelivered("bob", pending.back().id));
+  uint64_t reclaimed = log.compact();
+  assert(reclaimed > 2990 * 1000);
+  assert(fs::file_size(shard) < before);
+
+  auto left = log.pending("bob", 50);
+  assert(left.size() == 10);
+  assert(left[0].body == body + "2990" && left[9].body == body + "2999");
+
+  // The other instance moves to the new file and keeps going
+  assert(bodies(other.pending("bob", 50)) == bodies(left));
+  assert(other.append("bob", "alice", "after compaction", 4000));
+  auto all = log.pending("bob", 50);
+  assert(all.size() == 11 && all.back().body == "after compaction" && all.back().id > left.back().id);
+
+  OfflineLog reopened(dir);
+  assert(reopened.open());
+  assert(reopened.pendingCount() == 11);
+
+  std::cout << "[PASS] test_compaction" << std::endl;
+}
+
+int main() {
+  test_append_and_deliver();
+  test_drop();
+  test_replay_and_sharing();
+  test_torn_tail();
+  test_compaction();
+
+  std::cout << "All tests passed!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,107 @@
+#include "../../server/PresenceCoalescer.h"
+#include <cassert>
+#include <iostream>
+
+using wizz::Packet;
+using wizz::PacketType;
+using wizz::PresenceCoalescer;
+
+void test_superseded_updates_merge() {
+  std::cout << "Running test_superseded_updates_merge..." << std::endl;
+
+  PresenceCoalescer coalescer;
+  assert(coalescer.addStatus("alice", 0, "hi")); // First: schedule a flush
+  assert(!coalescer.addStatus("bob", 1, ""));
+  for (uint32_t i = 0; i < 50; ++i)
+    assert(!coalescer.addStatus("alice", i % 3, "churn"));
+  assert(!coalescer.addTyping("bob", true));
+  assert(!coalescer.addTyping("bob", false));
+
+  auto packets = coalescer.flush(true);
+  assert(packets.size() == 1);
+  Packet &batch = packets[0];
+  assert(batch.type() == PacketType::PresenceBatch);
+
+  assert(batch.readInt() == 2);
+  assert(batch.readString() == "alice"); // First-seen order is kept
+  assert(batch.readInt() == 49 % 3);
+  assert(batch.readString() == "churn");
+  assert(batch.readString() == "bob");
+  assert(batch.readInt() == 1);
+  assert(batch.readString() == "");
+
+  assert(batch.readInt() == 1);
+  assert(batch.readString() == "bob");
+  assert(batch.readInt() == 0);
+  assert(batch.remaining() == 0);
+
+  assert(coalescer.empty());
+  assert(coalescer.addStatus("alice", 3, "")); // Next window starts fresh
+
+  std::cout << "[PASS] test_superseded_updates_merge" << std::endl;
+}
+
+void test_legacy_fallback() {
+  std::cout << "Running test_legacy_fallback..." << std::endl;
+
+  PresenceCoalescer coalescer;
+  coalescer.addStatus("alice", 0, "a");
+  coalescer.addStatus("alice", 2, "b");
+  coalescer.addTyping("carl", true);
+
+  auto packets = coalescer.flush(false);
+  assert(packets.size() == 2);
+  assert(packets[0].type() == PacketType::ContactStatusChange);
+  assert(packets[0].readInt() == 2);
+  assert(packets[0].readString() == "alice");
+  assert(packets[0].readString() == "b");
+  assert(packets[1].type() == PacketType::TypingIndicator);
+  assert(packets[1].readString() == "carl");
+  assert(packets[1].readInt() == 1);
+
+  std::cout << "[PASS] test_legacy_fallback" << std::endl;
+}
+
+void test_flush_typing_for_one_user() {
+  std::cout << "Running test_flush_typing_for_one_user..." << std::endl;
+
+  PresenceCoalescer coalescer;
+  coalescer.addTyping("alice", true);
+  coalescer.addTyping("bob", true);
+  coalescer.addTyping("carl", false);
+  assert(coalescer.flushTyping("nobody", true).empty());
+
+  // Only bob's entry goes, ahead of his message
+  auto packets = coalescer.flushTyping("bob", true);
+  assert(packets.size() == 1);
+  assert(packets[0].type() == PacketType::PresenceBatch);
+  assert(packets[0].readInt() == 0);
+  assert(packets[0].readInt() == 1);
+  assert(packets[0].readString() == "bob");
+  assert(packets[0].readInt() == 1);
+
+  // The others stay pending, in order, and can still be merged
+  assert(!coalescer.addTyping("carl", true));
+  packets = coalescer.flush(false);
+  assert(packets.size() == 2);
+  assert(packets[0].readString() == "alice");
+  assert(packets[1].readString() == "carl");
+  assert(packets[1].readInt() == 1);
+
+  // Nothing left: the timer's flush sends nothing
+  coalescer.addTyping("alice", false);
+  assert(coalescer.flushTyping("alice", false).size() == 1);
+  assert(coalescer.empty());
+  assert(coalescer.flush(true).empty());
+
+  std::cout << "[PASS] test_flush_typing_for_one_user" << std::endl;
+}
+
+int main() {
+  test_superseded_updates_merge();
+  test_legacy_fallback();
+  test_flush_typing_for_one_user();
+
+  std::cout << "All tests passed!" << std::endl;
+  return 0;
+}
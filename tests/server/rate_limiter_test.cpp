@@ -0,0 +1,112 @@
+#include "../../server/RateLimiter.h"
+#include <cassert>
+#include <iostream>
+
+using wizz::Packet;
+using wizz::PacketType;
+using wizz::RateLimit;
+using wizz::RateLimiter;
+using namespace std::chrono_literals;
+
+void test_burst_then_refill() {
+  std::cout << "Running test_burst_then_refill..." << std::endl;
+
+  RateLimiter limiter;
+  const RateLimit limit{10, 5};
+  auto t = RateLimiter::Clock::time_point{} + 1h;
+
+  for (int i = 0; i < 5; ++i)
+    assert(limiter.allow(PacketType::TypingIndicator, limit, t));
+  assert(!limiter.allow(PacketType::TypingIndicator, limit, t));
+  assert(limiter.startedThrottling()); // Logged once...
+  assert(!limiter.allow(PacketType::TypingIndicator, limit, t));
+  assert(!limiter.startedThrottling()); // ...not per packet
+  assert(limiter.throttled() == 2);
+
+  // 10/s: one token every 100 ms
+  t += 100ms;
+  assert(limiter.allow(PacketType::TypingIndicator, limit, t));
+  assert(!limiter.allow(PacketType::TypingIndicator, limit, t));
+  assert(limiter.startedThrottling()); // A new run
+
+  // Idle time refills up to the burst, no further
+  t += 10s;
+  for (int i = 0; i < 5; ++i)
+    assert(limiter.allow(PacketType::TypingIndicator, limit, t));
+  assert(!limiter.allow(PacketType::TypingIndicator, limit, t));
+
+  std::cout << "[PASS] test_burst_then_refill" << std::endl;
+}
+
+void test_types_are_independent() {
+  std::cout << "Running test_types_are_independent..." << std::endl;
+
+  RateLimiter limiter;
+  auto t = RateLimiter::Clock::time_point{} + 1h;
+
+  assert(limiter.allow(PacketType::Nudge, {1, 1}, t));
+  assert(!limiter.allow(PacketType::Nudge, {1, 1}, t));
+  // A flood of one type leaves the others alone
+  for (int i = 0; i < 10; ++i)
+    assert(limiter.allow(PacketType::GetAvatar, {50, 10}, t));
+  assert(!limiter.allow(PacketType::GetAvatar, {50, 10}, t));
+  assert(limiter.throttled() == 2);
+
+  std::cout << "[PASS] test_types_are_independent" << std::endl;
+}
+
+Packet status(const std::string &text) {
+  Packet packet(PacketType::UpdateStatus);
+  packet.writeString(text);
+  return packet;
+}
+
+void test_deferred_keeps_latest() {
+  std::cout << "Running test_deferred_keeps_latest..." << std::endl;
+
+  RateLimiter limiter;
+  const RateLimit limit{10, 1};
+  auto t = RateLimiter::Clock::time_point{} + 1h;
+
+  assert(limiter.allow(PacketType::UpdateStatus, limit, t));
+  assert(!limiter.allow(PacketType::UpdateStatus, limit, t));
+  assert(limiter.defer(status("busy"), "", limit));
+  assert(!limiter.allow(PacketType::UpdateStatus, limit, t));
+  assert(limiter.defer(status("away"), "", limit)); // Replaces "busy"
+  Packet typing(PacketType::TypingIndicator);
+  assert(limiter.allow(PacketType::TypingIndicator, limit, t));
+  assert(limiter.defer(typing, "bob", limit));
+  assert(limiter.defer(typing, "carol", limit)); // Another key
+
+  // No token yet
+  assert(limiter.takeDeferred(t).empty());
+  assert(limiter.hasDeferred());
+
+  t += 100ms;
+  auto ready = limiter.takeDeferred(t);
+  assert(ready.size() == 2);
+  assert(ready[0].type() == PacketType::UpdateStatus && ready[0].readString() == "away");
+  assert(ready[1].type() == PacketType::TypingIndicator);
+
+  // carol's waits for the next typing token; a newer update supersedes it
+  assert(limiter.hasDeferred());
+  limiter.supersede(PacketType::TypingIndicator, "carol");
+  assert(!limiter.hasDeferred());
+
+  // Bounded, however many keys a client makes up
+  for (size_t i = 0; i < RateLimiter::MAX_DEFERRED; ++i)
+    assert(limiter.defer(typing, std::to_string(i), limit));
+  assert(!limiter.defer(typing, "one too many", limit));
+  assert(limiter.defer(typing, "0", limit));
+
+  std::cout << "[PASS] test_deferred_keeps_latest" << std::endl;
+}
+
+int main() {
+  test_burst_then_refill();
+  test_types_are_independent();
+  test_deferred_keeps_latest();
+
+  std::cout << "All tests passed!" << std::endl;
+  return 0;
+}
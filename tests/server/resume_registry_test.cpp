@@ -0,0 +1,124 @@
+#include "../../server/ResumeRegistry.h"
+#include <cassert>
+#include <iostream>
+
+using wizz::INVALID_USER;
+using wizz::ResumeRegistry;
+using namespace std::chrono_literals;
+
+namespace {
+
+ResumeRegistry::Parked parkedUser(wizz::UserId user) {
+  ResumeRegistry::Parked parked;
+  parked.user = user;
+  parked.status = 2;
+  parked.customStatus = "at lunch";
+  // Contact 3 was online on session 30, contact 5 offline
+  parked.contacts = {{3, 30, 0, "hi"}, {5, 0, 3, ""}};
+  return parked;
+}
+
+} // namespace
+
+void test_tokens() {
+  std::cout << "Running test_tokens..." << std::endl;
+
+  ResumeRegistry registry;
+  std::string first = registry.issue(7);
+  assert(first.size() == 32);
+  assert(registry.find(first) == 7);
+  assert(registry.find("") == INVALID_USER);
+
+  // A new login or resume replaces the token
+  std::string second = registry.issue(7);
+  assert(second != first);
+  assert(registry.find(first) == INVALID_USER);
+  assert(registry.find(second) == 7);
+
+  assert(registry.issue(8) != second);
+  assert(registry.find(second) == 7);
+
+  std::cout << "[PASS] test_tokens" << std::endl;
+}
+
+void test_park_and_take() {
+  std::cout << "Running test_park_and_take..." << std::endl;
+
+  ResumeRegistry registry(30s);
+  auto now = ResumeRegistry::Clock::time_point{} + 1h;
+  std::string token = registry.issue(7);
+  assert(!registry.parked(7));
+
+  registry.park(parkedUser(7), now);
+  assert(!registry.empty());
+  assert(registry.parked(7)->expires == now + 30s);
+  assert(registry.find(token) == 7);
+
+  ResumeRegistry::Parked parked = registry.take(7);
+  assert(parked.status == 2 && parked.customStatus == "at lunch");
+  assert(parked.contacts.size() == 2);
+  assert(!registry.parked(7) && registry.empty());
+
+  // A full login drops the parked state along with the old token
+  registry.park(parkedUser(7), now);
+  registry.issue(7);
+  assert(!registry.parked(7));
+
+  std::cout << "[PASS] test_park_and_take" << std::endl;
+}
+
+void test_expiry() {
+  std::cout << "Running test_expiry..." << std::endl;
+
+  ResumeRegistry registry(30s);
+  auto now = ResumeRegistry::Clock::time_point{} + 1h;
+  std::string early = registry.issue(1);
+  std::string late = registry.issue(2);
+  registry.park(parkedUser(1), now);
+  registry.park(parkedUser(2), now + 10s);
+
+  assert(registry.expire(now + 29s).empty());
+  std::vector<ResumeRegistry::Parked> expired = registry.expire(now + 30s);
+  assert(expired.size() == 1 && expired[0].user == 1);
+  assert(registry.find(early) == INVALID_USER); // Too late to resume
+  assert(registry.find(late) == 2 && registry.parked(2));
+
+  expired = registry.expire(now + 1h);
+  assert(expired.size() == 1 && expired[0].user == 2);
+  assert(registry.empty());
+
+  std::cout << "[PASS] test_expiry" << std::endl;
+}
+
+void test_saw_online() {
+  std::cout << "Running test_saw_online..." << std::endl;
+
+  ResumeRegistry::Parked parked = parkedUser(7);
+  assert(ResumeRegistry::sawOnline(parked, 3, 30));
+  assert(!ResumeRegistry::sawOnline(parked, 3, 31)); // Logged in again since
+  assert(!ResumeRegistry::sawOnline(parked, 5, 50)); // Was offline
+  assert(!ResumeRegistry::sawOnline(parked, 4, 30)); // Not a contact then
+
+  std::cout << "[PASS] test_saw_online" << std::endl;
+}
+
+void test_disabled() {
+  std::cout << "Running test_disabled..." << std::endl;
+
+  ResumeRegistry registry(0s);
+  assert(!registry.enabled());
+  registry.setGrace(5s);
+  assert(registry.enabled());
+
+  std::cout << "[PASS] test_disabled" << std::endl;
+}
+
+int main() {
+  test_tokens();
+  test_park_and_take();
+  test_expiry();
+  test_saw_online();
+  test_disabled();
+  std::cout << "All tests passed!" << std::endl;
+  return 0;
+}
@@ -1,103 +1,653 @@
+// TLS load generator. Drives many concurrent clients from a few io threads
+// through a scenario (see scenarios/*.scn) and reports throughput and
+// latency percentiles per operation.
+//
+//   stress_test [--scenario FILE] [--clients N] [--duration SEC]
+//               [--threads N] [--host IP] [--port N] [--server PATH]
+//               [--json FILE]
+//
+// With --server, that wizz_server binary is started on --port in the
+// current directory (which needs server/certs) and stopped at the end.
+// Exits non-zero if a client could not log in or an enabled operation
+// never completed, so CI can run it against a local server.
+
+#include <asio.hpp>
+#include <asio/ssl.hpp>
+
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <deque>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
-// Use our actual Protocol Library
 #include "../../common/Packet.h"
-#include "../../common/Types.h"
+#include "../../server/Metrics.h"
 
-// Platform Compatibility
 #ifdef _WIN32
 #include <winsock2.h>
-#include <ws2tcpip.h>
-#ifdef _MSC_VER
-#pragma comment(lib, "ws2_32.lib")
-#endif
 #else
 #include <arpa/inet.h>
-#include <sys/socket.h>
+#include <csignal>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
 #include <unistd.h>
-// SocketType is defined in Types.h now, but we need standard headers for
-// socket() calls here if not fully abstracting
 #endif
 
-// Constants
-const std::string SERVER_IP = "127.0.0.1";
-const int SERVER_PORT = 8080;
+using wizz::Counter;
+using wizz::Histogram;
+using wizz::Packet;
+using wizz::PacketHeader;
+using wizz::PacketType;
+using Clock = std::chrono::steady_clock;
 
-void run_client() {
-#ifdef _WIN32
-  WSADATA wsaData;
-  WSAStartup(MAKEWORD(2, 2), &wsaData);
-#endif
+namespace {
+
+// Everything a scenario file can set. Rates are per client, per second.
+struct Scenario {
+  int clients = 100;
+  int threads = 2;
+  double duration = 10;      // Seconds of load once everyone is logged in
+  double connectRate = 500;  // New connections per second while ramping up
+  int contacts = 4;          // Presence subscriptions per client
+  double chatRate = 0;       // DirectMessage to a random client
+  double presenceRate = 0;   // UpdateStatus, seen by subscribers
+  double voiceRate = 0;      // VoiceMessage of voiceBytes to a random client
+  uint32_t voiceBytes = 16000;
+  double gameRate = 0;       // GameInvite, accepted by the invitee
+};
+
+// One "key value..." per line, '#' starts a comment
+bool loadScenario(const std::string &path, Scenario &s) {
+  std::ifstream file(path);
+  if (!file) {
+    std::cerr << "Cannot open scenario " << path << std::endl;
+    return false;
+  }
+  std::string line;
+  while (std::getline(file, line)) {
+    std::istringstream in(line.substr(0, line.find('#')));
+    std::string key;
+    if (!(in >> key))
+      continue;
+    if (key == "clients") in >> s.clients;
+    else if (key == "threads") in >> s.threads;
+    else if (key == "duration") in >> s.duration;
+    else if (key == "connect") in >> s.connectRate;
+    else if (key == "contacts") in >> s.contacts;
+    else if (key == "chat") in >> s.chatRate;
+    else if (key == "presence") in >> s.presenceRate;
+    else if (key == "game") in >> s.gameRate;
+    else if (key == "voice") {
+      in >> s.voiceRate;
+      uint32_t bytes;
+      if (in >> bytes)
+        s.voiceBytes = bytes;
+      else if (!in.eof())
+        in.setstate(std::ios::failbit);
+      else
+        in.clear();
+    } else {
+      std::cerr << "Unknown scenario key: " << key << std::endl;
+      return false;
+    }
+    if (in.fail()) {
+      std::cerr << "Bad scenario line: " << line << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+enum Op { Connect, Login, ChatAck, ChatDeliver, Presence, Voice, Game, OP_COUNT };
 
-  // 1. Create Socket
-  SocketType sock = socket(AF_INET, SOCK_STREAM, 0);
-  if (sock == INVALID_SOCKET_VAL) {
-    std::cerr << "[Client] Error creating socket" << std::endl;
-    return;
-  }
-
-  // 2. Define Server Address
-  sockaddr_in serverAddr{};
-  serverAddr.sin_family = AF_INET;
-  serverAddr.sin_port = htons(SERVER_PORT);
-  inet_pton(AF_INET, SERVER_IP.c_str(), &serverAddr.sin_addr);
-
-  // 3. Connect
-  std::cout << "[Client] Connecting to " << SERVER_IP << ":" << SERVER_PORT
-            << "..." << std::endl;
-  if (connect(sock, (struct sockaddr *)&serverAddr, sizeof(serverAddr)) < 0) {
-    std::cerr << "[Client] Connection Failed!" << std::endl;
-  } else {
-    std::cout << "[Client] Connected!" << std::endl;
-
-    // 4. Send Data (Day 3 Update)
-    // Construct a Register Packet (Day 4 Test)
-    wizz::Packet regPacket(wizz::PacketType::Register);
-    regPacket.writeString("TestRegUser"); // Unique User
-    regPacket.writeString("Pass123");
-
-    std::vector<uint8_t> buffer = regPacket.serialize();
-
-    std::cout << "[Client] Sending " << buffer.size()
-              << " bytes (Registration)..." << std::endl;
-    send(sock, reinterpret_cast<const char *>(buffer.data()), buffer.size(), 0);
-
-    // 5. Receive Response
-    char recvBuf[1024];
-    int bytes = recv(sock, recvBuf, sizeof(recvBuf), 0);
-    if (bytes > 0) {
-      // In a real client, we would buffer this too.
-      // Here we assume the test is on localhost and we get the full packet.
-      // Skip Header (12 bytes) to see the string payload roughly
-      // Or better: Use Packet class to deserialize
-      std::vector<uint8_t> respData(recvBuf, recvBuf + bytes);
-      wizz::Packet resp(respData); // Deserializes
-
-      std::cout << "[Client] Response Type: " << static_cast<int>(resp.type())
-                << std::endl;
-      if (resp.type() == wizz::PacketType::LoginSuccess) {
-        std::string msg = resp.readString();
-        std::cout << "[Client] SUCCESS Message: " << msg << std::endl;
-      } else if (resp.type() == wizz::PacketType::LoginFailed) {
-        std::string msg = resp.readString();
-        std::cout << "[Client] FAILURE Message: " << msg << std::endl;
+// Shared by every io thread: counters and histograms are atomic
+struct OpStats {
+  const char *name;
+  Counter sent;
+  Histogram latency; // Nanoseconds
+};
+
+OpStats g_stats[OP_COUNT] = {{"connect", {}, {}},  {"login", {}, {}},
+                             {"chat.ack", {}, {}}, {"chat.deliver", {}, {}},
+                             {"presence", {}, {}}, {"voice", {}, {}},
+                             {"game", {}, {}}};
+
+const Clock::time_point g_epoch = Clock::now();
+
+uint64_t nowNs() {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - g_epoch).count());
+}
+
+struct Run {
+  Scenario scenario;
+  asio::ip::tcp::endpoint endpoint;
+  std::string userPrefix = "load";
+  std::string tag; // Marks stamps from this process; older ones are ignored
+  std::atomic<int> loggedIn{0};
+  std::atomic<int> failed{0};
+  Counter errors;
+  std::atomic<bool> stopping{false};
+};
+
+// Client side of the v1 protocol, driven by the scenario's timers
+class LoadClient : public std::enable_shared_from_this<LoadClient> {
+public:
+  LoadClient(int index, asio::io_context &io, asio::ssl::context &ssl, Run &run)
+      : m_index(index), m_run(run), m_socket(io, ssl),
+        m_rng(static_cast<uint32_t>(index) * 2654435761u + 1),
+        m_timers{asio::steady_timer(io), asio::steady_timer(io), asio::steady_timer(io),
+                 asio::steady_timer(io)} {}
+
+  void start() {
+    auto self(shared_from_this());
+    m_started = Clock::now();
+    m_socket.lowest_layer().async_connect(m_run.endpoint, [this, self](const asio::error_code &ec) {
+      if (ec)
+        return fail("connect", ec);
+      m_socket.async_handshake(asio::ssl::stream_base::client,
+                               [this, self](const asio::error_code &ec) {
+                                 if (ec)
+                                   return fail("handshake", ec);
+                                 g_stats[Connect].latency.recordSince(m_started);
+                                 Packet reg(PacketType::Register);
+                                 reg.writeString(name(m_index));
+                                 reg.writeString("load-pw");
+                                 send(reg);
+                                 readHeader();
+                               });
+    });
+    g_stats[Connect].sent.add();
+  }
+
+  // Load phase: every enabled operation runs as a Poisson process
+  void beginLoad() {
+    const Scenario &s = m_run.scenario;
+    const double rates[] = {s.chatRate, s.presenceRate, s.voiceRate, s.gameRate};
+    for (int i = 0; i < 4; ++i) {
+      if (rates[i] > 0 && m_loggedIn)
+        schedule(i, rates[i]);
+    }
+  }
+
+  void stop() {
+    for (auto &timer : m_timers)
+      timer.cancel();
+    asio::error_code ec;
+    m_socket.lowest_layer().close(ec);
+  }
+
+private:
+  int m_index;
+  Run &m_run;
+  asio::ssl::stream<asio::ip::tcp::socket> m_socket;
+  std::mt19937 m_rng;
+  asio::steady_timer m_timers[4];
+  Clock::time_point m_started;
+  bool m_loginSent = false;
+  bool m_loggedIn = false;
+
+  uint8_t m_header[sizeof(PacketHeader)];
+  std::vector<uint8_t> m_body;
+  std::deque<std::vector<uint8_t>> m_outbox;
+  bool m_writing = false;
+
+  uint32_t m_seq = 0;
+  std::deque<std::pair<uint32_t, uint64_t>> m_unacked; // seq, sent at
+  std::unordered_map<std::string, uint64_t> m_invites; // Invitee, sent at
+
+  std::string name(int index) const { return m_run.userPrefix + std::to_string(index); }
+
+  std::string stamp() const { return m_run.tag + ":" + std::to_string(nowNs()); }
+
+  // Latency of a stamp made by any client of this run
+  bool readStamp(const std::string &text, uint64_t &latency) const {
+    if (text.size() <= m_run.tag.size() || text.compare(0, m_run.tag.size(), m_run.tag) != 0 ||
+        text[m_run.tag.size()] != ':')
+      return false;
+    uint64_t sent = std::strtoull(text.c_str() + m_run.tag.size() + 1, nullptr, 10);
+    uint64_t now = nowNs();
+    latency = now > sent ? now - sent : 0;
+    return true;
+  }
+
+  std::string randomPeer() {
+    int clients = m_run.scenario.clients;
+    if (clients < 2)
+      return name(m_index);
+    int peer = std::uniform_int_distribution<int>(0, clients - 2)(m_rng);
+    return name(peer >= m_index ? peer + 1 : peer);
+  }
+
+  void fail(const char *what, const asio::error_code &ec) {
+    if (m_run.stopping)
+      return;
+    if (!m_loggedIn) {
+      m_run.failed.fetch_add(1);
+      std::cerr << "[Client " << m_index << "] " << what << " failed: " << ec.message() << std::endl;
+    } else {
+      m_run.errors.add();
+    }
+    m_loggedIn = false;
+    stop();
+  }
+
+  void send(const Packet &packet) {
+    m_outbox.push_back(packet.serialize());
+    doWrite();
+  }
+
+  void doWrite() {
+    if (m_writing || m_outbox.empty())
+      return;
+    m_writing = true;
+    auto self(shared_from_this());
+    asio::async_write(m_socket, asio::buffer(m_outbox.front()),
+                      [this, self](const asio::error_code &ec, std::size_t) {
+                        m_writing = false;
+                        m_outbox.pop_front();
+                        if (ec)
+                          return fail("write", ec);
+                        doWrite();
+                      });
+  }
+
+  void readHeader() {
+    auto self(shared_from_this());
+    asio::async_read(m_socket, asio::buffer(m_header, sizeof(m_header)),
+                     [this, self](const asio::error_code &ec, std::size_t) {
+                       if (ec)
+                         return fail("read", ec);
+                       PacketHeader header;
+                       std::memcpy(&header, m_header, sizeof(header));
+                       m_body.resize(ntohl(header.length));
+                       asio::async_read(m_socket, asio::buffer(m_body),
+                                        [this, self](const asio::error_code &ec, std::size_t) {
+                                          if (ec)
+                                            return fail("read", ec);
+                                          std::vector<uint8_t> raw(m_header, m_header + sizeof(m_header));
+                                          raw.insert(raw.end(), m_body.begin(), m_body.end());
+                                          try {
+                                            Packet packet(raw);
+                                            onPacket(packet);
+                                          } catch (const std::exception &) {
+                                            m_run.errors.add();
+                                          }
+                                          readHeader();
+                                        });
+                     });
+  }
+
+  void onPacket(Packet &packet) {
+    switch (packet.type()) {
+    case PacketType::RegisterSuccess:
+    case PacketType::RegisterFailed: { // Already registered by an earlier run
+      if (m_loginSent)
+        break;
+      m_loginSent = true;
+      m_started = Clock::now();
+      Packet login(PacketType::Login);
+      login.writeString(name(m_index));
+      login.writeString("load-pw");
+      send(login);
+      g_stats[Login].sent.add();
+      break;
+    }
+    case PacketType::LoginSuccess: {
+      if (m_loggedIn)
+        break;
+      g_stats[Login].latency.recordSince(m_started);
+      m_loggedIn = true;
+      if (packet.remaining() >= 4)
+        m_seq = packet.readInt(); // Continue numbering from an earlier run
+      for (int i = 1; i <= m_run.scenario.contacts && i < m_run.scenario.clients; ++i) {
+        Packet add(PacketType::AddContact);
+        add.writeString(name((m_index + i) % m_run.scenario.clients));
+        send(add);
+      }
+      m_run.loggedIn.fetch_add(1);
+      break;
+    }
+    case PacketType::LoginFailed:
+      fail("login", asio::error::access_denied);
+      break;
+    case PacketType::MessageSent: { // Cumulative
+      uint32_t seq = packet.readInt();
+      uint64_t now = nowNs();
+      while (!m_unacked.empty() && m_unacked.front().first <= seq) {
+        g_stats[ChatAck].latency.record(now - m_unacked.front().second);
+        m_unacked.pop_front();
+      }
+      break;
+    }
+    case PacketType::DirectMessage: {
+      packet.readString(); // Sender
+      uint64_t latency;
+      if (readStamp(packet.readString(), latency))
+        g_stats[ChatDeliver].latency.record(latency);
+      break;
+    }
+    case PacketType::ContactStatusChange: {
+      packet.readInt();    // Status
+      packet.readString(); // Contact
+      uint64_t latency;
+      if (readStamp(packet.readString(), latency))
+        g_stats[Presence].latency.record(latency);
+      break;
+    }
+    case PacketType::VoiceMessage: {
+      packet.readString(); // Sender
+      packet.readInt();    // Duration
+      std::vector<uint8_t> data = packet.readBytes(packet.readInt());
+      std::string text(data.begin(), std::find(data.begin(), data.end(), 0));
+      uint64_t latency;
+      if (readStamp(text, latency))
+        g_stats[Voice].latency.record(latency);
+      break;
+    }
+    case PacketType::GameInvite: {
+      std::string sender = packet.readString();
+      std::string game = packet.readString();
+      Packet accept(PacketType::GameInviteResponse);
+      accept.writeString(sender);
+      accept.writeString(game);
+      accept.writeInt(1);
+      send(accept);
+      break;
+    }
+    case PacketType::GameStart: {
+      packet.readString(); // Game
+      packet.readString(); // Room
+      bool inviter = packet.readInt() == 'X';
+      auto it = m_invites.find(packet.readString());
+      if (inviter && it != m_invites.end()) {
+        g_stats[Game].latency.record(nowNs() - it->second);
+        m_invites.erase(it);
       }
+      break;
+    }
+    case PacketType::Error:
+      m_run.errors.add();
+      break;
+    default:
+      break;
     }
   }
 
-  // Cleanup
-  close_socket_raw(sock);
+  void schedule(int op, double rate) {
+    auto delay = std::chrono::duration<double>(std::exponential_distribution<double>(rate)(m_rng));
+    auto self(shared_from_this());
+    m_timers[op].expires_after(std::chrono::duration_cast<Clock::duration>(delay));
+    m_timers[op].async_wait([this, self, op, rate](const asio::error_code &ec) {
+      if (ec || m_run.stopping || !m_loggedIn)
+        return;
+      perform(op);
+      schedule(op, rate);
+    });
+  }
 
-#ifdef _WIN32
-  WSACleanup();
+  void perform(int op) {
+    switch (op) {
+    case 0: { // chat
+      Packet msg(PacketType::DirectMessage);
+      msg.writeString(randomPeer());
+      msg.writeString(stamp());
+      msg.writeInt(++m_seq);
+      m_unacked.emplace_back(m_seq, nowNs());
+      send(msg);
+      g_stats[ChatAck].sent.add();
+      g_stats[ChatDeliver].sent.add();
+      break;
+    }
+    case 1: { // presence
+      Packet status(PacketType::UpdateStatus);
+      status.writeString(stamp());
+      send(status);
+      g_stats[Presence].sent.add();
+      break;
+    }
+    case 2: { // voice
+      std::vector<uint8_t> data(m_run.scenario.voiceBytes, 0);
+      std::string text = stamp();
+      std::memcpy(data.data(), text.data(), std::min(text.size(), data.size()));
+      Packet voice(PacketType::VoiceMessage);
+      voice.writeString(randomPeer());
+      voice.writeInt(1); // Duration (seconds)
+      voice.writeInt(static_cast<uint32_t>(data.size()));
+      voice.writeData(data.data(), data.size());
+      voice.writeInt(0); // VoiceCodec::Wav
+      send(voice);
+      g_stats[Voice].sent.add();
+      break;
+    }
+    case 3: { // game
+      std::string peer = randomPeer();
+      if (!m_invites.emplace(peer, nowNs()).second)
+        break; // Still waiting on that one
+      Packet invite(PacketType::GameInvite);
+      invite.writeString(peer);
+      invite.writeString("TicTacToe");
+      send(invite);
+      g_stats[Game].sent.add();
+      break;
+    }
+    }
+  }
+};
+
+#ifndef _WIN32
+pid_t spawnServer(const std::string &path, int port) {
+  pid_t pid = fork();
+  if (pid == 0) {
+    int log = open("server.log", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (log >= 0) {
+      dup2(log, STDOUT_FILENO);
+      dup2(log, STDERR_FILENO);
+    }
+    std::string portArg = std::to_string(port);
+    execl(path.c_str(), path.c_str(), "--port", portArg.c_str(), static_cast<char *>(nullptr));
+    _exit(127);
+  }
+  return pid;
+}
 #endif
+
+bool waitForServer(const asio::ip::tcp::endpoint &endpoint, std::chrono::seconds timeout) {
+  asio::io_context io;
+  auto deadline = Clock::now() + timeout;
+  while (Clock::now() < deadline) {
+    asio::ip::tcp::socket socket(io);
+    asio::error_code ec;
+    socket.connect(endpoint, ec);
+    if (!ec)
+      return true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  return false;
 }
 
-int main() {
-  run_client();
-  return 0;
+double ms(uint64_t ns) { return static_cast<double>(ns) / 1e6; }
+
+void report(const Run &run, double rampSeconds, double loadSeconds, const std::string &jsonPath) {
+  std::printf("\n%-14s %9s %9s %10s %9s %9s %9s %9s\n", "operation", "sent", "done", "per sec",
+              "p50 ms", "p99 ms", "p999 ms", "max ms");
+  std::ostringstream json;
+  json << "{\"clients\":" << run.scenario.clients << ",\"ramp_seconds\":" << rampSeconds
+       << ",\"seconds\":" << loadSeconds
+       << ",\"errors\":" << run.errors.value() << ",\"operations\":{";
+  bool first = true;
+  for (const OpStats &op : g_stats) {
+    if (op.sent.value() == 0)
+      continue;
+    const Histogram &h = op.latency;
+    // Connect and login happen during ramp-up; the rest over the load phase
+    double seconds = (&op - g_stats) <= Login ? rampSeconds : loadSeconds;
+    double rate = seconds > 0 ? static_cast<double>(h.count()) / seconds : 0;
+    std::printf("%-14s %9llu %9llu %10.1f %9.3f %9.3f %9.3f %9.3f\n", op.name,
+                static_cast<unsigned long long>(op.sent.value()),
+                static_cast<unsigned long long>(h.count()), rate, ms(h.quantile(0.5)),
+                ms(h.quantile(0.99)), ms(h.quantile(0.999)), ms(h.quantile(1.0)));
+    json << (first ? "" : ",") << "\"" << op.name << "\":{\"sent\":" << op.sent.value()
+         << ",\"done\":" << h.count() << ",\"per_sec\":" << rate
+         << ",\"p50_ms\":" << ms(h.quantile(0.5)) << ",\"p99_ms\":" << ms(h.quantile(0.99))
+         << ",\"p999_ms\":" << ms(h.quantile(0.999)) << ",\"max_ms\":" << ms(h.quantile(1.0))
+         << "}";
+    first = false;
+  }
+  json << "}}\n";
+  std::printf("errors: %llu, failed logins: %d\n",
+              static_cast<unsigned long long>(run.errors.value()), run.failed.load());
+
+  if (!jsonPath.empty()) {
+    std::ofstream file(jsonPath);
+    file << json.str();
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Run run;
+  std::string host = "127.0.0.1";
+  int port = 8080;
+  std::string serverPath, jsonPath;
+  int clients = -1, threads = -1;
+  double duration = -1;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--scenario" && hasValue) {
+      if (!loadScenario(argv[++i], run.scenario))
+        return 2;
+    } else if (arg == "--clients" && hasValue) {
+      clients = std::atoi(argv[++i]);
+    } else if (arg == "--threads" && hasValue) {
+      threads = std::atoi(argv[++i]);
+    } else if (arg == "--duration" && hasValue) {
+      duration = std::atof(argv[++i]);
+    } else if (arg == "--host" && hasValue) {
+      host = argv[++i];
+    } else if (arg == "--port" && hasValue) {
+      port = std::atoi(argv[++i]);
+    } else if (arg == "--server" && hasValue) {
+      serverPath = argv[++i];
+    } else if (arg == "--json" && hasValue) {
+      jsonPath = argv[++i];
+    } else {
+      std::cerr << "Unknown argument: " << arg << std::endl;
+      return 2;
+    }
+  }
+  Scenario &scenario = run.scenario;
+  if (clients > 0) scenario.clients = clients;
+  if (threads > 0) scenario.threads = threads;
+  if (duration >= 0) scenario.duration = duration;
+  run.endpoint = asio::ip::tcp::endpoint(asio::ip::make_address(host),
+                                         static_cast<unsigned short>(port));
+  run.tag = std::to_string(std::random_device{}());
+
+#ifndef _WIN32
+  // One descriptor per client here, and another in a spawned server
+  rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+  std::signal(SIGPIPE, SIG_IGN);
+
+  pid_t serverPid = -1;
+  if (!serverPath.empty()) {
+    serverPid = spawnServer(serverPath, port);
+    if (serverPid < 0 || !waitForServer(run.endpoint, std::chrono::seconds(15))) {
+      std::cerr << "Server did not come up on port " << port << std::endl;
+      if (serverPid > 0)
+        kill(serverPid, SIGKILL);
+      return 1;
+    }
+  }
+#else
+  if (!serverPath.empty()) {
+    std::cerr << "--server is not supported on Windows; start the server first" << std::endl;
+    return 2;
+  }
+#endif
+
+  asio::ssl::context ssl(asio::ssl::context::tls_client);
+  ssl.set_verify_mode(asio::ssl::verify_none); // Test certificates
+
+  std::vector<std::unique_ptr<asio::io_context>> ios;
+  std::vector<asio::executor_work_guard<asio::io_context::executor_type>> guards;
+  std::vector<std::thread> workers;
+  for (int t = 0; t < scenario.threads; ++t) {
+    ios.push_back(std::make_unique<asio::io_context>(1));
+    guards.push_back(asio::make_work_guard(*ios.back()));
+  }
+  for (auto &io : ios)
+    workers.emplace_back([&io] { io->run(); });
+
+  std::printf("%d clients on %d threads against %s:%d\n", scenario.clients, scenario.threads,
+              host.c_str(), port);
+
+  // Ramp up at the scenario's connection rate
+  std::vector<std::shared_ptr<LoadClient>> all;
+  auto rampStart = Clock::now();
+  for (int i = 0; i < scenario.clients; ++i) {
+    asio::io_context &io = *ios[i % ios.size()];
+    all.push_back(std::make_shared<LoadClient>(i, io, ssl, run));
+    asio::post(io, [client = all.back()] { client->start(); });
+    std::this_thread::sleep_until(rampStart + std::chrono::duration_cast<Clock::duration>(
+                                                  std::chrono::duration<double>((i + 1) / scenario.connectRate)));
+  }
+  auto loginDeadline = Clock::now() + std::chrono::seconds(60);
+  while (run.loggedIn + run.failed < scenario.clients && Clock::now() < loginDeadline)
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  double rampSeconds = std::chrono::duration<double>(Clock::now() - rampStart).count();
+  std::printf("%d logged in, %d failed after %.1f s\n", run.loggedIn.load(), run.failed.load(),
+              rampSeconds);
+
+  auto loadStart = Clock::now();
+  for (size_t i = 0; i < all.size(); ++i)
+    asio::post(*ios[i % ios.size()], [client = all[i]] { client->beginLoad(); });
+  std::this_thread::sleep_for(std::chrono::duration<double>(scenario.duration));
+  double loadSeconds = std::chrono::duration<double>(Clock::now() - loadStart).count();
+
+  // Stop issuing, give in-flight operations a moment, then hang up
+  run.stopping = true;
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  for (size_t i = 0; i < all.size(); ++i)
+    asio::post(*ios[i % ios.size()], [client = all[i]] { client->stop(); });
+  guards.clear();
+  for (auto &worker : workers)
+    worker.join();
+
+#ifndef _WIN32
+  if (serverPid > 0) {
+    kill(serverPid, SIGTERM);
+    waitpid(serverPid, nullptr, 0);
+  }
+#endif
+
+  report(run, rampSeconds, loadSeconds, jsonPath);
+
+  bool ok = run.failed == 0 && run.loggedIn == scenario.clients;
+  for (const OpStats &op : g_stats) {
+    if (op.sent.value() > 0 && op.latency.count() == 0) {
+      std::cerr << "No " << op.name << " completed" << std::endl;
+      ok = false;
+    }
+  }
+  return ok ? 0 : 1;
 }
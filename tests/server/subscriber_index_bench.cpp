@@ -0,0 +1,100 @@
+// Login/logout cost against the online population. Each user has a fixed
+// number of contacts; with the subscriber index the per-login time should
+// stay flat as the number of online users grows (cache effects aside).
+#include "../../server/SubscriberIndex.h"
+#include "../../server/UserDirectory.h"
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <set>
+#include <vector>
+
+using wizz::SubscriberIndex;
+using wizz::UserDirectory;
+using wizz::UserId;
+
+static constexpr size_t CONTACTS_PER_USER = 50;
+static constexpr size_t MEASURED_LOGINS = 2000;
+static constexpr size_t SCANNED_LOGINS = 20;
+
+static std::string userName(size_t i) { return "user" + std::to_string(i); }
+
+// Contact names as the database returns them
+static std::vector<std::string> contactsFor(size_t user, size_t population, std::mt19937 &rng) {
+  std::uniform_int_distribution<size_t> pick(0, population - 1);
+  std::set<std::string> contacts;
+  while (contacts.size() < CONTACTS_PER_USER) {
+    size_t other = pick(rng);
+    if (other != user) contacts.insert(userName(other));
+  }
+  return std::vector<std::string>(contacts.begin(), contacts.end());
+}
+
+static std::vector<UserId> intern(UserDirectory &users, const std::vector<std::string> &names) {
+  std::vector<UserId> ids;
+  ids.reserve(names.size());
+  for (const auto &name : names) ids.push_back(users.intern(name));
+  return ids;
+}
+
+int main() {
+  std::cout << std::setw(10) << "online" << std::setw(16) << "login+fanout"
+            << std::setw(12) << "logout" << std::setw(16) << "full scan" << std::endl;
+
+  for (size_t population : {1000, 10000, 100000}) {
+    std::mt19937 rng(42);
+    UserDirectory users;
+    SubscriberIndex index;
+    std::vector<std::vector<std::string>> contacts;
+    for (size_t i = 0; i < population; ++i) {
+      contacts.push_back(contactsFor(i, population, rng));
+      UserId id = users.intern(userName(i));
+      index.add(id, intern(users, contacts.back()));
+    }
+
+    // Random members drop off and reconnect; the population stays the same
+    std::uniform_int_distribution<size_t> pick(0, population - 1);
+    std::vector<size_t> members;
+    for (size_t i = 0; i < MEASURED_LOGINS; ++i) members.push_back(pick(rng));
+
+    std::chrono::steady_clock::duration loginTime{}, logoutTime{};
+    size_t notified = 0;
+    for (size_t member : members) {
+      std::string name = userName(member);
+
+      auto start = std::chrono::steady_clock::now();
+      index.remove(users.find(name));
+      auto loggedOut = std::chrono::steady_clock::now();
+      UserId id = users.intern(name);
+      index.add(id, intern(users, contacts[member]));
+      notified += index.subscribersOf(id).size();
+      auto loggedIn = std::chrono::steady_clock::now();
+
+      logoutTime += loggedOut - start;
+      loginTime += loggedIn - loggedOut;
+    }
+
+    // What login used to do: walk every online user against the contact set
+    std::vector<std::string> online;
+    for (size_t i = 0; i < population; ++i) online.push_back(userName(i));
+    auto scanStart = std::chrono::steady_clock::now();
+    size_t scanned = 0;
+    for (size_t i = 0; i < SCANNED_LOGINS; ++i) {
+      std::set<std::string> loginContacts(contacts[members[i]].begin(), contacts[members[i]].end());
+      for (const auto &name : online) scanned += loginContacts.count(name);
+    }
+    double scanTime = std::chrono::duration<double, std::micro>(
+                          std::chrono::steady_clock::now() - scanStart).count() / SCANNED_LOGINS;
+
+    auto perOp = [](std::chrono::steady_clock::duration total) {
+      return std::chrono::duration<double, std::micro>(total).count() / MEASURED_LOGINS;
+    };
+    std::cout << std::setw(10) << population << std::setw(13) << std::fixed << std::setprecision(2)
+              << perOp(loginTime) << " us" << std::setw(9) << perOp(logoutTime) << " us"
+              << std::setw(13) << scanTime << " us   (" << notified / MEASURED_LOGINS
+              << " subscribers/login, " << scanned / SCANNED_LOGINS << " found by scan)" << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,79 @@
+#include "../../server/SubscriberIndex.h"
+#include <cassert>
+#include <iostream>
+
+using wizz::SubscriberIndex;
+using wizz::UserId;
+
+enum : UserId { ALICE, BOB, CARL, DAVE };
+
+using Ids = std::vector<UserId>;
+
+void test_login_logout() {
+  std::cout << "Running test_login_logout..." << std::endl;
+
+  SubscriberIndex index;
+  index.add(ALICE, {CARL, BOB, ALICE, BOB});
+  assert(index.contactsOf(ALICE) == (Ids{BOB, CARL})); // Sorted, no self
+  // Subscriptions exist before the contact comes online
+  assert(index.subscribersOf(BOB) == Ids{ALICE});
+  assert(index.subscribersOf(CARL) == Ids{ALICE});
+  assert(index.subscribersOf(ALICE).empty());
+
+  index.add(BOB, {ALICE});
+  assert(index.subscribersOf(ALICE) == Ids{BOB});
+
+  index.remove(BOB);
+  assert(!index.isOnline(BOB));
+  assert(index.subscribersOf(ALICE).empty());
+  assert(index.subscribersOf(BOB) == Ids{ALICE}); // Alice still watches bob
+
+  index.remove(ALICE);
+  assert(index.subscribersOf(BOB).empty());
+  assert(index.subscribersOf(CARL).empty());
+  assert(index.subscribersOf(DAVE).empty()); // Never seen
+
+  std::cout << "[PASS] test_login_logout" << std::endl;
+}
+
+void test_relogin_replaces_contacts() {
+  std::cout << "Running test_relogin_replaces_contacts..." << std::endl;
+
+  SubscriberIndex index;
+  index.add(ALICE, {BOB});
+  index.add(ALICE, {CARL});
+  assert(index.subscribersOf(BOB).empty());
+  assert(index.subscribersOf(CARL) == Ids{ALICE});
+
+  std::cout << "[PASS] test_relogin_replaces_contacts" << std::endl;
+}
+
+void test_contact_changes_are_symmetric() {
+  std::cout << "Running test_contact_changes_are_symmetric..." << std::endl;
+
+  SubscriberIndex index;
+  index.add(ALICE, {});
+  index.add(BOB, {});
+
+  // Alice adds bob: bob gains alice as a follower without re-login
+  index.update(ALICE, {BOB});
+  assert(index.subscribersOf(BOB) == Ids{ALICE});
+  assert(index.subscribersOf(ALICE) == Ids{BOB});
+  assert(index.contactsOf(BOB) == Ids{ALICE});
+
+  index.update(ALICE, {});
+  assert(index.subscribersOf(BOB).empty());
+  assert(index.subscribersOf(ALICE).empty());
+  assert(index.contactsOf(BOB).empty());
+
+  std::cout << "[PASS] test_contact_changes_are_symmetric" << std::endl;
+}
+
+int main() {
+  test_login_logout();
+  test_relogin_replaces_contacts();
+  test_contact_changes_are_symmetric();
+
+  std::cout << "All tests passed!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,156 @@
+#include "../../server/Tracer.h"
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+using wizz::TraceEvent;
+using wizz::Tracer;
+using wizz::TraceScope;
+using wizz::TraceSpan;
+
+void test_sampling() {
+  std::cout << "Running test_sampling..." << std::endl;
+
+  Tracer &tracer = Tracer::instance();
+  for (int i = 0; i < 1000; ++i)
+    assert(tracer.sample() == 0); // Off by default
+
+  tracer.setSampleRate(1.0);
+  uint64_t previous = 0;
+  for (int i = 0; i < 1000; ++i) {
+    uint64_t trace = tracer.sample();
+    assert(trace > previous); // Every packet, fresh ids
+    previous = trace;
+  }
+
+  tracer.setSampleRate(0.1);
+  int sampled = 0;
+  for (int i = 0; i < 100000; ++i)
+    sampled += tracer.sample() != 0;
+  assert(sampled > 9000 && sampled < 11000);
+
+  tracer.setSampleRate(0);
+  assert(tracer.sample() == 0);
+
+  std::cout << "[PASS] test_sampling" << std::endl;
+}
+
+void test_spans_follow_scope() {
+  std::cout << "Running test_spans_follow_scope..." << std::endl;
+
+  Tracer &tracer = Tracer::instance();
+  tracer.clear();
+
+  { TraceSpan untraced("untraced"); }
+  assert(tracer.events().empty());
+
+  {
+    TraceScope scope(7);
+    TraceSpan outer("outer", 300);
+    {
+      TraceScope nested(9);
+      TraceSpan inner("inner");
+    }
+    assert(Tracer::current() == 7);
+  }
+  assert(Tracer::current() == 0);
+
+  std::vector<TraceEvent> events = tracer.events();
+  assert(events.size() == 2);
+  assert(std::string(events[0].name) == "inner" && events[0].trace == 9);
+  assert(std::string(events[1].name) == "outer" && events[1].trace == 7);
+  assert(events[1].arg == 300);
+  assert(events[1].start <= events[0].start);
+  assert(events[1].duration >= events[0].duration);
+
+  std::cout << "[PASS] test_spans_follow_scope" << std::endl;
+}
+
+void test_handoff_between_threads() {
+  std::cout << "Running test_handoff_between_threads..." << std::endl;
+
+  // What postTask does: capture the poster's trace, restore it on the worker
+  Tracer &tracer = Tracer::instance();
+  tracer.clear();
+  tracer.nameThread("main");
+
+  uint64_t captured;
+  {
+    TraceScope scope(42);
+    captured = Tracer::current();
+  }
+  std::thread worker([captured] {
+    Tracer::instance().nameThread("worker");
+    assert(Tracer::current() == 0);
+    TraceScope scope(captured);
+    TraceSpan span("db.run");
+  });
+  worker.join();
+  { TraceSpan notTraced("after"); }
+
+  std::vector<TraceEvent> events = tracer.events();
+  assert(events.size() == 1);
+  assert(events[0].trace == 42);
+
+  std::cout << "[PASS] test_handoff_between_threads" << std::endl;
+}
+
+void test_ring_keeps_newest() {
+  std::cout << "Running test_ring_keeps_newest..." << std::endl;
+
+  Tracer &tracer = Tracer::instance();
+  tracer.clear();
+  auto now = Tracer::Clock::now();
+  for (uint64_t i = 1; i <= Tracer::CAPACITY + 10; ++i)
+    tracer.record("span", i, now, now);
+
+  std::vector<TraceEvent> events = tracer.events();
+  assert(events.size() == Tracer::CAPACITY);
+  assert(events.front().trace == 11);
+  assert(events.back().trace == Tracer::CAPACITY + 10);
+
+  std::cout << "[PASS] test_ring_keeps_newest" << std::endl;
+}
+
+void test_chrome_json() {
+  std::cout << "Running test_chrome_json..." << std::endl;
+
+  Tracer &tracer = Tracer::instance();
+  tracer.clear();
+  auto start = Tracer::Clock::time_point(std::chrono::nanoseconds(5000250));
+  tracer.record("handler", 3, start, start + std::chrono::nanoseconds(1500), 100);
+
+  std::string json = tracer.chromeJson();
+  auto has = [&](const std::string &s) { return json.find(s) != std::string::npos; };
+  assert(json.rfind("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", 0) == 0);
+  assert(has("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"));
+  assert(has("\"args\":{\"name\":\"worker\"}}"));
+  assert(has("{\"name\":\"handler\",\"ph\":\"X\",\"pid\":1,\"tid\":"));
+  assert(has("\"ts\":5000.250,\"dur\":1.500,\"args\":{\"trace\":3,\"arg\":100}}"));
+  assert(json.substr(json.size() - 3) == "]}\n");
+
+  const char *path = "tracer_test.json";
+  assert(tracer.writeFile(path));
+  std::ifstream file(path);
+  std::stringstream read;
+  read << file.rdbuf();
+  assert(read.str() == json);
+  std::remove(path);
+
+  std::cout << "[PASS] test_chrome_json" << std::endl;
+}
+
+int main() {
+  test_sampling();
+  test_spans_follow_scope();
+  test_handoff_between_threads();
+  test_ring_keeps_newest();
+  test_chrome_json();
+
+  std::cout << "All tests passed!" << std::endl;
+  return 0;
+}
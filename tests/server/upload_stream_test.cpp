@@ -0,0 +1,228 @@
+#include "../../server/ContentHash.h"
+#include "../../server/UploadStream.h"
+#include <cassert>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+using wizz::InboundPacket;
+using wizz::Packet;
+using wizz::PacketType;
+
+static const std::string UPLOAD_DIR = "upload_stream_test_tmp";
+
+static std::vector<uint8_t> makeBlob(size_t n) {
+  std::vector<uint8_t> blob(n);
+  for (size_t i = 0; i < n; ++i)
+    blob[i] = static_cast<uint8_t>(i * 31 + 7);
+  return blob;
+}
+
+static std::vector<uint8_t> readFile(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  return std::vector<uint8_t>(std::istreambuf_iterator<char>(in), {});
+}
+
+// Feeds `bytes` in chunks of `step` and returns how many were consumed
+static size_t feedInChunks(InboundPacket &inbound,
+                           const std::vector<uint8_t> &bytes, size_t step) {
+  size_t used = 0;
+  while (used < bytes.size() && !inbound.complete()) {
+    size_t n = std::min(step, bytes.size() - used);
+    used += inbound.feed(bytes.data() + used, n);
+  }
+  return used;
+}
+
+void test_small_packet_is_buffered() {
+  std::cout << "Running test_small_packet_is_buffered..." << std::endl;
+
+  Packet p(PacketType::DirectMessage);
+  p.writeString("bob");
+  p.writeString("hello");
+  auto bytes = p.serialize();
+
+  InboundPacket inbound(UPLOAD_DIR);
+  assert(feedInChunks(inbound, bytes, 3) == bytes.size());
+  assert(inbound.complete());
+  assert(!inbound.streamed());
+
+  Packet out = inbound.takePacket();
+  assert(out.type() == PacketType::DirectMessage);
+  assert(out.readString() == "bob");
+  assert(out.readString() == "hello");
+
+  std::cout << "[PASS] test_small_packet_is_buffered" << std::endl;
+}
+
+void test_large_voice_is_streamed() {
+  std::cout << "Running test_large_voice_is_streamed..." << std::endl;
+
+  auto blob = makeBlob(300 * 1024);
+  Packet p(PacketType::VoiceMessage);
+  p.writeString("bob");
+  p.writeInt(12);
+  p.writeInt(static_cast<uint32_t>(blob.size()));
+  p.writeData(blob.data(), blob.size());
+  p.writeInt(42); // Trailing field after the blob
+  auto bytes = p.serialize();
+
+  // A second packet right behind it must be left untouched
+  Packet next(PacketType::Nudge);
+  next.writeString("bob");
+  auto nextBytes = next.serialize();
+  bytes.insert(bytes.end(), nextBytes.begin(), nextBytes.end());
+
+  std::string path;
+  {
+    InboundPacket inbound(UPLOAD_DIR);
+    size_t used = feedInChunks(inbound, bytes, 16 * 1024 + 5);
+    assert(inbound.complete());
+    assert(inbound.streamed());
+    assert(used == bytes.size() - nextBytes.size());
+
+    path = inbound.upload().path;
+    assert(inbound.upload().size == blob.size());
+    assert(inbound.upload().hash ==
+           wizz::ContentHash::of(blob.data(), blob.size()));
+    assert(readFile(path) == blob);
+
+    Packet meta = inbound.takePacket();
+    assert(meta.type() == PacketType::VoiceMessage);
+    assert(meta.readString() == "bob");
+    assert(meta.readInt() == 12);
+    assert(meta.readInt() == blob.size());
+    assert(meta.readInt() == 42);
+    assert(meta.remaining() == 0);
+  }
+  // Nobody claimed the file: it is cleaned up
+  assert(!std::filesystem::exists(path));
+
+  std::cout << "[PASS] test_large_voice_is_streamed" << std::endl;
+}
+
+void test_metadata_split_across_reads() {
+  std::cout << "Running test_metadata_split_across_reads..." << std::endl;
+
+  auto blob = makeBlob(128 * 1024);
+  Packet p(PacketType::UpdateAvatar);
+  p.writeInt(static_cast<uint32_t>(blob.size()));
+  p.writeData(blob.data(), blob.size());
+  auto bytes = p.serialize();
+
+  InboundPacket inbound(UPLOAD_DIR);
+  assert(feedInChunks(inbound, bytes, 1) == bytes.size());
+  assert(inbound.streamed());
+  assert(readFile(inbound.upload().path) == blob);
+
+  std::cout << "[PASS] test_metadata_split_across_reads" << std::endl;
+}
+
+void test_writes_go_to_the_executor() {
+  std::cout << "Running test_writes_go_to_the_executor..." << std::endl;
+
+  auto blob = makeBlob(600 * 1024);
+  Packet p(PacketType::UpdateAvatar);
+  p.writeInt(static_cast<uint32_t>(blob.size()));
+  p.writeData(blob.data(), blob.size());
+  auto bytes = p.serialize();
+
+  // Stands in for the DB thread: nothing touches the disk until run
+  std::vector<std::function<void()>> queued;
+  auto runQueued = [&queued]() {
+    for (auto &task : queued)
+      task();
+    queued.clear();
+  };
+
+  std::string path;
+  {
+    InboundPacket inbound(UPLOAD_DIR, nullptr,
+                          [&queued](std::function<void()> task) {
+                            queued.push_back(std::move(task));
+                          });
+    feedInChunks(inbound, bytes, 16 * 1024);
+    assert(inbound.complete());
+    path = inbound.upload().path;
+    assert(!std::filesystem::exists(path));
+    // Buffered into a few large writes, not one per read
+    assert(queued.size() < 8);
+
+    runQueued();
+    assert(readFile(path) == blob);
+  }
+  // The cleanup is queued behind the writes too
+  assert(std::filesystem::exists(path));
+  runQueued();
+  assert(!std::filesystem::exists(path));
+
+  std::cout << "[PASS] test_writes_go_to_the_executor" << std::endl;
+}
+
+void test_upload_refused_without_directory() {
+  std::cout << "Running test_upload_refused_without_directory..." << std::endl;
+
+  auto blob = makeBlob(100 * 1024);
+  Packet p(PacketType::UpdateAvatar);
+  p.writeInt(static_cast<uint32_t>(blob.size()));
+  p.writeData(blob.data(), blob.size());
+  auto bytes = p.serialize();
+
+  InboundPacket inbound("");
+  bool threw = false;
+  try {
+    feedInChunks(inbound, bytes, 4096);
+  } catch (const std::runtime_error &) {
+    threw = true;
+  }
+  assert(threw);
+
+  // Small packets still go through
+  Packet small(PacketType::UpdateAvatar);
+  small.writeInt(3);
+  small.writeData(blob.data(), 3);
+  auto smallBytes = small.serialize();
+  InboundPacket buffered("");
+  feedInChunks(buffered, smallBytes, 4096);
+  assert(buffered.complete() && !buffered.streamed());
+
+  std::cout << "[PASS] test_upload_refused_without_directory" << std::endl;
+}
+
+void test_bad_blob_length_is_rejected() {
+  std::cout << "Running test_bad_blob_length_is_rejected..." << std::endl;
+
+  auto blob = makeBlob(100 * 1024);
+  Packet p(PacketType::UpdateAvatar);
+  p.writeInt(static_cast<uint32_t>(blob.size() * 2)); // Lies about its size
+  p.writeData(blob.data(), blob.size());
+  auto bytes = p.serialize();
+
+  InboundPacket inbound(UPLOAD_DIR);
+  bool threw = false;
+  try {
+    feedInChunks(inbound, bytes, 4096);
+  } catch (const std::runtime_error &) {
+    threw = true;
+  }
+  assert(threw);
+
+  std::cout << "[PASS] test_bad_blob_length_is_rejected" << std::endl;
+}
+
+int main() {
+  test_small_packet_is_buffered();
+  test_large_voice_is_streamed();
+  test_metadata_split_across_reads();
+  test_writes_go_to_the_executor();
+  test_upload_refused_without_directory();
+  test_bad_blob_length_is_rejected();
+
+  std::filesystem::remove_all(UPLOAD_DIR);
+  std::cout << "All tests passed!" << std::endl;
+  return 0;
+}
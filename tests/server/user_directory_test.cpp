@@ -0,0 +1,37 @@
+#include "../../server/UserDirectory.h"
+#include <cassert>
+#include <iostream>
+
+using wizz::INVALID_USER;
+using wizz::UserDirectory;
+using wizz::UserId;
+
+void test_interning() {
+  std::cout << "Running test_interning..." << std::endl;
+
+  UserDirectory users;
+  assert(users.find("alice") == INVALID_USER);
+  UserId alice = users.intern("alice");
+  UserId bob = users.intern("bob");
+  assert(alice == 0 && bob == 1); // Dense
+  assert(users.intern("alice") == alice);
+  assert(users.find("bob") == bob);
+  assert(users.name(bob) == "bob");
+
+  // Growth must not invalidate the names the map is keyed on
+  for (int i = 0; i < 10000; ++i)
+    users.intern("user" + std::to_string(i));
+  assert(users.size() == 10002);
+  assert(users.find("alice") == alice);
+  assert(users.find("user9999") == 10001);
+  assert(users.name(alice) == "alice");
+
+  std::cout << "[PASS] test_interning" << std::endl;
+}
+
+int main() {
+  test_interning();
+
+  std::cout << "All tests passed!" << std::endl;
+  return 0;
+}